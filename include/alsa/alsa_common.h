@@ -3,10 +3,15 @@
 #include <alsa/asoundlib.h>
 
 #include <atomic>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
 
+namespace totton::audio {
+class LevelMeter;
+} // namespace totton::audio
+
 namespace totton::alsa {
 
 struct AlsaHandle {
@@ -16,35 +21,55 @@ struct AlsaHandle {
   unsigned int rate = 0;
 };
 
+// Snapshot of snd_pcm_status(); timestampSeconds is CLOCK_MONOTONIC and 0
+// when the driver does not provide timestamps.
+struct PcmStatus {
+  snd_pcm_uframes_t avail = 0;
+  snd_pcm_sframes_t delay = 0;
+  double timestampSeconds = 0.0;
+};
+
 snd_pcm_format_t ParseFormat(const std::string &format);
 size_t BytesPerSample(snd_pcm_format_t format);
 
 bool ConvertPcmToFloat(const void *src, snd_pcm_format_t format, size_t frames,
                        unsigned int channels, std::vector<float> *dst);
+// meter, when set, observes every sample (before clamping) in the same pass.
 bool ConvertFloatToPcm(const std::vector<float> &src, snd_pcm_format_t format,
-                       std::vector<uint8_t> *dst);
+                       std::vector<uint8_t> *dst,
+                       totton::audio::LevelMeter *meter = nullptr);
 
+// exactRate fails instead of settling for the nearest rate, and turns off
+// the plug layer's resampling so the hardware itself runs at rate.
 bool ConfigurePcm(snd_pcm_t *handle, snd_pcm_format_t format,
                   unsigned int channels, unsigned int rate,
                   snd_pcm_uframes_t requestedPeriod,
                   snd_pcm_uframes_t requestedBuffer,
                   snd_pcm_uframes_t *periodOut, snd_pcm_uframes_t *bufferOut,
-                  unsigned int *rateOut, bool playback);
+                  unsigned int *rateOut, bool playback,
+                  bool exactRate = false);
 
 std::optional<AlsaHandle>
 OpenPcm(const std::string &device, snd_pcm_stream_t stream,
         snd_pcm_format_t format, unsigned int channels, unsigned int rate,
-        snd_pcm_uframes_t period, snd_pcm_uframes_t buffer);
+        snd_pcm_uframes_t period, snd_pcm_uframes_t buffer,
+        bool exactRate = false);
 
 std::optional<AlsaHandle>
 OpenCaptureAutoRate(const std::string &device, snd_pcm_format_t format,
                     unsigned int channels, unsigned int requestedRate,
                     snd_pcm_uframes_t period, snd_pcm_uframes_t buffer);
 
-bool RecoverPcm(snd_pcm_t *handle, int err, const char *label);
+// xruns, when given, is incremented for every recovered -EPIPE (overrun or
+// underrun) so callers can export the count.
+bool RecoverPcm(snd_pcm_t *handle, int err, const char *label,
+                std::atomic<uint64_t> *xruns = nullptr);
+bool QueryPcmStatus(snd_pcm_t *handle, PcmStatus *status);
 bool ReadFull(snd_pcm_t *handle, void *buffer, snd_pcm_uframes_t frames,
-              const std::atomic<bool> &running);
+              const std::atomic<bool> &running,
+              std::atomic<uint64_t> *xruns = nullptr);
 bool WriteFull(snd_pcm_t *handle, const void *buffer, snd_pcm_uframes_t frames,
-               const std::atomic<bool> &running);
+               const std::atomic<bool> &running,
+               std::atomic<uint64_t> *xruns = nullptr);
 
 } // namespace totton::alsa
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "audio/adaptive_resampler.h"
+#include "audio/drift_controller.h"
+
+#include <alsa/asoundlib.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace totton::alsa {
+
+// Keeps capture and playback clocks in step: measures their ratio from
+// status timestamps, and trims an input-rate resampler with a PI loop so the
+// audio queued between resampler and DAC stays at the level it settled at.
+// nominalRatio: output frames per captured frame with perfect clocks.
+class DriftCompensation {
+public:
+  DriftCompensation(unsigned int channels, unsigned int outputRate,
+                    double nominalRatio, std::size_t periodFrames);
+
+  bool Process(const float *input, std::size_t frames,
+               std::vector<float> *output);
+
+  void OnCaptured(std::size_t frames) { captured_ += frames; }
+  void OnPlayed(std::size_t frames) { played_ += frames; }
+
+  // queuedFrames: output-rate frames buffered ahead of the playback PCM.
+  void Update(snd_pcm_t *capture, snd_pcm_t *playback,
+              std::size_t queuedFrames);
+
+private:
+  audio::AdaptiveResampler resampler_;
+  audio::DriftEstimator estimator_;
+  audio::DriftController controller_;
+  unsigned int outputRate_;
+  double nominalRatio_;
+  uint64_t captured_ = 0;
+  uint64_t played_ = 0;
+  bool primed_ = false;
+  std::chrono::steady_clock::time_point lastUpdate_{};
+};
+
+} // namespace totton::alsa
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "audio/eq_parser.h"
+#include "audio/param_exchange.h"
+#include "vulkan/vulkan_streaming_upsampler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace totton::alsa {
+
+// Multiplies the kernel's spectrum by the EQ's frequency response at the
+// output rate. The response is scaled down when it boosts anywhere, so an
+// EQ never raises the filter's peak gain.
+void ApplyEq(const EQ::EqProfile &profile, double outputRate,
+             vulkan::FilterKernel *kernel);
+
+// Filter kernels rebuilt off the audio thread and switched in by it at the
+// next period boundary. Kernels are built on the control side, or taken from
+// the filter a rate change just loaded, and freed once retired by Publish()
+// or Collect(), so Apply() never allocates or frees one. Control threads
+// transform filters without holding mutex_, which the audio thread takes
+// during a rate change, and only lock it to publish.
+class KernelUpdates {
+public:
+  KernelUpdates(std::string filterPath, vulkan::FilterConfig config,
+                double outputRate);
+
+  // Control side. Rebuilds the kernel from the current filter file and EQ.
+  bool Reload(std::string *errorMessage);
+
+  // Control side. Switches to another filter file, which must keep the FFT
+  // size, block size, resampling factors and half-band stage count of the
+  // loaded filter; only its FFT kernel is switched. Refused when a rate
+  // change started after Generation() returned generation.
+  bool SwitchFilter(const std::string &filterPath, uint64_t generation,
+                    std::string *errorMessage);
+
+  // Control side. Applies profile on top of the filter; nullopt removes the
+  // EQ again.
+  bool SetEq(std::optional<EQ::EqProfile> profile, std::string *errorMessage);
+
+  // Counts rate changes; filters resolved for one generation must not be
+  // published in another.
+  uint64_t Generation() const;
+
+  // Audio thread, as a rate change starts: refuses kernels control threads
+  // are still building for the old rate.
+  void BeginRebase();
+
+  // Audio thread, at the end of a rate change: follows kernel, the one the
+  // filter loaded for the new rate built, with the EQ at the new output
+  // rate. Publishing it right away hands it to the new upsamplers at the
+  // next Apply().
+  void Rebase(std::string filterPath, vulkan::FilterKernel kernel,
+              double outputRate);
+
+  // Control side: frees the kernel the audio thread switched away from.
+  void Collect() { exchange_.Collect(); }
+
+  // Control side: whether the audio thread rejected a published kernel since
+  // the previous call.
+  bool TakeRejected() { return rejected_.exchange(false); }
+
+  std::string FilterPath() const;
+  bool EqActive() const;
+
+  // Audio thread, between periods. Wait-free. Acquire() has already retired
+  // the previous kernel to Collect(), so a kernel an upsampler rejects puts
+  // every channel back on the filter it loaded rather than leaving any on
+  // the retired one.
+  void Apply(std::vector<vulkan::VulkanStreamingUpsampler> *channelUpsamplers);
+
+private:
+  // Control side, with buildMutex_ held. Builds filterPath's kernel with eq
+  // for the current geometry and output rate and, unless a rate change
+  // started in between, publishes it and makes both current.
+  bool Publish(std::string filterPath, std::optional<EQ::EqProfile> eq,
+               uint64_t generation, std::string *errorMessage);
+
+  // Serializes the control-side builders, so each starts from the path and
+  // EQ the previous one made current.
+  std::mutex buildMutex_;
+  mutable std::mutex mutex_;
+  // Guarded by mutex_.
+  vulkan::FilterConfig config_;
+  double outputRate_;
+  std::string filterPath_;
+  std::optional<EQ::EqProfile> eq_;
+  uint64_t generation_ = 0;
+  audio::ParamExchange<vulkan::FilterKernel> exchange_;
+  // Audio thread only.
+  const vulkan::FilterKernel *applied_ = nullptr;
+  // The current kernel when the upsamplers rejected it, so it is not
+  // retried every period; like applied_ it is never a freed kernel.
+  const vulkan::FilterKernel *skipped_ = nullptr;
+  std::atomic<bool> rejected_{false};
+};
+
+} // namespace totton::alsa
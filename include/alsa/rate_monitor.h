@@ -0,0 +1,58 @@
+#pragma once
+
+#include "audio/rate_detector.h"
+
+#include <alsa/asoundlib.h>
+
+#include <cstdint>
+#include <string>
+
+namespace totton::alsa {
+
+// Card index a PCM name refers to ("hw:1", "plughw:1,0", "hw:CARD=Gadget"),
+// or -1 for names without one ("default", "null").
+int CardIndexForPcm(const std::string &device);
+
+// Watches a running capture PCM for its source switching rate. Cards that
+// report the source rate in a control (the USB audio gadget's "Capture
+// Rate") are followed through control events; for everything else the rate
+// frames actually arrive at is measured from status timestamps.
+class CaptureRateMonitor {
+public:
+  CaptureRateMonitor() = default;
+  ~CaptureRateMonitor();
+  CaptureRateMonitor(const CaptureRateMonitor &) = delete;
+  CaptureRateMonitor &operator=(const CaptureRateMonitor &) = delete;
+
+  // Looks for a rate control on the device's card and starts measuring
+  // against nominalRate, the rate the capture PCM was opened at.
+  void Start(const std::string &device, unsigned int nominalRate);
+  // After the capture PCM was reopened at nominalRate to follow
+  // requestedRate (0 when any rate would do). A requested rate the PCM did
+  // not come up at is not reported again until the source announces one.
+  void Rearm(unsigned int nominalRate, unsigned int requestedRate = 0);
+
+  // Audio thread, after each period of framesRead frames. Returns the rate
+  // the source switched to, 0 while it still matches the PCM. A control
+  // reading 0 (no signal) is not a change.
+  unsigned int Poll(snd_pcm_t *capture, snd_pcm_uframes_t framesRead);
+
+  // Name of the rate control followed, empty when measuring.
+  const std::string &ControlName() const { return controlName_; }
+
+  // The source's rate while the PCM could not be reopened at it, else 0.
+  unsigned int RejectedRate() const { return gate_.Rejected(); }
+
+private:
+  unsigned int ReadControlRate();
+
+  snd_ctl_t *ctl_ = nullptr;
+  std::string controlName_;
+  unsigned int nominal_ = 0;
+  unsigned int pending_ = 0;
+  uint64_t framesRead_ = 0;
+  audio::RateDetector detector_;
+  audio::RateChangeGate gate_;
+};
+
+} // namespace totton::alsa
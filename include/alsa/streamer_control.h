@@ -0,0 +1,63 @@
+#pragma once
+
+#include "alsa/kernel_updates.h"
+#include "audio/metrics_registry.h"
+#include "audio/soft_gain.h"
+#include "zmq/command_server.h"
+#include "zmq/event_stream.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace totton::alsa {
+
+// What the streamer's control commands act on. Handlers run on the command
+// server's threads, several at once: they build filter kernels through
+// kernelUpdates and post everything else to commands, so a request never
+// waits on the audio thread and the audio thread never waits on a request.
+struct ControlContext {
+  // Where PHASE_TYPE_SET looks filters up; filterPinned (--filter) refuses
+  // phase switches.
+  std::string filterDir;
+  bool filterPinned = false;
+  // Rate and ratio filters are looked up for: the capture rate, or the rate
+  // it is resampled to. Follow input rate changes; written with phaseMutex
+  // held.
+  std::atomic<unsigned int> inputRate{0};
+  std::atomic<unsigned int> ratio{1};
+  const audio::MetricsRegistry *metrics = nullptr;
+  KernelUpdates *kernelUpdates = nullptr;     // Null without a filter.
+  zmq_server::EventPublisher *events = nullptr; // Null without PUB.
+  audio::ControlQueue *commands = nullptr;
+  // Cleared by SHUTDOWN.
+  std::atomic<bool> *running = nullptr;
+  std::chrono::steady_clock::time_point startTime;
+  // Guards phase, and is held while a rate change reads the phase and while
+  // it publishes the new rates and filter, so they change together. Never
+  // held across a filter build.
+  std::mutex phaseMutex;
+  // Serializes phase switches, which hold it across their filter build.
+  std::mutex phaseSwitchMutex;
+  std::string phase;
+  std::atomic<bool> muted{false};
+  std::atomic<uint64_t> reloads{0};
+  std::atomic<uint64_t> softResets{0};
+};
+
+// Registers PING, STATS, RELOAD, PHASE_TYPE_GET/SET, EQ_SET/CLEAR, MUTE,
+// UNMUTE, SOFT_RESET and SHUTDOWN on server. context must outlive it.
+void RegisterControlCommands(zmq_server::ZmqCommandServer *server,
+                             ControlContext *context);
+
+// Tells subscribers which kernel the next periods run with. phase is only
+// passed by the phase switch, which holds phaseSwitchMutex while it runs.
+void EmitFilterEvent(ControlContext *context, const std::string &reason,
+                     const std::string &phase = "");
+
+// The counters event.stats reports changes of.
+zmq_server::StatsSample SampleStats(const audio::MetricsRegistry &metrics);
+
+} // namespace totton::alsa
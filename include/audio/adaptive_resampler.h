@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace totton::audio {
+
+// Variable-ratio polyphase resampler for small clock corrections.
+//
+// Interpolates interleaved float frames with a Kaiser-windowed sinc whose
+// fractional phase is taken from a table of kPhases sub-filters and linearly
+// interpolated between neighbours, so the ratio can change on every call
+// without glitches. Intended for ratios within a few hundred ppm of 1.0
+// (clock-drift compensation), not for sample-rate conversion between rate
+// families.
+class AdaptiveResampler {
+public:
+  static constexpr std::size_t kTaps = 32;
+  static constexpr std::size_t kPhases = 256;
+
+  AdaptiveResampler();
+
+  void Init(unsigned int channels);
+  void Reset();
+  // Sizes the input history for calls of up to maxFrames frames so that
+  // Process() does not allocate in steady state. Call after Init().
+  void Reserve(std::size_t maxFrames);
+
+  // Output frames produced per input frame; clamped to [0.99, 1.01].
+  void SetRatio(double ratio);
+  double GetRatio() const { return ratio_; }
+
+  // Appends the resampled frames for frames interleaved input frames to
+  // *output. Roughly frames * ratio frames are produced per call.
+  bool Process(const float *input, std::size_t frames,
+               std::vector<float> *output);
+
+  // Group delay in input frames.
+  static constexpr std::size_t LatencyFrames() { return kTaps / 2; }
+
+private:
+  std::vector<float> table_;
+  std::vector<float> history_;
+  unsigned int channels_ = 0;
+  double ratio_ = 1.0;
+  double position_ = 0.0;
+};
+
+} // namespace totton::audio
@@ -23,13 +23,26 @@ struct NegotiatedConfig {
   int inputRate;                       // Input sample rate
   AudioEngine::RateFamily inputFamily; // RATE_44K or RATE_48K
   int outputRate;                      // Negotiated output rate
-  int upsampleRatio;            // Upsampling ratio (outputRate / inputRate)
+  int upsampleRatio; // Upsampling ratio (outputRate / inputRate, or
+                     // outputRate / resampleRate)
+  int resampleRate = 0; // Rate the input is resampled to ahead of the
+                        // upsampler, 0 when it is upsampled as is
   bool isValid;                 // Whether negotiation succeeded
   bool requiresReconfiguration; // True if ALSA needs reconfiguration (family
                                 // change)
   std::string errorMessage;     // Error message if failed
+
+  // Output PCM layout, chosen from the probed hardware details
+  DacCapability::SampleFormat outputFormat =
+      DacCapability::SampleFormat::S32_LE;
+  unsigned long periodFrames = 0; // Output period in frames
+  unsigned long bufferFrames = 0; // Output buffer in frames
+  double latencyMs = 0.0;         // bufferFrames at outputRate
 };
 
+// Input period alsa_streamer uses unless told otherwise
+constexpr unsigned long DEFAULT_INPUT_PERIOD_FRAMES = 1024;
+
 /**
  * @brief Negotiate optimal output rate based on input and DAC capabilities
  *
@@ -37,17 +50,31 @@ struct NegotiatedConfig {
  * @param dacCap DAC capability information from DacCapability::scan()
  * @param currentOutputRate Currently configured output rate (0 if not
  * configured)
+ * @param inputPeriodFrames Capture period; one output period carries its
+ * upsampled frames
  * @return NegotiatedConfig with optimal settings
  *
+ * Layout: the first of S32_LE, S24_3LE and S16_LE the DAC takes (the
+ * formats the output conversion writes; S32_LE needs no byte packing), the
+ * upsampled input period clamped to the DAC's period range, and the
+ * fewest periods per buffer the device handles without underruns: two,
+ * or three for batch and block-transfer devices whose position only
+ * moves in whole periods.
+ *
  * Design Decision (Issue #12):
  *   Cross-family switching (44.1k <-> 48k) sets requiresReconfiguration=true.
- *   This causes ~1 second soft mute during ALSA reconfiguration.
- *   Same-family switching is instant and glitch-free.
- *   No resampling is used to preserve ultimate audio quality.
+ *   alsa_streamer then fades the queued output out and drains and reopens
+ *   only the playback PCM, a gap of about one DAC buffer.
+ *   Same-family switching keeps the output rate and only swaps the filter.
+ *   Family rates the DAC runs are never resampled, to preserve ultimate
+ *   audio quality. Only inputs with no integer path to the DAC get a
+ *   resampleRate: rates outside both families, the other family on DACs
+ *   that run just one, and rates above the DAC's best.
  */
-NegotiatedConfig negotiate(int inputRate,
-                           const DacCapability::Capability &dacCap,
-                           int currentOutputRate = 0);
+NegotiatedConfig
+negotiate(int inputRate, const DacCapability::Capability &dacCap,
+          int currentOutputRate = 0,
+          unsigned long inputPeriodFrames = DEFAULT_INPUT_PERIOD_FRAMES);
 
 /**
  * @brief Get the target output rate for a given family
@@ -69,6 +96,18 @@ int getBestRateForFamily(AudioEngine::RateFamily family,
  */
 int calculateUpsampleRatio(int inputRate, int outputRate);
 
+/**
+ * @brief Rate to resample inputRate to so that a ratio in {1, 2, 4, 8, 16}
+ * reaches outputRate
+ *
+ * The lowest 44.1k or 48k family rate dividing outputRate by such a ratio
+ * that is not below inputRate, so the input keeps its whole band; outputRate
+ * itself for inputs above it.
+ * @return The rate (inputRate when no resampling is needed), or 0 for
+ * invalid rates
+ */
+int getResampleRate(int inputRate, int outputRate);
+
 /**
  * @brief Check if two rates belong to the same family
  */
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+namespace totton::audio {
+
+// Measures the rate ratio between two device clocks from (frame position,
+// timestamp) pairs, e.g. snd_pcm_status() htstamps for capture and playback.
+// Both devices must be timestamped against the same system clock.
+class DriftEstimator {
+public:
+  // Seconds of observation required before Ratio() reports a measurement.
+  explicit DriftEstimator(double windowSeconds = 5.0);
+
+  void Reset();
+
+  // Hardware frame position of each device (frames transferred, corrected by
+  // avail/delay) at timestampSeconds.
+  void AddCaptureSample(uint64_t frames, double timestampSeconds);
+  void AddPlaybackSample(uint64_t frames, double timestampSeconds);
+
+  bool HasEstimate() const;
+  // playbackRate / captureRate as measured, 1.0 until HasEstimate().
+  double Ratio() const;
+
+private:
+  struct Track {
+    bool valid = false;
+    uint64_t firstFrames = 0;
+    double firstTime = 0.0;
+    uint64_t lastFrames = 0;
+    double lastTime = 0.0;
+
+    void Add(uint64_t frames, double timestamp);
+    double Span() const { return valid ? lastTime - firstTime : 0.0; }
+    double Rate() const;
+  };
+
+  double windowSeconds_;
+  Track capture_;
+  Track playback_;
+};
+
+struct DriftControllerConfig {
+  // Proportional and integral gains, in ratio units per second of fill
+  // error and per second of fill error times seconds.
+  double kp = 0.1;
+  double ki = 0.005;
+  // Correction limit around the feed-forward ratio.
+  double maxCorrectionPpm = 1000.0;
+  // Time constant of the fill level smoothing; block-wise filter output makes
+  // the raw fill jump by a whole block.
+  double smoothingSeconds = 0.5;
+  // The target fill is learned as the smoothed level after this long.
+  double warmupSeconds = 2.0;
+};
+
+// PI controller keeping a buffer at its target fill by trimming the
+// resampling ratio (output frames per input frame).
+class DriftController {
+public:
+  explicit DriftController(const DriftControllerConfig &config = {});
+
+  void Reset();
+
+  // fillSeconds: frames queued between resampler and DAC, in seconds.
+  // feedForward: measured clock ratio (1.0 if unknown). Returns the ratio to
+  // apply to the resampler.
+  double Update(double fillSeconds, double dtSeconds, double feedForward);
+
+  bool IsLocked() const { return elapsed_ >= config_.warmupSeconds; }
+  double TargetSeconds() const { return target_; }
+  double SmoothedFillSeconds() const { return smoothed_; }
+  double Ratio() const { return ratio_; }
+
+private:
+  DriftControllerConfig config_;
+  bool primed_ = false;
+  double elapsed_ = 0.0;
+  double smoothed_ = 0.0;
+  double target_ = 0.0;
+  double integral_ = 0.0;
+  double ratio_ = 1.0;
+};
+
+} // namespace totton::audio
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace totton::audio {
+
+constexpr std::size_t kMeterMaxChannels = 8;
+constexpr std::size_t kSpectrumBands = 48;
+
+// One metering window, copied by value from the audio thread to the
+// publisher through an MpscQueue.
+struct MeterFrame {
+  uint64_t frames = 0;
+  uint32_t channels = 0;
+  // Largest |sample| and RMS per channel, 1.0 being full scale.
+  std::array<float, kMeterMaxChannels> peak{};
+  std::array<float, kMeterMaxChannels> rms{};
+  // Samples at or beyond full scale, which the PCM conversion clamps.
+  std::array<uint32_t, kMeterMaxChannels> clips{};
+  // Mean filtered band power (VulkanStreamingUpsampler::TakeSpectrum()),
+  // summed over channels; only meaningful when spectrumBlocks > 0.
+  uint32_t spectrumBlocks = 0;
+  std::array<float, kSpectrumBands> spectrum{};
+};
+
+// Per-channel peak, RMS and clip counts of the output. Observe() is called
+// by the float to PCM conversion for every interleaved sample, so metering
+// rides on a pass that already touches each one. Channels beyond
+// kMeterMaxChannels are skipped. Audio thread only; never allocates.
+class LevelMeter {
+public:
+  explicit LevelMeter(unsigned int channels)
+      : stride_(std::max(channels, 1u)) {}
+
+  void Observe(float sample) {
+    if (channel_ < kMeterMaxChannels) {
+      const float magnitude = std::fabs(sample);
+      Channel &channel = channels_[channel_];
+      channel.peak = std::max(channel.peak, magnitude);
+      channel.sumSquares += static_cast<double>(sample) * sample;
+      channel.clips += magnitude >= 1.0f ? 1 : 0;
+    }
+    if (++channel_ == stride_) {
+      channel_ = 0;
+      ++frames_;
+    }
+  }
+
+  // Whole frames observed since the last Finish().
+  uint64_t Frames() const { return frames_; }
+
+  // Moves the window into frame's level fields and starts a new one.
+  void Finish(MeterFrame *frame) {
+    const std::size_t count = std::min<std::size_t>(stride_, kMeterMaxChannels);
+    frame->frames = frames_;
+    frame->channels = static_cast<uint32_t>(count);
+    for (std::size_t ch = 0; ch < count; ++ch) {
+      Channel &channel = channels_[ch];
+      frame->peak[ch] = channel.peak;
+      frame->rms[ch] =
+          frames_ > 0 ? static_cast<float>(std::sqrt(
+                            channel.sumSquares / static_cast<double>(frames_)))
+                      : 0.0f;
+      frame->clips[ch] = channel.clips;
+      channel = Channel{};
+    }
+    frames_ = 0;
+  }
+
+private:
+  struct Channel {
+    float peak = 0.0f;
+    double sumSquares = 0.0;
+    uint32_t clips = 0;
+  };
+
+  unsigned int stride_;
+  unsigned int channel_ = 0;
+  uint64_t frames_ = 0;
+  std::array<Channel, kMeterMaxChannels> channels_{};
+};
+
+} // namespace totton::audio
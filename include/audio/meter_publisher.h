@@ -0,0 +1,47 @@
+#pragma once
+
+#include "audio/level_meter.h"
+#include "audio/mpsc_queue.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace totton::audio {
+
+// Finished level meter windows, from the audio thread to the meter
+// publisher. A full queue drops the window.
+using MeterQueue = MpscQueue<MeterFrame, 8>;
+
+// A meter window as the payload of an event.meters event: peak and RMS in
+// dBFS and clip counts per channel, and the band powers in dB when the
+// window carries a spectrum.
+std::string MeterFrameJson(const MeterFrame &frame);
+
+// Hands the meter windows the audio thread queued to emit as JSON, checking
+// the queue twice per window so events go out close to on time.
+class MeterPublisher {
+public:
+  using Emitter = std::function<void(const std::string &json)>;
+
+  // rate: meter windows per second.
+  MeterPublisher(MeterQueue *queue, Emitter emit, double rate);
+  ~MeterPublisher();
+
+  void Start();
+  void Stop();
+
+private:
+  MeterQueue *queue_;
+  Emitter emit_;
+  std::chrono::microseconds interval_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+} // namespace totton::audio
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace totton::audio {
+
+// Processing stages timed once per period by the streaming loop.
+enum class Stage : std::size_t {
+  Convert,  // PCM to float and drift resampling.
+  Fft,      // Forward transform of every filter block.
+  Multiply, // Spectrum multiply.
+  Ifft,     // Inverse transform and overlap-save output.
+  Output,   // Output ring drain and float to PCM conversion.
+  Count,
+};
+
+const char *StageName(Stage stage);
+
+// GPU FFT timing per period, from Vulkan timestamp queries. Only recorded
+// when the VkFFT path runs on a queue that supports timestamps.
+enum class GpuTiming : std::size_t {
+  Execute, // Device time of the FFT dispatches.
+  Queue,   // Submission latency plus fence wake-up around them.
+  Host,    // Host-side copies, spectrum multiply and buffer mapping.
+  Count,
+};
+
+const char *GpuTimingName(GpuTiming timing);
+
+// Log2-bucketed duration histogram. Record() is lock-free and allocation-free
+// and meant for a single writer; readers on other threads see a slightly
+// torn but always monotonic view.
+class LatencyHistogram {
+public:
+  // Bucket i counts durations in [2^i, 2^(i+1)) ns; bucket 0 also holds 0.
+  static constexpr std::size_t kBuckets = 32;
+
+  struct Snapshot {
+    std::array<uint64_t, kBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t sumNs = 0;
+    uint64_t maxNs = 0;
+
+    // Upper bound of the bucket holding the given quantile (0..1).
+    uint64_t PercentileNs(double quantile) const;
+  };
+
+  void Record(uint64_t ns) {
+    std::size_t bucket = 0;
+    for (uint64_t v = ns >> 1; v != 0 && bucket + 1 < kBuckets; v >>= 1) {
+      ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    sumNs_.fetch_add(ns, std::memory_order_relaxed);
+    if (ns > maxNs_.load(std::memory_order_relaxed)) {
+      maxNs_.store(ns, std::memory_order_relaxed);
+    }
+    count_.fetch_add(1, std::memory_order_release);
+  }
+
+  Snapshot Read() const;
+
+private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sumNs_{0};
+  std::atomic<uint64_t> maxNs_{0};
+};
+
+// Current, lowest and highest fill of a ring buffer, in frames.
+class FillWatermark {
+public:
+  struct Snapshot {
+    uint64_t current = 0;
+    uint64_t low = 0;
+    uint64_t high = 0;
+    uint64_t capacity = 0;
+  };
+
+  void SetCapacity(uint64_t frames) {
+    capacity_.store(frames, std::memory_order_relaxed);
+  }
+
+  // Single writer: plain load/store keeps the audio thread free of CAS loops.
+  void Observe(uint64_t frames) {
+    current_.store(frames, std::memory_order_relaxed);
+    if (frames < low_.load(std::memory_order_relaxed)) {
+      low_.store(frames, std::memory_order_relaxed);
+    }
+    if (frames > high_.load(std::memory_order_relaxed)) {
+      high_.store(frames, std::memory_order_relaxed);
+    }
+  }
+
+  Snapshot Read() const;
+
+private:
+  std::atomic<uint64_t> current_{0};
+  std::atomic<uint64_t> low_{UINT64_MAX};
+  std::atomic<uint64_t> high_{0};
+  std::atomic<uint64_t> capacity_{0};
+};
+
+// Runtime metrics shared between the audio thread, which only touches
+// relaxed atomics, and a publisher thread that serialises them. Nothing here
+// locks or allocates on the recording side.
+class MetricsRegistry {
+public:
+  MetricsRegistry();
+
+  void SetRates(unsigned int inputRate, unsigned int outputRate);
+  // Processing budget for one period; longer cycles count as deadline misses.
+  void SetDeadlineNs(uint64_t ns) {
+    deadlineNs_.store(ns, std::memory_order_relaxed);
+  }
+  void SetMode(const char *mode) { mode_.store(mode); }
+
+  // Passed to ReadFull()/WriteFull() so RecoverPcm() can count xruns.
+  std::atomic<uint64_t> *CaptureXruns() { return &captureXruns_; }
+  std::atomic<uint64_t> *PlaybackXruns() { return &playbackXruns_; }
+
+  // Ring overflows that dropped the audio accumulated so far. Counted rather
+  // than logged on the audio thread; the stats publisher reports them.
+  void CountInputOverflow() {
+    inputOverflows_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void CountOutputOverflow() {
+    outputOverflows_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void RecordStage(Stage stage, uint64_t ns) {
+    stages_[static_cast<std::size_t>(stage)].Record(ns);
+  }
+  void RecordGpu(GpuTiming timing, uint64_t ns) {
+    gpu_[static_cast<std::size_t>(timing)].Record(ns);
+  }
+  // Compute time of one period (blocking device I/O excluded).
+  void RecordCycle(uint64_t ns) {
+    cycles_.Record(ns);
+    const uint64_t deadline = deadlineNs_.load(std::memory_order_relaxed);
+    if (deadline > 0 && ns > deadline) {
+      deadlineMisses_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  FillWatermark &InputFill() { return inputFill_; }
+  FillWatermark &OutputFill() { return outputFill_; }
+
+  uint64_t CaptureXrunCount() const {
+    return captureXruns_.load(std::memory_order_relaxed);
+  }
+  uint64_t PlaybackXrunCount() const {
+    return playbackXruns_.load(std::memory_order_relaxed);
+  }
+  uint64_t InputOverflowCount() const {
+    return inputOverflows_.load(std::memory_order_relaxed);
+  }
+  uint64_t OutputOverflowCount() const {
+    return outputOverflows_.load(std::memory_order_relaxed);
+  }
+  uint64_t DeadlineMissCount() const {
+    return deadlineMisses_.load(std::memory_order_relaxed);
+  }
+  LatencyHistogram::Snapshot ReadStage(Stage stage) const {
+    return stages_[static_cast<std::size_t>(stage)].Read();
+  }
+  LatencyHistogram::Snapshot ReadGpu(GpuTiming timing) const {
+    return gpu_[static_cast<std::size_t>(timing)].Read();
+  }
+  LatencyHistogram::Snapshot ReadCycle() const { return cycles_.Read(); }
+  const FillWatermark &InputFill() const { return inputFill_; }
+  const FillWatermark &OutputFill() const { return outputFill_; }
+  unsigned int InputRate() const {
+    return inputRate_.load(std::memory_order_relaxed);
+  }
+  unsigned int OutputRate() const {
+    return outputRate_.load(std::memory_order_relaxed);
+  }
+  uint64_t DeadlineNs() const {
+    return deadlineNs_.load(std::memory_order_relaxed);
+  }
+  const char *Mode() const { return mode_.load(); }
+
+  // Stats file layout read by the web UI: input_rate, output_rate and
+  // audio.xrun.total at the top, ring overflows, per-stage and GPU timings
+  // and fills below.
+  std::string ToJson() const;
+  // Writes ToJson() to a sibling temp file and renames it over path, so
+  // readers never see a partial document.
+  bool WriteStatsFile(const std::string &path,
+                      std::string *errorMessage) const;
+
+private:
+  std::atomic<unsigned int> inputRate_{0};
+  std::atomic<unsigned int> outputRate_{0};
+  std::atomic<uint64_t> deadlineNs_{0};
+  std::atomic<const char *> mode_;
+  std::atomic<uint64_t> captureXruns_{0};
+  std::atomic<uint64_t> playbackXruns_{0};
+  std::atomic<uint64_t> inputOverflows_{0};
+  std::atomic<uint64_t> outputOverflows_{0};
+  std::atomic<uint64_t> deadlineMisses_{0};
+  std::array<LatencyHistogram, static_cast<std::size_t>(Stage::Count)>
+      stages_{};
+  std::array<LatencyHistogram, static_cast<std::size_t>(GpuTiming::Count)>
+      gpu_{};
+  LatencyHistogram cycles_;
+  FillWatermark inputFill_;
+  FillWatermark outputFill_;
+  uint64_t startNs_ = 0;
+};
+
+// Monotonic clock in nanoseconds, for stage timing.
+uint64_t MonotonicNs();
+
+} // namespace totton::audio
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace totton::audio {
+
+// Bounded multi-producer, single-consumer queue (Vyukov's bounded queue
+// without the CAS on the head): each slot's sequence number says whether it
+// is free for the producer or filled for the consumer, so a push is one CAS
+// on the tail plus two stores and never waits on another thread.
+// Lock-free and allocation-free on both sides; a full queue fails the push
+// instead of blocking.
+//
+// Thread safety:
+//   Any number of producers. One consumer at a time; callers that pop from
+//   several threads serialise TryPop() themselves.
+template <typename T, std::size_t Capacity> class MpscQueue {
+  static_assert(Capacity > 0, "queue needs at least one slot");
+
+public:
+  MpscQueue() {
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  bool TryPush(const T &value) {
+    std::size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots_[pos % slots_.size()];
+      const std::size_t sequence =
+          slot.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(sequence) -
+                        static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          slot.value = value;
+          slot.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool TryPop(T *value) {
+    const std::size_t pos = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[pos % slots_.size()];
+    const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != pos + 1) {
+      return false;
+    }
+    *value = slot.value;
+    head_.store(pos + 1, std::memory_order_relaxed);
+    slot.sequence.store(pos + slots_.size(), std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Slot {
+    std::atomic<std::size_t> sequence{0};
+    T value{};
+  };
+
+  std::array<Slot, Capacity> slots_;
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  alignas(64) std::atomic<std::size_t> head_{0};
+};
+
+} // namespace totton::audio
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace totton::audio {
+
+// Hands immutable parameter snapshots (filter kernels, spectra, gains) from
+// control threads to the audio thread without locks.
+//
+// Usage:
+//   ParamExchange<Kernel> exchange;
+//   exchange.Publish(BuildKernel());       // control thread
+//   const Kernel *kernel = exchange.Acquire();  // audio thread, per block
+//
+// Pointer triple buffer: the control thread owns the object it is building,
+// the audio thread owns the one it reads (front), and the middle slot
+// carries either a fresh snapshot towards the audio thread or the front it
+// retired back towards the control thread. Acquire() is wait-free (one load,
+// and one exchange when something new arrived) and never frees anything;
+// every object is deleted by Publish() or Collect(), i.e. on the control
+// side. A snapshot published before the audio thread picked up the previous
+// one replaces it, so the audio thread only ever sees the newest.
+//
+// Thread safety:
+//   One audio-side reader. Publish() and Collect() may be called from any
+//   number of non-real-time threads. The pointer returned by Acquire() stays
+//   valid until the next Acquire() on the same thread.
+template <typename T> class ParamExchange {
+  static_assert(alignof(T) >= 2, "the low pointer bit marks fresh snapshots");
+
+public:
+  ParamExchange() = default;
+  ParamExchange(const ParamExchange &) = delete;
+  ParamExchange &operator=(const ParamExchange &) = delete;
+
+  ~ParamExchange() {
+    delete front_;
+    delete Pointer(middle_.load(std::memory_order_acquire));
+  }
+
+  // Makes value the next snapshot Acquire() returns and frees whatever the
+  // audio thread retired, or an earlier snapshot it never picked up.
+  void Publish(std::unique_ptr<T> value) {
+    const uintptr_t previous = middle_.exchange(
+        reinterpret_cast<uintptr_t>(value.release()) | kFresh,
+        std::memory_order_acq_rel);
+    delete Pointer(previous);
+  }
+
+  // Frees the snapshot the audio thread retired, if any, without publishing.
+  void Collect() {
+    uintptr_t middle = middle_.load(std::memory_order_acquire);
+    // A fresh snapshot belongs to the audio thread; only a retired one,
+    // which the audio thread no longer touches, may be taken back.
+    if (middle != 0 && (middle & kFresh) == 0 &&
+        middle_.compare_exchange_strong(middle, 0,
+                                        std::memory_order_acq_rel)) {
+      delete Pointer(middle);
+    }
+  }
+
+  // Audio thread: the newest published snapshot, or nullptr before the
+  // first Publish().
+  const T *Acquire() {
+    if (middle_.load(std::memory_order_relaxed) & kFresh) {
+      const uintptr_t fresh = middle_.exchange(
+          reinterpret_cast<uintptr_t>(front_), std::memory_order_acq_rel);
+      front_ = Pointer(fresh);
+    }
+    return front_;
+  }
+
+private:
+  static constexpr uintptr_t kFresh = 1;
+
+  static T *Pointer(uintptr_t value) {
+    return reinterpret_cast<T *>(value & ~kFresh);
+  }
+
+  std::atomic<uintptr_t> middle_{0};
+  // Audio thread only.
+  T *front_ = nullptr;
+};
+
+} // namespace totton::audio
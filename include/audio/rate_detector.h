@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+namespace totton::audio {
+
+// Notices a capture device delivering frames at a different rate than it was
+// opened at. Hardware-clocked inputs (S/PDIF receivers, USB gadgets) do that
+// when their source switches rate without the driver reconfiguring the PCM.
+// Fed (frame position, timestamp) pairs like DriftEstimator.
+class RateDetector {
+public:
+  // Each measurement spans windowSeconds; a change is reported once
+  // `confirmations` consecutive windows measured the same standard rate.
+  explicit RateDetector(double windowSeconds = 0.5, int confirmations = 2);
+
+  // Starts over for a PCM running at nominalRate.
+  void Reset(unsigned int nominalRate);
+
+  // frames: hardware frame position (frames read plus avail) at
+  // timestampSeconds. Returns the source rate once a change is confirmed,
+  // 0 otherwise. Stale or zero timestamps are ignored.
+  unsigned int AddSample(uint64_t frames, double timestampSeconds);
+
+  // Rate of the last completed window, 0 before the first.
+  double MeasuredRate() const { return measured_; }
+
+private:
+  double windowSeconds_;
+  int confirmations_;
+  unsigned int nominal_ = 0;
+  bool started_ = false;
+  uint64_t windowFrames_ = 0;
+  double windowTime_ = 0.0;
+  double measured_ = 0.0;
+  unsigned int candidate_ = 0;
+  int agreeing_ = 0;
+};
+
+// Decides which source rates a capture PCM should be reopened at. A rate the
+// PCM could not be reopened at (it fell back to another one) is held back
+// until the source announces a rate again, so a device that cannot follow
+// is not reopened every period.
+class RateChangeGate {
+public:
+  // After the PCM was (re)opened at nominalRate to follow requestedRate, 0
+  // when no particular rate was asked for.
+  void Rearm(unsigned int nominalRate, unsigned int requestedRate);
+
+  // sourceRate: what the source runs at, 0 when unknown. newEvent: it comes
+  // with a fresh announcement (a control event) rather than a re-read or a
+  // repeated measurement, which retries a rejected rate. Returns the rate
+  // to reopen at, 0 to carry on.
+  unsigned int Update(unsigned int sourceRate, bool newEvent);
+
+  // The rate the source runs at but the PCM could not be opened at, 0 when
+  // the PCM follows the source. The captured audio is garbage meanwhile.
+  unsigned int Rejected() const { return rejected_; }
+
+private:
+  unsigned int nominal_ = 0;
+  unsigned int rejected_ = 0;
+};
+
+// The 44.1k or 48k family rate (8 kHz to 768 kHz) within relative
+// tolerance of rate, or 0.
+unsigned int NearestStandardRate(double rate, double tolerance = 0.005);
+
+} // namespace totton::audio
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace totton::audio {
+
+// Fixed-ratio polyphase resampler between any two sample rates.
+//
+// The ratio outputRate / inputRate is reduced to L / M and realised as
+// upsampling by L, a Kaiser-windowed sinc lowpass and decimation by M, with
+// only the L sub-filters (phases) the output actually needs evaluated. All
+// phases are precomputed in Init(), so Process() is one dot product per
+// output sample and channel over contiguous coefficients and history, the
+// part that runs in SIMD. Meant to bring a rate outside the 44.1k and 48k
+// families (or one the DAC does not run) to a rate the upsampling filters
+// exist for, e.g. 44.1k -> 48k is L/M = 160/147.
+class RationalResampler {
+public:
+  // Largest L accepted. Every pair of standard rates (8 kHz to 768 kHz)
+  // fits; 11.025k -> 48k needs the most phases, 640.
+  static constexpr unsigned int kMaxPhases = 2048;
+
+  RationalResampler() = default;
+
+  bool Init(unsigned int channels, unsigned int inputRate,
+            unsigned int outputRate, std::string *errorMessage);
+  void Reset();
+  // Sizes the per-channel history for calls of up to maxFrames frames so
+  // that Process() does not allocate in steady state. Call after Init().
+  void Reserve(std::size_t maxFrames);
+
+  // Appends the resampled frames for frames interleaved input frames to
+  // *output: MinOutputFrames(frames) or one more.
+  bool Process(const float *input, std::size_t frames,
+               std::vector<float> *output);
+
+  // Output frames a call with inputFrames frames produces at least.
+  std::size_t MinOutputFrames(std::size_t inputFrames) const {
+    return inputFrames * interpolation_ / decimation_;
+  }
+
+  unsigned int InputRate() const { return inputRate_; }
+  unsigned int OutputRate() const { return outputRate_; }
+  // Reduced ratio L / M.
+  unsigned int Interpolation() const { return interpolation_; }
+  unsigned int Decimation() const { return decimation_; }
+  // Taps per phase.
+  std::size_t Taps() const { return taps_; }
+  // Group delay in input frames.
+  std::size_t LatencyFrames() const { return taps_ / 2; }
+
+private:
+  // interpolation_ rows of taps_ coefficients, each reversed so that a row
+  // lines up with the oldest-to-newest history it is applied to.
+  std::vector<float> table_;
+  // One contiguous history per channel: taps_ - 1 frames from previous
+  // calls, then the frames of the current one.
+  std::vector<std::vector<float>> history_;
+  unsigned int channels_ = 0;
+  unsigned int inputRate_ = 0;
+  unsigned int outputRate_ = 0;
+  unsigned int interpolation_ = 1;
+  unsigned int decimation_ = 1;
+  std::size_t taps_ = 0;
+  // Newest history frame and phase the next output is computed from.
+  std::size_t next_ = 0;
+  unsigned int phase_ = 0;
+};
+
+} // namespace totton::audio
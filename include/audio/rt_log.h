@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Logging that is safe to call from the audio thread. Post() copies a
+// fixed-size record into a preallocated lock-free queue; a low-priority
+// writer thread formats the records and writes them out, rate limited per
+// message code. When the queue is full the record is dropped and counted
+// instead of blocking the caller.
+namespace totton::audio::rtlog {
+
+enum class Code : uint8_t {
+  InputOverflow,  // Input ring overflow; accumulated audio dropped.
+  OutputOverflow, // Output ring overflow; accumulated audio dropped.
+  OutputUnderrun, // Output ring could not supply a period.
+  XrunRecovered,  // text: PCM label.
+  RecoverFailed,  // text: PCM label, detail: snd_strerror().
+  PcmError,       // text: PCM label, detail: snd_strerror().
+  VkfftFallback,  // text: initialization error.
+  DriftLocked,    // arg0: target fill in microseconds.
+  Count,
+};
+
+const char *CodeName(Code code);
+
+constexpr std::size_t kTextBytes = 96;
+constexpr std::size_t kQueueCapacity = 256;
+// At most this many records per code are written per second; the rest are
+// summarised as a suppressed count.
+constexpr std::size_t kBurstPerSecond = 5;
+
+struct Record {
+  Code code = Code::Count;
+  uint64_t timeNs = 0;
+  int64_t arg0 = 0;
+  int64_t arg1 = 0;
+  const char *detail = nullptr;
+  char text[kTextBytes] = {};
+};
+
+// Lock-free, allocation-free and never blocks. text is copied (truncated to
+// kTextBytes - 1); detail must point to static storage, such as a string
+// literal or snd_strerror(). While no writer runs, the record is written
+// synchronously instead, so tools that never start one still see it.
+void Post(Code code, const char *text = nullptr, const char *detail = nullptr,
+          int64_t arg0 = 0, int64_t arg1 = 0);
+
+// The message a record formats to, without rate limiting.
+std::string Format(const Record &record);
+
+// Starts the writer thread; out defaults to std::cerr and must outlive it.
+void StartWriter(std::ostream *out = nullptr);
+// Stops the writer after it has written everything queued so far.
+void StopWriter();
+bool WriterRunning();
+
+// Records dropped because the queue was full, since process start.
+uint64_t DroppedCount();
+
+// Starts the writer for the lifetime of the object.
+class ScopedWriter {
+public:
+  explicit ScopedWriter(std::ostream *out = nullptr) { StartWriter(out); }
+  ~ScopedWriter() { StopWriter(); }
+  ScopedWriter(const ScopedWriter &) = delete;
+  ScopedWriter &operator=(const ScopedWriter &) = delete;
+};
+
+} // namespace totton::audio::rtlog
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "audio/mpsc_queue.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace totton::audio {
+
+// Requests the control side hands to the audio thread, which drains them
+// between periods.
+enum class ControlCommand : uint8_t {
+  Mute,
+  Unmute,
+  SoftReset,
+};
+
+using ControlQueue = MpscQueue<ControlCommand, 16>;
+
+// Fades the captured signal for mute and soft reset. Audio thread only.
+class SoftGain {
+public:
+  // holdFrames is how long a soft reset keeps the input silent before the
+  // filters are reset, so they hold nothing but silence by then.
+  SoftGain(unsigned int channels, unsigned int rate, std::size_t holdFrames);
+
+  void Apply(ControlCommand command);
+
+  // Silences the stream while its samples are not at the rate they are
+  // played at; independent of a Mute command.
+  void Hold(bool held) { held_ = held; }
+
+  // After a rate change: re-times the ramp for the new rate and starts from
+  // silence, so the new stream fades in. A mute stays in effect.
+  void Restart(unsigned int rate, std::size_t holdFrames);
+
+  // True while the signal passes through unchanged.
+  bool IsUnity() const { return gain_ == 1.0f && Target() == 1.0f; }
+
+  // Ramps interleaved samples towards the target gain over 10 ms. Returns
+  // true once a soft reset has faded out and held silence for holdFrames;
+  // the caller resets its filters then, and the signal fades back in.
+  bool Process(float *samples, std::size_t frames);
+
+private:
+  float Target() const {
+    return (muted_ || held_ || resetPending_) ? 0.0f : 1.0f;
+  }
+
+  const unsigned int channels_;
+  float step_;
+  std::size_t holdFrames_;
+  float gain_ = 1.0f;
+  bool muted_ = false;
+  bool held_ = false;
+  bool resetPending_ = false;
+  std::size_t silentFrames_ = 0;
+};
+
+} // namespace totton::audio
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "audio/metrics_registry.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace totton::audio {
+
+// Rewrites the stats file from the metrics registry at a fixed cadence on its
+// own thread, so the audio thread never formats or does file I/O.
+class StatsPublisher {
+public:
+  // tracePath, when set, receives the trace dumps requested by SIGUSR1.
+  StatsPublisher(const MetricsRegistry &registry, std::string path,
+                 std::string tracePath,
+                 std::chrono::milliseconds interval = std::chrono::seconds(1));
+  ~StatsPublisher();
+
+  // Runs on the publisher thread after every stats write, for control-side
+  // work that must stay off the audio thread. Set before Start().
+  void SetHousekeeping(std::function<void()> housekeeping) {
+    housekeeping_ = std::move(housekeeping);
+  }
+
+  void Start();
+  // Writes the stats file a last time and joins the thread.
+  void Stop();
+
+private:
+  const MetricsRegistry &registry_;
+  std::string path_;
+  std::string tracePath_;
+  std::chrono::milliseconds interval_;
+  std::function<void()> housekeeping_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+} // namespace totton::audio
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace totton::audio {
+
+class MetricsRegistry;
+
+// POSIX shared memory name of the streamer's stats block
+// (/dev/shm/totton_stats on Linux).
+constexpr const char *kDefaultStatsShmName = "/totton_stats";
+
+constexpr uint32_t kStatsShmMagic = 0x53545354; // "TSTS"
+constexpr uint32_t kStatsShmVersion = 2;
+
+// Layout v2 is fixed: fields are only ever appended, with a version bump
+// (v2 appended the GPU timings). Every field is 8-byte aligned so the block
+// can be copied word by word.
+struct StatsShmTiming {
+  uint64_t count;
+  uint64_t sumNs;
+  uint64_t maxNs;
+  uint64_t p99Ns;
+};
+
+struct StatsShmFill {
+  uint64_t current;
+  uint64_t low;
+  uint64_t high;
+  uint64_t capacity;
+};
+
+struct StatsShmPayload {
+  uint64_t updateCount;
+  uint64_t timestampNs; // CLOCK_MONOTONIC of the last update.
+  uint64_t inputRate;
+  uint64_t outputRate;
+  char mode[16]; // NUL-terminated stream mode label.
+  uint64_t captureXruns;
+  uint64_t playbackXruns;
+  uint64_t deadlineMisses;
+  uint64_t deadlineNs;
+  StatsShmTiming cycle;
+  StatsShmTiming stages[5]; // Indexed by Stage.
+  StatsShmFill inputFill;
+  StatsShmFill outputFill;
+  StatsShmTiming gpu[3]; // Indexed by GpuTiming.
+};
+static_assert(sizeof(StatsShmPayload) == 432, "stats shm layout changed");
+static_assert(sizeof(StatsShmPayload) % 8 == 0, "payload must be words");
+
+// The header occupies one cache line; the payload follows it. sequence is
+// the seqlock counter: odd while the writer is mid-update.
+struct StatsShmHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t payloadOffset;
+  uint32_t payloadBytes;
+  uint64_t sequence;
+  uint8_t reserved[40];
+};
+static_assert(sizeof(StatsShmHeader) == 64, "stats shm header changed");
+
+// Summarises the registry into the fixed layout; p99 comes from the
+// histogram buckets. Cheap enough to run once per period.
+void FillStatsShmPayload(const MetricsRegistry &metrics,
+                         StatsShmPayload *payload);
+
+// Single writer. Open() creates (or takes over) the segment; Publish() does
+// no syscalls, locks or allocations.
+class StatsShmWriter {
+public:
+  StatsShmWriter() = default;
+  StatsShmWriter(const StatsShmWriter &) = delete;
+  StatsShmWriter &operator=(const StatsShmWriter &) = delete;
+  ~StatsShmWriter();
+
+  bool Open(const std::string &name, std::string *errorMessage);
+  // Unmaps and unlinks the segment so readers see the streamer is gone.
+  void Close();
+  bool IsOpen() const { return base_ != nullptr; }
+
+  // updateCount is assigned by the writer.
+  void Publish(const StatsShmPayload &payload);
+
+private:
+  std::string name_;
+  void *base_ = nullptr;
+  std::size_t size_ = 0;
+  uint64_t updates_ = 0;
+};
+
+// Any number of readers; never blocks the writer.
+class StatsShmReader {
+public:
+  StatsShmReader() = default;
+  StatsShmReader(const StatsShmReader &) = delete;
+  StatsShmReader &operator=(const StatsShmReader &) = delete;
+  ~StatsShmReader();
+
+  // Fails if the segment is missing or has a different magic/version.
+  bool Open(const std::string &name, std::string *errorMessage);
+  void Close();
+
+  // Copies a consistent snapshot; false if the writer kept the block busy
+  // for maxAttempts tries.
+  bool Read(StatsShmPayload *payload, int maxAttempts = 1000) const;
+
+private:
+  const void *base_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace totton::audio
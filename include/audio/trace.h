@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Lightweight span tracing for the audio pipeline. Spans land in a
+// preallocated per-thread ring (oldest overwritten) and are dumped as Chrome
+// trace-event JSON, viewable in Perfetto or chrome://tracing. While tracing
+// is disabled a Scope costs one relaxed load and a branch.
+namespace totton::audio::trace {
+
+namespace detail {
+extern std::atomic<bool> gEnabled;
+uint64_t NowNs();
+} // namespace detail
+
+inline bool Enabled() {
+  return detail::gEnabled.load(std::memory_order_relaxed);
+}
+
+// Starts recording. Each thread gets a ring of eventsPerThread spans the
+// first time it records or calls RegisterThread().
+void Enable(std::size_t eventsPerThread = 1 << 16);
+void Disable();
+
+// Allocates the calling thread's ring up front and names the thread in the
+// trace. Call before entering a real-time loop so recording never allocates.
+void RegisterThread(const char *name);
+
+// No-op while disabled. name must stay valid until the last dump (use
+// string literals). Timestamps are steady_clock nanoseconds.
+void Record(const char *name, uint64_t beginNs, uint64_t endNs);
+
+// Records the enclosing block as one span.
+class Scope {
+public:
+  explicit Scope(const char *name)
+      : name_(Enabled() ? name : nullptr),
+        beginNs_(name_ ? detail::NowNs() : 0) {}
+  ~Scope() {
+    if (name_) {
+      Record(name_, beginNs_, detail::NowNs());
+    }
+  }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+private:
+  const char *name_;
+  uint64_t beginNs_;
+};
+
+// Async-signal-safe; the dump happens on the next DumpIfRequested().
+void RequestDump();
+bool DumpIfRequested(const std::string &path, std::string *errorMessage);
+
+// Writes every buffered span of every thread to path.
+bool Dump(const std::string &path, std::string *errorMessage);
+
+} // namespace totton::audio::trace
@@ -15,86 +15,202 @@
 //   buffer.write(data, count);
 //   buffer.read(dst, count);
 //
+// Zero-copy usage (DSP stages reading/writing in place):
+//   auto out = buffer.prepareWrite(count);  // empty span if no room
+//   fill out.first[0..firstSize) and out.second[0..secondSize)
+//   buffer.commitWrite(count);
+//
+//   auto in = buffer.peekRead(count);       // empty span if not enough data
+//   use in.first / in.second
+//   buffer.consume(count);
+//
 // Thread safety:
 //   Safe for single producer / single consumer pattern with atomic operations.
-//   Producer thread calls write(), consumer thread calls read().
+//   Producer thread calls write()/prepareWrite()/commitWrite(), consumer thread
+//   calls read()/peekRead()/consume().
 //   For multi-producer or multi-consumer, use mutex externally.
 //
 // Memory ordering / invariants:
-//   - SPSC only: producer is the sole writer of tail_, consumer is the sole
-//     writer of head_ (both use relaxed operations).
-//   - size_ is the synchronization point between threads:
-//       * write(): sample writes happen-before size_.fetch_add(..., release)
-//       * read(): size_.load(acquire) happens-before reading samples
+//   - SPSC only: producer is the sole writer of tail, consumer is the sole
+//     writer of head. Both indices run freely and are masked on access, so
+//     head <= tail and tail - head <= capacity() always hold.
+//   - Storage is rounded up to a power of two so wrapping is a mask instead
+//     of a division; capacity() still reports the requested size and the
+//     fill level never exceeds it.
+//   - Producer and consumer indices live on separate cache lines, each next
+//     to a cached copy of the other side's index. The remote index is only
+//     re-read (acquire) when the cached value says there is not enough room
+//     or data, so the common path touches no shared cache line.
+//   - Sample writes happen-before tail.store(release); the consumer's
+//     tail.load(acquire) happens-before reading samples (and symmetrically
+//     for head and slot reuse).
 //   - clear() must be externally synchronized and called only when both threads
 //     are stopped or paused (no concurrent write/read), otherwise data races.
 class AudioRingBuffer {
 public:
+  // A region of the ring as up to two contiguous segments; second is empty
+  // unless the region wraps around the end of the storage.
+  template <typename T> struct Span {
+    T *first = nullptr;
+    size_t firstSize = 0;
+    T *second = nullptr;
+    size_t secondSize = 0;
+
+    size_t size() const { return firstSize + secondSize; }
+    bool empty() const { return size() == 0; }
+  };
+  using WriteSpan = Span<float>;
+  using ReadSpan = Span<const float>;
+
   AudioRingBuffer() = default;
 
   void init(size_t capacity) {
     assert(capacity > 0 && "AudioRingBuffer capacity must be > 0");
-    buffer_.assign(capacity, 0.0f);
-    head_.store(0, std::memory_order_relaxed);
-    tail_.store(0, std::memory_order_relaxed);
-    size_.store(0, std::memory_order_relaxed);
+    size_t storage = 1;
+    while (storage < capacity) {
+      storage <<= 1;
+    }
+    buffer_.assign(storage, 0.0f);
+    mask_ = storage - 1;
+    capacity_ = capacity;
+    resetIndices();
   }
 
-  size_t capacity() const { return buffer_.size(); }
+  size_t capacity() const { return capacity_; }
 
   size_t availableToRead() const {
-    return size_.load(std::memory_order_acquire);
+    // Load head first: tail only grows, so the difference is never negative.
+    const size_t head = consumer_.head.load(std::memory_order_acquire);
+    const size_t tail = producer_.tail.load(std::memory_order_acquire);
+    return std::min(tail - head, capacity_);
   }
 
-  size_t availableToWrite() const {
-    return capacity() - size_.load(std::memory_order_acquire);
-  }
+  size_t availableToWrite() const { return capacity_ - availableToRead(); }
 
   // Producer thread calls this.
   bool write(const float *data, size_t count) {
-    size_t cap = capacity();
-    if (cap == 0 || count > availableToWrite()) {
+    if (count == 0) {
+      return capacity_ != 0;
+    }
+    WriteSpan span = prepareWrite(count);
+    if (span.empty()) {
       return false;
     }
-    size_t tail = tail_.load(std::memory_order_relaxed);
-    size_t first = std::min(count, cap - tail);
-    std::memcpy(buffer_.data() + tail, data, first * sizeof(float));
-    size_t remaining = count - first;
-    if (remaining > 0) {
-      std::memcpy(buffer_.data(), data + first, remaining * sizeof(float));
+    std::memcpy(span.first, data, span.firstSize * sizeof(float));
+    if (span.secondSize > 0) {
+      std::memcpy(span.second, data + span.firstSize,
+                  span.secondSize * sizeof(float));
     }
-    tail_.store((tail + count) % cap, std::memory_order_relaxed);
-    size_.fetch_add(count, std::memory_order_release);
+    commitWrite(count);
     return true;
   }
 
   // Consumer thread calls this.
   bool read(float *dst, size_t count) {
-    size_t cap = capacity();
-    if (cap == 0 || count > availableToRead()) {
+    if (count == 0) {
+      return capacity_ != 0;
+    }
+    ReadSpan span = peekRead(count);
+    if (span.empty()) {
       return false;
     }
-    size_t head = head_.load(std::memory_order_relaxed);
-    size_t first = std::min(count, cap - head);
-    std::memcpy(dst, buffer_.data() + head, first * sizeof(float));
-    size_t remaining = count - first;
-    if (remaining > 0) {
-      std::memcpy(dst + first, buffer_.data(), remaining * sizeof(float));
+    std::memcpy(dst, span.first, span.firstSize * sizeof(float));
+    if (span.secondSize > 0) {
+      std::memcpy(dst + span.firstSize, span.second,
+                  span.secondSize * sizeof(float));
     }
-    head_.store((head + count) % cap, std::memory_order_relaxed);
-    size_.fetch_sub(count, std::memory_order_release);
+    consume(count);
     return true;
   }
 
-  void clear() {
-    head_.store(0, std::memory_order_relaxed);
-    tail_.store(0, std::memory_order_relaxed);
-    size_.store(0, std::memory_order_release);
+  // Producer thread: returns writable space for exactly count samples, or an
+  // empty span if there is not enough room. Publish with commitWrite().
+  WriteSpan prepareWrite(size_t count) {
+    if (count == 0 || count > capacity_) {
+      return {};
+    }
+    const size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    if (capacity_ - (tail - producer_.cachedHead) < count) {
+      producer_.cachedHead = consumer_.head.load(std::memory_order_acquire);
+      if (capacity_ - (tail - producer_.cachedHead) < count) {
+        return {};
+      }
+    }
+    return makeSpan<float>(buffer_.data(), tail, count);
   }
 
+  // Producer thread: publishes count samples filled via prepareWrite().
+  void commitWrite(size_t count) {
+    const size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    assert(tail + count - producer_.cachedHead <= capacity_ &&
+           "commitWrite exceeds prepared space");
+    producer_.tail.store(tail + count, std::memory_order_release);
+  }
+
+  // Consumer thread: returns readable data for exactly count samples, or an
+  // empty span if not enough is available. Release with consume().
+  ReadSpan peekRead(size_t count) {
+    if (count == 0 || count > capacity_) {
+      return {};
+    }
+    const size_t head = consumer_.head.load(std::memory_order_relaxed);
+    if (consumer_.cachedTail - head < count) {
+      consumer_.cachedTail = producer_.tail.load(std::memory_order_acquire);
+      if (consumer_.cachedTail - head < count) {
+        return {};
+      }
+    }
+    return makeSpan<const float>(buffer_.data(), head, count);
+  }
+
+  // Consumer thread: releases count samples obtained via peekRead().
+  void consume(size_t count) {
+    const size_t head = consumer_.head.load(std::memory_order_relaxed);
+    assert(consumer_.cachedTail - head >= count &&
+           "consume exceeds peeked data");
+    consumer_.head.store(head + count, std::memory_order_release);
+  }
+
+  void clear() { resetIndices(); }
+
 private:
+  // 64 bytes covers the Cortex-A72/A76 cores on Raspberry Pi 4/5 and x86.
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) ProducerIndex {
+    std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+  };
+
+  struct alignas(kCacheLineSize) ConsumerIndex {
+    std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+  };
+
+  template <typename T, typename Base>
+  Span<T> makeSpan(Base *base, size_t index, size_t count) const {
+    const size_t offset = index & mask_;
+    const size_t first = std::min(count, buffer_.size() - offset);
+    Span<T> span;
+    span.first = base + offset;
+    span.firstSize = first;
+    if (count > first) {
+      span.second = base;
+      span.secondSize = count - first;
+    }
+    return span;
+  }
+
+  void resetIndices() {
+    producer_.cachedHead = 0;
+    consumer_.cachedTail = 0;
+    producer_.tail.store(0, std::memory_order_release);
+    consumer_.head.store(0, std::memory_order_release);
+  }
+
   std::vector<float> buffer_;
-  std::atomic<size_t> head_{0};
-  std::atomic<size_t> tail_{0};
-  std::atomic<size_t> size_{0};
+  size_t mask_ = 0;
+  size_t capacity_ = 0;
+  ProducerIndex producer_;
+  ConsumerIndex consumer_;
 };
@@ -5,11 +5,19 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace DacCapability {
 
+// Sample formats probed by scan()
+enum class SampleFormat { S16_LE, S24_3LE, S24_LE, S32_LE, FLOAT_LE };
+
 // DAC capability information
 struct Capability {
   std::string deviceName;          // ALSA device name (e.g., "hw:0")
@@ -19,6 +27,23 @@ struct Capability {
   int maxChannels;                 // Maximum channels
   bool isValid;                    // Whether scan was successful
   std::string errorMessage;        // Error message if scan failed
+
+  // Hardware details; the defaults mean "not probed".
+  int minChannels = 0;               // Minimum channels
+  std::vector<SampleFormat> formats; // Supported formats (empty if unknown)
+  bool rwInterleaved = true;         // snd_pcm_writei() access
+  bool mmapInterleaved = false;      // Interleaved mmap access
+  unsigned long minPeriodFrames = 0; // Period size range (0 if unknown)
+  unsigned long maxPeriodFrames = 0;
+  unsigned long minBufferFrames = 0; // Buffer size range (0 if unknown)
+  unsigned long maxBufferFrames = 0;
+  bool isBatch = false;         // Position only updates once per period
+  bool isBlockTransfer = false; // Transfers in blocks (USB, some I2S)
+  bool isDouble = false;        // Double-buffered in hardware
+  bool isJointDuplex = false;   // Playback and capture are coupled
+  bool canPause = false;
+  bool canResume = false;
+  bool canSyncStart = false;
 };
 
 struct DeviceOption {
@@ -26,17 +51,71 @@ struct DeviceOption {
   std::string label;
 };
 
+// Devices of both stream directions from one pass over the cards
+struct DeviceList {
+  std::vector<DeviceOption> playback;
+  std::vector<DeviceOption> capture;
+};
+
 // Scan DAC capabilities via ALSA
 Capability scan(const std::string &device);
 
-// Get list of available ALSA playback devices
+// Walk every card and sort its PCM devices by the directions they support
+DeviceList enumerateDevices();
+
+// Get list of available ALSA playback devices (from the registry)
 std::vector<DeviceOption> listPlaybackDevices();
-// Get list of available ALSA capture devices
+// Get list of available ALSA capture devices (from the registry)
 std::vector<DeviceOption> listCaptureDevices();
 
+// Cached device lists and capabilities. Until startWatching() every query
+// enumerates the cards again; once watching, a background thread
+// re-enumerates whenever inotify reports a node added to or removed from
+// the watched directory (/dev/snd), and queries answer from memory.
+class DeviceRegistry {
+public:
+  static DeviceRegistry &instance();
+
+  DeviceRegistry() = default;
+  ~DeviceRegistry();
+  DeviceRegistry(const DeviceRegistry &) = delete;
+  DeviceRegistry &operator=(const DeviceRegistry &) = delete;
+
+  // Falls back to re-enumerating every few seconds when inotify is not
+  // available or the directory does not exist yet.
+  bool startWatching(const std::string &directory = "/dev/snd");
+  void stopWatching();
+  bool watching() const { return watching_.load(); }
+
+  DeviceList devices();
+  // Cached per device name. Failed scans (device busy, unplugged) are not
+  // cached, so the next query opens the device again.
+  Capability capability(const std::string &device);
+  // Bumped each time the watcher re-enumerates the cards.
+  uint64_t generation() const { return generation_.load(); }
+
+private:
+  void refresh();
+  void watchLoop(int inotifyFd);
+
+  std::mutex mutex_;
+  DeviceList devices_;
+  std::map<std::string, Capability> capabilities_;
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<bool> watching_{false};
+  std::thread watcher_;
+  int wakePipe_[2] = {-1, -1};
+};
+
+// ALSA name of a format (e.g., "S24_3LE")
+const char *sampleFormatName(SampleFormat format);
+
 // Check if a specific sample rate is supported by the DAC
 bool isRateSupported(const Capability &cap, int sampleRate);
 
+// Check if the DAC takes a sample format (true when formats are unknown)
+bool isFormatSupported(const Capability &cap, SampleFormat format);
+
 // Get the maximum supported rate that is <= the requested rate
 int getBestSupportedRate(const Capability &cap, int requestedRate);
 
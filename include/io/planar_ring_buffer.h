@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lock-free multi-channel planar ring buffer (single producer/single consumer)
+// whose indices advance in whole frames for all channels at once.
+//
+// Usage:
+//   PlanarRingBuffer buffer;
+//   buffer.init(channels, capacityFrames);  // both must be > 0
+//   buffer.writeInterleaved(data, frames);  // or prepareWrite/commitWrite
+//   auto region = buffer.peekRead(buffer.readable());  // or a fixed count
+//   process region.first(ch)[0..firstFrames), region.second(ch)[...]
+//   buffer.consume(frames);
+//
+// Thread safety:
+//   Producer thread calls prepareWrite()/commitWrite()/writeInterleaved(),
+//   consumer thread calls readable()/peekRead()/consume(). requestFlush()
+//   may be called from any thread (producer on overflow, control thread on
+//   reset).
+//
+// Memory ordering / invariants:
+//   - One tail and one head index cover every channel, so a frame becomes
+//     visible on all channels with a single release store and readiness is a
+//     single comparison instead of one per channel.
+//   - Indices run freely and are masked into power-of-two per-channel storage;
+//     capacityFrames() reports the requested size.
+//   - Producer and consumer indices live on separate cache lines together with
+//     a cached copy of the other side's index (see AudioRingBuffer).
+//
+// Flush / epoch protocol:
+//   requestFlush() snapshots the current tail and raises flushTarget_ to it.
+//   The consumer, which is the only writer of head, services the request at
+//   its next readable() or peekRead() by jumping head forward to the target and
+//   incrementing epoch(). Frames committed after the request survive, head
+//   can never pass tail, and no thread ever writes an index it does not own,
+//   so a flush is safe while both sides are running. Consumers compare
+//   epoch() against a stored value to detect the discontinuity (e.g. to reset
+//   filter state).
+//
+//   clear() resets everything and, like AudioRingBuffer::clear(), must only be
+//   called while neither side is running.
+class PlanarRingBuffer {
+public:
+  // A range of frames on every channel as up to two contiguous segments per
+  // channel; the second segment is empty unless the range wraps.
+  template <typename T> struct Region {
+    T *base = nullptr;
+    size_t stride = 0;
+    size_t offset = 0;
+    size_t firstFrames = 0;
+    size_t secondFrames = 0;
+
+    size_t frames() const { return firstFrames + secondFrames; }
+    bool empty() const { return frames() == 0; }
+    T *first(unsigned int channel) const {
+      return base + channel * stride + offset;
+    }
+    T *second(unsigned int channel) const { return base + channel * stride; }
+  };
+  using WriteRegion = Region<float>;
+  using ReadRegion = Region<const float>;
+
+  PlanarRingBuffer() = default;
+
+  void init(unsigned int channels, size_t capacityFrames) {
+    assert(channels > 0 && "PlanarRingBuffer channels must be > 0");
+    assert(capacityFrames > 0 && "PlanarRingBuffer capacity must be > 0");
+    size_t storage = 1;
+    while (storage < capacityFrames) {
+      storage <<= 1;
+    }
+    buffer_.assign(storage * channels, 0.0f);
+    stride_ = storage;
+    mask_ = storage - 1;
+    channels_ = channels;
+    capacity_ = capacityFrames;
+    clear();
+  }
+
+  unsigned int channels() const { return channels_; }
+  size_t capacityFrames() const { return capacity_; }
+
+  // Frames committed and not yet consumed (a pending flush is not applied).
+  size_t availableToRead() const {
+    const size_t head = consumer_.head.load(std::memory_order_acquire);
+    const size_t tail = producer_.tail.load(std::memory_order_acquire);
+    return std::min(tail - head, capacity_);
+  }
+
+  size_t availableToWrite() const { return capacity_ - availableToRead(); }
+
+  // Consumer thread: services any pending flush, then returns the frames
+  // peekRead() can hand out. Size "read everything" requests with this, not
+  // availableToRead(), which still counts frames a flush will drop.
+  size_t readable() {
+    serviceFlush();
+    return availableToRead();
+  }
+
+  // Number of flushes serviced by the consumer so far.
+  uint64_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+  // Producer thread: writable space for exactly frames frames on every
+  // channel, or an empty region if there is not enough room.
+  WriteRegion prepareWrite(size_t frames) {
+    if (frames == 0 || frames > capacity_) {
+      return {};
+    }
+    const size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    if (capacity_ - (tail - producer_.cachedHead) < frames) {
+      producer_.cachedHead = consumer_.head.load(std::memory_order_acquire);
+      if (capacity_ - (tail - producer_.cachedHead) < frames) {
+        return {};
+      }
+    }
+    return makeRegion<float>(buffer_.data(), tail, frames);
+  }
+
+  // Producer thread: publishes frames filled via prepareWrite().
+  void commitWrite(size_t frames) {
+    const size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    assert(tail + frames - producer_.cachedHead <= capacity_ &&
+           "commitWrite exceeds prepared space");
+    producer_.tail.store(tail + frames, std::memory_order_release);
+  }
+
+  // Producer thread: deinterleaves frames * channels() samples into the ring.
+  bool writeInterleaved(const float *data, size_t frames) {
+    WriteRegion region = prepareWrite(frames);
+    if (region.empty()) {
+      return false;
+    }
+    for (unsigned int ch = 0; ch < channels_; ++ch) {
+      float *dst = region.first(ch);
+      const float *src = data + ch;
+      for (size_t i = 0; i < region.firstFrames; ++i) {
+        dst[i] = src[i * channels_];
+      }
+      dst = region.second(ch);
+      src += region.firstFrames * channels_;
+      for (size_t i = 0; i < region.secondFrames; ++i) {
+        dst[i] = src[i * channels_];
+      }
+    }
+    commitWrite(frames);
+    return true;
+  }
+
+  // Consumer thread: readable data for exactly frames frames on every
+  // channel, or an empty region if not enough is available. Services any
+  // pending flush first.
+  ReadRegion peekRead(size_t frames) {
+    serviceFlush();
+    if (frames == 0 || frames > capacity_) {
+      return {};
+    }
+    const size_t head = consumer_.head.load(std::memory_order_relaxed);
+    if (consumer_.cachedTail - head < frames) {
+      consumer_.cachedTail = producer_.tail.load(std::memory_order_acquire);
+      if (consumer_.cachedTail - head < frames) {
+        return {};
+      }
+    }
+    return makeRegion<const float>(buffer_.data(), head, frames);
+  }
+
+  // Consumer thread: releases frames obtained via peekRead().
+  void consume(size_t frames) {
+    const size_t head = consumer_.head.load(std::memory_order_relaxed);
+    assert(consumer_.cachedTail - head >= frames &&
+           "consume exceeds peeked data");
+    consumer_.head.store(head + frames, std::memory_order_release);
+  }
+
+  // Any thread: discard every frame committed before this call. Applied by
+  // the consumer at its next peekRead().
+  void requestFlush() {
+    const size_t target = producer_.tail.load(std::memory_order_acquire);
+    size_t current = flushTarget_.load(std::memory_order_relaxed);
+    while (current < target &&
+           !flushTarget_.compare_exchange_weak(current, target,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+    }
+  }
+
+  void clear() {
+    producer_.cachedHead = 0;
+    consumer_.cachedTail = 0;
+    producer_.tail.store(0, std::memory_order_release);
+    consumer_.head.store(0, std::memory_order_release);
+    flushTarget_.store(0, std::memory_order_release);
+  }
+
+private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) ProducerIndex {
+    std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+  };
+
+  struct alignas(kCacheLineSize) ConsumerIndex {
+    std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+  };
+
+  void serviceFlush() {
+    const size_t target = flushTarget_.load(std::memory_order_acquire);
+    const size_t head = consumer_.head.load(std::memory_order_relaxed);
+    if (target <= head) {
+      return;
+    }
+    // target was read from tail, so everything up to it is committed.
+    consumer_.cachedTail = std::max(consumer_.cachedTail, target);
+    consumer_.head.store(target, std::memory_order_release);
+    epoch_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  template <typename T, typename Base>
+  Region<T> makeRegion(Base *base, size_t index, size_t frames) const {
+    Region<T> region;
+    region.base = base;
+    region.stride = stride_;
+    region.offset = index & mask_;
+    region.firstFrames = std::min(frames, stride_ - region.offset);
+    region.secondFrames = frames - region.firstFrames;
+    return region;
+  }
+
+  std::vector<float> buffer_;
+  size_t stride_ = 0;
+  size_t mask_ = 0;
+  size_t capacity_ = 0;
+  unsigned int channels_ = 0;
+  ProducerIndex producer_;
+  ConsumerIndex consumer_;
+  alignas(kCacheLineSize) std::atomic<size_t> flushTarget_{0};
+  std::atomic<uint64_t> epoch_{0};
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <complex>
 #include <cstddef>
 #include <cstdint>
@@ -9,12 +10,61 @@
 
 namespace totton::vulkan {
 
+// A half-band 2x stage: a symmetric FIR of 4k - 1 taps whose taps at even
+// offsets from the centre are zero, centre tap 1 (DC gain 2).
+struct HalfbandStageConfig {
+  std::string coefficientsPath;
+  std::size_t taps = 0;
+};
+
 struct FilterConfig {
   std::string coefficientsPath;
   std::size_t taps = 0;
   std::size_t fftSize = 0;
   std::size_t blockSize = 0;
+  // Overall factor, half-band stages included.
   std::size_t upsampleFactor = 1;
+  // Keeps every Mth filtered sample instead; exclusive with upsampling.
+  std::size_t downsampleFactor = 1;
+  // Run after the FFT kernel, in order, each doubling the rate. The kernel
+  // itself upsamples by KernelFactor() and only has to be steep at its own
+  // rate; the stages remove the images above it at a few taps per sample.
+  std::vector<HalfbandStageConfig> halfbandStages;
+
+  std::size_t CascadeFactor() const {
+    return std::size_t{1} << halfbandStages.size();
+  }
+  std::size_t KernelFactor() const {
+    return std::max<std::size_t>(upsampleFactor, 1) / CascadeFactor();
+  }
+  // Output samples per FFT block, after the half-band stages or decimation.
+  std::size_t OutputBlockSize() const {
+    return blockSize * CascadeFactor() /
+           std::max<std::size_t>(downsampleFactor, 1);
+  }
+};
+
+// A filter's frequency response, prepared off the audio thread by
+// BuildKernel() and switched to with UseKernel().
+struct FilterKernel {
+  FilterConfig config;
+  std::vector<std::complex<float>> spectrum;
+};
+
+// Wall time spent in each FilterBlock() stage, summed over blocks.
+struct StageTimings {
+  uint64_t fftNs = 0;
+  uint64_t multiplyNs = 0;
+  uint64_t ifftNs = 0;
+  std::size_t blocks = 0;
+  // VkFFT blocks whose timestamps were read back. gpuNs is device
+  // time of the forward and inverse dispatches; queueNs is the rest of the
+  // submit-to-fence-wake time (submission latency plus fence wake-up);
+  // hostNs is the CPU work around them (copies, spectrum multiply, mapping).
+  uint64_t gpuNs = 0;
+  uint64_t queueNs = 0;
+  uint64_t hostNs = 0;
+  std::size_t gpuBlocks = 0;
 };
 
 class VulkanStreamingUpsampler {
@@ -27,24 +77,134 @@ public:
   operator=(VulkanStreamingUpsampler &&) noexcept = default;
   ~VulkanStreamingUpsampler();
 
+  // Whether LoadFilter() tries the VkFFT backend (default true). The CPU
+  // FFT is always the fallback.
+  void SetGpuEnabled(bool enabled) { gpuEnabled_ = enabled; }
   bool LoadFilter(const std::string &jsonPath, std::string *errorMessage);
+  // Loads and transforms a filter without touching any upsampler, for
+  // control threads preparing a UseKernel() switch.
+  static bool BuildKernel(const std::string &jsonPath, FilterKernel *kernel,
+                          std::string *errorMessage);
+  // Filters with kernel from the next block on; nullptr returns to the
+  // filter LoadFilter() loaded. The kernel must match the loaded FFT size,
+  // block size, resampling factors and number of half-band stages and stay
+  // alive until it is replaced; the half-band stages LoadFilter() loaded
+  // stay in use. The overlap carries over, so the switch needs no reset.
+  // Wait-free.
+  bool UseKernel(const FilterKernel *kernel);
+  // Filters exactly one block of GetInputBlockSize() samples into
+  // GetConfig().OutputBlockSize() samples; any other count returns an empty
+  // vector. Bypasses the Process() input buffer and allocates the result,
+  // so streaming loops use Process() instead.
   std::vector<float> ProcessBlock(const float *input, std::size_t count);
+  // Streaming interface: accepts any number of input samples, buffers them
+  // until a full block is available and appends every completed output
+  // sample to *output. Returns false if no filter is loaded. Allocation-free
+  // once *output has the capacity for the blocks completed by the call.
+  bool Process(const float *input, std::size_t count,
+               std::vector<float> *output);
+  // Pads buffered input with silence and appends the remaining output,
+  // including the convolution tail of the kernel and every half-band
+  // stage, then resets the stream.
+  bool Flush(std::vector<float> *output);
   void Reset();
 
   const FilterConfig &GetConfig() const;
+  // The kernel LoadFilter() built, as BuildKernel() builds it from the same
+  // file, for publishing a loaded filter without transforming it again.
+  // Allocates.
+  FilterKernel GetKernel() const;
+  std::size_t GetInputBlockSize() const;
+  // True when blocks run through VkFFT rather than the CPU FFT.
+  bool UsingGpu() const { return vkfft_ != nullptr; }
+  // Returns the stage timings accumulated since the previous call and starts
+  // a new accumulation window.
+  StageTimings TakeStageTimings();
+
+  // Sums the power of every filtered block's spectrum into bands spaced
+  // logarithmically from 20 Hz to outputRate / 2, inside the spectrum
+  // multiply that already visits each bin. With half-band stages the
+  // spectrum ends at the kernel's Nyquist, so the bands above stay empty;
+  // when decimating, bins above outputRate / 2 are left out.
+  // Call after LoadFilter(), which turns it off again; bands == 0 turns it
+  // off. Allocates.
+  void EnableSpectrum(std::size_t bands, double outputRate);
+  // Adds the mean band power since the previous call to bands[0..n) and
+  // returns the number of blocks it covers; a full-scale sine reads about
+  // 1.0 in its band. Allocation-free.
+  std::size_t TakeSpectrum(float *bands);
 
 private:
-  bool LoadFilterConfig(const std::string &jsonPath, FilterConfig *config,
-                        std::string *errorMessage);
-  bool LoadCoefficients(const FilterConfig &config, std::string *errorMessage);
+  // Runtime state of a HalfbandStageConfig. Only every other tap is
+  // nonzero and those are symmetric, so an output pair costs K multiplies:
+  //   y[2m]     = sum_k side[k] * (x[m - K + 1 + k] + x[m - K - k])
+  //   y[2m + 1] = centre * x[m - K + 1]
+  struct Halfband {
+    std::vector<float> side;
+    float centre = 0.0f;
+    // 2K - 1 samples of history followed by the block being filtered.
+    std::vector<float> buffer;
+    // Even outputs, accumulated one tap at a time across the block.
+    std::vector<float> even;
+
+    std::size_t History() const { return 2 * side.size() - 1; }
+    // Filters the count samples after the history into 2 * count outputs.
+    void Filter(std::size_t count, float *output);
+  };
+
+  static bool LoadFilterConfig(const std::string &jsonPath,
+                               FilterConfig *config,
+                               std::string *errorMessage);
+  static bool LoadCoefficients(const FilterConfig &config,
+                               std::vector<float> *coefficients,
+                               std::string *errorMessage);
+  static bool ReadCoefficients(const std::string &path, std::size_t taps,
+                               std::vector<float> *coefficients,
+                               std::string *errorMessage);
+  static bool LoadHalfbands(const FilterConfig &config,
+                            std::vector<Halfband> *halfbands,
+                            std::string *errorMessage);
+  static bool ComputeSpectrum(const FilterConfig &config,
+                              const std::vector<float> &coefficients,
+                              std::vector<std::complex<float>> *spectrum,
+                              std::string *errorMessage);
   bool PrepareSpectrum(std::string *errorMessage);
+  bool FilterBlock(const float *input, float *output);
+  // Copies a decimated block out of the folded, inverse-transformed
+  // spectrum.
+  void EmitDecimated(float *output);
+  // Runs the kernel output waiting in the first stage through every stage.
+  void RunHalfbands(float *output);
+  // Multiplies bin i by the filter response, adding it to the spectrum
+  // bands when bin i is below spectrumBand_.size().
+  std::complex<float> FilterBin(std::size_t i, std::complex<float> value,
+                                const std::complex<float> &response);
 
   struct VkfftContext;
   std::unique_ptr<VkfftContext> vkfft_;
   FilterConfig config_{};
   std::vector<float> coefficients_{};
   std::vector<float> overlap_{};
+  std::vector<float> pending_{};
   std::vector<std::complex<float>> filterSpectrum_{};
+  // Set by UseKernel(); overrides filterSpectrum_ while non-null.
+  const FilterKernel *kernel_ = nullptr;
+  // Per-block FFT scratch, sized once so FilterBlock() never allocates.
+  std::vector<float> timeScratch_{};
+  std::vector<std::complex<float>> freqScratch_{};
+  // The kernel writes into the first stage's buffer, each stage into the
+  // next one's and the last into the caller's output.
+  std::vector<Halfband> halfbands_{};
+  // Filtered spectrum folded to fftSize / downsampleFactor bins when
+  // decimating; empty otherwise.
+  std::vector<std::complex<float>> foldScratch_{};
+  StageTimings timings_{};
+  // Band of each bin up to Nyquist, kNoBand below 20 Hz; empty when the
+  // spectrum is off.
+  std::vector<uint16_t> spectrumBand_{};
+  std::vector<float> spectrumPower_{};
+  std::size_t spectrumBlocks_ = 0;
+  bool gpuEnabled_ = true;
   bool initialized_ = false;
 };
 
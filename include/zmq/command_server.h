@@ -1,6 +1,11 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -8,6 +13,7 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace totton::zmq_server {
 
@@ -23,14 +29,31 @@ struct ZmqResponse {
   bool ok = true;
 };
 
+struct HandlerOptions {
+  // Runs on the socket thread instead of the worker pool. For cheap handlers
+  // (PING, getters, queue posts) that must answer even while every worker
+  // is busy; an inline handler must never block.
+  bool runInline = false;
+  // Worker handlers only: the client gets a TIMEOUT error once this passes
+  // and the late result is discarded.
+  std::chrono::milliseconds timeout{2000};
+};
+
+// Serves commands on a ROUTER socket. One thread owns the sockets and
+// zmq_poll()s them; requests go to a small worker pool and replies go back
+// in whatever order handlers finish, so one slow handler never delays
+// another client. REQ and DEALER clients both work.
 class ZmqCommandServer {
 public:
   using Handler = std::function<ZmqResponse(const ZmqRequest &)>;
 
-  ZmqCommandServer(std::string endpoint, std::string pubEndpoint);
+  ZmqCommandServer(std::string endpoint, std::string pubEndpoint,
+                   std::size_t workerCount = 2);
   ~ZmqCommandServer();
 
-  void Register(const std::string &command, Handler handler);
+  // Register before Start().
+  void Register(const std::string &command, Handler handler,
+                HandlerOptions options = {});
   bool Start();
   void Stop();
 
@@ -39,26 +62,58 @@ public:
                                 const std::string &message);
 
   std::optional<std::string> Publish(const std::string &message);
+  // Sends [topic, message] so SUB sockets can filter on topic.
+  std::optional<std::string> Publish(const std::string &topic,
+                                     const std::string &message);
+  // Same, but ZeroMQ takes message over without copying and frees it once
+  // sent; for large or frequent events.
+  std::optional<std::string> PublishZeroCopy(const std::string &topic,
+                                             std::string message);
 
 private:
+  struct Entry {
+    Handler handler;
+    HandlerOptions options;
+  };
+  struct Job {
+    uint64_t id = 0;
+    ZmqRequest request;
+    const Entry *entry = nullptr;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
   ZmqRequest BuildRequest(const std::string &raw) const;
-  std::string Dispatch(const ZmqRequest &request);
+  // Returns the handler for request, or sets *error to the reply.
+  const Entry *Resolve(const ZmqRequest &request, std::string *error) const;
+  static ZmqResponse Invoke(const Entry &entry, const ZmqRequest &request);
+  void ServeLoop();
+  void WorkerLoop();
   bool InitializeSockets();
   void CleanupSockets();
   void CleanupIpcPath(const std::string &endpoint) const;
 
   std::string endpoint_;
   std::string pubEndpoint_;
-  std::unordered_map<std::string, Handler> handlers_;
+  std::size_t workerCount_;
+  std::unordered_map<std::string, Entry> handlers_;
   std::atomic<bool> running_{false};
   std::thread serverThread_;
+  std::vector<std::thread> workers_;
   std::mutex pubMutex_;
 
+  // Jobs waiting for a worker.
+  std::mutex jobMutex_;
+  std::condition_variable jobCv_;
+  std::deque<Job> jobs_;
+  bool stopWorkers_ = false;
+
   class Impl;
   std::unique_ptr<Impl> impl_;
 };
 
 std::string ExtractJsonString(const std::string &json, const std::string &key,
                               std::string *out);
+// Escapes value for use inside a JSON string literal.
+std::string EscapeJson(const std::string &value);
 
 } // namespace totton::zmq_server
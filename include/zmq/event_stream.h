@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace totton::zmq_server {
+
+class ZmqCommandServer;
+
+// Topics on the PUB socket. Every event is two frames, [topic, body], so a
+// SUB socket filters on the topic prefix: "event." receives everything,
+// "event.xrun" only xrun bursts.
+namespace topic {
+constexpr char kRate[] = "event.rate";               // Stream rates changed.
+constexpr char kNegotiation[] = "event.negotiation"; // Device rates agreed.
+constexpr char kFilter[] = "event.filter"; // Filter, phase or EQ swapped.
+constexpr char kXrun[] = "event.xrun";     // New xruns since the last sample.
+constexpr char kDevices[] = "event.devices"; // ALSA device list changed.
+constexpr char kMetrics[] = "event.metrics"; // Periodic counter deltas.
+constexpr char kMeters[] = "event.meters"; // Output levels and spectrum.
+} // namespace topic
+
+// Stamps events and publishes them through a ZmqCommandServer. The body is
+//   {"topic":"event.rate","seq":12,"ts_ms":...,"data":{...}}
+// where seq counts from 1 per topic, so a subscriber to any set of topics
+// can tell a dropped event (slow subscriber, HWM) by a skipped number.
+class EventPublisher {
+public:
+  // server may be null, which makes Emit() a no-op.
+  explicit EventPublisher(ZmqCommandServer *server) : server_(server) {}
+
+  // Thread-safe; events on one topic are sent in seq order.
+  void Emit(const std::string &topic, const std::string &dataJson);
+
+private:
+  ZmqCommandServer *server_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, uint64_t> sequences_;
+};
+
+// The stream counters events are derived from: the streamer's metrics
+// registry, or the stats file it writes once per second.
+struct StatsSample {
+  unsigned int inputRate = 0;
+  unsigned int outputRate = 0;
+  uint64_t captureXruns = 0;
+  uint64_t playbackXruns = 0;
+  uint64_t inputOverflows = 0;
+  uint64_t outputOverflows = 0;
+  uint64_t deadlineMisses = 0;
+  uint64_t uptimeMs = 0;
+};
+
+// Reads a sample from MetricsRegistry::ToJson() output.
+std::optional<StatsSample> ParseStatsSample(const std::string &json);
+
+// Turns successive samples into rate, xrun and metrics events. Counters
+// that go backwards (a streamer restart) start a new baseline.
+class StatsEventTracker {
+public:
+  using Sink =
+      std::function<void(const std::string &topic, const std::string &data)>;
+
+  explicit StatsEventTracker(Sink sink) : sink_(std::move(sink)) {}
+
+  void Update(const StatsSample &sample);
+
+private:
+  Sink sink_;
+  std::optional<StatsSample> last_;
+};
+
+} // namespace totton::zmq_server
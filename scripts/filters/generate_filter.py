@@ -23,6 +23,9 @@ class MinimumPhaseMethod(Enum):
     HILBERT = "hilbert"
 
 
+# ストリーマが読み込めるハーフバンド段数の上限
+MAX_HALFBAND_STAGES = 4
+
 MULTI_RATE_CONFIGS = {
     "44k_16x": {"input_rate": 44100, "ratio": 16, "stopband": 22050},
     "44k_8x": {"input_rate": 88200, "ratio": 8, "stopband": 44100},
@@ -51,6 +54,9 @@ class FilterConfig:
     dc_gain_factor: float = 0.99
     output_prefix: str | None = None
     phase_suffix: str = "min_phase"
+    # FFTカーネルの後段に置く2倍ハーフバンド段の数。upsample_ratio はカーネル
+    # 自身の倍率で、全体の倍率は overall_ratio になる
+    halfband_stages: int = 0
 
     def __post_init__(self) -> None:
         if self.n_taps <= 0:
@@ -61,6 +67,10 @@ class FilterConfig:
             raise ValueError("アップサンプリング比率は正の整数である必要があります")
         if self.kaiser_beta < 0:
             raise ValueError("Kaiser βは非負である必要があります")
+        if not 0 <= self.halfband_stages <= MAX_HALFBAND_STAGES:
+            raise ValueError(
+                f"ハーフバンド段数は0から{MAX_HALFBAND_STAGES}である必要があります"
+            )
 
         nyquist = self.input_rate // 2
         if self.passband_end > nyquist:
@@ -92,6 +102,10 @@ class FilterConfig:
     def output_rate(self) -> int:
         return self.input_rate * self.upsample_ratio
 
+    @property
+    def overall_ratio(self) -> int:
+        return self.upsample_ratio << self.halfband_stages
+
     @property
     def family(self) -> str:
         return "44k" if self.input_rate % 44100 == 0 else "48k"
@@ -116,7 +130,7 @@ class FilterConfig:
     def base_name(self) -> str:
         if self.output_prefix:
             return self.output_prefix
-        return f"filter_{self.family}_{self.upsample_ratio}x_{self.taps_label}_{self.phase_suffix}"
+        return f"filter_{self.family}_{self.overall_ratio}x_{self.taps_label}_{self.phase_suffix}"
 
 
 def kaiser_window(numtaps: int, beta: float) -> np.ndarray:
@@ -124,6 +138,42 @@ def kaiser_window(numtaps: int, beta: float) -> np.ndarray:
     return np.kaiser(numtaps, beta)
 
 
+def split_cascade_ratio(overall_ratio: int, halfband_stages: int) -> int:
+    """全体の倍率からハーフバンド段の分を除いたカーネルの倍率を返す"""
+    cascade = 1 << halfband_stages
+    if overall_ratio % cascade != 0 or overall_ratio // cascade < 1:
+        raise ValueError(
+            f"アップサンプリング比率 {overall_ratio} は {halfband_stages} 段の"
+            f"ハーフバンド（{cascade}倍）で割り切れる必要があります"
+        )
+    return overall_ratio // cascade
+
+
+def design_halfband(
+    output_rate: int, passband_end: int, attenuation_db: float
+) -> np.ndarray:
+    """output_rate へ2倍するハーフバンド段を設計する
+
+    出力レートの1/4で切るKaiser窓sincを 4k - 1 タップで作る。中心からの偶数
+    オフセットは厳密に0、中心タップは1.0、DCゲインは2。遷移帯域はパスバンド
+    終端から入力レートに折り返るその像まで。
+    """
+    input_rate = output_rate // 2
+    width = (input_rate - 2 * passband_end) / (output_rate / 2)
+    if width <= 0:
+        raise ValueError("ハーフバンド段の入力レートがパスバンドに対して低すぎます")
+    numtaps, beta = signal.kaiserord(attenuation_db, width)
+    numtaps = max(3, 4 * ((numtaps + 1 + 3) // 4) - 1)
+    offsets = np.arange(numtaps) - numtaps // 2
+    h = np.sinc(offsets / 2.0) * np.kaiser(numtaps, beta)
+    h[offsets % 2 == 0] = 0.0
+    h[numtaps // 2] = 1.0
+    # 奇数オフセットのタップの和を1にし、DCゲインをちょうど2にする
+    odd = offsets % 2 != 0
+    h[odd] /= np.sum(h[odd])
+    return h
+
+
 def compute_frequency_response(
     h: np.ndarray, fs: int, worN: int = 16384
 ) -> tuple[np.ndarray, np.ndarray]:
@@ -170,9 +220,27 @@ class FilterExporter:
         self._export_binary(h, base_name)
         if not skip_header:
             self._export_header(h, metadata, base_name)
+        if self.config.halfband_stages > 0:
+            metadata["halfband_stages"] = self._export_halfbands(base_name)
         self._export_metadata(metadata, base_name)
         return base_name
 
+    def _export_halfbands(self, base_name: str) -> list[dict[str, Any]]:
+        """ハーフバンド段を設計して書き出し、サイドカー用の記述を返す"""
+        stages = []
+        stage_output_rate = self.config.output_rate
+        for index in range(self.config.halfband_stages):
+            stage_output_rate *= 2
+            h = design_halfband(
+                stage_output_rate,
+                self.config.passband_end,
+                self.config.stopband_attenuation_db,
+            )
+            stage_name = f"{base_name}_hb{index + 1}"
+            self._export_binary(h, stage_name)
+            stages.append({"coefficients_bin": f"{stage_name}.bin", "taps": len(h)})
+        return stages
+
     def _export_binary(self, h: np.ndarray, base_name: str) -> None:
         binary_path = self.output_dir / f"{base_name}.bin"
         h.astype(np.float32).tofile(binary_path)
@@ -214,7 +282,8 @@ class FilterExporter:
         metadata["taps"] = actual_taps
         metadata["fft_size"] = fft_size
         metadata["block_size"] = block_size
-        metadata["upsample_factor"] = self.config.upsample_ratio
+        # ハーフバンド段を含む全体の倍率
+        metadata["upsample_factor"] = self.config.overall_ratio
 
         metadata_path = self.output_dir / f"{base_name}.json"
 
@@ -24,6 +24,7 @@ from .generate_filter import (
     generate_multi_rate_header,
     calculate_safe_gain,
     print_safe_gain_recommendation,
+    split_cascade_ratio,
 )
 
 
@@ -127,6 +128,7 @@ def _build_config(
     stopband_attenuation: int,
     kaiser_beta: float,
     output_prefix: str | None,
+    halfband_stages: int = 0,
 ) -> FilterConfig:
     return FilterConfig(
         n_taps=taps,
@@ -138,6 +140,7 @@ def _build_config(
         kaiser_beta=kaiser_beta,
         output_prefix=output_prefix,
         phase_suffix="linear_phase",
+        halfband_stages=halfband_stages,
     )
 
 
@@ -147,12 +150,13 @@ def generate_single_filter(
     config = _build_config(
         taps=args.taps,
         input_rate=args.input_rate,
-        ratio=args.upsample_ratio,
+        ratio=split_cascade_ratio(args.upsample_ratio, args.halfband_stages),
         passband_end=args.passband_end,
         stopband_start=args.stopband_start,
         stopband_attenuation=args.stopband_attenuation,
         kaiser_beta=args.kaiser_beta,
         output_prefix=args.output_prefix,
+        halfband_stages=args.halfband_stages,
     )
     generator = LinearPhaseGenerator(config)
     return generator.generate(filter_name=filter_name, skip_header=skip_header)
@@ -201,6 +205,8 @@ def generate_all_filters(args: argparse.Namespace) -> None:
 
     if args.output_prefix:
         print("\n注意: --output-prefix は --generate-all 時は無視されます")
+    if args.halfband_stages:
+        print("\n注意: --halfband-stages は --generate-all 時は無視されます")
     print()
 
     arg_values = {
@@ -237,6 +243,7 @@ def generate_all_filters(args: argparse.Namespace) -> None:
             local_args.upsample_ratio = cfg["ratio"]
             local_args.stopband_start = cfg["stopband"]
             local_args.output_prefix = None
+            local_args.halfband_stages = 0
             try:
                 base_name, actual_taps = generate_single_filter(
                     local_args, filter_name=name, skip_header=True
@@ -304,6 +311,13 @@ def parse_args() -> argparse.Namespace:
     parser.add_argument(
         "--kaiser-beta", type=float, default=28.0, help="Kaiser window β"
     )
+    parser.add_argument(
+        "--halfband-stages",
+        type=int,
+        default=0,
+        help="2x half-band stages after the FFT kernel (single-run only); "
+        "--upsample-ratio stays the overall ratio",
+    )
     parser.add_argument(
         "--output-prefix",
         type=str,
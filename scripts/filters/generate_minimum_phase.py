@@ -25,6 +25,7 @@ from .generate_filter import (
     generate_multi_rate_header,
     calculate_safe_gain,
     print_safe_gain_recommendation,
+    split_cascade_ratio,
 )
 
 try:
@@ -201,13 +202,14 @@ def _create_config_from_args(args: argparse.Namespace) -> FilterConfig:
     return FilterConfig(
         n_taps=args.taps,
         input_rate=args.input_rate,
-        upsample_ratio=args.upsample_ratio,
+        upsample_ratio=split_cascade_ratio(args.upsample_ratio, args.halfband_stages),
         passband_end=args.passband_end,
         stopband_start=args.stopband_start,
         stopband_attenuation_db=args.stopband_attenuation,
         kaiser_beta=args.kaiser_beta,
         minimum_phase_method=MinimumPhaseMethod(args.minimum_phase_method),
         output_prefix=args.output_prefix,
+        halfband_stages=args.halfband_stages,
     )
 
 
@@ -263,6 +265,8 @@ def generate_all_filters(args: argparse.Namespace) -> None:
 
     if args.output_prefix:
         print("\n注意: --output-prefix は --generate-all 時は無視されます")
+    if args.halfband_stages:
+        print("\n注意: --halfband-stages は --generate-all 時は無視されます")
     print()
 
     arg_values = {
@@ -300,6 +304,7 @@ def generate_all_filters(args: argparse.Namespace) -> None:
             local_args.upsample_ratio = cfg["ratio"]
             local_args.stopband_start = cfg["stopband"]
             local_args.output_prefix = None
+            local_args.halfband_stages = 0
             try:
                 base_name, actual_taps = generate_single_filter(
                     local_args, filter_name=name, skip_header=True
@@ -374,6 +379,13 @@ def parse_args() -> argparse.Namespace:
         default=MinimumPhaseMethod.HOMOMORPHIC.value,
         help="Minimum phase conversion method",
     )
+    parser.add_argument(
+        "--halfband-stages",
+        type=int,
+        default=0,
+        help="2x half-band stages after the FFT kernel (single-run only); "
+        "--upsample-ratio stays the overall ratio",
+    )
     parser.add_argument(
         "--output-prefix",
         type=str,
@@ -1,5 +1,8 @@
 #include "alsa/alsa_common.h"
 
+#include "audio/level_meter.h"
+#include "audio/rt_log.h"
+
 #include <algorithm>
 #include <atomic>
 #include <cctype>
@@ -45,7 +48,9 @@ bool ConvertPcmToFloat(const void *src, snd_pcm_format_t format, size_t frames,
     return false;
   }
   const size_t samples = frames * static_cast<size_t>(channels);
-  dst->assign(samples, 0.0f);
+  // Every sample is overwritten below; resize() reuses the capacity from the
+  // previous period instead of zero-filling it again.
+  dst->resize(samples);
 
   if (format == SND_PCM_FORMAT_S16_LE) {
     const auto *in = static_cast<const int16_t *>(src);
@@ -84,8 +89,30 @@ bool ConvertPcmToFloat(const void *src, snd_pcm_format_t format, size_t frames,
   return false;
 }
 
+namespace {
+
+// Clamps each sample to [-1, upper] and hands it to store(index, clamped).
+// The metered loop is separate so unmetered conversion stays as it was.
+template <typename Store>
+void ConvertSamples(const std::vector<float> &src, float upper,
+                    totton::audio::LevelMeter *meter, Store store) {
+  if (meter) {
+    for (size_t i = 0; i < src.size(); ++i) {
+      meter->Observe(src[i]);
+      store(i, std::max(-1.0f, std::min(upper, src[i])));
+    }
+    return;
+  }
+  for (size_t i = 0; i < src.size(); ++i) {
+    store(i, std::max(-1.0f, std::min(upper, src[i])));
+  }
+}
+
+} // namespace
+
 bool ConvertFloatToPcm(const std::vector<float> &src, snd_pcm_format_t format,
-                       std::vector<uint8_t> *dst) {
+                       std::vector<uint8_t> *dst,
+                       totton::audio::LevelMeter *meter) {
   if (!dst) {
     return false;
   }
@@ -93,33 +120,31 @@ bool ConvertFloatToPcm(const std::vector<float> &src, snd_pcm_format_t format,
   if (format == SND_PCM_FORMAT_S16_LE) {
     dst->resize(src.size() * 2);
     auto *out = reinterpret_cast<int16_t *>(dst->data());
-    for (size_t i = 0; i < src.size(); ++i) {
-      float clamped = std::max(-1.0f, std::min(0.9999695f, src[i]));
+    ConvertSamples(src, 0.9999695f, meter, [out](size_t i, float clamped) {
       out[i] = static_cast<int16_t>(clamped * 32768.0f);
-    }
+    });
     return true;
   }
 
   if (format == SND_PCM_FORMAT_S32_LE) {
     dst->resize(src.size() * 4);
     auto *out = reinterpret_cast<int32_t *>(dst->data());
-    for (size_t i = 0; i < src.size(); ++i) {
-      float clamped = std::max(-1.0f, std::min(0.9999999f, src[i]));
+    ConvertSamples(src, 0.9999999f, meter, [out](size_t i, float clamped) {
       out[i] = static_cast<int32_t>(clamped * 2147483648.0f);
-    }
+    });
     return true;
   }
 
   if (format == SND_PCM_FORMAT_S24_3LE) {
     dst->resize(src.size() * 3);
-    for (size_t i = 0; i < src.size(); ++i) {
-      float clamped = std::max(-1.0f, std::min(0.9999999f, src[i]));
+    uint8_t *out = dst->data();
+    ConvertSamples(src, 0.9999999f, meter, [out](size_t i, float clamped) {
       int32_t value = static_cast<int32_t>(clamped * 8388608.0f);
       size_t idx = i * 3;
-      (*dst)[idx] = static_cast<uint8_t>(value & 0xFF);
-      (*dst)[idx + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
-      (*dst)[idx + 2] = static_cast<uint8_t>((value >> 16) & 0xFF);
-    }
+      out[idx] = static_cast<uint8_t>(value & 0xFF);
+      out[idx + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+      out[idx + 2] = static_cast<uint8_t>((value >> 16) & 0xFF);
+    });
     return true;
   }
 
@@ -131,7 +156,7 @@ bool ConfigurePcm(snd_pcm_t *handle, snd_pcm_format_t format,
                   snd_pcm_uframes_t requestedPeriod,
                   snd_pcm_uframes_t requestedBuffer,
                   snd_pcm_uframes_t *periodOut, snd_pcm_uframes_t *bufferOut,
-                  unsigned int *rateOut, bool playback) {
+                  unsigned int *rateOut, bool playback, bool exactRate) {
   snd_pcm_hw_params_t *hwParams;
   snd_pcm_hw_params_alloca(&hwParams);
   snd_pcm_hw_params_any(handle, hwParams);
@@ -154,7 +179,12 @@ bool ConfigurePcm(snd_pcm_t *handle, snd_pcm_format_t format,
   }
 
   unsigned int rateNear = rate;
-  err = snd_pcm_hw_params_set_rate_near(handle, hwParams, &rateNear, nullptr);
+  if (exactRate) {
+    snd_pcm_hw_params_set_rate_resample(handle, hwParams, 0);
+    err = snd_pcm_hw_params_set_rate(handle, hwParams, rate, 0);
+  } else {
+    err = snd_pcm_hw_params_set_rate_near(handle, hwParams, &rateNear, nullptr);
+  }
   if (err < 0) {
     std::cerr << "ALSA: Cannot set rate: " << snd_strerror(err) << "\n";
     return false;
@@ -187,14 +217,18 @@ bool ConfigurePcm(snd_pcm_t *handle, snd_pcm_format_t format,
   snd_pcm_hw_params_get_period_size(hwParams, &period, nullptr);
   snd_pcm_hw_params_get_buffer_size(hwParams, &buffer);
 
-  if (playback) {
-    snd_pcm_sw_params_t *swParams;
-    snd_pcm_sw_params_alloca(&swParams);
-    if (snd_pcm_sw_params_current(handle, swParams) == 0) {
+  snd_pcm_sw_params_t *swParams;
+  snd_pcm_sw_params_alloca(&swParams);
+  if (snd_pcm_sw_params_current(handle, swParams) == 0) {
+    if (playback) {
       snd_pcm_sw_params_set_start_threshold(handle, swParams, buffer);
       snd_pcm_sw_params_set_avail_min(handle, swParams, period);
-      snd_pcm_sw_params(handle, swParams);
     }
+    // Monotonic status timestamps let callers compare device clocks.
+    snd_pcm_sw_params_set_tstamp_mode(handle, swParams, SND_PCM_TSTAMP_ENABLE);
+    snd_pcm_sw_params_set_tstamp_type(handle, swParams,
+                                      SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    snd_pcm_sw_params(handle, swParams);
   }
 
   err = snd_pcm_prepare(handle);
@@ -219,7 +253,7 @@ bool ConfigurePcm(snd_pcm_t *handle, snd_pcm_format_t format,
 std::optional<AlsaHandle>
 OpenPcm(const std::string &device, snd_pcm_stream_t stream,
         snd_pcm_format_t format, unsigned int channels, unsigned int rate,
-        snd_pcm_uframes_t period, snd_pcm_uframes_t buffer) {
+        snd_pcm_uframes_t period, snd_pcm_uframes_t buffer, bool exactRate) {
   snd_pcm_t *handle = nullptr;
   int err = snd_pcm_open(&handle, device.c_str(), stream, 0);
   if (err < 0) {
@@ -232,7 +266,7 @@ OpenPcm(const std::string &device, snd_pcm_stream_t stream,
   result.handle = handle;
   if (!ConfigurePcm(handle, format, channels, rate, period, buffer,
                     &result.periodFrames, &result.bufferFrames, &result.rate,
-                    stream == SND_PCM_STREAM_PLAYBACK)) {
+                    stream == SND_PCM_STREAM_PLAYBACK, exactRate)) {
     snd_pcm_close(handle);
     return std::nullopt;
   }
@@ -266,21 +300,29 @@ OpenCaptureAutoRate(const std::string &device, snd_pcm_format_t format,
   return std::nullopt;
 }
 
-bool RecoverPcm(snd_pcm_t *handle, int err, const char *label) {
+bool RecoverPcm(snd_pcm_t *handle, int err, const char *label,
+                std::atomic<uint64_t> *xruns) {
   if (err >= 0) {
     return true;
   }
+  if (err == -EPIPE && xruns) {
+    xruns->fetch_add(1, std::memory_order_relaxed);
+  }
+  // Runs on the audio thread: log through the real-time queue.
   int recover = snd_pcm_recover(handle, err, 1);
   if (recover < 0) {
-    std::cerr << label << ": recover failed: " << snd_strerror(recover) << "\n";
+    totton::audio::rtlog::Post(totton::audio::rtlog::Code::RecoverFailed,
+                               label, snd_strerror(recover));
     return false;
   }
-  std::cerr << label << ": XRUN recovered\n";
+  totton::audio::rtlog::Post(totton::audio::rtlog::Code::XrunRecovered,
+                             label);
   return true;
 }
 
 bool ReadFull(snd_pcm_t *handle, void *buffer, snd_pcm_uframes_t frames,
-              const std::atomic<bool> &running) {
+              const std::atomic<bool> &running,
+              std::atomic<uint64_t> *xruns) {
   auto *ptr = static_cast<uint8_t *>(buffer);
   snd_pcm_uframes_t remaining = frames;
   size_t frameBytes = static_cast<size_t>(snd_pcm_frames_to_bytes(handle, 1));
@@ -288,14 +330,16 @@ bool ReadFull(snd_pcm_t *handle, void *buffer, snd_pcm_uframes_t frames,
   while (remaining > 0 && running.load()) {
     snd_pcm_sframes_t n = snd_pcm_readi(handle, ptr, remaining);
     if (n == -EPIPE || n == -ESTRPIPE || n == -EINTR) {
-      if (!RecoverPcm(handle, static_cast<int>(n), "ALSA capture")) {
+      if (!RecoverPcm(handle, static_cast<int>(n), "ALSA capture",
+                      xruns)) {
         return false;
       }
       continue;
     }
     if (n < 0) {
-      std::cerr << "ALSA capture error: " << snd_strerror(static_cast<int>(n))
-                << "\n";
+      totton::audio::rtlog::Post(totton::audio::rtlog::Code::PcmError,
+                                 "ALSA capture",
+                                 snd_strerror(static_cast<int>(n)));
       return false;
     }
     if (n == 0) {
@@ -307,8 +351,27 @@ bool ReadFull(snd_pcm_t *handle, void *buffer, snd_pcm_uframes_t frames,
   return remaining == 0;
 }
 
+bool QueryPcmStatus(snd_pcm_t *handle, PcmStatus *status) {
+  if (!handle || !status) {
+    return false;
+  }
+  snd_pcm_status_t *raw;
+  snd_pcm_status_alloca(&raw);
+  if (snd_pcm_status(handle, raw) < 0) {
+    return false;
+  }
+  snd_htimestamp_t timestamp{};
+  snd_pcm_status_get_htstamp(raw, &timestamp);
+  status->avail = snd_pcm_status_get_avail(raw);
+  status->delay = snd_pcm_status_get_delay(raw);
+  status->timestampSeconds = static_cast<double>(timestamp.tv_sec) +
+                             static_cast<double>(timestamp.tv_nsec) * 1e-9;
+  return true;
+}
+
 bool WriteFull(snd_pcm_t *handle, const void *buffer, snd_pcm_uframes_t frames,
-               const std::atomic<bool> &running) {
+               const std::atomic<bool> &running,
+               std::atomic<uint64_t> *xruns) {
   auto *ptr = static_cast<const uint8_t *>(buffer);
   snd_pcm_uframes_t remaining = frames;
   size_t frameBytes = static_cast<size_t>(snd_pcm_frames_to_bytes(handle, 1));
@@ -316,14 +379,16 @@ bool WriteFull(snd_pcm_t *handle, const void *buffer, snd_pcm_uframes_t frames,
   while (remaining > 0 && running.load()) {
     snd_pcm_sframes_t n = snd_pcm_writei(handle, ptr, remaining);
     if (n == -EPIPE || n == -ESTRPIPE || n == -EINTR) {
-      if (!RecoverPcm(handle, static_cast<int>(n), "ALSA playback")) {
+      if (!RecoverPcm(handle, static_cast<int>(n), "ALSA playback",
+                      xruns)) {
         return false;
       }
       continue;
     }
     if (n < 0) {
-      std::cerr << "ALSA playback error: " << snd_strerror(static_cast<int>(n))
-                << "\n";
+      totton::audio::rtlog::Post(totton::audio::rtlog::Code::PcmError,
+                                 "ALSA playback",
+                                 snd_strerror(static_cast<int>(n)));
       return false;
     }
     if (n == 0) {
@@ -1,20 +1,51 @@
 #include "alsa/alsa_common.h"
 #include "alsa/alsa_filter_selector.h"
+#include "alsa/drift_compensation.h"
+#include "alsa/kernel_updates.h"
+#include "alsa/rate_monitor.h"
+#include "audio/auto_negotiation.h"
+#include "audio/level_meter.h"
+#include "audio/meter_publisher.h"
+#include "audio/metrics_registry.h"
+#include "audio/rational_resampler.h"
+#include "audio/rt_log.h"
+#include "audio/soft_gain.h"
+#include "audio/stats_publisher.h"
+#include "audio/stats_shm.h"
+#include "audio/trace.h"
 #include "io/audio_ring_buffer.h"
+#include "io/dac_capability.h"
+#include "io/planar_ring_buffer.h"
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <csignal>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "vulkan/vulkan_streaming_upsampler.h"
 
+#if defined(ENABLE_ZMQ)
+#include "alsa/streamer_control.h"
+#include "zmq/command_server.h"
+#include "zmq/event_stream.h"
+#endif
+
+#if defined(ALSA_STREAMER_ALLOC_CHECK)
+#include "alloc_counter.h"
+#endif
+
 namespace {
 
 struct CliOptions {
@@ -31,14 +62,114 @@ struct CliOptions {
   unsigned int periodFrames = 0;
   unsigned int bufferFrames = 0;
   unsigned int ratio = 1;
+  bool ratioSpecified = false;
   std::string format = "s32";
+  bool formatSpecified = false;
+  bool autoNegotiate = false;
+  bool keepOutputRate = false;
+  bool driftCompensation = false;
+  std::string statsPath;
+  std::string statsShmName;
+  std::string tracePath;
+  std::string zmqEndpoint;
+  std::string zmqPubEndpoint;
+  double meterRate = 30.0;
   bool showHelp = false;
 };
 
+std::string DefaultStatsPath() {
+  const char *env = std::getenv("TOTTON_STATS_PATH");
+  if (env && *env) {
+    return env;
+  }
+  return "/tmp/gpu_upsampler_stats.json";
+}
+
+std::string DefaultStatsShmName() {
+  const char *env = std::getenv("TOTTON_STATS_SHM");
+  if (env && *env) {
+    return env;
+  }
+  return totton::audio::kDefaultStatsShmName;
+}
+
+enum class StreamMode {
+  Passthrough, // No filter, matching rates and formats: capture bytes go
+               // straight out.
+  Convert,     // No filter, but the playback rate or format differs.
+  Filter,      // Upsampling filter active.
+};
+
+// Heap allocations made by the audio thread once the loop is warm. Only the
+// alsa_streamer_alloc_check build links the counting allocator; in the
+// regular build this compiles to nothing. Counting starts after the first
+// period that produced output, when every reused buffer has been sized.
+class SteadyStateAllocations {
+public:
+  void OnPeriod(bool producedOutput) {
+#if defined(ALSA_STREAMER_ALLOC_CHECK)
+    if (armed_) {
+      ++periods_;
+    } else if (producedOutput) {
+      armed_ = true;
+      start_ = totton::test::ThreadAllocationCount();
+    }
+#else
+    (void)producedOutput;
+#endif
+  }
+
+  // A rate change resizes the buffers; counting resumes once the loop is
+  // warm again.
+  void OnReconfigure() {
+#if defined(ALSA_STREAMER_ALLOC_CHECK)
+    if (armed_) {
+      counted_ += totton::test::ThreadAllocationCount() - start_;
+      armed_ = false;
+    }
+#endif
+  }
+
+  // Prints the count for alsa_streamer_alloc_smoke to check.
+  void Report() const {
+#if defined(ALSA_STREAMER_ALLOC_CHECK)
+    const uint64_t allocations =
+        counted_ +
+        (armed_ ? totton::test::ThreadAllocationCount() - start_ : 0);
+    std::cerr << "Steady-state allocations: " << allocations << " in "
+              << periods_ << " periods\n";
+#endif
+  }
+
+private:
+  bool armed_ = false;
+  uint64_t start_ = 0;
+  uint64_t counted_ = 0;
+  uint64_t periods_ = 0;
+};
+
+const char *StreamModeLabel(StreamMode mode) {
+  switch (mode) {
+  case StreamMode::Passthrough:
+    return "passthrough";
+  case StreamMode::Convert:
+    return "convert";
+  case StreamMode::Filter:
+    return "filter";
+  }
+  return "unknown";
+}
+
 std::atomic<bool> gRunning{true};
 
 void SignalHandler(int) { gRunning.store(false); }
 
+void TraceDumpHandler(int) { totton::audio::trace::RequestDump(); }
+
+std::atomic<bool> gReloadRequested{false};
+
+void ReloadHandler(int) { gReloadRequested.store(true); }
+
 void PrintUsage(const char *argv0) {
   std::cout
       << "Usage: " << argv0 << " --in <device> --out <device> [options]\n"
@@ -54,13 +185,31 @@ void PrintUsage(const char *argv0) {
          "(default: min)\n"
       << "  --ratio <1|2|4|8|16>     Upsample ratio suffix for auto lookup "
          "(default: 1)\n"
-      << "  --rate <hz>             Requested input sample rate (auto if "
-         "omitted)\n"
+      << "  --auto                  Probe the output DAC and pick the ratio, "
+         "filter, format, period and buffer it supports\n"
+      << "  --rate <hz>             Requested input sample rate (auto and "
+         "followed live if omitted, unless --filter is given)\n"
+      << "  --keep-output-rate      Never reopen the DAC on an input rate "
+         "change; resample to a rate that reaches it instead\n"
       << "  --channels <n>          Channel count (default: 2)\n"
       << "  --format <s16|s24|s32>  PCM format (default: s32)\n"
-      << "  --period <frames>       ALSA period frames (default: 1024; "
-         "clamped when filter is active)\n"
+      << "  --period <frames>       ALSA period frames (default: 1024)\n"
       << "  --buffer <frames>       ALSA buffer frames (default: period*4)\n"
+      << "  --drift-comp            Track capture/playback clock drift with "
+         "adaptive resampling\n"
+      << "  --stats-file <path>     Runtime stats JSON (default: "
+         "$TOTTON_STATS_PATH or /tmp/gpu_upsampler_stats.json)\n"
+      << "  --stats-shm <name>      Shared memory stats segment (default: "
+         "$TOTTON_STATS_SHM or /totton_stats)\n"
+      << "  --trace <path>          Record pipeline spans; write Chrome trace "
+         "JSON on SIGUSR1 and exit\n"
+      << "  --zmq-endpoint <ep>     Serve control commands (RELOAD, "
+         "PHASE_TYPE_SET, EQ_SET, MUTE, SOFT_RESET, STATS) on this ZeroMQ "
+         "endpoint\n"
+      << "  --zmq-pub-endpoint <ep> Publish state events (rates, filter "
+         "swaps, xruns, metrics) on this endpoint; needs --zmq-endpoint\n"
+      << "  --meter-rate <hz>       Level meter and spectrum events per "
+         "second on the PUB endpoint (default: 30, 0 disables)\n"
       << "  --help                  Show this help\n";
 }
 
@@ -82,6 +231,18 @@ bool ParseArgs(int argc, char **argv, CliOptions *options) {
       options->showHelp = true;
       return true;
     }
+    if (arg == "--drift-comp") {
+      options->driftCompensation = true;
+      continue;
+    }
+    if (arg == "--keep-output-rate") {
+      options->keepOutputRate = true;
+      continue;
+    }
+    if (arg == "--auto") {
+      options->autoNegotiate = true;
+      continue;
+    }
     if (arg == "--in") {
       const char *val = requireValue("--in");
       if (!val) {
@@ -145,6 +306,7 @@ bool ParseArgs(int argc, char **argv, CliOptions *options) {
         return false;
       }
       options->ratio = static_cast<unsigned int>(std::stoul(val));
+      options->ratioSpecified = true;
       continue;
     }
     if (arg == "--rate") {
@@ -169,6 +331,59 @@ bool ParseArgs(int argc, char **argv, CliOptions *options) {
         return false;
       }
       options->format = val;
+      options->formatSpecified = true;
+      continue;
+    }
+    if (arg == "--stats-file") {
+      const char *val = requireValue("--stats-file");
+      if (!val) {
+        return false;
+      }
+      options->statsPath = val;
+      continue;
+    }
+    if (arg == "--stats-shm") {
+      const char *val = requireValue("--stats-shm");
+      if (!val) {
+        return false;
+      }
+      options->statsShmName = val;
+      continue;
+    }
+    if (arg == "--trace") {
+      const char *val = requireValue("--trace");
+      if (!val) {
+        return false;
+      }
+      options->tracePath = val;
+      continue;
+    }
+    if (arg == "--zmq-endpoint") {
+      const char *val = requireValue("--zmq-endpoint");
+      if (!val) {
+        return false;
+      }
+      options->zmqEndpoint = val;
+      continue;
+    }
+    if (arg == "--zmq-pub-endpoint") {
+      const char *val = requireValue("--zmq-pub-endpoint");
+      if (!val) {
+        return false;
+      }
+      options->zmqPubEndpoint = val;
+      continue;
+    }
+    if (arg == "--meter-rate") {
+      const char *val = requireValue("--meter-rate");
+      if (!val) {
+        return false;
+      }
+      options->meterRate = std::stod(val);
+      if (options->meterRate < 0.0) {
+        std::cerr << "--meter-rate must not be negative\n";
+        return false;
+      }
       continue;
     }
     if (arg == "--period") {
@@ -195,11 +410,83 @@ bool ParseArgs(int argc, char **argv, CliOptions *options) {
   return true;
 }
 
+snd_pcm_format_t ToPcmFormat(DacCapability::SampleFormat format) {
+  switch (format) {
+  case DacCapability::SampleFormat::S16_LE:
+    return SND_PCM_FORMAT_S16_LE;
+  case DacCapability::SampleFormat::S24_3LE:
+    return SND_PCM_FORMAT_S24_3LE;
+  case DacCapability::SampleFormat::S32_LE:
+    return SND_PCM_FORMAT_S32_LE;
+  default:
+    return SND_PCM_FORMAT_UNKNOWN;
+  }
+}
+
+// --auto: probes the output DAC, negotiates the highest rate of the input's
+// family it runs at natively, and points the filter lookup at the ratio
+// that reaches it. Inputs with no integer path to that rate are resampled
+// first. Without --format the DAC is opened in the negotiated format; the
+// capture side keeps the format it opened with.
+bool NegotiateOutput(CliOptions *options, unsigned int inputRate,
+                     snd_pcm_format_t *playbackFormat,
+                     AutoNegotiation::NegotiatedConfig *negotiated) {
+  const auto capability =
+      DacCapability::DeviceRegistry::instance().capability(
+          options->outputDevice);
+  if (!capability.isValid) {
+    std::cerr << "Cannot probe " << options->outputDevice << ": "
+              << capability.errorMessage << "\n";
+    return false;
+  }
+  const unsigned long period =
+      options->periodFrames > 0 ? options->periodFrames
+                                : AutoNegotiation::DEFAULT_INPUT_PERIOD_FRAMES;
+  *negotiated = AutoNegotiation::negotiate(static_cast<int>(inputRate),
+                                           capability, 0, period);
+  if (!negotiated->isValid) {
+    std::cerr << "Auto negotiation failed: " << negotiated->errorMessage
+              << "\n";
+    return false;
+  }
+
+  if (!options->formatSpecified) {
+    *playbackFormat = ToPcmFormat(negotiated->outputFormat);
+  }
+  options->requestedRate = inputRate;
+  options->ratio = static_cast<unsigned int>(negotiated->upsampleRatio);
+  options->filterDirSpecified = true;
+  std::cerr << "Auto: " << options->outputDevice << " runs "
+            << negotiated->outputRate << " Hz for " << inputRate
+            << " Hz input (";
+  if (negotiated->resampleRate != 0) {
+    std::cerr << "resampled to " << negotiated->resampleRate << " Hz, ";
+  }
+  std::cerr << negotiated->upsampleRatio << "x), "
+            << DacCapability::sampleFormatName(negotiated->outputFormat)
+            << ", period " << negotiated->periodFrames << ", buffer "
+            << negotiated->bufferFrames << " frames (" << std::fixed
+            << std::setprecision(1) << negotiated->latencyMs << " ms)\n"
+            << std::defaultfloat;
+  return true;
+}
+
+// Rate --filter-dir filters are looked up for: the input's own when it is a
+// 44.1k or 48k family rate, otherwise the lowest family rate above it (32k
+// to 48k, 22.05k to 44.1k), which the input is resampled to first.
+unsigned int FilterDirRate(unsigned int inputRate) {
+  const int rate = static_cast<int>(inputRate);
+  return static_cast<unsigned int>(AutoNegotiation::getResampleRate(
+      rate, AutoNegotiation::getTargetRateForFamily(
+                AutoNegotiation::getRateFamily(rate))));
+}
+
 bool PrepareFilter(
-    const CliOptions &options, snd_pcm_format_t format,
+    const CliOptions &options, unsigned int inputRate,
     totton::vulkan::VulkanStreamingUpsampler *upsampler,
     std::vector<totton::vulkan::VulkanStreamingUpsampler> *channelUpsamplers,
-    std::optional<totton::vulkan::FilterConfig> *filterConfig) {
+    std::optional<totton::vulkan::FilterConfig> *filterConfig,
+    std::string *filterPath) {
   const bool filterRequired = !options.filterPath.empty();
   const bool autoFilterRequested =
       options.filterDirSpecified || !options.filterPath.empty();
@@ -208,18 +495,6 @@ bool PrepareFilter(
     return true;
   }
 
-  unsigned int inputRate = options.requestedRate;
-  if (inputRate == 0) {
-    auto preview = totton::alsa::OpenCaptureAutoRate(
-        options.inputDevice, format, options.channels, options.requestedRate,
-        options.periodFrames, options.bufferFrames);
-    if (!preview) {
-      return false;
-    }
-    inputRate = preview->rate;
-    snd_pcm_close(preview->handle);
-  }
-
   std::string filterError;
   auto selection = totton::alsa::ResolveFilterPath(
       options.filterPath, options.filterDir, options.phase, options.ratio,
@@ -245,12 +520,262 @@ bool PrepareFilter(
   if (filterConfig) {
     *filterConfig = upsampler->GetConfig();
   }
+  if (filterPath) {
+    *filterPath = selection->path;
+  }
   if (channelUpsamplers) {
     channelUpsamplers->assign(options.channels, *upsampler);
   }
   return true;
 }
 
+// What the stream runs at after the capture source switched rate.
+struct RatePlan {
+  unsigned int ratio = 1;      // Upsample ratio, 1 without a filter.
+  unsigned int streamRate = 0; // Input rate after resampling, if any.
+  unsigned int outputRate = 0;
+  std::string filterPath; // Empty: no filter.
+  std::optional<AutoNegotiation::NegotiatedConfig> negotiated; // --auto.
+};
+
+// Picks the filter and output rate for inputRate. Keeping the DAC at
+// currentOutputRate is preferred, so a change within the rate family only
+// swaps the filter: --auto renegotiates against the cached DAC capability,
+// --filter-dir lookup first tries the ratio that lands on the current rate.
+// With --keep-output-rate the DAC always stays; input of the other family
+// is resampled to a rate the filters reach it from.
+bool PlanRateChange(const CliOptions &options, const std::string &phase,
+                    unsigned int inputRate, unsigned int currentOutputRate,
+                    unsigned long capturePeriod, RatePlan *plan) {
+  const unsigned int keptRate =
+      static_cast<unsigned int>(AutoNegotiation::getResampleRate(
+          static_cast<int>(inputRate), static_cast<int>(currentOutputRate)));
+  plan->streamRate = inputRate;
+  std::vector<unsigned int> ratios;
+  if (options.autoNegotiate) {
+    const auto capability =
+        DacCapability::DeviceRegistry::instance().capability(
+            options.outputDevice);
+    if (!capability.isValid) {
+      std::cerr << "Cannot probe " << options.outputDevice << ": "
+                << capability.errorMessage << "\n";
+      return false;
+    }
+    plan->negotiated = AutoNegotiation::negotiate(
+        static_cast<int>(inputRate), capability,
+        static_cast<int>(currentOutputRate), capturePeriod);
+    if (!plan->negotiated->isValid) {
+      std::cerr << "Auto negotiation failed for " << inputRate << " Hz: "
+                << plan->negotiated->errorMessage << "\n";
+      return false;
+    }
+    auto &negotiated = *plan->negotiated;
+    if (options.keepOutputRate && negotiated.requiresReconfiguration) {
+      negotiated.outputRate = static_cast<int>(currentOutputRate);
+      negotiated.resampleRate =
+          keptRate != inputRate ? static_cast<int>(keptRate) : 0;
+      negotiated.upsampleRatio =
+          static_cast<int>(currentOutputRate / keptRate);
+      negotiated.requiresReconfiguration = false;
+    }
+    if (negotiated.resampleRate != 0) {
+      plan->streamRate = static_cast<unsigned int>(negotiated.resampleRate);
+    }
+    ratios.push_back(static_cast<unsigned int>(negotiated.upsampleRatio));
+  } else if (options.filterDirSpecified) {
+    plan->streamRate =
+        options.keepOutputRate ? keptRate : FilterDirRate(inputRate);
+    if (currentOutputRate % plan->streamRate == 0) {
+      ratios.push_back(currentOutputRate / plan->streamRate);
+    }
+    if (!options.keepOutputRate) {
+      ratios.push_back(options.ratio);
+    }
+  } else if (options.keepOutputRate) {
+    plan->streamRate = currentOutputRate;
+  }
+
+  std::string filterError;
+  for (unsigned int ratio : ratios) {
+    const auto selection = totton::alsa::ResolveFilterPath(
+        "", options.filterDir, phase, ratio, plan->streamRate, &filterError);
+    if (selection) {
+      plan->ratio = ratio;
+      plan->filterPath = selection->path;
+      break;
+    }
+  }
+  if (plan->negotiated && plan->negotiated->upsampleRatio > 1 &&
+      plan->filterPath.empty()) {
+    std::cerr << "--auto needs a " << plan->negotiated->upsampleRatio
+              << "x filter for " << plan->streamRate << " Hz in "
+              << options.filterDir << "\n";
+    return false;
+  }
+  if (!ratios.empty() && plan->filterPath.empty()) {
+    if (!filterError.empty()) {
+      std::cerr << "Filter not available, continuing without filter: "
+                << filterError << "\n";
+    }
+    // Without a filter the input goes straight to the DAC rate it keeps,
+    // or is not resampled at all.
+    plan->streamRate = options.keepOutputRate ? currentOutputRate : inputRate;
+  }
+  plan->outputRate = plan->streamRate * plan->ratio;
+  return true;
+}
+
+// Audio thread, once a period: closes the meter window when it is long
+// enough and queues it with the filtered spectrum of the same blocks.
+void QueueMeterFrame(
+    totton::audio::LevelMeter *meter, uint64_t windowFrames,
+    std::vector<totton::vulkan::VulkanStreamingUpsampler> *channelUpsamplers,
+    totton::audio::MeterQueue *queue) {
+  if (meter->Frames() < windowFrames) {
+    return;
+  }
+  totton::audio::MeterFrame frame;
+  meter->Finish(&frame);
+  for (auto &upsampler : *channelUpsamplers) {
+    const std::size_t blocks = upsampler.TakeSpectrum(frame.spectrum.data());
+    frame.spectrumBlocks = static_cast<uint32_t>(blocks);
+  }
+  queue->TryPush(frame);
+}
+
+// Moves the FFT, multiply and IFFT times of the blocks filtered this period,
+// and their GPU timestamps when VkFFT provides them, into the registry.
+void RecordFilterTimings(
+    std::vector<totton::vulkan::VulkanStreamingUpsampler> *channelUpsamplers,
+    totton::audio::MetricsRegistry *metrics) {
+  totton::vulkan::StageTimings total;
+  for (auto &upsampler : *channelUpsamplers) {
+    const totton::vulkan::StageTimings timings = upsampler.TakeStageTimings();
+    total.fftNs += timings.fftNs;
+    total.multiplyNs += timings.multiplyNs;
+    total.ifftNs += timings.ifftNs;
+    total.blocks += timings.blocks;
+    total.gpuNs += timings.gpuNs;
+    total.queueNs += timings.queueNs;
+    total.hostNs += timings.hostNs;
+    total.gpuBlocks += timings.gpuBlocks;
+  }
+  if (total.blocks == 0) {
+    return;
+  }
+  metrics->RecordStage(totton::audio::Stage::Fft, total.fftNs);
+  metrics->RecordStage(totton::audio::Stage::Multiply, total.multiplyNs);
+  metrics->RecordStage(totton::audio::Stage::Ifft, total.ifftNs);
+  if (total.gpuBlocks == 0) {
+    return;
+  }
+  metrics->RecordGpu(totton::audio::GpuTiming::Execute, total.gpuNs);
+  metrics->RecordGpu(totton::audio::GpuTiming::Queue, total.queueNs);
+  metrics->RecordGpu(totton::audio::GpuTiming::Host, total.hostNs);
+}
+
+// Sizes the filter output buffers for the most blocks a single
+// FilterBufferedInput() call over maxInputFrames frames can complete, so the
+// streaming loop reuses them instead of growing them on the audio thread.
+void ReserveFilterOutput(
+    const std::vector<totton::vulkan::VulkanStreamingUpsampler>
+        &channelUpsamplers,
+    std::size_t maxInputFrames, std::vector<std::vector<float>> *channelOutput,
+    std::vector<float> *output) {
+  if (channelUpsamplers.empty()) {
+    return;
+  }
+  const auto &upsampler = channelUpsamplers.front();
+  const std::size_t blockInputFrames = upsampler.GetInputBlockSize();
+  if (blockInputFrames == 0) {
+    return;
+  }
+  // Up to blockInputFrames - 1 frames may already be pending.
+  const std::size_t frames = (maxInputFrames / blockInputFrames + 1) *
+                             upsampler.GetConfig().OutputBlockSize();
+  for (auto &out : *channelOutput) {
+    out.reserve(frames);
+  }
+  output->reserve(frames * channelOutput->size());
+}
+
+// Interleaves per-channel filter output into *output. Every channel is fed
+// the same frames, so a length mismatch means a filter failed.
+bool InterleaveChannels(const std::vector<std::vector<float>> &channelOutput,
+                        std::vector<float> *output) {
+  const size_t channels = channelOutput.size();
+  const size_t frames = channels > 0 ? channelOutput[0].size() : 0;
+  output->resize(frames * channels);
+  for (size_t ch = 0; ch < channels; ++ch) {
+    if (channelOutput[ch].size() != frames) {
+      return false;
+    }
+    for (size_t i = 0; i < frames; ++i) {
+      (*output)[i * channels + ch] = channelOutput[ch][i];
+    }
+  }
+  return true;
+}
+
+// Runs every frame buffered in input through the per-channel upsamplers and
+// interleaves whatever output became ready into *output. A serviced flush
+// (new epoch) restarts the filters instead of splicing stale overlap onto
+// the new signal.
+bool FilterBufferedInput(
+    PlanarRingBuffer *input,
+    std::vector<totton::vulkan::VulkanStreamingUpsampler> *channelUpsamplers,
+    uint64_t *epoch, std::vector<std::vector<float>> *channelOutput,
+    std::vector<float> *output) {
+  totton::audio::trace::Scope trace("filter");
+  const PlanarRingBuffer::ReadRegion region =
+      input->peekRead(input->readable());
+  if (input->epoch() != *epoch) {
+    *epoch = input->epoch();
+    for (auto &upsampler : *channelUpsamplers) {
+      upsampler.Reset();
+    }
+  }
+  for (unsigned int ch = 0; ch < channelUpsamplers->size(); ++ch) {
+    auto &upsampler = (*channelUpsamplers)[ch];
+    auto &out = (*channelOutput)[ch];
+    out.clear();
+    if (!upsampler.Process(region.first(ch), region.firstFrames, &out) ||
+        !upsampler.Process(region.second(ch), region.secondFrames, &out)) {
+      return false;
+    }
+  }
+  if (!region.empty()) {
+    input->consume(region.frames());
+  }
+  return InterleaveChannels(*channelOutput, output);
+}
+
+// Before a rate change: plays what the output ring still holds, fading to
+// silence over at most rampFrames, so the old stream is not cut off
+// mid-waveform. The rest of the ring is dropped.
+bool FadeOutRing(AudioRingBuffer *ring, unsigned int channels,
+                 std::size_t rampFrames, snd_pcm_format_t format,
+                 snd_pcm_t *playback) {
+  const std::size_t frames =
+      std::min(ring->availableToRead() / channels, rampFrames);
+  std::vector<float> tail(frames * channels);
+  if (frames == 0 || !ring->read(tail.data(), tail.size())) {
+    ring->clear();
+    return true;
+  }
+  ring->clear();
+  for (std::size_t i = 0; i < frames; ++i) {
+    const float gain =
+        1.0f - static_cast<float>(i + 1) / static_cast<float>(frames);
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+      tail[i * channels + ch] *= gain;
+    }
+  }
+  std::vector<uint8_t> pcm;
+  return totton::alsa::ConvertFloatToPcm(tail, format, &pcm) &&
+         totton::alsa::WriteFull(playback, pcm.data(), frames, gRunning);
+}
+
 bool ProcessFilePipeline(
     const CliOptions &options, snd_pcm_format_t format,
     std::vector<totton::vulkan::VulkanStreamingUpsampler> *channelUpsamplers,
@@ -282,8 +807,37 @@ bool ProcessFilePipeline(
   std::vector<float> processed;
   std::vector<uint8_t> outBuffer;
 
+  const bool filterActive = channelUpsamplers && !channelUpsamplers->empty();
+  const StreamMode mode =
+      filterActive ? StreamMode::Filter : StreamMode::Passthrough;
+  PlanarRingBuffer inputBuffer;
+  uint64_t inputEpoch = 0;
+  std::vector<std::vector<float>> channelOutput(options.channels);
+  SteadyStateAllocations allocations;
+  if (filterActive) {
+    inputBuffer.init(options.channels, periodFrames);
+    floatBuffer.reserve(static_cast<size_t>(periodFrames) * options.channels);
+    ReserveFilterOutput(*channelUpsamplers, inputBuffer.capacityFrames(),
+                        &channelOutput, &processed);
+    outBuffer.reserve(processed.capacity() *
+                      totton::alsa::BytesPerSample(format));
+  }
   std::cerr << "File processing started: input " << options.requestedRate
-            << " Hz, period " << periodFrames << " frames\n";
+            << " Hz, period " << periodFrames << " frames, mode "
+            << StreamModeLabel(mode) << "\n";
+
+  auto writeProcessed = [&]() {
+    if (processed.empty()) {
+      return true;
+    }
+    if (!totton::alsa::ConvertFloatToPcm(processed, format, &outBuffer)) {
+      std::cerr << "PCM output conversion failed\n";
+      return false;
+    }
+    output.write(reinterpret_cast<const char *>(outBuffer.data()),
+                 static_cast<std::streamsize>(outBuffer.size()));
+    return true;
+  };
 
   while (gRunning.load()) {
     input.read(reinterpret_cast<char *>(rawBuffer.data()),
@@ -298,47 +852,44 @@ bool ProcessFilePipeline(
       break;
     }
 
-    if (framesRead < periodFrames) {
-      std::fill(rawBuffer.begin() + framesRead * frameBytes, rawBuffer.end(),
-                0);
+    if (!filterActive) {
+      // Passthrough: no filter is active, so the PCM bytes are written back
+      // unchanged (bit-exact, no float round trip).
+      output.write(reinterpret_cast<const char *>(rawBuffer.data()),
+                   static_cast<std::streamsize>(framesRead * frameBytes));
+      continue;
     }
 
-    if (!totton::alsa::ConvertPcmToFloat(rawBuffer.data(), format, periodFrames,
+    if (!totton::alsa::ConvertPcmToFloat(rawBuffer.data(), format, framesRead,
                                          options.channels, &floatBuffer)) {
       std::cerr << "PCM conversion failed\n";
       return false;
     }
+    if (!inputBuffer.writeInterleaved(floatBuffer.data(), framesRead) ||
+        !FilterBufferedInput(&inputBuffer, channelUpsamplers, &inputEpoch,
+                             &channelOutput, &processed)) {
+      std::cerr << "Filter processing failed\n";
+      return false;
+    }
+    if (!writeProcessed()) {
+      return false;
+    }
+    allocations.OnPeriod(!processed.empty());
+  }
+  allocations.Report();
 
-    processed.assign(floatBuffer.size(), 0.0f);
-
-    if (channelUpsamplers && !channelUpsamplers->empty()) {
-      const size_t frames = periodFrames;
-      for (unsigned int ch = 0; ch < options.channels; ++ch) {
-        std::vector<float> channel(frames, 0.0f);
-        for (size_t i = 0; i < frames; ++i) {
-          channel[i] = floatBuffer[i * options.channels + ch];
-        }
-        std::vector<float> out = (*channelUpsamplers)[ch].ProcessBlock(
-            channel.data(), channel.size());
-        if (out.size() != frames) {
-          std::cerr << "Filter output size mismatch\n";
-          return false;
-        }
-        for (size_t i = 0; i < frames; ++i) {
-          processed[i * options.channels + ch] = out[i];
-        }
+  if (filterActive) {
+    // Drain the convolution tail so the last input frames are not cut off.
+    for (unsigned int ch = 0; ch < options.channels; ++ch) {
+      channelOutput[ch].clear();
+      if (!(*channelUpsamplers)[ch].Flush(&channelOutput[ch])) {
+        std::cerr << "Filter flush failed\n";
+        return false;
       }
-    } else {
-      processed = floatBuffer;
     }
-
-    if (!totton::alsa::ConvertFloatToPcm(processed, format, &outBuffer)) {
-      std::cerr << "PCM output conversion failed\n";
+    if (!InterleaveChannels(channelOutput, &processed) || !writeProcessed()) {
       return false;
     }
-
-    output.write(reinterpret_cast<const char *>(outBuffer.data()),
-                 static_cast<std::streamsize>(framesRead * frameBytes));
   }
 
   std::cerr << "File processing stopped\n";
@@ -371,211 +922,796 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  snd_pcm_format_t format = totton::alsa::ParseFormat(options.format);
-  if (format == SND_PCM_FORMAT_UNKNOWN) {
+  const snd_pcm_format_t captureFormat =
+      totton::alsa::ParseFormat(options.format);
+  if (captureFormat == SND_PCM_FORMAT_UNKNOWN) {
     std::cerr << "Unsupported format: " << options.format << "\n";
     return 1;
   }
+#if !defined(ENABLE_ZMQ)
+  if (!options.zmqEndpoint.empty() || !options.zmqPubEndpoint.empty()) {
+    std::cerr << "--zmq-endpoint and --zmq-pub-endpoint need a build with "
+                 "ENABLE_ZMQ\n";
+    return 1;
+  }
+#endif
+  if (!options.zmqPubEndpoint.empty() && options.zmqEndpoint.empty()) {
+    std::cerr << "--zmq-pub-endpoint needs --zmq-endpoint\n";
+    return 1;
+  }
+  if (options.autoNegotiate &&
+      (fileMode || !options.filterPath.empty() || options.ratioSpecified)) {
+    std::cerr << "--auto probes the output device and picks the filter; it "
+                 "cannot be combined with file mode, --filter or --ratio\n";
+    return 1;
+  }
 
   std::signal(SIGINT, SignalHandler);
   std::signal(SIGTERM, SignalHandler);
+  // Everything the audio path logs goes through this writer thread, which
+  // drains the queue before main returns.
+  totton::audio::rtlog::ScopedWriter logWriter;
+  if (!options.tracePath.empty()) {
+    totton::audio::trace::Enable();
+    totton::audio::trace::RegisterThread("audio");
+    std::signal(SIGUSR1, TraceDumpHandler);
+    std::cerr << "Tracing enabled; SIGUSR1 or exit writes "
+              << options.tracePath << "\n";
+  }
+  auto dumpTrace = [&]() {
+    std::string traceError;
+    if (!options.tracePath.empty() &&
+        !totton::audio::trace::Dump(options.tracePath, &traceError)) {
+      std::cerr << traceError << "\n";
+    }
+  };
 
   totton::vulkan::VulkanStreamingUpsampler upsampler;
   std::vector<totton::vulkan::VulkanStreamingUpsampler> channelUpsamplers;
   std::optional<totton::vulkan::FilterConfig> filterConfig;
+  std::string filterPath;
+
+  // Without --rate the input follows its source: a rate change is detected
+  // on the capture path and the stream is reconfigured in place. A --filter
+  // filter is for one input rate, so it pins the rate like --rate does.
+  const bool followRate = !fileMode && options.requestedRate == 0 &&
+                          options.filterPath.empty();
+  // The upsamplers buffer input internally, so any period size works.
+  const unsigned int periodFrames =
+      options.periodFrames > 0 ? options.periodFrames : 1024;
+  // Opened once, up front: negotiation and filter selection both follow the
+  // rate it runs at.
+  std::optional<totton::alsa::AlsaHandle> capture;
+  if (!fileMode) {
+    capture = totton::alsa::OpenCaptureAutoRate(
+        options.inputDevice, captureFormat, options.channels,
+        options.requestedRate, periodFrames, options.bufferFrames);
+    if (!capture) {
+      return 1;
+    }
+  }
+  const unsigned int inputRate =
+      capture ? capture->rate : options.requestedRate;
 
-  if (!PrepareFilter(options, format, &upsampler, &channelUpsamplers,
-                     &filterConfig)) {
+  // Differs from captureFormat only when --auto picks the DAC's format;
+  // samples are converted through float on the way.
+  snd_pcm_format_t playbackFormat = captureFormat;
+  std::optional<AutoNegotiation::NegotiatedConfig> negotiated;
+  if (options.autoNegotiate) {
+    negotiated.emplace();
+    if (!NegotiateOutput(&options, inputRate, &playbackFormat,
+                         &*negotiated)) {
+      return 1;
+    }
+  }
+
+  // Rate drift compensation and the filter run at. The input is resampled
+  // to it when it has no integer path to the DAC (--auto) or is outside
+  // the rate families the filters exist for (--filter-dir).
+  unsigned int streamRate = inputRate;
+  if (negotiated && negotiated->resampleRate != 0) {
+    streamRate = static_cast<unsigned int>(negotiated->resampleRate);
+  } else if (!fileMode && !negotiated && options.filterDirSpecified &&
+             options.filterPath.empty()) {
+    streamRate = FilterDirRate(inputRate);
+  }
+  if (!PrepareFilter(options, streamRate, &upsampler, &channelUpsamplers,
+                     &filterConfig, &filterPath)) {
+    return 1;
+  }
+  if (!negotiated && !filterConfig) {
+    streamRate = inputRate;
+  }
+  // Without the filter the DAC would be opened at the input rate, which is
+  // exactly what --auto is meant to avoid.
+  if (negotiated && negotiated->upsampleRatio > 1 &&
+      (!filterConfig ||
+       filterConfig->upsampleFactor !=
+           static_cast<std::size_t>(negotiated->upsampleRatio))) {
+    std::cerr << "--auto needs a " << negotiated->upsampleRatio
+              << "x filter in " << options.filterDir << "\n";
+    return 1;
+  }
+  // The live loop sizes everything from an integer upsample factor; input
+  // above what the DAC runs goes through the input resampler instead.
+  if (!fileMode && filterConfig && filterConfig->downsampleFactor > 1) {
+    std::cerr << "Decimating filters are only supported with --in-file\n";
     return 1;
   }
   std::size_t upsampleFactor = 1;
   std::size_t blockInputFrames = 0;
-  std::size_t blockOutputFrames = 0;
   if (filterConfig) {
     upsampleFactor = std::max<std::size_t>(filterConfig->upsampleFactor, 1);
-    blockOutputFrames = filterConfig->blockSize;
-    blockInputFrames = filterConfig->blockSize / upsampleFactor;
+    blockInputFrames = upsampler.GetInputBlockSize();
     if (blockInputFrames == 0) {
       std::cerr << "Invalid filter block size for input buffering.\n";
       return 1;
     }
   }
 
-  unsigned int periodFrames = options.periodFrames;
-  if (fileMode && blockInputFrames > 0) {
-    periodFrames = static_cast<unsigned int>(blockInputFrames);
-  } else if (periodFrames == 0) {
-    periodFrames = 1024;
-    if (blockInputFrames > 0) {
-      periodFrames = static_cast<unsigned int>(
-          std::min<std::size_t>(periodFrames, blockInputFrames));
-    }
-  } else if (!fileMode && blockInputFrames > 0 &&
-             periodFrames > blockInputFrames) {
-    std::cerr << "ALSA period is larger than filter input block; clamping to "
-              << blockInputFrames << " frames\n";
-    periodFrames = static_cast<unsigned int>(blockInputFrames);
-  }
-
   if (fileMode) {
-    if (!ProcessFilePipeline(options, format, &channelUpsamplers,
-                             periodFrames)) {
-      return 1;
-    }
-    return 0;
+    const bool ok = ProcessFilePipeline(options, captureFormat,
+                                        &channelUpsamplers, periodFrames);
+    dumpTrace();
+    return ok ? 0 : 1;
   }
 
-  auto capture = totton::alsa::OpenCaptureAutoRate(
-      options.inputDevice, format, options.channels, options.requestedRate,
-      periodFrames, options.bufferFrames);
-  if (!capture) {
+  // Runs ahead of drift compensation and the filter whenever the stream
+  // rate differs from the capture rate.
+  std::optional<totton::audio::RationalResampler> inputResampler;
+  // Frames one capture period yields at the stream rate: this or, from the
+  // resampler, one more.
+  std::size_t streamPeriodFrames = capture->periodFrames;
+  auto prepareResampler = [&]() {
+    inputResampler.reset();
+    streamPeriodFrames = capture->periodFrames;
+    if (streamRate == capture->rate) {
+      return true;
+    }
+    std::string error;
+    inputResampler.emplace();
+    if (!inputResampler->Init(options.channels, capture->rate, streamRate,
+                              &error)) {
+      std::cerr << error << "\n";
+      return false;
+    }
+    inputResampler->Reserve(capture->periodFrames);
+    streamPeriodFrames = inputResampler->MinOutputFrames(capture->periodFrames);
+    std::cerr << "Resampling input " << capture->rate << " -> " << streamRate
+              << " Hz (" << inputResampler->Interpolation() << "/"
+              << inputResampler->Decimation() << ", "
+              << inputResampler->Taps() << " taps per phase)\n";
+    return true;
+  };
+  if (!prepareResampler()) {
     return 1;
   }
 
-  unsigned int outputRate = capture->rate;
-  std::size_t streamInputFrames = capture->periodFrames;
-  std::size_t streamOutputFrames = capture->periodFrames;
-  if (filterConfig) {
-    outputRate = static_cast<unsigned int>(capture->rate * upsampleFactor);
-    streamInputFrames = blockInputFrames;
-    streamOutputFrames = blockOutputFrames;
-  }
+  unsigned int outputRate =
+      static_cast<unsigned int>(streamRate * upsampleFactor);
 
-  const auto outputFrames =
-      static_cast<size_t>(capture->periodFrames) * upsampleFactor;
-  const snd_pcm_uframes_t outputBufferFrames =
+  std::size_t outputFrames = streamPeriodFrames * upsampleFactor;
+  snd_pcm_uframes_t outputPeriodFrames = outputFrames;
+  snd_pcm_uframes_t outputBufferFrames =
       (options.bufferFrames > 0)
-          ? static_cast<snd_pcm_uframes_t>(options.bufferFrames) *
-                upsampleFactor
+          ? static_cast<snd_pcm_uframes_t>(
+                static_cast<uint64_t>(options.bufferFrames) * outputRate /
+                capture->rate)
           : 0;
+  // --auto opens the DAC at exactly the negotiated rate, never through a
+  // resampling plugin, with the period and buffer its ranges allow. Writes
+  // stay one capture period of output each.
+  if (negotiated) {
+    outputPeriodFrames = negotiated->periodFrames;
+    if (options.bufferFrames == 0) {
+      outputBufferFrames = negotiated->bufferFrames;
+    }
+  }
   auto playback = totton::alsa::OpenPcm(
-      options.outputDevice, SND_PCM_STREAM_PLAYBACK, format, options.channels,
-      outputRate, outputFrames, outputBufferFrames);
+      options.outputDevice, SND_PCM_STREAM_PLAYBACK, playbackFormat,
+      options.channels, outputRate, outputPeriodFrames, outputBufferFrames,
+      negotiated.has_value());
   if (!playback) {
     return 1;
   }
 
+  auto selectMode = [&]() {
+    if (!channelUpsamplers.empty()) {
+      return StreamMode::Filter;
+    }
+    // Both PCMs share the channel count, so with no filter only the
+    // negotiated format and the rate ALSA actually granted can differ.
+    // Drift compensation resamples, so it rules out bit-perfect output.
+    return (playbackFormat == captureFormat &&
+            playback->rate == capture->rate && !options.driftCompensation)
+               ? StreamMode::Passthrough
+               : StreamMode::Convert;
+  };
+  StreamMode mode = selectMode();
+  std::optional<totton::alsa::DriftCompensation> drift;
+  if (options.driftCompensation) {
+    drift.emplace(options.channels, playback->rate,
+                  static_cast<double>(outputRate) / capture->rate,
+                  streamPeriodFrames + 1);
+  }
+  // Filter output, resampled and drift-compensated audio vary in length per
+  // period, so they go through the output ring instead of straight to
+  // playback.
+  bool useOutputRing = !channelUpsamplers.empty() || drift.has_value() ||
+                       inputResampler.has_value();
+
   const size_t frameBytes =
-      totton::alsa::BytesPerSample(format) * options.channels;
+      totton::alsa::BytesPerSample(captureFormat) * options.channels;
   std::vector<uint8_t> rawBuffer(capture->periodFrames * frameBytes);
   std::vector<float> floatBuffer;
   std::vector<float> processed;
   std::vector<uint8_t> outBuffer;
-  std::vector<std::unique_ptr<AudioRingBuffer>> inputBuffers;
+  PlanarRingBuffer inputBuffer;
+  uint64_t inputEpoch = 0;
   AudioRingBuffer outputBuffer;
-  std::vector<std::vector<float>> channelBlocks;
-  std::vector<float> interleavedBlock;
+  std::vector<std::vector<float>> channelOutput(options.channels);
+  std::vector<float> filtered;
+  std::vector<float> rateConverted;
+  std::vector<float> resampled;
+  SteadyStateAllocations allocations;
+  // SIGHUP rebuilds the filter kernel on the publisher thread, control
+  // commands on the command server thread; the loop switches to it between
+  // periods.
+  std::optional<totton::alsa::KernelUpdates> kernelUpdates;
+  if (!channelUpsamplers.empty()) {
+    kernelUpdates.emplace(filterPath, *filterConfig, playback->rate);
+    std::signal(SIGHUP, ReloadHandler);
+  }
+  totton::audio::ControlQueue controlCommands;
+  // Output metering, on while meter events are published.
+  std::optional<totton::audio::LevelMeter> levelMeter;
+  uint64_t meterWindowFrames = 0;
+  totton::audio::MeterQueue meterQueue;
+  // A soft reset holds silence for a whole FFT of input, so the filters are
+  // reset with nothing but silence in flight. It counts captured frames, and
+  // the input resampler holds a kernel of them as well.
+  auto softResetHold = [&]() -> std::size_t {
+    if (!filterConfig) {
+      return 0;
+    }
+    const std::size_t fftInput =
+        filterConfig->fftSize / filterConfig->KernelFactor();
+    if (!inputResampler) {
+      return fftInput;
+    }
+    return fftInput * capture->rate / streamRate + inputResampler->Taps();
+  };
+  totton::audio::SoftGain softGain(options.channels, capture->rate,
+                                   softResetHold());
+
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetRates(capture->rate, playback->rate);
+  metrics.SetMode(StreamModeLabel(mode));
+  // A period must be processed within its own duration to keep up.
+  metrics.SetDeadlineNs(static_cast<uint64_t>(capture->periodFrames) *
+                        1000000000ULL / capture->rate);
+#if defined(ENABLE_ZMQ)
+  // Declared before the stats publisher, whose housekeeping uses them.
+  totton::alsa::ControlContext control;
+  control.filterDir = options.filterDir;
+  control.filterPinned = !options.filterPath.empty();
+  control.inputRate = streamRate;
+  control.ratio = options.ratio;
+  control.metrics = &metrics;
+  control.kernelUpdates = kernelUpdates ? &*kernelUpdates : nullptr;
+  control.commands = &controlCommands;
+  control.running = &gRunning;
+  control.startTime = std::chrono::steady_clock::now();
+  control.phase = options.phase == "min" ? "minimum" : options.phase;
+  std::optional<totton::zmq_server::ZmqCommandServer> controlServer;
+  std::optional<totton::zmq_server::EventPublisher> controlEvents;
+  std::optional<totton::zmq_server::StatsEventTracker> statsEvents;
+  // What the devices granted: at startup and after every rate change.
+  auto emitNegotiation = [&](const char *reason) {
+    if (!controlEvents) {
+      return;
+    }
+    controlEvents->Emit(
+        totton::zmq_server::topic::kNegotiation,
+        "{\"reason\":\"" + std::string(reason) +
+            "\",\"requested_rate\":" + std::to_string(options.requestedRate) +
+            ",\"input_rate\":" + std::to_string(capture->rate) +
+            ",\"resample_rate\":" +
+            std::to_string(inputResampler ? streamRate : 0) +
+            ",\"output_rate\":" + std::to_string(playback->rate) +
+            ",\"upsample_factor\":" + std::to_string(upsampleFactor) +
+            ",\"mode\":\"" + StreamModeLabel(mode) + "\"}");
+  };
+  if (!options.zmqEndpoint.empty()) {
+    controlServer.emplace(options.zmqEndpoint, options.zmqPubEndpoint);
+    totton::alsa::RegisterControlCommands(&*controlServer, &control);
+    if (!controlServer->Start()) {
+      return 1;
+    }
+    std::cerr << "Control server listening on " << options.zmqEndpoint
+              << "\n";
+  }
+  if (controlServer && !options.zmqPubEndpoint.empty()) {
+    controlEvents.emplace(&*controlServer);
+    control.events = &*controlEvents;
+    statsEvents.emplace(
+        [&controlEvents](const std::string &topic, const std::string &data) {
+          controlEvents->Emit(topic, data);
+        });
+    emitNegotiation("start");
+    std::cerr << "Publishing events on " << options.zmqPubEndpoint << "\n";
+  }
+  std::optional<totton::audio::MeterPublisher> meterPublisher;
+  if (controlEvents && options.meterRate > 0.0) {
+    levelMeter.emplace(options.channels);
+    meterWindowFrames = std::max<uint64_t>(
+        static_cast<uint64_t>(playback->rate / options.meterRate), 1);
+    for (auto &channelUpsampler : channelUpsamplers) {
+      channelUpsampler.EnableSpectrum(totton::audio::kSpectrumBands,
+                                      playback->rate);
+    }
+    meterPublisher.emplace(
+        &meterQueue,
+        [&controlEvents](const std::string &json) {
+          controlEvents->Emit(totton::zmq_server::topic::kMeters, json);
+        },
+        options.meterRate);
+    meterPublisher->Start();
+  }
+#endif
+  totton::audio::StatsPublisher statsPublisher(
+      metrics,
+      options.statsPath.empty() ? DefaultStatsPath() : options.statsPath,
+      options.tracePath);
+  statsPublisher.SetHousekeeping([&]() {
+    if (kernelUpdates) {
+      if (gReloadRequested.exchange(false)) {
+        std::string error;
+        if (kernelUpdates->Reload(&error)) {
+          std::cerr << "Filter reloaded: " << kernelUpdates->FilterPath()
+                    << "\n";
+#if defined(ENABLE_ZMQ)
+          totton::alsa::EmitFilterEvent(&control, "reload");
+#endif
+        } else {
+          std::cerr << "Filter reload failed: " << error << "\n";
+        }
+      }
+      if (kernelUpdates->TakeRejected()) {
+        std::cerr << "Filter kernel rejected by the upsampler; playing the "
+                     "loaded filter\n";
+      }
+      kernelUpdates->Collect();
+    }
+#if defined(ENABLE_ZMQ)
+    if (statsEvents) {
+      statsEvents->Update(totton::alsa::SampleStats(metrics));
+    }
+#endif
+  });
+  statsPublisher.Start();
+  // Refreshed every period by the audio thread itself: plain stores into a
+  // seqlocked block, so local readers poll it without touching the daemon.
+  totton::audio::StatsShmWriter statsShm;
+  totton::audio::StatsShmPayload statsShmPayload{};
+  {
+    const std::string shmName = options.statsShmName.empty()
+                                    ? DefaultStatsShmName()
+                                    : options.statsShmName;
+    std::string shmError;
+    if (!statsShm.Open(shmName, &shmError)) {
+      std::cerr << "Stats shared memory disabled: " << shmError << "\n";
+    }
+  }
+  auto publishStatsShm = [&]() {
+    if (statsShm.IsOpen()) {
+      totton::audio::FillStatsShmPayload(metrics, &statsShmPayload);
+      statsShm.Publish(statsShmPayload);
+    }
+  };
 
   std::cerr << "ALSA streaming started: input " << capture->rate << " Hz, "
             << "output " << outputRate << " Hz, "
-            << "period " << capture->periodFrames << " frames\n";
+            << "period " << capture->periodFrames << " frames, "
+            << "mode " << StreamModeLabel(mode) << "\n";
+  if (mode == StreamMode::Convert && playback->rate != capture->rate &&
+      !inputResampler) {
+    std::cerr << "Playback rate " << playback->rate
+              << " Hz differs from capture; passthrough disabled\n";
+  }
+  if (drift) {
+    std::cerr << "Drift compensation enabled\n";
+  }
 
-  if (!channelUpsamplers.empty()) {
-    const std::size_t inputCapacity =
-        std::max(streamInputFrames,
-                 static_cast<size_t>(capture->periodFrames)) *
-        3;
-    const std::size_t outputCapacityFrames =
-        std::max(streamOutputFrames, outputFrames) * 3;
-
-    inputBuffers.clear();
-    inputBuffers.reserve(options.channels);
-    for (unsigned int ch = 0; ch < options.channels; ++ch) {
-      auto buffer = std::make_unique<AudioRingBuffer>();
-      buffer->init(inputCapacity);
-      inputBuffers.emplace_back(std::move(buffer));
+  // Sizes the rings and everything the loop resizes per period up front;
+  // again after a rate change.
+  auto sizeBuffers = [&]() {
+    if (useOutputRing) {
+      // Filter output arrives in whole blocks while playback drains one
+      // period per loop. Priming with the worst-case shortfall (block minus
+      // the largest step shared by block and period) keeps a full period
+      // ready every iteration without inserting silence later.
+      // Drift compensation adds one period of headroom so the controller
+      // can move the fill level in both directions. Resampled input reaches
+      // the filter in periods alternating by a frame, so there the
+      // shortfall is bounded by a whole block instead.
+      const std::size_t period = streamPeriodFrames;
+      std::size_t primeFrames = drift ? outputFrames : 0;
+      if (inputResampler) {
+        primeFrames += blockInputFrames * upsampleFactor;
+      } else if (blockInputFrames > 0) {
+        std::size_t step = blockInputFrames;
+        for (std::size_t rem = period; rem != 0;) {
+          const std::size_t next = step % rem;
+          step = rem;
+          rem = next;
+        }
+        primeFrames += (blockInputFrames - step) * upsampleFactor;
+      }
+      const std::size_t outputCapacityFrames =
+          primeFrames +
+          std::max(blockInputFrames * upsampleFactor, outputFrames) * 3;
+
+      // The resampler may deliver a few frames more than one period.
+      inputBuffer.init(options.channels, period * 2 + 64);
+      inputEpoch = inputBuffer.epoch();
+      outputBuffer.init(outputCapacityFrames * options.channels);
+      metrics.InputFill().SetCapacity(inputBuffer.capacityFrames());
+      metrics.OutputFill().SetCapacity(outputCapacityFrames);
+      const std::vector<float> silence(primeFrames * options.channels, 0.0f);
+      outputBuffer.write(silence.data(), silence.size());
+      ReserveFilterOutput(channelUpsamplers, inputBuffer.capacityFrames(),
+                          &channelOutput, &filtered);
+    }
+    floatBuffer.reserve(static_cast<size_t>(capture->periodFrames) *
+                        options.channels);
+    if (inputResampler) {
+      rateConverted.reserve((streamPeriodFrames + 1) * options.channels);
+    }
+    if (drift) {
+      // The resampler ratio is clamped to within 1% of unity.
+      resampled.reserve((streamPeriodFrames + streamPeriodFrames / 64 + 3) *
+                        options.channels);
     }
-    outputBuffer.init(outputCapacityFrames * options.channels);
+    processed.reserve(outputFrames * options.channels);
+    outBuffer.reserve(processed.capacity() *
+                      totton::alsa::BytesPerSample(playbackFormat));
+  };
+  sizeBuffers();
 
-    channelBlocks.assign(options.channels,
-                         std::vector<float>(streamInputFrames, 0.0f));
-    interleavedBlock.assign(streamOutputFrames * options.channels, 0.0f);
+  // Blocking playback writes are timed separately so the cycle time only
+  // counts processing.
+  uint64_t writeNs = 0;
+  auto writePlayback = [&](const void *data, snd_pcm_uframes_t frames) {
+    totton::audio::trace::Scope trace("playback.write");
+    const uint64_t start = totton::audio::MonotonicNs();
+    const bool ok = totton::alsa::WriteFull(playback->handle, data, frames,
+                                            gRunning, metrics.PlaybackXruns());
+    writeNs += totton::audio::MonotonicNs() - start;
+    return ok;
+  };
+  totton::audio::LevelMeter *meter = levelMeter ? &*levelMeter : nullptr;
+
+  totton::alsa::CaptureRateMonitor rateMonitor;
+  if (followRate) {
+    rateMonitor.Start(options.inputDevice, capture->rate);
+    std::cerr << "Following input rate changes"
+              << (rateMonitor.ControlName().empty()
+                      ? std::string(" (measured)")
+                      : " (control '" + rateMonitor.ControlName() + "')")
+              << "\n";
   }
+  // Follows the capture source to newRate, or to whatever rate the device
+  // opens at again when newRate is 0 (after the capture PCM failed). Only
+  // the capture PCM is reopened when the output rate can stay; otherwise
+  // the queued output fades out and the DAC is drained and reopened. The
+  // new stream fades in either way.
+  auto reconfigure = [&](unsigned int newRate) {
+    const auto started = std::chrono::steady_clock::now();
+    const unsigned int previousRate = capture->rate;
+#if defined(ENABLE_ZMQ)
+    // Held only to read the phase and, at the end, to publish the new rates
+    // and filter; a phase switch resolved against the old rate fails once
+    // BeginRebase() moves the generation on.
+    std::unique_lock<std::mutex> phaseLock(control.phaseMutex);
+    const std::string phase = control.phase == "minimum" ? "min"
+                                                         : control.phase;
+#else
+    const std::string phase = options.phase;
+#endif
+    if (kernelUpdates) {
+      kernelUpdates->BeginRebase();
+    }
+#if defined(ENABLE_ZMQ)
+    phaseLock.unlock();
+#endif
+    snd_pcm_drop(capture->handle);
+    snd_pcm_close(capture->handle);
+    // Exact rate: a plug layer resampling from the old rate would hide the
+    // change rather than follow it.
+    capture = newRate != 0
+                  ? totton::alsa::OpenPcm(
+                        options.inputDevice, SND_PCM_STREAM_CAPTURE,
+                        captureFormat, options.channels, newRate,
+                        periodFrames, options.bufferFrames, true)
+                  : std::nullopt;
+    if (!capture) {
+      capture = totton::alsa::OpenCaptureAutoRate(
+          options.inputDevice, captureFormat, options.channels, 0,
+          periodFrames, options.bufferFrames);
+    }
+    if (!capture) {
+      return false;
+    }
+
+    RatePlan plan;
+    if (!PlanRateChange(options, phase, capture->rate, playback->rate,
+                        capture->periodFrames, &plan)) {
+      return false;
+    }
+    std::vector<totton::vulkan::VulkanStreamingUpsampler> nextUpsamplers;
+    std::optional<totton::vulkan::FilterConfig> nextConfig;
+    // What KernelUpdates publishes for the new filter, without transforming
+    // it a second time.
+    std::optional<totton::vulkan::FilterKernel> nextKernel;
+    if (!plan.filterPath.empty()) {
+      totton::vulkan::VulkanStreamingUpsampler loaded;
+      std::string error;
+      if (!loaded.LoadFilter(plan.filterPath, &error)) {
+        std::cerr << "Filter load failed: " << error << "\n";
+        return false;
+      }
+      nextConfig = loaded.GetConfig();
+      if (kernelUpdates) {
+        nextKernel = loaded.GetKernel();
+      }
+      nextUpsamplers.assign(options.channels, loaded);
+    }
+
+    const bool reopenPlayback = plan.outputRate != playback->rate;
+    if (useOutputRing &&
+        !FadeOutRing(&outputBuffer, options.channels, playback->rate / 200,
+                     playbackFormat, playback->handle)) {
+      return false;
+    }
+    if (reopenPlayback) {
+      snd_pcm_drain(playback->handle);
+      snd_pcm_close(playback->handle);
+      snd_pcm_uframes_t period = static_cast<snd_pcm_uframes_t>(
+          static_cast<uint64_t>(capture->periodFrames) * plan.outputRate /
+          capture->rate);
+      snd_pcm_uframes_t buffer = static_cast<snd_pcm_uframes_t>(
+          static_cast<uint64_t>(options.bufferFrames) * plan.outputRate /
+          capture->rate);
+      if (plan.negotiated) {
+        period = plan.negotiated->periodFrames;
+        if (options.bufferFrames == 0) {
+          buffer = plan.negotiated->bufferFrames;
+        }
+      }
+      playback = totton::alsa::OpenPcm(
+          options.outputDevice, SND_PCM_STREAM_PLAYBACK, playbackFormat,
+          options.channels, plan.outputRate, period, buffer,
+          plan.negotiated.has_value());
+      if (!playback) {
+        return false;
+      }
+    }
+
+    channelUpsamplers = std::move(nextUpsamplers);
+    filterConfig = nextConfig;
+    filterPath = plan.filterPath;
+    upsampleFactor =
+        filterConfig ? std::max<std::size_t>(filterConfig->upsampleFactor, 1)
+                     : 1;
+    blockInputFrames =
+        filterConfig ? channelUpsamplers.front().GetInputBlockSize() : 0;
+    streamRate = plan.streamRate;
+    if (!prepareResampler()) {
+      return false;
+    }
+    outputRate = playback->rate;
+    outputFrames = streamPeriodFrames * upsampleFactor;
+    mode = selectMode();
+    drift.reset();
+    if (options.driftCompensation) {
+      drift.emplace(options.channels, playback->rate,
+                    static_cast<double>(plan.outputRate) / capture->rate,
+                    streamPeriodFrames + 1);
+    }
+    useOutputRing = !channelUpsamplers.empty() || drift.has_value() ||
+                    inputResampler.has_value();
+    rawBuffer.resize(capture->periodFrames * frameBytes);
+    sizeBuffers();
+#if defined(ENABLE_ZMQ)
+    phaseLock.lock();
+#endif
+    // KernelUpdates is shared with the control threads, so it is only ever
+    // created at startup: a filter first found after a rate change runs
+    // without SIGHUP reloads or EQ until the next restart.
+    if (kernelUpdates && nextKernel) {
+      kernelUpdates->Rebase(filterPath, std::move(*nextKernel),
+                            playback->rate);
+    }
+    softGain.Restart(capture->rate, softResetHold());
+    metrics.SetRates(capture->rate, playback->rate);
+    metrics.SetMode(StreamModeLabel(mode));
+    metrics.SetDeadlineNs(static_cast<uint64_t>(capture->periodFrames) *
+                          1000000000ULL / capture->rate);
+    if (levelMeter) {
+      meterWindowFrames = std::max<uint64_t>(
+          static_cast<uint64_t>(playback->rate / options.meterRate), 1);
+      for (auto &channelUpsampler : channelUpsamplers) {
+        channelUpsampler.EnableSpectrum(totton::audio::kSpectrumBands,
+                                        playback->rate);
+      }
+    }
+    rateMonitor.Rearm(capture->rate, newRate);
+    allocations.OnReconfigure();
+#if defined(ENABLE_ZMQ)
+    control.inputRate = streamRate;
+    control.ratio = plan.ratio;
+    phaseLock.unlock();
+    emitNegotiation("rate_change");
+    if (filterConfig) {
+      totton::alsa::EmitFilterEvent(&control, "rate_change");
+    }
+#endif
+
+    const auto elapsedMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started)
+            .count();
+    std::cerr << "Input rate changed: " << previousRate << " -> "
+              << capture->rate << " Hz";
+    if (inputResampler) {
+      std::cerr << " (resampled to " << streamRate << " Hz)";
+    }
+    std::cerr << ", output " << playback->rate << " Hz ("
+              << (reopenPlayback ? "playback reopened" : "filter swapped")
+              << "), mode " << StreamModeLabel(mode) << ", " << elapsedMs
+              << " ms\n";
+    if (rateMonitor.RejectedRate() != 0) {
+      std::cerr << "Capture cannot run at " << rateMonitor.RejectedRate()
+                << " Hz; muted until the source changes rate\n";
+    }
+    return true;
+  };
+  // A failed capture PCM is reopened once per successful read, so a device
+  // that is gone for good still ends the stream.
+  bool readSinceReopen = true;
 
   while (gRunning.load()) {
+    const uint64_t readStart = totton::audio::MonotonicNs();
     if (!totton::alsa::ReadFull(capture->handle, rawBuffer.data(),
-                                capture->periodFrames, gRunning)) {
+                                capture->periodFrames, gRunning,
+                                metrics.CaptureXruns())) {
+      if (followRate && readSinceReopen && gRunning.load()) {
+        readSinceReopen = false;
+        if (reconfigure(0)) {
+          continue;
+        }
+      }
       break;
     }
+    readSinceReopen = true;
+    totton::audio::trace::Record("capture.read", readStart,
+                                 totton::audio::MonotonicNs());
+    if (followRate) {
+      const unsigned int sourceRate =
+          rateMonitor.Poll(capture->handle, capture->periodFrames);
+      if (sourceRate != 0) {
+        // This period was captured at the old rate; drop it.
+        if (!reconfigure(sourceRate)) {
+          break;
+        }
+        continue;
+      }
+      softGain.Hold(rateMonitor.RejectedRate() != 0);
+    }
+
+    totton::audio::ControlCommand command;
+    while (controlCommands.TryPop(&command)) {
+      softGain.Apply(command);
+    }
 
-    if (!totton::alsa::ConvertPcmToFloat(rawBuffer.data(), format,
+    if (mode == StreamMode::Passthrough && softGain.IsUnity()) {
+      // Capture and playback share rawBuffer: no conversion, no extra copy.
+      // While muted or fading, passthrough takes the float path below.
+      if (!writePlayback(rawBuffer.data(), capture->periodFrames)) {
+        break;
+      }
+      publishStatsShm();
+      allocations.OnPeriod(true);
+      continue;
+    }
+
+    const uint64_t cycleStart = totton::audio::MonotonicNs();
+    writeNs = 0;
+    if (!totton::alsa::ConvertPcmToFloat(rawBuffer.data(), captureFormat,
                                          capture->periodFrames,
                                          options.channels, &floatBuffer)) {
       std::cerr << "PCM conversion failed\n";
       break;
     }
+    if (softGain.Process(floatBuffer.data(), capture->periodFrames) &&
+        !channelUpsamplers.empty()) {
+      // Faded out and held long enough that the filters only hold silence.
+      inputBuffer.requestFlush();
+    }
 
-    if (!channelUpsamplers.empty()) {
-      const size_t frames = capture->periodFrames;
-      for (unsigned int ch = 0; ch < options.channels; ++ch) {
-        std::vector<float> channel(frames, 0.0f);
-        for (size_t i = 0; i < frames; ++i) {
-          channel[i] = floatBuffer[i * options.channels + ch];
-        }
-        if (!inputBuffers[ch]->write(channel.data(), channel.size())) {
-          std::cerr << "Input buffer overflow; dropping accumulated audio\n";
-          for (auto &buffer : inputBuffers) {
-            buffer->clear();
-          }
-          break;
-        }
+    const float *samples = floatBuffer.data();
+    std::size_t frames = capture->periodFrames;
+    if (inputResampler) {
+      totton::audio::trace::Scope trace("input.resample");
+      rateConverted.clear();
+      if (!inputResampler->Process(samples, frames, &rateConverted)) {
+        std::cerr << "Input resampler failed\n";
+        break;
       }
+      samples = rateConverted.data();
+      frames = rateConverted.size() / options.channels;
+    }
+    if (drift) {
+      drift->OnCaptured(capture->periodFrames);
+      if (!drift->Process(samples, frames, &resampled)) {
+        std::cerr << "Drift resampler failed\n";
+        break;
+      }
+      samples = resampled.data();
+      frames = resampled.size() / options.channels;
+    }
+    const uint64_t convertEnd = totton::audio::MonotonicNs();
+    metrics.RecordStage(totton::audio::Stage::Convert,
+                        convertEnd - cycleStart);
+    totton::audio::trace::Record("convert", cycleStart, convertEnd);
 
-      while (gRunning.load()) {
-        bool ready = outputBuffer.availableToWrite() >=
-                     (streamOutputFrames * options.channels);
-        for (const auto &buffer : inputBuffers) {
-          if (buffer->availableToRead() < streamInputFrames) {
-            ready = false;
-            break;
-          }
-        }
-        if (!ready) {
-          break;
-        }
-
-        for (unsigned int ch = 0; ch < options.channels; ++ch) {
-          if (!inputBuffers[ch]->read(channelBlocks[ch].data(),
-                                      channelBlocks[ch].size())) {
-            gRunning.store(false);
-            break;
-          }
-          std::vector<float> out = channelUpsamplers[ch].ProcessBlock(
-              channelBlocks[ch].data(), channelBlocks[ch].size());
-          if (out.size() != streamOutputFrames) {
-            std::cerr << "Filter output size mismatch\n";
-            gRunning.store(false);
-            break;
-          }
-          for (size_t i = 0; i < streamOutputFrames; ++i) {
-            interleavedBlock[i * options.channels + ch] = out[i];
-          }
-        }
-        if (!gRunning.load()) {
-          break;
-        }
-        if (!outputBuffer.write(interleavedBlock.data(),
-                                interleavedBlock.size())) {
-          std::cerr << "Output buffer overflow; dropping accumulated audio\n";
-          outputBuffer.clear();
-          break;
-        }
+    if (!channelUpsamplers.empty()) {
+      if (kernelUpdates) {
+        kernelUpdates->Apply(&channelUpsamplers);
+      }
+      if (!inputBuffer.writeInterleaved(samples, frames)) {
+        metrics.CountInputOverflow();
+        totton::audio::rtlog::Post(totton::audio::rtlog::Code::InputOverflow);
+        inputBuffer.requestFlush();
+      }
+      metrics.InputFill().Observe(inputBuffer.availableToRead());
+      if (!FilterBufferedInput(&inputBuffer, &channelUpsamplers, &inputEpoch,
+                               &channelOutput, &filtered)) {
+        std::cerr << "Filter processing failed\n";
+        break;
+      }
+      RecordFilterTimings(&channelUpsamplers, &metrics);
+      if (!outputBuffer.write(filtered.data(), filtered.size())) {
+        metrics.CountOutputOverflow();
+        totton::audio::rtlog::Post(totton::audio::rtlog::Code::OutputOverflow);
+        outputBuffer.clear();
+      }
+    } else if (useOutputRing) {
+      if (!outputBuffer.write(samples, frames * options.channels)) {
+        metrics.CountOutputOverflow();
+        totton::audio::rtlog::Post(totton::audio::rtlog::Code::OutputOverflow);
+        outputBuffer.clear();
       }
     } else {
       processed = floatBuffer;
     }
 
-    if (channelUpsamplers.empty()) {
-      if (!totton::alsa::ConvertFloatToPcm(processed, format, &outBuffer)) {
+    const uint64_t outputStart = totton::audio::MonotonicNs();
+    uint64_t outputEnd = 0;
+    if (!useOutputRing) {
+      if (!totton::alsa::ConvertFloatToPcm(processed, playbackFormat,
+                                           &outBuffer, meter)) {
         std::cerr << "PCM output conversion failed\n";
         break;
       }
 
-      if (!totton::alsa::WriteFull(playback->handle, outBuffer.data(),
-                                   outputFrames, gRunning)) {
+      if (!writePlayback(outBuffer.data(), outputFrames)) {
         break;
       }
     } else {
+      metrics.OutputFill().Observe(outputBuffer.availableToRead() /
+                                   options.channels);
       processed.assign(outputFrames * options.channels, 0.0f);
       bool wroteOutput = false;
       while (outputBuffer.availableToRead() >=
@@ -583,38 +1719,79 @@ int main(int argc, char **argv) {
              gRunning.load()) {
         if (!outputBuffer.read(processed.data(),
                                outputFrames * options.channels)) {
-          std::cerr << "Output buffer underrun\n";
+          totton::audio::rtlog::Post(
+              totton::audio::rtlog::Code::OutputUnderrun);
           break;
         }
-        if (!totton::alsa::ConvertFloatToPcm(processed, format, &outBuffer)) {
+        if (!totton::alsa::ConvertFloatToPcm(processed, playbackFormat,
+                                             &outBuffer, meter)) {
           std::cerr << "PCM output conversion failed\n";
           gRunning.store(false);
           break;
         }
-        if (!totton::alsa::WriteFull(playback->handle, outBuffer.data(),
-                                     outputFrames, gRunning)) {
+        if (!writePlayback(outBuffer.data(), outputFrames)) {
           gRunning.store(false);
           break;
         }
+        if (drift) {
+          drift->OnPlayed(outputFrames);
+        }
         wroteOutput = true;
       }
       if (!wroteOutput && gRunning.load()) {
-        if (!totton::alsa::ConvertFloatToPcm(processed, format, &outBuffer)) {
+        if (!totton::alsa::ConvertFloatToPcm(processed, playbackFormat,
+                                             &outBuffer, meter)) {
           std::cerr << "PCM output conversion failed\n";
           gRunning.store(false);
-        } else if (!totton::alsa::WriteFull(playback->handle, outBuffer.data(),
-                                            outputFrames, gRunning)) {
+        } else if (!writePlayback(outBuffer.data(), outputFrames)) {
           gRunning.store(false);
+        } else if (drift) {
+          drift->OnPlayed(outputFrames);
         }
       }
+      metrics.OutputFill().Observe(outputBuffer.availableToRead() /
+                                   options.channels);
+      outputEnd = totton::audio::MonotonicNs();
+      if (drift) {
+        drift->Update(capture->handle, playback->handle,
+                      outputBuffer.availableToRead() / options.channels);
+      }
     }
+    const uint64_t cycleEnd = totton::audio::MonotonicNs();
+    if (outputEnd == 0) {
+      outputEnd = cycleEnd;
+    }
+    metrics.RecordStage(totton::audio::Stage::Output,
+                        outputEnd - outputStart - writeNs);
+    metrics.RecordCycle(cycleEnd - cycleStart - writeNs);
+    totton::audio::trace::Record("output", outputStart, outputEnd);
+    totton::audio::trace::Record("period", cycleStart, cycleEnd);
+    if (meter) {
+      QueueMeterFrame(meter, meterWindowFrames, &channelUpsamplers,
+                      &meterQueue);
+    }
+    publishStatsShm();
+    allocations.OnPeriod(channelUpsamplers.empty() || !filtered.empty());
+  }
+  allocations.Report();
+
+#if defined(ENABLE_ZMQ)
+  if (meterPublisher) {
+    meterPublisher->Stop();
+  }
+  if (controlServer) {
+    controlServer->Stop();
   }
+#endif
+  statsPublisher.Stop();
+  dumpTrace();
 
-  if (capture->handle) {
+  // A failed rate change leaves either PCM closed.
+  if (capture && capture->handle) {
     snd_pcm_drop(capture->handle);
     snd_pcm_close(capture->handle);
   }
-  if (playback->handle) {
+  if (playback && playback->handle) {
     snd_pcm_drain(playback->handle);
     snd_pcm_close(playback->handle);
   }
@@ -0,0 +1,63 @@
+#include "alsa/drift_compensation.h"
+
+#include "alsa/alsa_common.h"
+#include "audio/rt_log.h"
+#include "audio/trace.h"
+
+#include <algorithm>
+
+namespace totton::alsa {
+
+DriftCompensation::DriftCompensation(unsigned int channels,
+                                     unsigned int outputRate,
+                                     double nominalRatio,
+                                     std::size_t periodFrames)
+    : outputRate_(outputRate), nominalRatio_(nominalRatio) {
+  resampler_.Init(channels);
+  resampler_.Reserve(periodFrames);
+}
+
+bool DriftCompensation::Process(const float *input, std::size_t frames,
+                                std::vector<float> *output) {
+  audio::trace::Scope trace("drift.resample");
+  output->clear();
+  return resampler_.Process(input, frames, output);
+}
+
+void DriftCompensation::Update(snd_pcm_t *capture, snd_pcm_t *playback,
+                               std::size_t queuedFrames) {
+  audio::trace::Scope trace("drift.update");
+  PcmStatus captureStatus;
+  PcmStatus playbackStatus;
+  if (!QueryPcmStatus(capture, &captureStatus) ||
+      !QueryPcmStatus(playback, &playbackStatus)) {
+    return;
+  }
+  estimator_.AddCaptureSample(captured_ + captureStatus.avail,
+                              captureStatus.timestampSeconds);
+  const auto delay = static_cast<uint64_t>(
+      std::max<snd_pcm_sframes_t>(playbackStatus.delay, 0));
+  if (played_ >= delay) {
+    estimator_.AddPlaybackSample(played_ - delay,
+                                 playbackStatus.timestampSeconds);
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double dt =
+      primed_ ? std::chrono::duration<double>(now - lastUpdate_).count() : 0.0;
+  lastUpdate_ = now;
+  primed_ = true;
+
+  const double fillSeconds =
+      static_cast<double>(queuedFrames + static_cast<std::size_t>(delay)) /
+      outputRate_;
+  const double feedForward = estimator_.Ratio() / nominalRatio_;
+  const bool wasLocked = controller_.IsLocked();
+  resampler_.SetRatio(controller_.Update(fillSeconds, dt, feedForward));
+  if (!wasLocked && controller_.IsLocked()) {
+    audio::rtlog::Post(audio::rtlog::Code::DriftLocked, nullptr, nullptr,
+                       static_cast<int64_t>(controller_.TargetSeconds() * 1e6));
+  }
+}
+
+} // namespace totton::alsa
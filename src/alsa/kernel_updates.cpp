@@ -0,0 +1,179 @@
+#include "alsa/kernel_updates.h"
+
+#include "audio/eq_to_fir.h"
+
+#include <algorithm>
+#include <complex>
+#include <memory>
+#include <utility>
+
+namespace totton::alsa {
+
+namespace {
+
+bool RateChanged(std::string *errorMessage) {
+  if (errorMessage) {
+    *errorMessage = "input rate changed during the update; retry";
+  }
+  return false;
+}
+
+} // namespace
+
+void ApplyEq(const EQ::EqProfile &profile, double outputRate,
+             vulkan::FilterKernel *kernel) {
+  auto &spectrum = kernel->spectrum;
+  const std::size_t fftSize = spectrum.size();
+  const auto response = EQ::computeEqResponseForFft(fftSize / 2 + 1, fftSize,
+                                                    outputRate, profile);
+  double peak = 0.0;
+  for (const auto &value : response) {
+    peak = std::max(peak, std::abs(value));
+  }
+  const double scale = peak > 1.0 ? 1.0 / peak : 1.0;
+  for (std::size_t i = 0; i < fftSize; ++i) {
+    // The filter is real, so the bins above Nyquist mirror those below.
+    const std::complex<double> gain =
+        i <= fftSize / 2 ? response[i] : std::conj(response[fftSize - i]);
+    spectrum[i] *= std::complex<float>(gain * scale);
+  }
+}
+
+KernelUpdates::KernelUpdates(std::string filterPath,
+                             vulkan::FilterConfig config, double outputRate)
+    : config_(std::move(config)), outputRate_(outputRate),
+      filterPath_(std::move(filterPath)) {}
+
+bool KernelUpdates::Reload(std::string *errorMessage) {
+  std::lock_guard<std::mutex> build(buildMutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::string filterPath = filterPath_;
+  std::optional<EQ::EqProfile> eq = eq_;
+  const uint64_t generation = generation_;
+  lock.unlock();
+  return Publish(std::move(filterPath), std::move(eq), generation,
+                 errorMessage);
+}
+
+bool KernelUpdates::SwitchFilter(const std::string &filterPath,
+                                 uint64_t generation,
+                                 std::string *errorMessage) {
+  std::lock_guard<std::mutex> build(buildMutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::optional<EQ::EqProfile> eq = eq_;
+  lock.unlock();
+  return Publish(filterPath, std::move(eq), generation, errorMessage);
+}
+
+bool KernelUpdates::SetEq(std::optional<EQ::EqProfile> profile,
+                          std::string *errorMessage) {
+  std::lock_guard<std::mutex> build(buildMutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::string filterPath = filterPath_;
+  const uint64_t generation = generation_;
+  lock.unlock();
+  return Publish(std::move(filterPath), std::move(profile), generation,
+                 errorMessage);
+}
+
+uint64_t KernelUpdates::Generation() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return generation_;
+}
+
+void KernelUpdates::BeginRebase() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++generation_;
+}
+
+void KernelUpdates::Rebase(std::string filterPath, vulkan::FilterKernel kernel,
+                           double outputRate) {
+  auto next = std::make_unique<vulkan::FilterKernel>(std::move(kernel));
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++generation_;
+  config_ = next->config;
+  outputRate_ = outputRate;
+  filterPath_ = std::move(filterPath);
+  if (eq_) {
+    // The kernel runs ahead of any half-band stages.
+    ApplyEq(*eq_, outputRate_ / static_cast<double>(config_.CascadeFactor()),
+            next.get());
+  }
+  exchange_.Publish(std::move(next));
+}
+
+std::string KernelUpdates::FilterPath() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return filterPath_;
+}
+
+bool KernelUpdates::EqActive() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return eq_.has_value();
+}
+
+void KernelUpdates::Apply(
+    std::vector<vulkan::VulkanStreamingUpsampler> *channelUpsamplers) {
+  const vulkan::FilterKernel *kernel = exchange_.Acquire();
+  if (kernel == applied_ || kernel == skipped_) {
+    return;
+  }
+  bool accepted = true;
+  for (auto &upsampler : *channelUpsamplers) {
+    accepted = upsampler.UseKernel(kernel) && accepted;
+  }
+  if (accepted) {
+    applied_ = kernel;
+    skipped_ = nullptr;
+    return;
+  }
+  for (auto &upsampler : *channelUpsamplers) {
+    upsampler.UseKernel(nullptr);
+  }
+  applied_ = nullptr;
+  skipped_ = kernel;
+  rejected_.store(true, std::memory_order_relaxed);
+}
+
+bool KernelUpdates::Publish(std::string filterPath,
+                            std::optional<EQ::EqProfile> eq,
+                            uint64_t generation, std::string *errorMessage) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const vulkan::FilterConfig config = config_;
+  const double outputRate = outputRate_;
+  const bool current = generation == generation_;
+  lock.unlock();
+  if (!current) {
+    return RateChanged(errorMessage);
+  }
+  auto kernel = std::make_unique<vulkan::FilterKernel>();
+  if (!vulkan::VulkanStreamingUpsampler::BuildKernel(filterPath, kernel.get(),
+                                                     errorMessage)) {
+    return false;
+  }
+  if (kernel->config.fftSize != config.fftSize ||
+      kernel->config.blockSize != config.blockSize ||
+      kernel->config.upsampleFactor != config.upsampleFactor ||
+      kernel->config.downsampleFactor != config.downsampleFactor ||
+      kernel->config.halfbandStages.size() != config.halfbandStages.size()) {
+    if (errorMessage) {
+      *errorMessage = "filter geometry changed; restart to load it";
+    }
+    return false;
+  }
+  if (eq) {
+    // The kernel runs ahead of any half-band stages.
+    ApplyEq(*eq, outputRate / static_cast<double>(config.CascadeFactor()),
+            kernel.get());
+  }
+  lock.lock();
+  if (generation != generation_) {
+    return RateChanged(errorMessage);
+  }
+  exchange_.Publish(std::move(kernel));
+  filterPath_ = std::move(filterPath);
+  eq_ = std::move(eq);
+  return true;
+}
+
+} // namespace totton::alsa
@@ -0,0 +1,136 @@
+#include "alsa/rate_monitor.h"
+
+#include "alsa/alsa_common.h"
+
+#include <cstring>
+
+namespace totton::alsa {
+
+namespace {
+
+// Controls known to carry the rate the source is sending.
+const char *const kRateControls[] = {
+    "Capture Rate", // USB audio gadget (u_audio): the host's playback rate.
+};
+
+bool ReadIntegerControl(snd_ctl_t *ctl, const char *name, long *value) {
+  snd_ctl_elem_id_t *id;
+  snd_ctl_elem_value_t *control;
+  snd_ctl_elem_id_alloca(&id);
+  snd_ctl_elem_value_alloca(&control);
+  snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_PCM);
+  snd_ctl_elem_id_set_name(id, name);
+  snd_ctl_elem_value_set_id(control, id);
+  if (snd_ctl_elem_read(ctl, control) < 0) {
+    return false;
+  }
+  *value = snd_ctl_elem_value_get_integer(control, 0);
+  return true;
+}
+
+} // namespace
+
+int CardIndexForPcm(const std::string &device) {
+  const auto colon = device.find(':');
+  if (colon == std::string::npos) {
+    return -1;
+  }
+  std::string card = device.substr(colon + 1);
+  card = card.substr(0, card.find(','));
+  if (card.rfind("CARD=", 0) == 0) {
+    card = card.substr(5);
+  }
+  if (card.empty()) {
+    return -1;
+  }
+  const int index = snd_card_get_index(card.c_str());
+  return index >= 0 ? index : -1;
+}
+
+CaptureRateMonitor::~CaptureRateMonitor() {
+  if (ctl_) {
+    snd_ctl_close(ctl_);
+  }
+}
+
+void CaptureRateMonitor::Start(const std::string &device,
+                               unsigned int nominalRate) {
+  const int card = CardIndexForPcm(device);
+  const std::string ctlName = "hw:" + std::to_string(card);
+  if (card >= 0 &&
+      snd_ctl_open(&ctl_, ctlName.c_str(), SND_CTL_NONBLOCK) >= 0) {
+    for (const char *name : kRateControls) {
+      long value = 0;
+      if (ReadIntegerControl(ctl_, name, &value)) {
+        controlName_ = name;
+        break;
+      }
+    }
+    if (controlName_.empty() || snd_ctl_subscribe_events(ctl_, 1) < 0) {
+      controlName_.clear();
+      snd_ctl_close(ctl_);
+      ctl_ = nullptr;
+    }
+  }
+  Rearm(nominalRate);
+}
+
+void CaptureRateMonitor::Rearm(unsigned int nominalRate,
+                               unsigned int requestedRate) {
+  nominal_ = nominalRate;
+  framesRead_ = 0;
+  detector_.Reset(nominalRate);
+  gate_.Rearm(nominalRate, requestedRate);
+  // The source may have switched before the PCM was (re)opened.
+  pending_ = ctl_ ? gate_.Update(ReadControlRate(), false) : 0;
+}
+
+unsigned int CaptureRateMonitor::ReadControlRate() {
+  long value = 0;
+  if (!ReadIntegerControl(ctl_, controlName_.c_str(), &value) || value <= 0) {
+    return 0;
+  }
+  return static_cast<unsigned int>(value);
+}
+
+unsigned int CaptureRateMonitor::Poll(snd_pcm_t *capture,
+                                      snd_pcm_uframes_t framesRead) {
+  framesRead_ += framesRead;
+  if (ctl_) {
+    snd_ctl_event_t *event;
+    snd_ctl_event_alloca(&event);
+    bool changed = false;
+    while (snd_ctl_read(ctl_, event) > 0) {
+      if (snd_ctl_event_get_type(event) != SND_CTL_EVENT_ELEM) {
+        continue;
+      }
+      const unsigned int mask = snd_ctl_event_elem_get_mask(event);
+      const char *name = snd_ctl_event_elem_get_name(event);
+      if (mask != SND_CTL_EVENT_MASK_REMOVE &&
+          (mask & SND_CTL_EVENT_MASK_VALUE) && name &&
+          controlName_ == name) {
+        changed = true;
+      }
+    }
+    if (changed) {
+      pending_ = gate_.Update(ReadControlRate(), true);
+    }
+    return pending_;
+  }
+
+  PcmStatus status;
+  if (!QueryPcmStatus(capture, &status)) {
+    return 0;
+  }
+  unsigned int rate =
+      detector_.AddSample(framesRead_ + status.avail, status.timestampSeconds);
+  // A window back at the PCM's rate ends a rejection; the detector itself
+  // only reports changes.
+  if (rate == 0 && gate_.Rejected() != 0 &&
+      audio::NearestStandardRate(detector_.MeasuredRate()) == nominal_) {
+    rate = nominal_;
+  }
+  return gate_.Update(rate, false);
+}
+
+} // namespace totton::alsa
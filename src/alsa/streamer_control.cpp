@@ -0,0 +1,278 @@
+#include "alsa/streamer_control.h"
+
+#include "alsa/alsa_filter_selector.h"
+#include "audio/eq_parser.h"
+
+#include <iostream>
+#include <optional>
+#include <utility>
+
+namespace totton::alsa {
+
+namespace {
+
+zmq_server::ZmqResponse ControlOk(const std::string &dataJson) {
+  return {zmq_server::ZmqCommandServer::BuildOk(dataJson)};
+}
+
+zmq_server::ZmqResponse ControlError(const std::string &code,
+                                     const std::string &message) {
+  return {zmq_server::ZmqCommandServer::BuildError(code, message), false};
+}
+
+zmq_server::ZmqResponse PostCommand(ControlContext *context,
+                                    audio::ControlCommand command,
+                                    const std::string &dataJson) {
+  if (!context->commands->TryPush(command)) {
+    return ControlError("BUSY", "control queue full; retry");
+  }
+  return ControlOk(dataJson);
+}
+
+} // namespace
+
+void EmitFilterEvent(ControlContext *context, const std::string &reason,
+                     const std::string &phase) {
+  if (!context->events || !context->kernelUpdates) {
+    return;
+  }
+  std::string data =
+      "{\"reason\":\"" + reason + "\",\"filter\":\"" +
+      zmq_server::EscapeJson(context->kernelUpdates->FilterPath()) +
+      "\",\"eq\":" + (context->kernelUpdates->EqActive() ? "true" : "false");
+  if (!phase.empty()) {
+    data += ",\"phase_type\":\"" + phase + "\"";
+  }
+  context->events->Emit(zmq_server::topic::kFilter, data + "}");
+}
+
+zmq_server::StatsSample SampleStats(const audio::MetricsRegistry &metrics) {
+  zmq_server::StatsSample sample;
+  sample.inputRate = metrics.InputRate();
+  sample.outputRate = metrics.OutputRate();
+  sample.captureXruns = metrics.CaptureXrunCount();
+  sample.playbackXruns = metrics.PlaybackXrunCount();
+  sample.inputOverflows = metrics.InputOverflowCount();
+  sample.outputOverflows = metrics.OutputOverflowCount();
+  sample.deadlineMisses = metrics.DeadlineMissCount();
+  sample.uptimeMs = audio::MonotonicNs() / 1000000;
+  return sample;
+}
+
+void RegisterControlCommands(zmq_server::ZmqCommandServer *server,
+                             ControlContext *context) {
+  using zmq_server::HandlerOptions;
+  using zmq_server::ZmqRequest;
+
+  // Queue posts and flags answer on the socket thread, even while every
+  // worker is building a kernel.
+  HandlerOptions inlineOptions;
+  inlineOptions.runInline = true;
+  // Reading coefficients and transforming a long filter takes seconds.
+  HandlerOptions kernelOptions;
+  kernelOptions.timeout = std::chrono::seconds(10);
+
+  server->Register(
+      "PING", [](const ZmqRequest &) { return ControlOk("{\"pong\":true}"); },
+      inlineOptions);
+
+  server->Register("STATS", [context](const ZmqRequest &) {
+    const auto uptimeMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - context->startTime)
+            .count();
+    std::string phase;
+    {
+      std::lock_guard<std::mutex> lock(context->phaseMutex);
+      phase = context->phase;
+    }
+    std::string data =
+        "{\"uptime_ms\":" + std::to_string(uptimeMs) + ",\"phase_type\":\"" +
+        phase + "\",\"muted\":" + (context->muted.load() ? "true" : "false") +
+        ",\"reloads\":" + std::to_string(context->reloads.load()) +
+        ",\"soft_resets\":" + std::to_string(context->softResets.load());
+    if (context->kernelUpdates) {
+      data += ",\"filter\":\"" +
+              zmq_server::EscapeJson(context->kernelUpdates->FilterPath()) +
+              "\",\"eq\":" +
+              (context->kernelUpdates->EqActive() ? "true" : "false");
+    }
+    // The same members the stats file carries, without its braces.
+    const std::string metrics = context->metrics->ToJson();
+    data += "," + metrics.substr(1, metrics.size() - 2) + "}";
+    return ControlOk(data);
+  });
+
+  server->Register(
+      "RELOAD",
+      [context](const ZmqRequest &request) {
+        if (!context->kernelUpdates) {
+          return ControlError("NO_FILTER", "no filter is active");
+        }
+        std::string path;
+        zmq_server::ExtractJsonString(request.raw, "path", &path);
+        std::string error;
+        KernelUpdates *updates = context->kernelUpdates;
+        const bool ok =
+            path.empty()
+                ? updates->Reload(&error)
+                : updates->SwitchFilter(path, updates->Generation(), &error);
+        if (!ok) {
+          return ControlError("FILTER_ERROR", error);
+        }
+        context->reloads.fetch_add(1);
+        const std::string filterPath = context->kernelUpdates->FilterPath();
+        std::cerr << "Filter reloaded: " << filterPath << "\n";
+        EmitFilterEvent(context, "reload");
+        return ControlOk("{\"reloaded\":true,\"filter\":\"" +
+                         zmq_server::EscapeJson(filterPath) + "\"}");
+      },
+      kernelOptions);
+
+  server->Register("PHASE_TYPE_GET", [context](const ZmqRequest &) {
+    std::lock_guard<std::mutex> lock(context->phaseMutex);
+    return ControlOk("{\"phase_type\":\"" + context->phase + "\"}");
+  });
+
+  server->Register(
+      "PHASE_TYPE_SET",
+      [context](const ZmqRequest &request) {
+        std::string phase;
+        zmq_server::ExtractJsonString(request.raw, "phase", &phase);
+        if (phase.empty()) {
+          zmq_server::ExtractJsonString(request.raw, "phase_type", &phase);
+        }
+        if (phase == "min") {
+          phase = "minimum";
+        }
+        if (phase != "minimum" && phase != "linear") {
+          return ControlError("INVALID_PARAMS",
+                              "phase must be minimum or linear");
+        }
+        if (!context->kernelUpdates) {
+          return ControlError("NO_FILTER", "no filter is active");
+        }
+        if (context->filterPinned) {
+          return ControlError("NOT_SUPPORTED",
+                              "--filter pins the filter; phase switching needs "
+                              "--filter-dir selection");
+        }
+        // The kernel is built without phaseMutex, which the audio thread
+        // takes during a rate change; a rate change starting meanwhile
+        // moves the generation on and fails the switch instead.
+        std::lock_guard<std::mutex> switchLock(context->phaseSwitchMutex);
+        std::unique_lock<std::mutex> lock(context->phaseMutex);
+        const uint64_t generation = context->kernelUpdates->Generation();
+        const unsigned int ratio = context->ratio.load();
+        const unsigned int inputRate = context->inputRate.load();
+        lock.unlock();
+        std::string error;
+        const auto selection = ResolveFilterPath(
+            "", context->filterDir, phase == "minimum" ? "min" : phase, ratio,
+            inputRate, &error);
+        if (!selection ||
+            !context->kernelUpdates->SwitchFilter(selection->path, generation,
+                                                  &error)) {
+          return ControlError("FILTER_ERROR", error);
+        }
+        lock.lock();
+        if (context->kernelUpdates->Generation() != generation) {
+          // The rate change loads the filter for the phase it read.
+          return ControlError("FILTER_ERROR",
+                              "input rate changed during the switch; retry");
+        }
+        context->phase = phase;
+        lock.unlock();
+        std::cerr << "Phase switched to " << phase << ": " << selection->path
+                  << "\n";
+        EmitFilterEvent(context, "phase", phase);
+        return ControlOk("{\"phase_type\":\"" + phase + "\"}");
+      },
+      kernelOptions);
+
+  server->Register(
+      "EQ_SET",
+      [context](const ZmqRequest &request) {
+        if (!context->kernelUpdates) {
+          return ControlError("NO_FILTER",
+                              "EQ is applied to the filter kernel");
+        }
+        std::string path;
+        zmq_server::ExtractJsonString(request.raw, "path", &path);
+        EQ::EqProfile profile;
+        if (path.empty() || !EQ::parseEqFile(path, profile)) {
+          return ControlError("INVALID_PARAMS",
+                              "path must name a readable EQ file");
+        }
+        std::string error;
+        if (!context->kernelUpdates->SetEq(std::move(profile), &error)) {
+          return ControlError("FILTER_ERROR", error);
+        }
+        std::cerr << "EQ applied: " << path << "\n";
+        EmitFilterEvent(context, "eq");
+        return ControlOk("{\"eq\":true}");
+      },
+      kernelOptions);
+
+  server->Register(
+      "EQ_CLEAR",
+      [context](const ZmqRequest &) {
+        if (!context->kernelUpdates) {
+          return ControlError("NO_FILTER",
+                              "EQ is applied to the filter kernel");
+        }
+        std::string error;
+        if (!context->kernelUpdates->SetEq(std::nullopt, &error)) {
+          return ControlError("FILTER_ERROR", error);
+        }
+        EmitFilterEvent(context, "eq");
+        return ControlOk("{\"eq\":false}");
+      },
+      kernelOptions);
+
+  server->Register(
+      "MUTE",
+      [context](const ZmqRequest &) {
+        auto response = PostCommand(context, audio::ControlCommand::Mute,
+                                    "{\"muted\":true}");
+        if (response.ok) {
+          context->muted.store(true);
+        }
+        return response;
+      },
+      inlineOptions);
+
+  server->Register(
+      "UNMUTE",
+      [context](const ZmqRequest &) {
+        auto response = PostCommand(context, audio::ControlCommand::Unmute,
+                                    "{\"muted\":false}");
+        if (response.ok) {
+          context->muted.store(false);
+        }
+        return response;
+      },
+      inlineOptions);
+
+  server->Register(
+      "SOFT_RESET",
+      [context](const ZmqRequest &) {
+        auto response = PostCommand(context, audio::ControlCommand::SoftReset,
+                                    "{\"reset\":true}");
+        if (response.ok) {
+          context->softResets.fetch_add(1);
+        }
+        return response;
+      },
+      inlineOptions);
+
+  server->Register(
+      "SHUTDOWN",
+      [context](const ZmqRequest &) {
+        context->running->store(false);
+        return ControlOk("{\"shutdown\":true}");
+      },
+      inlineOptions);
+}
+
+} // namespace totton::alsa
@@ -0,0 +1,135 @@
+#include "audio/adaptive_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace totton::audio {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+// Passband edge relative to Nyquist and Kaiser window shape: about 90 dB of
+// stopband rejection with the 32-tap kernel.
+constexpr double kCutoff = 0.9;
+constexpr double kKaiserBeta = 9.0;
+constexpr double kMinRatio = 0.99;
+constexpr double kMaxRatio = 1.01;
+
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  const double halfX = x / 2.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= (halfX / k) * (halfX / k);
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+double Kernel(double distance, double halfWidth) {
+  const double x = distance / halfWidth;
+  if (std::abs(x) >= 1.0) {
+    return 0.0;
+  }
+  const double window =
+      BesselI0(kKaiserBeta * std::sqrt(1.0 - x * x)) / BesselI0(kKaiserBeta);
+  const double arg = kCutoff * distance;
+  const double sinc =
+      (std::abs(arg) < 1e-12) ? 1.0 : std::sin(kPi * arg) / (kPi * arg);
+  return kCutoff * sinc * window;
+}
+
+} // namespace
+
+AdaptiveResampler::AdaptiveResampler() {
+  constexpr std::size_t half = kTaps / 2;
+  // kPhases + 1 rows so the last phase can interpolate towards frac == 1.
+  table_.assign((kPhases + 1) * kTaps, 0.0f);
+  for (std::size_t p = 0; p <= kPhases; ++p) {
+    const double frac = static_cast<double>(p) / kPhases;
+    double sum = 0.0;
+    std::vector<double> row(kTaps);
+    for (std::size_t k = 0; k < kTaps; ++k) {
+      const double distance =
+          frac + static_cast<double>(half - 1) - static_cast<double>(k);
+      row[k] = Kernel(distance, static_cast<double>(half));
+      sum += row[k];
+    }
+    // Unity DC gain for every phase avoids ratio-dependent ripple.
+    for (std::size_t k = 0; k < kTaps; ++k) {
+      table_[p * kTaps + k] = static_cast<float>(row[k] / sum);
+    }
+  }
+}
+
+void AdaptiveResampler::Init(unsigned int channels) {
+  channels_ = channels;
+  Reset();
+}
+
+void AdaptiveResampler::Reset() {
+  constexpr std::size_t half = kTaps / 2;
+  history_.assign((half - 1) * channels_, 0.0f);
+  position_ = static_cast<double>(half - 1);
+}
+
+void AdaptiveResampler::Reserve(std::size_t maxFrames) {
+  // Up to kTaps frames of history stay behind between calls.
+  history_.reserve((maxFrames + kTaps) * channels_);
+}
+
+void AdaptiveResampler::SetRatio(double ratio) {
+  ratio_ = std::clamp(ratio, kMinRatio, kMaxRatio);
+}
+
+bool AdaptiveResampler::Process(const float *input, std::size_t frames,
+                                std::vector<float> *output) {
+  if (channels_ == 0 || !output || (!input && frames > 0)) {
+    return false;
+  }
+  constexpr std::size_t half = kTaps / 2;
+  history_.insert(history_.end(), input, input + frames * channels_);
+  const std::size_t available = history_.size() / channels_;
+  const double step = 1.0 / ratio_;
+
+  float coeffs[kTaps];
+  while (true) {
+    const std::size_t index = static_cast<std::size_t>(position_);
+    if (index + half >= available) {
+      break;
+    }
+    const double phase = (position_ - static_cast<double>(index)) * kPhases;
+    const std::size_t row = std::min(static_cast<std::size_t>(phase), kPhases);
+    const float blend = static_cast<float>(phase - static_cast<double>(row));
+    const float *row0 = &table_[row * kTaps];
+    const float *row1 = &table_[std::min(row + 1, kPhases) * kTaps];
+    for (std::size_t k = 0; k < kTaps; ++k) {
+      coeffs[k] = row0[k] + blend * (row1[k] - row0[k]);
+    }
+
+    const float *base = &history_[(index + 1 - half) * channels_];
+    const std::size_t offset = output->size();
+    output->resize(offset + channels_, 0.0f);
+    for (unsigned int ch = 0; ch < channels_; ++ch) {
+      float acc = 0.0f;
+      for (std::size_t k = 0; k < kTaps; ++k) {
+        acc += base[k * channels_ + ch] * coeffs[k];
+      }
+      (*output)[offset + ch] = acc;
+    }
+    position_ += step;
+  }
+
+  // Keep the half - 1 frames of history the next output still needs.
+  const std::size_t index = static_cast<std::size_t>(position_);
+  const std::size_t drop =
+      std::min(index > half - 1 ? index - (half - 1) : 0, available);
+  const auto dropSamples = static_cast<std::ptrdiff_t>(drop * channels_);
+  history_.erase(history_.begin(), history_.begin() + dropSamples);
+  position_ -= static_cast<double>(drop);
+  return true;
+}
+
+} // namespace totton::audio
@@ -7,6 +7,7 @@
 #include "audio/pcm_format_set.h"
 
 #include <algorithm>
+#include <iterator>
 
 namespace AutoNegotiation {
 
@@ -69,9 +70,89 @@ int calculateUpsampleRatio(int inputRate, int outputRate) {
   return outputRate / inputRate;
 }
 
+int getResampleRate(int inputRate, int outputRate) {
+  if (inputRate <= 0 || outputRate <= 0) {
+    return 0;
+  }
+  // Largest ratio first: the lowest rate that still carries the input's
+  // whole band.
+  for (int ratio : {16, 8, 4, 2, 1}) {
+    if (outputRate % ratio != 0) {
+      continue;
+    }
+    const int rate = outputRate / ratio;
+    const auto candidate = static_cast<uint32_t>(rate);
+    if ((PcmFormatSet::is44kFamilyRate(candidate) ||
+         PcmFormatSet::is48kFamilyRate(candidate)) &&
+        rate >= inputRate) {
+      return rate;
+    }
+  }
+  return outputRate;
+}
+
+namespace {
+
+// Formats the output conversion can write, cheapest first.
+constexpr DacCapability::SampleFormat kOutputFormats[] = {
+    DacCapability::SampleFormat::S32_LE,
+    DacCapability::SampleFormat::S24_3LE,
+    DacCapability::SampleFormat::S16_LE,
+};
+
+unsigned long clampToRange(unsigned long value, unsigned long minValue,
+                           unsigned long maxValue) {
+  if (minValue > 0 && value < minValue) {
+    value = minValue;
+  }
+  if (maxValue > 0 && value > maxValue) {
+    value = maxValue;
+  }
+  return value;
+}
+
+// Picks format, period and buffer for config->outputRate. Returns false
+// with config->errorMessage set when the DAC takes no writable format.
+bool chooseLayout(const DacCapability::Capability &dacCap,
+                  unsigned long inputPeriodFrames, NegotiatedConfig *config) {
+  const auto format = std::find_if(
+      std::begin(kOutputFormats), std::end(kOutputFormats),
+      [&](DacCapability::SampleFormat candidate) {
+        return DacCapability::isFormatSupported(dacCap, candidate);
+      });
+  if (format == std::end(kOutputFormats)) {
+    config->errorMessage = "DAC supports none of S32_LE, S24_3LE or S16_LE";
+    return false;
+  }
+  config->outputFormat = *format;
+
+  const unsigned long periods =
+      (dacCap.isBatch || dacCap.isBlockTransfer) ? 3 : 2;
+  // The input period at the output rate, resampled first or not.
+  const auto upsampledPeriod = static_cast<unsigned long>(
+      static_cast<uint64_t>(inputPeriodFrames) *
+      static_cast<uint64_t>(config->outputRate) /
+      static_cast<uint64_t>(config->inputRate));
+  unsigned long period = clampToRange(upsampledPeriod, dacCap.minPeriodFrames,
+                                      dacCap.maxPeriodFrames);
+  // A buffer must hold at least two periods.
+  if (dacCap.maxBufferFrames > 0 && period * 2 > dacCap.maxBufferFrames) {
+    period = dacCap.maxBufferFrames / 2;
+  }
+  config->periodFrames = period;
+  config->bufferFrames = clampToRange(period * periods, dacCap.minBufferFrames,
+                                      dacCap.maxBufferFrames);
+  config->latencyMs = static_cast<double>(config->bufferFrames) * 1000.0 /
+                      static_cast<double>(config->outputRate);
+  return true;
+}
+
+} // namespace
+
 NegotiatedConfig negotiate(int inputRate,
                            const DacCapability::Capability &dacCap,
-                           int currentOutputRate) {
+                           int currentOutputRate,
+                           unsigned long inputPeriodFrames) {
   NegotiatedConfig config;
   config.inputRate = inputRate;
   config.inputFamily = AudioEngine::RateFamily::RATE_UNKNOWN;
@@ -96,24 +177,31 @@ NegotiatedConfig negotiate(int inputRate,
   // Now safe to determine rate family
   config.inputFamily = getRateFamily(inputRate);
 
-  // Get the best supported output rate for this input family
+  // Get the best supported output rate for this input family, or for the
+  // other family on DACs that run only one of them
   int targetOutputRate = getBestRateForFamily(config.inputFamily, dacCap);
+  if (targetOutputRate == 0) {
+    targetOutputRate = getBestRateForFamily(
+        config.inputFamily == AudioEngine::RateFamily::RATE_44K
+            ? AudioEngine::RateFamily::RATE_48K
+            : AudioEngine::RateFamily::RATE_44K,
+        dacCap);
+  }
 
   if (targetOutputRate == 0) {
-    config.errorMessage = "No supported output rate for input family";
+    config.errorMessage = "No supported output rate for either family";
     return config;
   }
 
-  // Ensure output rate is >= input rate
-  if (targetOutputRate < inputRate) {
-    config.errorMessage =
-        "Target output rate (" + std::to_string(targetOutputRate) +
-        ") is less than input rate (" + std::to_string(inputRate) + ")";
-    return config;
+  // Inputs outside the families (32k, 22.05k), of the other family, or above
+  // the DAC's best rate are resampled to a rate the filters reach it from
+  const int resampleRate = getResampleRate(inputRate, targetOutputRate);
+  if (resampleRate != inputRate) {
+    config.resampleRate = resampleRate;
   }
 
   // Calculate upsampling ratio
-  int ratio = calculateUpsampleRatio(inputRate, targetOutputRate);
+  int ratio = calculateUpsampleRatio(resampleRate, targetOutputRate);
   if (ratio == 0) {
     config.errorMessage = "Cannot calculate integer upsampling ratio";
     return config;
@@ -126,11 +214,18 @@ NegotiatedConfig negotiate(int inputRate,
     config.errorMessage =
         "Unsupported input rate: " + std::to_string(inputRate) + " Hz (ratio " +
         std::to_string(ratio) + " not in {1, 2, 4, 8, 16})";
+    config.resampleRate = 0;
     return config;
   }
 
   config.outputRate = targetOutputRate;
   config.upsampleRatio = ratio;
+  if (!chooseLayout(dacCap, inputPeriodFrames, &config)) {
+    config.outputRate = 0;
+    config.upsampleRatio = 0;
+    config.resampleRate = 0;
+    return config;
+  }
   config.isValid = true;
 
   // Determine if reconfiguration is needed
@@ -0,0 +1,105 @@
+#include "audio/drift_controller.h"
+
+#include <algorithm>
+
+namespace totton::audio {
+
+void DriftEstimator::Track::Add(uint64_t frames, double timestamp) {
+  if (!valid) {
+    firstFrames = lastFrames = frames;
+    firstTime = lastTime = timestamp;
+    valid = true;
+    return;
+  }
+  // Ignore stale or repeated timestamps (e.g. status read before start).
+  if (timestamp > lastTime && frames >= lastFrames) {
+    lastFrames = frames;
+    lastTime = timestamp;
+  }
+}
+
+double DriftEstimator::Track::Rate() const {
+  const double span = Span();
+  if (span <= 0.0) {
+    return 0.0;
+  }
+  return static_cast<double>(lastFrames - firstFrames) / span;
+}
+
+DriftEstimator::DriftEstimator(double windowSeconds)
+    : windowSeconds_(windowSeconds) {}
+
+void DriftEstimator::Reset() {
+  capture_ = Track{};
+  playback_ = Track{};
+}
+
+void DriftEstimator::AddCaptureSample(uint64_t frames,
+                                      double timestampSeconds) {
+  capture_.Add(frames, timestampSeconds);
+}
+
+void DriftEstimator::AddPlaybackSample(uint64_t frames,
+                                       double timestampSeconds) {
+  playback_.Add(frames, timestampSeconds);
+}
+
+bool DriftEstimator::HasEstimate() const {
+  return capture_.Span() >= windowSeconds_ &&
+         playback_.Span() >= windowSeconds_ && capture_.Rate() > 0.0 &&
+         playback_.Rate() > 0.0;
+}
+
+double DriftEstimator::Ratio() const {
+  if (!HasEstimate()) {
+    return 1.0;
+  }
+  return playback_.Rate() / capture_.Rate();
+}
+
+DriftController::DriftController(const DriftControllerConfig &config)
+    : config_(config) {}
+
+void DriftController::Reset() {
+  primed_ = false;
+  elapsed_ = 0.0;
+  smoothed_ = 0.0;
+  target_ = 0.0;
+  integral_ = 0.0;
+  ratio_ = 1.0;
+}
+
+double DriftController::Update(double fillSeconds, double dtSeconds,
+                               double feedForward) {
+  if (!primed_) {
+    smoothed_ = fillSeconds;
+    primed_ = true;
+  } else if (dtSeconds > 0.0) {
+    const double alpha = dtSeconds / (config_.smoothingSeconds + dtSeconds);
+    smoothed_ += alpha * (fillSeconds - smoothed_);
+  }
+  elapsed_ += std::max(dtSeconds, 0.0);
+
+  if (!IsLocked()) {
+    // Let the pipeline settle, then hold whatever level it settled at.
+    target_ = smoothed_;
+    ratio_ = feedForward;
+    return ratio_;
+  }
+
+  const double maxCorrection = config_.maxCorrectionPpm * 1e-6;
+  const double error = target_ - smoothed_;
+  integral_ += error * dtSeconds;
+  if (config_.ki > 0.0) {
+    // Anti-windup: the integral alone may not exceed the correction limit.
+    const double limit = maxCorrection / config_.ki;
+    integral_ = std::clamp(integral_, -limit, limit);
+  }
+  const double correction =
+      std::clamp(config_.kp * error + config_.ki * integral_, -maxCorrection,
+                 maxCorrection);
+  ratio_ = feedForward * (1.0 + correction);
+  return ratio_;
+}
+
+} // namespace totton::audio
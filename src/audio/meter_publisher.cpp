@@ -0,0 +1,75 @@
+#include "audio/meter_publisher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+namespace totton::audio {
+
+namespace {
+
+double ToDb(double value, double floorDb) {
+  return value > 0.0 ? std::max(floorDb, 20.0 * std::log10(value)) : floorDb;
+}
+
+} // namespace
+
+std::string MeterFrameJson(const MeterFrame &frame) {
+  constexpr double kFloorDb = -160.0;
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  out << "{\"frames\":" << frame.frames << ",\"channels\":[";
+  for (uint32_t ch = 0; ch < frame.channels; ++ch) {
+    out << (ch > 0 ? "," : "") << "{\"peak_db\":"
+        << ToDb(frame.peak[ch], kFloorDb)
+        << ",\"rms_db\":" << ToDb(frame.rms[ch], kFloorDb)
+        << ",\"clips\":" << frame.clips[ch] << "}";
+  }
+  out << "]";
+  if (frame.spectrumBlocks > 0) {
+    // Band powers: half the dB of an amplitude.
+    out << ",\"spectrum_db\":[";
+    for (std::size_t b = 0; b < frame.spectrum.size(); ++b) {
+      out << (b > 0 ? "," : "")
+          << ToDb(std::sqrt(std::max(frame.spectrum[b], 0.0f)), kFloorDb);
+    }
+    out << "]";
+  }
+  out << "}";
+  return out.str();
+}
+
+MeterPublisher::MeterPublisher(MeterQueue *queue, Emitter emit, double rate)
+    : queue_(queue), emit_(std::move(emit)),
+      interval_(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::duration<double>(0.5 / rate))) {}
+
+MeterPublisher::~MeterPublisher() { Stop(); }
+
+void MeterPublisher::Start() {
+  thread_ = std::thread([this]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, interval_, [this]() { return stop_; })) {
+      MeterFrame frame;
+      while (queue_->TryPop(&frame)) {
+        emit_(MeterFrameJson(frame));
+      }
+    }
+  });
+}
+
+void MeterPublisher::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+} // namespace totton::audio
@@ -0,0 +1,192 @@
+#include "audio/metrics_registry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace totton::audio {
+namespace {
+
+double ToMicros(uint64_t ns) { return static_cast<double>(ns) / 1000.0; }
+
+void AppendHistogram(std::ostringstream &out,
+                     const LatencyHistogram::Snapshot &snapshot) {
+  const double meanUs =
+      snapshot.count > 0 ? ToMicros(snapshot.sumNs) / snapshot.count : 0.0;
+  out << "{\"count\":" << snapshot.count << ",\"mean_us\":" << meanUs
+      << ",\"p50_us\":" << ToMicros(snapshot.PercentileNs(0.5))
+      << ",\"p99_us\":" << ToMicros(snapshot.PercentileNs(0.99))
+      << ",\"max_us\":" << ToMicros(snapshot.maxNs) << "}";
+}
+
+void AppendFill(std::ostringstream &out, const FillWatermark::Snapshot &fill) {
+  out << "{\"current\":" << fill.current << ",\"low\":" << fill.low
+      << ",\"high\":" << fill.high << ",\"capacity\":" << fill.capacity << "}";
+}
+
+} // namespace
+
+const char *StageName(Stage stage) {
+  switch (stage) {
+  case Stage::Convert:
+    return "convert";
+  case Stage::Fft:
+    return "fft";
+  case Stage::Multiply:
+    return "multiply";
+  case Stage::Ifft:
+    return "ifft";
+  case Stage::Output:
+    return "output";
+  case Stage::Count:
+    break;
+  }
+  return "unknown";
+}
+
+const char *GpuTimingName(GpuTiming timing) {
+  switch (timing) {
+  case GpuTiming::Execute:
+    return "execute";
+  case GpuTiming::Queue:
+    return "queue";
+  case GpuTiming::Host:
+    return "host";
+  case GpuTiming::Count:
+    break;
+  }
+  return "unknown";
+}
+
+uint64_t MonotonicNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+uint64_t LatencyHistogram::Snapshot::PercentileNs(double quantile) const {
+  if (count == 0) {
+    return 0;
+  }
+  const auto rank = static_cast<uint64_t>(quantile * (count - 1)) + 1;
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < kBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      // The top bucket's bound would overstate the largest sample.
+      return std::min((uint64_t{2} << i) - 1, maxNs);
+    }
+  }
+  return maxNs;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Read() const {
+  Snapshot snapshot;
+  // Pairs with the release increment in Record(): every counted sample has
+  // its bucket visible. Buckets may run ahead of count, never behind.
+  snapshot.count = count_.load(std::memory_order_acquire);
+  uint64_t bucketTotal = 0;
+  for (std::size_t i = 0; i < kBuckets; ++i) {
+    snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    bucketTotal += snapshot.buckets[i];
+  }
+  snapshot.count = std::max(snapshot.count, bucketTotal);
+  snapshot.sumNs = sumNs_.load(std::memory_order_relaxed);
+  snapshot.maxNs = maxNs_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+FillWatermark::Snapshot FillWatermark::Read() const {
+  Snapshot snapshot;
+  snapshot.current = current_.load(std::memory_order_relaxed);
+  const uint64_t low = low_.load(std::memory_order_relaxed);
+  snapshot.low = (low == UINT64_MAX) ? 0 : low;
+  snapshot.high = high_.load(std::memory_order_relaxed);
+  snapshot.capacity = capacity_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+MetricsRegistry::MetricsRegistry()
+    : mode_("unknown"), startNs_(MonotonicNs()) {}
+
+void MetricsRegistry::SetRates(unsigned int inputRate,
+                               unsigned int outputRate) {
+  inputRate_.store(inputRate, std::memory_order_relaxed);
+  outputRate_.store(outputRate, std::memory_order_relaxed);
+}
+
+std::string MetricsRegistry::ToJson() const {
+  const uint64_t captureXruns = CaptureXrunCount();
+  const uint64_t playbackXruns = PlaybackXrunCount();
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"input_rate\":" << inputRate_.load(std::memory_order_relaxed)
+      << ",\"output_rate\":" << outputRate_.load(std::memory_order_relaxed)
+      << ",\"mode\":\"" << mode_.load() << "\""
+      << ",\"audio\":{\"uptime_ms\":" << (MonotonicNs() - startNs_) / 1000000
+      << ",\"xrun\":{\"total\":" << captureXruns + playbackXruns
+      << ",\"capture\":" << captureXruns << ",\"playback\":" << playbackXruns
+      << "},\"overflow\":{\"input\":" << InputOverflowCount()
+      << ",\"output\":" << OutputOverflowCount()
+      << "},\"deadline\":{\"budget_us\":"
+      << ToMicros(deadlineNs_.load(std::memory_order_relaxed))
+      << ",\"misses\":" << DeadlineMissCount() << ",\"cycle\":";
+  AppendHistogram(out, cycles_.Read());
+  out << "},\"stages\":{";
+  for (std::size_t i = 0; i < stages_.size(); ++i) {
+    if (i > 0) {
+      out << ",";
+    }
+    out << "\"" << StageName(static_cast<Stage>(i)) << "\":";
+    AppendHistogram(out, stages_[i].Read());
+  }
+  out << "},\"gpu\":{";
+  for (std::size_t i = 0; i < gpu_.size(); ++i) {
+    if (i > 0) {
+      out << ",";
+    }
+    out << "\"" << GpuTimingName(static_cast<GpuTiming>(i)) << "\":";
+    AppendHistogram(out, gpu_[i].Read());
+  }
+  out << "},\"fill\":{\"input\":";
+  AppendFill(out, inputFill_.Read());
+  out << ",\"output\":";
+  AppendFill(out, outputFill_.Read());
+  out << "}}}";
+  return out.str();
+}
+
+bool MetricsRegistry::WriteStatsFile(const std::string &path,
+                                     std::string *errorMessage) const {
+  const std::string tempPath = path + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::trunc);
+    if (!file) {
+      if (errorMessage) {
+        *errorMessage = "Failed to open " + tempPath;
+      }
+      return false;
+    }
+    file << ToJson() << "\n";
+    if (!file) {
+      if (errorMessage) {
+        *errorMessage = "Failed to write " + tempPath;
+      }
+      return false;
+    }
+  }
+  if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+    if (errorMessage) {
+      *errorMessage = "Failed to rename " + tempPath + " to " + path;
+    }
+    std::remove(tempPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace totton::audio
@@ -0,0 +1,91 @@
+#include "audio/rate_detector.h"
+
+#include <cmath>
+
+namespace totton::audio {
+
+namespace {
+
+constexpr unsigned int kStandardRates[] = {
+    8000,  11025, 16000,  22050,  32000,  44100,  48000, 88200,
+    96000, 176400, 192000, 352800, 384000, 705600, 768000};
+
+// Clock drift is measured in ppm; a source switching rate moves the frame
+// rate by several percent at least (48k vs 44.1k is 8.8%).
+constexpr double kChangeThreshold = 0.02;
+
+} // namespace
+
+unsigned int NearestStandardRate(double rate, double tolerance) {
+  for (unsigned int standard : kStandardRates) {
+    if (std::fabs(rate / standard - 1.0) <= tolerance) {
+      return standard;
+    }
+  }
+  return 0;
+}
+
+RateDetector::RateDetector(double windowSeconds, int confirmations)
+    : windowSeconds_(windowSeconds), confirmations_(confirmations) {}
+
+void RateDetector::Reset(unsigned int nominalRate) {
+  nominal_ = nominalRate;
+  started_ = false;
+  measured_ = 0.0;
+  candidate_ = 0;
+  agreeing_ = 0;
+}
+
+unsigned int RateDetector::AddSample(uint64_t frames,
+                                     double timestampSeconds) {
+  if (nominal_ == 0 || timestampSeconds <= 0.0) {
+    return 0;
+  }
+  // A recovered xrun or a restarted PCM moves the position backwards.
+  if (!started_ || frames < windowFrames_ || timestampSeconds < windowTime_) {
+    windowFrames_ = frames;
+    windowTime_ = timestampSeconds;
+    started_ = true;
+    return 0;
+  }
+  const double span = timestampSeconds - windowTime_;
+  if (span < windowSeconds_) {
+    return 0;
+  }
+  measured_ = static_cast<double>(frames - windowFrames_) / span;
+  windowFrames_ = frames;
+  windowTime_ = timestampSeconds;
+
+  unsigned int rate = 0;
+  if (std::fabs(measured_ / nominal_ - 1.0) > kChangeThreshold) {
+    rate = NearestStandardRate(measured_);
+  }
+  if (rate == 0 || rate != candidate_) {
+    candidate_ = rate;
+    agreeing_ = rate == 0 ? 0 : 1;
+  } else {
+    ++agreeing_;
+  }
+  return (candidate_ != 0 && agreeing_ >= confirmations_) ? candidate_ : 0;
+}
+
+void RateChangeGate::Rearm(unsigned int nominalRate,
+                           unsigned int requestedRate) {
+  nominal_ = nominalRate;
+  rejected_ = (requestedRate != 0 && requestedRate != nominalRate)
+                  ? requestedRate
+                  : 0;
+}
+
+unsigned int RateChangeGate::Update(unsigned int sourceRate, bool newEvent) {
+  if (newEvent || (sourceRate != 0 && sourceRate != rejected_)) {
+    // The source moved on, or asked again.
+    rejected_ = 0;
+  }
+  if (sourceRate == 0 || sourceRate == nominal_ || sourceRate == rejected_) {
+    return 0;
+  }
+  return sourceRate;
+}
+
+} // namespace totton::audio
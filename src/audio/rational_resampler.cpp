@@ -0,0 +1,205 @@
+#include "audio/rational_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace totton::audio {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+// Taps per phase at the lower of the two rates. With the passband ending at
+// 0.9 and the stopband starting at 1.0 of the lower rate's Nyquist, the
+// Kaiser window below rejects the stopband by about 100 dB. Decimating
+// stretches the kernel by M / L so the transition stays that narrow.
+constexpr std::size_t kBaseTaps = 128;
+constexpr double kCutoff = 0.95;
+constexpr double kKaiserBeta = 10.0;
+// Rows are padded to whole SIMD blocks.
+constexpr std::size_t kTapAlign = 8;
+// Keeps a pathological ratio from building a table of hundreds of MB.
+constexpr std::size_t kMaxTableSize = std::size_t{1} << 22;
+
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  const double halfX = x / 2.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= (halfX / k) * (halfX / k);
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+// n is a multiple of kTapAlign. Two accumulators hide the add latency.
+float DotProduct(const float *a, const float *b, std::size_t n) {
+#if defined(__ARM_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  for (std::size_t i = 0; i < n; i += 8) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  const float32x4_t acc = vaddq_f32(acc0, acc1);
+#if defined(__aarch64__)
+  return vaddvq_f32(acc);
+#else
+  const float32x2_t half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+  return vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+#elif defined(__SSE__)
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (std::size_t i = 0; i < n; i += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                       _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+  }
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, _mm_add_ps(acc0, acc1));
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+  float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (std::size_t i = 0; i < n; i += 4) {
+    for (std::size_t lane = 0; lane < 4; ++lane) {
+      acc[lane] += a[i + lane] * b[i + lane];
+    }
+  }
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+} // namespace
+
+bool RationalResampler::Init(unsigned int channels, unsigned int inputRate,
+                             unsigned int outputRate,
+                             std::string *errorMessage) {
+  if (channels == 0 || inputRate == 0 || outputRate == 0) {
+    if (errorMessage) {
+      *errorMessage = "Resampler needs channels and both rates";
+    }
+    return false;
+  }
+  const unsigned int divisor = std::gcd(inputRate, outputRate);
+  const unsigned int interpolation = outputRate / divisor;
+  const unsigned int decimation = inputRate / divisor;
+  const double stretch =
+      std::max(1.0, static_cast<double>(decimation) / interpolation);
+  const auto minTaps =
+      static_cast<std::size_t>(std::ceil(kBaseTaps * stretch));
+  const std::size_t taps = (minTaps + kTapAlign - 1) / kTapAlign * kTapAlign;
+  if (interpolation > kMaxPhases || interpolation * taps > kMaxTableSize) {
+    if (errorMessage) {
+      *errorMessage = "Cannot resample " + std::to_string(inputRate) +
+                      " Hz to " + std::to_string(outputRate) +
+                      " Hz: ratio " + std::to_string(interpolation) + "/" +
+                      std::to_string(decimation) + " needs too many phases";
+    }
+    return false;
+  }
+
+  channels_ = channels;
+  inputRate_ = inputRate;
+  outputRate_ = outputRate;
+  interpolation_ = interpolation;
+  decimation_ = decimation;
+  taps_ = taps;
+
+  // Prototype lowpass at L times the input rate, cut off below the lower
+  // Nyquist; phase p takes every L-th coefficient starting at p.
+  const std::size_t length = interpolation_ * taps_;
+  const double center = static_cast<double>(length - 1) / 2.0;
+  const double halfWidth = static_cast<double>(length) / 2.0;
+  const double cutoff =
+      kCutoff / static_cast<double>(std::max(interpolation_, decimation_));
+  const double windowScale = BesselI0(kKaiserBeta);
+  table_.assign(length, 0.0f);
+  std::vector<double> row(taps_);
+  for (unsigned int p = 0; p < interpolation_; ++p) {
+    double sum = 0.0;
+    for (std::size_t k = 0; k < taps_; ++k) {
+      const double distance =
+          static_cast<double>(p + k * interpolation_) - center;
+      const double x = distance / halfWidth;
+      const double window =
+          BesselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - x * x))) /
+          windowScale;
+      const double arg = cutoff * distance;
+      const double sinc =
+          (std::abs(arg) < 1e-12) ? 1.0 : std::sin(kPi * arg) / (kPi * arg);
+      row[k] = sinc * window;
+      sum += row[k];
+    }
+    // Unity DC gain for every phase avoids a ripple at the output rate.
+    float *out = &table_[p * taps_];
+    for (std::size_t k = 0; k < taps_; ++k) {
+      out[taps_ - 1 - k] = static_cast<float>(row[k] / sum);
+    }
+  }
+  Reset();
+  return true;
+}
+
+void RationalResampler::Reset() {
+  history_.assign(channels_, std::vector<float>(taps_ - 1, 0.0f));
+  next_ = taps_ - 1;
+  phase_ = 0;
+}
+
+void RationalResampler::Reserve(std::size_t maxFrames) {
+  for (auto &channel : history_) {
+    channel.reserve(maxFrames + taps_);
+  }
+}
+
+bool RationalResampler::Process(const float *input, std::size_t frames,
+                                std::vector<float> *output) {
+  if (channels_ == 0 || !output || (!input && frames > 0)) {
+    return false;
+  }
+  for (unsigned int ch = 0; ch < channels_; ++ch) {
+    auto &channel = history_[ch];
+    const std::size_t offset = channel.size();
+    channel.resize(offset + frames);
+    for (std::size_t i = 0; i < frames; ++i) {
+      channel[offset + i] = input[i * channels_ + ch];
+    }
+  }
+  const std::size_t available = history_.front().size();
+
+  while (next_ < available) {
+    const float *coeffs = &table_[phase_ * taps_];
+    const std::size_t first = next_ + 1 - taps_;
+    const std::size_t offset = output->size();
+    output->resize(offset + channels_);
+    for (unsigned int ch = 0; ch < channels_; ++ch) {
+      (*output)[offset + ch] =
+          DotProduct(coeffs, history_[ch].data() + first, taps_);
+    }
+    phase_ += decimation_;
+    next_ += phase_ / interpolation_;
+    phase_ %= interpolation_;
+  }
+
+  // Keep the taps_ - 1 frames of history the next output still needs. When
+  // decimating, the next output may lie past the end of this call's input.
+  const std::size_t drop = std::min(next_ + 1 - taps_, available);
+  for (auto &channel : history_) {
+    channel.erase(channel.begin(),
+                  channel.begin() + static_cast<std::ptrdiff_t>(drop));
+  }
+  next_ -= drop;
+  return true;
+}
+
+} // namespace totton::audio
@@ -0,0 +1,253 @@
+#include "audio/rt_log.h"
+
+#include "audio/mpsc_queue.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace totton::audio::rtlog {
+
+namespace {
+
+constexpr auto kWriterInterval = std::chrono::milliseconds(20);
+constexpr uint64_t kRateWindowNs = 1000000000ULL;
+
+uint64_t NowNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+// Per-code write budget of kBurstPerSecond records per window of record
+// time. Suppressed records are reported once their window closes.
+class RateLimiter {
+public:
+  void Write(const Record &record, std::ostream &out) {
+    Window &window = windows_[static_cast<std::size_t>(record.code)];
+    if (record.timeNs - window.startNs >= kRateWindowNs) {
+      Summarise(record.code, &window, out);
+      window.startNs = record.timeNs;
+      window.written = 0;
+    }
+    if (window.written < kBurstPerSecond) {
+      out << Format(record) << "\n";
+      ++window.written;
+    } else {
+      ++window.suppressed;
+    }
+  }
+
+  void Flush(std::ostream &out) {
+    for (std::size_t i = 0; i < windows_.size(); ++i) {
+      Summarise(static_cast<Code>(i), &windows_[i], out);
+    }
+  }
+
+private:
+  struct Window {
+    uint64_t startNs = 0;
+    std::size_t written = 0;
+    uint64_t suppressed = 0;
+  };
+
+  static void Summarise(Code code, Window *window, std::ostream &out) {
+    if (window->suppressed > 0) {
+      out << CodeName(code) << ": " << window->suppressed
+          << " similar message(s) suppressed\n";
+      window->suppressed = 0;
+    }
+  }
+
+  std::array<Window, static_cast<std::size_t>(Code::Count)> windows_{};
+};
+
+// Single consumer: only the writer, or a synchronous Post() holding the
+// output mutex, pops.
+MpscQueue<Record, kQueueCapacity> gQueue;
+std::atomic<uint64_t> gDropped{0};
+std::atomic<bool> gWriterRunning{false};
+
+// Guards the consumer side: the rate limiter, the output stream and popping.
+std::mutex gOutputMutex;
+RateLimiter gLimiter;
+uint64_t gReportedDropped = 0;
+
+// Controls the writer thread; producers never touch these.
+std::mutex gWriterMutex;
+std::condition_variable gWriterCv;
+std::thread gWriter;
+std::ostream *gOut = nullptr;
+bool gStopWriter = false;
+
+// Caller holds gOutputMutex.
+void DrainLocked(std::ostream &out) {
+  Record record;
+  while (gQueue.TryPop(&record)) {
+    gLimiter.Write(record, out);
+  }
+  const uint64_t dropped = gDropped.load(std::memory_order_relaxed);
+  if (dropped != gReportedDropped) {
+    out << "Log queue full; " << dropped - gReportedDropped
+        << " message(s) dropped\n";
+    gReportedDropped = dropped;
+  }
+  out.flush();
+}
+
+void WriterLoop() {
+  // Best effort: the writer should never compete with the audio thread.
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+  std::unique_lock<std::mutex> lock(gWriterMutex);
+  while (true) {
+    const bool stopping =
+        gWriterCv.wait_for(lock, kWriterInterval, []() { return gStopWriter; });
+    {
+      std::lock_guard<std::mutex> output(gOutputMutex);
+      DrainLocked(*gOut);
+      if (stopping) {
+        gLimiter.Flush(*gOut);
+        gOut->flush();
+      }
+    }
+    if (stopping) {
+      break;
+    }
+  }
+}
+
+} // namespace
+
+const char *CodeName(Code code) {
+  switch (code) {
+  case Code::InputOverflow:
+    return "input overflow";
+  case Code::OutputOverflow:
+    return "output overflow";
+  case Code::OutputUnderrun:
+    return "output underrun";
+  case Code::XrunRecovered:
+    return "xrun recovered";
+  case Code::RecoverFailed:
+    return "xrun recovery failed";
+  case Code::PcmError:
+    return "pcm error";
+  case Code::VkfftFallback:
+    return "vkfft fallback";
+  case Code::DriftLocked:
+    return "drift locked";
+  case Code::Count:
+    break;
+  }
+  return "unknown";
+}
+
+std::string Format(const Record &record) {
+  const char *detail = record.detail ? record.detail : "";
+  std::ostringstream out;
+  switch (record.code) {
+  case Code::InputOverflow:
+    out << "Input buffer overflow; dropping accumulated audio";
+    break;
+  case Code::OutputOverflow:
+    out << "Output buffer overflow; dropping accumulated audio";
+    break;
+  case Code::OutputUnderrun:
+    out << "Output buffer underrun";
+    break;
+  case Code::XrunRecovered:
+    out << record.text << ": XRUN recovered";
+    break;
+  case Code::RecoverFailed:
+    out << record.text << ": recover failed: " << detail;
+    break;
+  case Code::PcmError:
+    out << record.text << " error: " << detail;
+    break;
+  case Code::VkfftFallback:
+    out << "VkFFT initialization failed; falling back to CPU: " << record.text;
+    break;
+  case Code::DriftLocked:
+    out << std::fixed << std::setprecision(1)
+        << "Drift compensation locked: target "
+        << static_cast<double>(record.arg0) / 1000.0 << " ms";
+    break;
+  case Code::Count:
+    out << "Unknown log record";
+    break;
+  }
+  return out.str();
+}
+
+void Post(Code code, const char *text, const char *detail, int64_t arg0,
+          int64_t arg1) {
+  Record record;
+  record.code = code;
+  record.timeNs = NowNs();
+  record.arg0 = arg0;
+  record.arg1 = arg1;
+  record.detail = detail;
+  if (text) {
+    std::strncpy(record.text, text, kTextBytes - 1);
+  }
+  if (!gWriterRunning.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> output(gOutputMutex);
+    if (!gQueue.TryPush(record)) {
+      gDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    DrainLocked(std::cerr);
+    return;
+  }
+  if (!gQueue.TryPush(record)) {
+    gDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void StartWriter(std::ostream *out) {
+  std::lock_guard<std::mutex> lock(gWriterMutex);
+  if (gWriter.joinable()) {
+    return;
+  }
+  gOut = out ? out : &std::cerr;
+  gStopWriter = false;
+  gWriter = std::thread(WriterLoop);
+  gWriterRunning.store(true, std::memory_order_release);
+}
+
+void StopWriter() {
+  {
+    std::lock_guard<std::mutex> lock(gWriterMutex);
+    if (!gWriter.joinable()) {
+      return;
+    }
+    // New records go out synchronously from here on.
+    gWriterRunning.store(false, std::memory_order_release);
+    gStopWriter = true;
+  }
+  gWriterCv.notify_one();
+  gWriter.join();
+  // A record posted while the writer was shutting down may still be queued.
+  std::lock_guard<std::mutex> output(gOutputMutex);
+  DrainLocked(*gOut);
+  gOut = nullptr;
+}
+
+bool WriterRunning() {
+  return gWriterRunning.load(std::memory_order_acquire);
+}
+
+uint64_t DroppedCount() { return gDropped.load(std::memory_order_relaxed); }
+
+} // namespace totton::audio::rtlog
@@ -0,0 +1,69 @@
+#include "audio/soft_gain.h"
+
+#include <algorithm>
+
+namespace totton::audio {
+
+namespace {
+
+// Gain change per frame that ramps between silence and unity in 10 ms.
+float RampStep(unsigned int rate) {
+  return 1.0f / static_cast<float>(std::max(rate / 100, 1u));
+}
+
+} // namespace
+
+SoftGain::SoftGain(unsigned int channels, unsigned int rate,
+                   std::size_t holdFrames)
+    : channels_(channels), step_(RampStep(rate)), holdFrames_(holdFrames) {}
+
+void SoftGain::Apply(ControlCommand command) {
+  switch (command) {
+  case ControlCommand::Mute:
+    muted_ = true;
+    break;
+  case ControlCommand::Unmute:
+    muted_ = false;
+    break;
+  case ControlCommand::SoftReset:
+    resetPending_ = true;
+    silentFrames_ = 0;
+    break;
+  }
+}
+
+void SoftGain::Restart(unsigned int rate, std::size_t holdFrames) {
+  step_ = RampStep(rate);
+  holdFrames_ = holdFrames;
+  gain_ = 0.0f;
+  resetPending_ = false;
+  silentFrames_ = 0;
+}
+
+bool SoftGain::Process(float *samples, std::size_t frames) {
+  if (IsUnity()) {
+    return false;
+  }
+  const float target = Target();
+  for (std::size_t i = 0; i < frames; ++i) {
+    if (gain_ < target) {
+      gain_ = std::min(target, gain_ + step_);
+    } else if (gain_ > target) {
+      gain_ = std::max(target, gain_ - step_);
+    }
+    if (gain_ == 0.0f) {
+      ++silentFrames_;
+    }
+    float *frame = samples + i * channels_;
+    for (unsigned int ch = 0; ch < channels_; ++ch) {
+      frame[ch] *= gain_;
+    }
+  }
+  if (resetPending_ && silentFrames_ >= holdFrames_) {
+    resetPending_ = false;
+    return true;
+  }
+  return false;
+}
+
+} // namespace totton::audio
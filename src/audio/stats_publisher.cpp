@@ -0,0 +1,57 @@
+#include "audio/stats_publisher.h"
+
+#include "audio/trace.h"
+
+#include <iostream>
+#include <utility>
+
+namespace totton::audio {
+
+StatsPublisher::StatsPublisher(const MetricsRegistry &registry,
+                               std::string path, std::string tracePath,
+                               std::chrono::milliseconds interval)
+    : registry_(registry), path_(std::move(path)),
+      tracePath_(std::move(tracePath)), interval_(interval) {}
+
+StatsPublisher::~StatsPublisher() { Stop(); }
+
+void StatsPublisher::Start() {
+  thread_ = std::thread([this]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool reported = false;
+    while (true) {
+      const bool stopping =
+          cv_.wait_for(lock, interval_, [this]() { return stop_; });
+      std::string error;
+      if (!registry_.WriteStatsFile(path_, &error) && !reported) {
+        std::cerr << "Stats file disabled: " << error << "\n";
+        reported = true;
+      }
+      if (!tracePath_.empty()) {
+        if (!trace::DumpIfRequested(tracePath_, &error)) {
+          std::cerr << error << "\n";
+        }
+      }
+      if (housekeeping_) {
+        housekeeping_();
+      }
+      if (stopping) {
+        break;
+      }
+    }
+  });
+}
+
+void StatsPublisher::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+} // namespace totton::audio
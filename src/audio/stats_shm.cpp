@@ -0,0 +1,235 @@
+#include "audio/stats_shm.h"
+
+#include "audio/metrics_registry.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace totton::audio {
+namespace {
+
+constexpr std::size_t kPayloadWords = sizeof(StatsShmPayload) / 8;
+constexpr std::size_t kSegmentBytes =
+    sizeof(StatsShmHeader) + sizeof(StatsShmPayload);
+
+StatsShmHeader *HeaderOf(void *base) {
+  return static_cast<StatsShmHeader *>(base);
+}
+
+const StatsShmHeader *HeaderOf(const void *base) {
+  return static_cast<const StatsShmHeader *>(base);
+}
+
+uint64_t *PayloadWords(void *base) {
+  return reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(base) +
+                                      sizeof(StatsShmHeader));
+}
+
+const uint64_t *PayloadWords(const void *base) {
+  return reinterpret_cast<const uint64_t *>(
+      static_cast<const uint8_t *>(base) + sizeof(StatsShmHeader));
+}
+
+// The payload is shared with other processes, so it is copied with relaxed
+// word-sized atomics rather than memcpy: the seqlock only has to detect a
+// torn copy, never make a racy one well-defined.
+void StoreWords(uint64_t *dst, const uint64_t *src) {
+  for (std::size_t i = 0; i < kPayloadWords; ++i) {
+    __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+  }
+}
+
+void LoadWords(uint64_t *dst, const uint64_t *src) {
+  for (std::size_t i = 0; i < kPayloadWords; ++i) {
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  }
+}
+
+void SetError(std::string *errorMessage, const std::string &message) {
+  if (errorMessage) {
+    *errorMessage = message + ": " + std::strerror(errno);
+  }
+}
+
+StatsShmTiming ToTiming(const LatencyHistogram::Snapshot &snapshot) {
+  return StatsShmTiming{snapshot.count, snapshot.sumNs, snapshot.maxNs,
+                        snapshot.PercentileNs(0.99)};
+}
+
+StatsShmFill ToFill(const FillWatermark::Snapshot &fill) {
+  return StatsShmFill{fill.current, fill.low, fill.high, fill.capacity};
+}
+
+} // namespace
+
+void FillStatsShmPayload(const MetricsRegistry &metrics,
+                         StatsShmPayload *payload) {
+  static_assert(sizeof(payload->stages) / sizeof(payload->stages[0]) ==
+                    static_cast<std::size_t>(Stage::Count),
+                "one timing slot per stage");
+  static_assert(sizeof(payload->gpu) / sizeof(payload->gpu[0]) ==
+                    static_cast<std::size_t>(GpuTiming::Count),
+                "one timing slot per GPU timing");
+  payload->timestampNs = MonotonicNs();
+  payload->inputRate = metrics.InputRate();
+  payload->outputRate = metrics.OutputRate();
+  std::memset(payload->mode, 0, sizeof(payload->mode));
+  std::strncpy(payload->mode, metrics.Mode(), sizeof(payload->mode) - 1);
+  payload->captureXruns = metrics.CaptureXrunCount();
+  payload->playbackXruns = metrics.PlaybackXrunCount();
+  payload->deadlineMisses = metrics.DeadlineMissCount();
+  payload->deadlineNs = metrics.DeadlineNs();
+  payload->cycle = ToTiming(metrics.ReadCycle());
+  for (std::size_t i = 0; i < static_cast<std::size_t>(Stage::Count); ++i) {
+    payload->stages[i] = ToTiming(metrics.ReadStage(static_cast<Stage>(i)));
+  }
+  payload->inputFill = ToFill(metrics.InputFill().Read());
+  payload->outputFill = ToFill(metrics.OutputFill().Read());
+  for (std::size_t i = 0; i < static_cast<std::size_t>(GpuTiming::Count);
+       ++i) {
+    payload->gpu[i] = ToTiming(metrics.ReadGpu(static_cast<GpuTiming>(i)));
+  }
+}
+
+StatsShmWriter::~StatsShmWriter() { Close(); }
+
+bool StatsShmWriter::Open(const std::string &name, std::string *errorMessage) {
+  Close();
+  const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    SetError(errorMessage, "shm_open " + name);
+    return false;
+  }
+  if (ftruncate(fd, static_cast<off_t>(kSegmentBytes)) != 0) {
+    SetError(errorMessage, "ftruncate " + name);
+    close(fd);
+    return false;
+  }
+  void *base = mmap(nullptr, kSegmentBytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    SetError(errorMessage, "mmap " + name);
+    return false;
+  }
+
+  // A leftover segment from a previous run may have readers attached: mark
+  // it busy while the header is rewritten, then start a fresh even count.
+  StatsShmHeader *header = HeaderOf(base);
+  __atomic_store_n(&header->sequence, uint64_t{1}, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  header->magic = kStatsShmMagic;
+  header->version = kStatsShmVersion;
+  header->payloadOffset = sizeof(StatsShmHeader);
+  header->payloadBytes = sizeof(StatsShmPayload);
+  const StatsShmPayload empty{};
+  StoreWords(PayloadWords(base), reinterpret_cast<const uint64_t *>(&empty));
+  __atomic_store_n(&header->sequence, uint64_t{2}, __ATOMIC_RELEASE);
+
+  name_ = name;
+  base_ = base;
+  size_ = kSegmentBytes;
+  updates_ = 0;
+  return true;
+}
+
+void StatsShmWriter::Close() {
+  if (!base_) {
+    return;
+  }
+  munmap(base_, size_);
+  shm_unlink(name_.c_str());
+  base_ = nullptr;
+  size_ = 0;
+}
+
+void StatsShmWriter::Publish(const StatsShmPayload &payload) {
+  if (!base_) {
+    return;
+  }
+  StatsShmHeader *header = HeaderOf(base_);
+  const uint64_t sequence =
+      __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  StatsShmPayload stamped = payload;
+  stamped.updateCount = ++updates_;
+  StoreWords(PayloadWords(base_),
+             reinterpret_cast<const uint64_t *>(&stamped));
+  __atomic_store_n(&header->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+StatsShmReader::~StatsShmReader() { Close(); }
+
+bool StatsShmReader::Open(const std::string &name, std::string *errorMessage) {
+  Close();
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    SetError(errorMessage, "shm_open " + name);
+    return false;
+  }
+  struct stat info {};
+  if (fstat(fd, &info) != 0 ||
+      static_cast<std::size_t>(info.st_size) < kSegmentBytes) {
+    if (errorMessage) {
+      *errorMessage = name + ": segment too small";
+    }
+    close(fd);
+    return false;
+  }
+  void *base = mmap(nullptr, kSegmentBytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    SetError(errorMessage, "mmap " + name);
+    return false;
+  }
+  const StatsShmHeader *header = HeaderOf(static_cast<const void *>(base));
+  if (header->magic != kStatsShmMagic || header->version != kStatsShmVersion ||
+      header->payloadBytes != sizeof(StatsShmPayload)) {
+    if (errorMessage) {
+      *errorMessage = name + ": unsupported stats layout";
+    }
+    munmap(base, kSegmentBytes);
+    return false;
+  }
+  base_ = base;
+  size_ = kSegmentBytes;
+  return true;
+}
+
+void StatsShmReader::Close() {
+  if (!base_) {
+    return;
+  }
+  munmap(const_cast<void *>(base_), size_);
+  base_ = nullptr;
+  size_ = 0;
+}
+
+bool StatsShmReader::Read(StatsShmPayload *payload, int maxAttempts) const {
+  if (!base_ || !payload) {
+    return false;
+  }
+  const StatsShmHeader *header = HeaderOf(base_);
+  for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+    const uint64_t before =
+        __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      continue;
+    }
+    LoadWords(reinterpret_cast<uint64_t *>(payload), PayloadWords(base_));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const uint64_t after = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+    if (before == after) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace totton::audio
@@ -0,0 +1,201 @@
+#include "audio/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace totton::audio::trace {
+
+namespace detail {
+std::atomic<bool> gEnabled{false};
+
+uint64_t NowNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+} // namespace detail
+
+namespace {
+
+// Fields are relaxed atomics so a dump can run while the owner records;
+// the head index tells the reader which slots may have been overwritten.
+struct Event {
+  std::atomic<const char *> name{nullptr};
+  std::atomic<uint64_t> beginNs{0};
+  std::atomic<uint64_t> endNs{0};
+};
+
+struct ThreadBuffer {
+  ThreadBuffer(std::size_t capacity, long tid) : events(capacity), tid(tid) {}
+
+  std::vector<Event> events;
+  std::atomic<uint64_t> head{0};
+  std::string name;
+  long tid;
+};
+
+struct Span {
+  const char *name;
+  uint64_t beginNs;
+  uint64_t endNs;
+};
+
+std::atomic<std::size_t> gCapacity{0};
+std::atomic<bool> gDumpRequested{false};
+// Guards registration and dumping only; recording never takes it. Buffers
+// outlive their threads so late dumps still see them.
+std::mutex gRegistryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> gBuffers;
+thread_local ThreadBuffer *tBuffer = nullptr;
+
+ThreadBuffer *ThisThreadBuffer() {
+  if (tBuffer) {
+    return tBuffer;
+  }
+  const std::size_t capacity = gCapacity.load(std::memory_order_relaxed);
+  if (capacity == 0) {
+    return nullptr;
+  }
+  auto buffer = std::make_unique<ThreadBuffer>(
+      capacity, static_cast<long>(syscall(SYS_gettid)));
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  tBuffer = buffer.get();
+  gBuffers.push_back(std::move(buffer));
+  return tBuffer;
+}
+
+// Copies the spans still intact in buffer, oldest first.
+void CollectSpans(const ThreadBuffer &buffer, std::vector<Span> *spans) {
+  const uint64_t capacity = buffer.events.size();
+  const uint64_t head = buffer.head.load(std::memory_order_acquire);
+  const uint64_t first = head > capacity ? head - capacity : 0;
+  std::vector<Span> copied;
+  copied.reserve(static_cast<std::size_t>(head - first));
+  for (uint64_t i = first; i < head; ++i) {
+    const Event &event = buffer.events[i % capacity];
+    copied.push_back(Span{event.name.load(std::memory_order_relaxed),
+                          event.beginNs.load(std::memory_order_relaxed),
+                          event.endNs.load(std::memory_order_relaxed)});
+  }
+  // Anything the writer lapped while we copied is unreliable.
+  const uint64_t after = buffer.head.load(std::memory_order_acquire);
+  const uint64_t valid = after > capacity ? after - capacity : 0;
+  const uint64_t skip = valid > first ? valid - first : 0;
+  for (uint64_t i = std::min<uint64_t>(skip, copied.size()); i < copied.size();
+       ++i) {
+    if (copied[i].name) {
+      spans->push_back(copied[i]);
+    }
+  }
+}
+
+void WriteEscaped(std::ostream &out, const std::string &value) {
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out << '\\';
+    }
+    out << c;
+  }
+}
+
+} // namespace
+
+void Enable(std::size_t eventsPerThread) {
+  gCapacity.store(std::max<std::size_t>(eventsPerThread, 1),
+                  std::memory_order_relaxed);
+  detail::gEnabled.store(true, std::memory_order_relaxed);
+}
+
+void Disable() { detail::gEnabled.store(false, std::memory_order_relaxed); }
+
+void RegisterThread(const char *name) {
+  ThreadBuffer *buffer = ThisThreadBuffer();
+  if (buffer && name) {
+    std::lock_guard<std::mutex> lock(gRegistryMutex);
+    buffer->name = name;
+  }
+}
+
+void Record(const char *name, uint64_t beginNs, uint64_t endNs) {
+  if (!Enabled()) {
+    return;
+  }
+  ThreadBuffer *buffer = tBuffer ? tBuffer : ThisThreadBuffer();
+  if (!buffer) {
+    return;
+  }
+  const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  Event &event = buffer->events[head % buffer->events.size()];
+  event.name.store(name, std::memory_order_relaxed);
+  event.beginNs.store(beginNs, std::memory_order_relaxed);
+  event.endNs.store(endNs, std::memory_order_relaxed);
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void RequestDump() {
+  gDumpRequested.store(true, std::memory_order_relaxed);
+}
+
+bool DumpIfRequested(const std::string &path, std::string *errorMessage) {
+  if (!gDumpRequested.exchange(false, std::memory_order_relaxed)) {
+    return true;
+  }
+  return Dump(path, errorMessage);
+}
+
+bool Dump(const std::string &path, std::string *errorMessage) {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) {
+    if (errorMessage) {
+      *errorMessage = "Failed to open trace file: " + path;
+    }
+    return false;
+  }
+
+  const long pid = static_cast<long>(getpid());
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  std::vector<Span> spans;
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  for (const auto &buffer : gBuffers) {
+    if (!buffer->name.empty()) {
+      out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\","
+          << "\"pid\":" << pid << ",\"tid\":" << buffer->tid
+          << ",\"args\":{\"name\":\"";
+      WriteEscaped(out, buffer->name);
+      out << "\"}}";
+      first = false;
+    }
+    spans.clear();
+    CollectSpans(*buffer, &spans);
+    for (const Span &span : spans) {
+      out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":\"";
+      WriteEscaped(out, span.name);
+      out << "\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+          << ",\"ts\":" << static_cast<double>(span.beginNs) / 1000.0
+          << ",\"dur\":"
+          << static_cast<double>(span.endNs - span.beginNs) / 1000.0 << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  if (!out) {
+    if (errorMessage) {
+      *errorMessage = "Failed to write trace file: " + path;
+    }
+    return false;
+  }
+  return true;
+}
+
+} // namespace totton::audio::trace
@@ -7,7 +7,13 @@
 
 #include <algorithm>
 #include <alsa/asoundlib.h>
+#include <cerrno>
 #include <cstdlib>
+#include <fcntl.h>
+#include <limits>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 namespace DacCapability {
 
@@ -33,22 +39,70 @@ void AppendUnique(std::vector<DeviceOption> &devices, const std::string &value,
   }
 }
 
-std::vector<DeviceOption> BuildDeviceOptions() {
-  std::vector<DeviceOption> devices;
-  AppendUnique(devices, "default", "default (system default)");
+struct FormatEntry {
+  SampleFormat format;
+  snd_pcm_format_t alsa;
+  const char *name;
+};
 
-  int card = -1;
-  while (snd_card_next(&card) >= 0 && card >= 0) {
-    const std::string cardName = GetCardLongName(card);
-    const std::string cardLabel =
-        cardName.empty() ? ("Card " + std::to_string(card)) : cardName;
-    const std::string hwValue = "hw:" + std::to_string(card);
-    const std::string plughwValue = "plughw:" + std::to_string(card);
-    AppendUnique(devices, hwValue, cardLabel + " (" + hwValue + ")");
-    AppendUnique(devices, plughwValue, cardLabel + " (" + plughwValue + ")");
+constexpr FormatEntry kFormats[] = {
+    {SampleFormat::S16_LE, SND_PCM_FORMAT_S16_LE, "S16_LE"},
+    {SampleFormat::S24_3LE, SND_PCM_FORMAT_S24_3LE, "S24_3LE"},
+    {SampleFormat::S24_LE, SND_PCM_FORMAT_S24_LE, "S24_LE"},
+    {SampleFormat::S32_LE, SND_PCM_FORMAT_S32_LE, "S32_LE"},
+    {SampleFormat::FLOAT_LE, SND_PCM_FORMAT_FLOAT_LE, "FLOAT_LE"},
+};
+
+// udev creates a card's nodes one at a time; wait for the burst to end.
+constexpr int kHotplugSettleMs = 200;
+// Re-enumeration interval when inotify cannot watch the directory.
+constexpr int kFallbackRefreshMs = 2000;
+
+void AppendCardEntries(std::vector<DeviceOption> &devices,
+                       const std::string &target, const std::string &label) {
+  const std::string hwValue = "hw:" + target;
+  const std::string plughwValue = "plughw:" + target;
+  AppendUnique(devices, hwValue, label + " (" + hwValue + ")");
+  AppendUnique(devices, plughwValue, label + " (" + plughwValue + ")");
+}
+
+// Lists each PCM device of card under the directions it actually has.
+// Device 0 keeps the short "hw:N" name.
+void AppendCardDevices(int card, const std::string &cardLabel,
+                       DeviceList *list) {
+  const std::string cardId = std::to_string(card);
+  snd_ctl_t *ctl = nullptr;
+  if (snd_ctl_open(&ctl, ("hw:" + cardId).c_str(), 0) < 0) {
+    // No control interface to ask; offer the card both ways.
+    AppendCardEntries(list->playback, cardId, cardLabel);
+    AppendCardEntries(list->capture, cardId, cardLabel);
+    return;
   }
 
-  return devices;
+  snd_pcm_info_t *info = nullptr;
+  snd_pcm_info_alloca(&info);
+  int device = -1;
+  while (snd_ctl_pcm_next_device(ctl, &device) >= 0 && device >= 0) {
+    const std::string target =
+        device == 0 ? cardId : cardId + "," + std::to_string(device);
+    for (auto stream : {SND_PCM_STREAM_PLAYBACK, SND_PCM_STREAM_CAPTURE}) {
+      snd_pcm_info_set_device(info, static_cast<unsigned int>(device));
+      snd_pcm_info_set_subdevice(info, 0);
+      snd_pcm_info_set_stream(info, stream);
+      if (snd_ctl_pcm_info(ctl, info) < 0) {
+        continue; // Not available in this direction.
+      }
+      std::string label = cardLabel;
+      const char *pcmName = snd_pcm_info_get_name(info);
+      if (device > 0 && pcmName && *pcmName) {
+        label += ": " + std::string(pcmName);
+      }
+      AppendCardEntries(stream == SND_PCM_STREAM_PLAYBACK ? list->playback
+                                                          : list->capture,
+                        target, label);
+    }
+  }
+  snd_ctl_close(ctl);
 }
 
 } // namespace
@@ -98,8 +152,11 @@ Capability scan(const std::string &device) {
     return cap;
   }
 
-  cap.minSampleRate = static_cast<int>(minRate);
-  cap.maxSampleRate = static_cast<int>(maxRate);
+  // Plugins without a rate constraint (null, plug) report UINT_MAX.
+  const unsigned int rateLimit =
+      static_cast<unsigned int>(std::numeric_limits<int>::max());
+  cap.minSampleRate = static_cast<int>(std::min(minRate, rateLimit));
+  cap.maxSampleRate = static_cast<int>(std::min(maxRate, rateLimit));
 
   unsigned int maxChannels;
   err = snd_pcm_hw_params_get_channels_max(params, &maxChannels);
@@ -107,6 +164,49 @@ Capability scan(const std::string &device) {
     cap.maxChannels = static_cast<int>(maxChannels);
   }
 
+  unsigned int minChannels;
+  err = snd_pcm_hw_params_get_channels_min(params, &minChannels);
+  if (err >= 0) {
+    cap.minChannels = static_cast<int>(minChannels);
+  }
+
+  snd_pcm_format_mask_t *formatMask = nullptr;
+  snd_pcm_format_mask_alloca(&formatMask);
+  snd_pcm_hw_params_get_format_mask(params, formatMask);
+  for (const auto &entry : kFormats) {
+    if (snd_pcm_format_mask_test(formatMask, entry.alsa)) {
+      cap.formats.push_back(entry.format);
+    }
+  }
+
+  cap.rwInterleaved = snd_pcm_hw_params_test_access(
+                          pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED) == 0;
+  cap.mmapInterleaved = snd_pcm_hw_params_test_access(
+                            pcm, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+
+  snd_pcm_uframes_t frames;
+  if (snd_pcm_hw_params_get_period_size_min(params, &frames, &dir) >= 0) {
+    cap.minPeriodFrames = frames;
+  }
+  if (snd_pcm_hw_params_get_period_size_max(params, &frames, &dir) >= 0) {
+    cap.maxPeriodFrames = frames;
+  }
+  if (snd_pcm_hw_params_get_buffer_size_min(params, &frames) >= 0) {
+    cap.minBufferFrames = frames;
+  }
+  if (snd_pcm_hw_params_get_buffer_size_max(params, &frames) >= 0) {
+    cap.maxBufferFrames = frames;
+  }
+
+  // Driver info flags; they do not depend on the rest of the configuration.
+  cap.isBatch = snd_pcm_hw_params_is_batch(params) == 1;
+  cap.isBlockTransfer = snd_pcm_hw_params_is_block_transfer(params) == 1;
+  cap.isDouble = snd_pcm_hw_params_is_double(params) == 1;
+  cap.isJointDuplex = snd_pcm_hw_params_is_joint_duplex(params) == 1;
+  cap.canPause = snd_pcm_hw_params_can_pause(params) == 1;
+  cap.canResume = snd_pcm_hw_params_can_resume(params) == 1;
+  cap.canSyncStart = snd_pcm_hw_params_can_sync_start(params) == 1;
+
   // Test common high-resolution audio sample rates
   const int testRates[] = {44100,  48000,  88200,  96000,  176400,  192000,
                            352800, 384000, 705600, 768000, 1411200, 1536000};
@@ -126,9 +226,163 @@ Capability scan(const std::string &device) {
   return cap;
 }
 
-std::vector<DeviceOption> listPlaybackDevices() { return BuildDeviceOptions(); }
+DeviceList enumerateDevices() {
+  DeviceList list;
+  AppendUnique(list.playback, "default", "default (system default)");
+  AppendUnique(list.capture, "default", "default (system default)");
+
+  int card = -1;
+  while (snd_card_next(&card) >= 0 && card >= 0) {
+    const std::string cardName = GetCardLongName(card);
+    const std::string cardLabel =
+        cardName.empty() ? ("Card " + std::to_string(card)) : cardName;
+    AppendCardDevices(card, cardLabel, &list);
+  }
+
+  return list;
+}
+
+std::vector<DeviceOption> listPlaybackDevices() {
+  return DeviceRegistry::instance().devices().playback;
+}
+
+std::vector<DeviceOption> listCaptureDevices() {
+  return DeviceRegistry::instance().devices().capture;
+}
+
+DeviceRegistry &DeviceRegistry::instance() {
+  static DeviceRegistry registry;
+  return registry;
+}
+
+DeviceRegistry::~DeviceRegistry() { stopWatching(); }
+
+bool DeviceRegistry::startWatching(const std::string &directory) {
+  if (watching()) {
+    return true;
+  }
+  if (::pipe2(wakePipe_, O_CLOEXEC | O_NONBLOCK) != 0) {
+    return false;
+  }
+  int inotifyFd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (inotifyFd >= 0 &&
+      ::inotify_add_watch(inotifyFd, directory.c_str(),
+                          IN_CREATE | IN_DELETE | IN_MOVED_TO |
+                              IN_MOVED_FROM) < 0) {
+    ::close(inotifyFd);
+    inotifyFd = -1;
+  }
+  // Nothing invalidated the cache while no one was watching.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capabilities_.clear();
+  }
+  refresh();
+  watching_.store(true);
+  watcher_ = std::thread([this, inotifyFd]() { watchLoop(inotifyFd); });
+  return true;
+}
+
+void DeviceRegistry::stopWatching() {
+  if (!watcher_.joinable()) {
+    return;
+  }
+  const char byte = 0;
+  (void)!::write(wakePipe_[1], &byte, 1);
+  watcher_.join();
+  watching_.store(false);
+  ::close(wakePipe_[0]);
+  ::close(wakePipe_[1]);
+  wakePipe_[0] = wakePipe_[1] = -1;
+}
+
+DeviceList DeviceRegistry::devices() {
+  if (!watching()) {
+    DeviceList list = enumerateDevices();
+    std::lock_guard<std::mutex> lock(mutex_);
+    devices_ = list;
+    return list;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return devices_;
+}
+
+Capability DeviceRegistry::capability(const std::string &device) {
+  if (watching()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = capabilities_.find(device);
+    if (it != capabilities_.end()) {
+      return it->second;
+    }
+  }
+  // Opening the device can block on a slow bus; never under the lock.
+  Capability cap = scan(device);
+  if (cap.isValid && watching()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capabilities_[device] = cap;
+  }
+  return cap;
+}
+
+void DeviceRegistry::refresh() {
+  DeviceList list = enumerateDevices();
+  std::lock_guard<std::mutex> lock(mutex_);
+  devices_ = std::move(list);
+}
+
+void DeviceRegistry::watchLoop(int inotifyFd) {
+  pollfd fds[2] = {{wakePipe_[0], POLLIN, 0}, {inotifyFd, POLLIN, 0}};
+  const nfds_t count = inotifyFd >= 0 ? 2 : 1;
+  const int timeoutMs = inotifyFd >= 0 ? -1 : kFallbackRefreshMs;
+  char buffer[4096];
+  while (true) {
+    const int ready = ::poll(fds, count, timeoutMs);
+    if (ready < 0 && errno != EINTR) {
+      break;
+    }
+    if (fds[0].revents & POLLIN) {
+      break;
+    }
+    if (ready > 0 && count == 2 && (fds[1].revents & POLLIN)) {
+      // Drain the burst; only "something changed" matters.
+      do {
+        while (::read(inotifyFd, buffer, sizeof(buffer)) > 0) {
+        }
+      } while (::poll(&fds[1], 1, kHotplugSettleMs) > 0);
+    } else if (ready != 0) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      capabilities_.clear();
+    }
+    refresh();
+    generation_.fetch_add(1);
+  }
+  if (inotifyFd >= 0) {
+    ::close(inotifyFd);
+  }
+}
+
+const char *sampleFormatName(SampleFormat format) {
+  for (const auto &entry : kFormats) {
+    if (entry.format == format) {
+      return entry.name;
+    }
+  }
+  return "UNKNOWN";
+}
 
-std::vector<DeviceOption> listCaptureDevices() { return BuildDeviceOptions(); }
+bool isFormatSupported(const Capability &cap, SampleFormat format) {
+  if (!cap.isValid) {
+    return false;
+  }
+  if (cap.formats.empty()) {
+    return true;
+  }
+  return std::find(cap.formats.begin(), cap.formats.end(), format) !=
+         cap.formats.end();
+}
 
 bool isRateSupported(const Capability &cap, int sampleRate) {
   if (!cap.isValid) {
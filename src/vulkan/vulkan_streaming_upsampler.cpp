@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -10,6 +12,8 @@
 #include <string>
 #include <system_error>
 
+#include "audio/rt_log.h"
+#include "audio/trace.h"
 #include "fft_utils.h"
 
 #if defined(ENABLE_VULKAN) && defined(USE_VKFFT)
@@ -21,6 +25,15 @@
 namespace totton::vulkan {
 namespace {
 
+// Spectrum band marker for bins below the lowest band.
+constexpr uint16_t kNoBand = 0xFFFF;
+constexpr double kSpectrumLowestHz = 20.0;
+// 16x from a 1x kernel.
+constexpr std::size_t kMaxHalfbandStages = 4;
+// Half-band taps that must be zero or mirror each other may differ by this
+// much relative to the centre tap (float rounding of the designed filter).
+constexpr float kHalfbandTolerance = 1e-5f;
+
 bool ExtractJsonString(const std::string &json, const std::string &key,
                        std::string *out) {
   const std::string pattern = "\"" + key + "\"";
@@ -72,6 +85,49 @@ bool ExtractJsonUnsigned(const std::string &json, const std::string &key,
   return true;
 }
 
+// Collects the text of each object in the array under key and removes the
+// array from *json, so top-level keys are not matched inside it. A missing
+// key is an empty array. Objects must not nest.
+bool ExtractJsonObjects(std::string *json, const std::string &key,
+                        std::vector<std::string> *objects) {
+  objects->clear();
+  const std::string pattern = "\"" + key + "\"";
+  const std::size_t start = json->find(pattern);
+  if (start == std::string::npos) {
+    return true;
+  }
+  const std::size_t open = json->find('[', start + pattern.size());
+  const std::size_t close =
+      open == std::string::npos ? open : json->find(']', open);
+  if (close == std::string::npos) {
+    return false;
+  }
+  std::size_t pos = open;
+  while (true) {
+    const std::size_t begin = json->find('{', pos);
+    if (begin == std::string::npos || begin > close) {
+      break;
+    }
+    const std::size_t end = json->find('}', begin);
+    if (end == std::string::npos || end > close) {
+      return false;
+    }
+    objects->push_back(json->substr(begin, end - begin + 1));
+    pos = end + 1;
+  }
+  json->erase(start, close - start + 1);
+  return true;
+}
+
+std::filesystem::path ResolveBin(const std::filesystem::path &jsonPath,
+                                 const std::string &binPath) {
+  std::filesystem::path bin = binPath;
+  if (!bin.is_absolute()) {
+    bin = jsonPath.parent_path() / bin;
+  }
+  return bin;
+}
+
 std::string ReadFileToString(const std::filesystem::path &path) {
   std::ifstream file(path);
   if (!file) {
@@ -89,6 +145,20 @@ std::string BuildError(const std::string &message, const std::string &detail) {
   return message + ": " + detail;
 }
 
+uint64_t ElapsedNs(std::chrono::steady_clock::time_point from,
+                   std::chrono::steady_clock::time_point to) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+// Same clock and epoch as totton::audio::trace timestamps.
+uint64_t SinceEpochNs(std::chrono::steady_clock::time_point at) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          at.time_since_epoch())
+          .count());
+}
+
 } // namespace
 
 #if defined(ENABLE_VULKAN) && defined(USE_VKFFT)
@@ -127,6 +197,18 @@ bool FindComputeQueueFamily(VkPhysicalDevice device, uint32_t *index) {
   return false;
 }
 
+uint32_t TimestampValidBits(VkPhysicalDevice device, uint32_t queueFamily) {
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                           queueFamilies.data());
+  if (queueFamily >= queueFamilyCount) {
+    return 0;
+  }
+  return queueFamilies[queueFamily].timestampValidBits;
+}
+
 int DeviceTypeRank(VkPhysicalDeviceType type) {
   switch (type) {
   case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
@@ -161,8 +243,21 @@ struct VulkanStreamingUpsampler::VkfftContext {
   VkFFTApplication app = VKFFT_ZERO_INIT;
   VkFFTConfiguration config = VKFFT_ZERO_INIT;
   VkFFTLaunchParams launchParams = VKFFT_ZERO_INIT;
+  // Two timestamps bracket each dispatch; VK_NULL_HANDLE when the queue
+  // family cannot write timestamps.
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  double timestampPeriodNs = 0.0;
+  uint64_t timestampMask = 0;
+  // Timing of the last Execute(): device time between the two timestamps
+  // and host time from vkQueueSubmit to the fence wait returning.
+  // lastGpuTimed is false when the timestamps could not be read back.
+  uint64_t lastGpuNs = 0;
+  uint64_t lastSubmitNs = 0;
+  bool lastGpuTimed = false;
   bool initialized = false;
 
+  bool HasTimestamps() const { return queryPool != VK_NULL_HANDLE; }
+
   ~VkfftContext() { Destroy(); }
 
   bool Initialize(std::size_t fftSize, std::string *errorMessage) {
@@ -269,6 +364,31 @@ struct VulkanStreamingUpsampler::VkfftContext {
       return fail("Failed to create Vulkan fence");
     }
 
+    // Timing is diagnostics only: without timestamp support the FFT still
+    // runs, it just reports no GPU time.
+    const uint32_t validBits =
+        TimestampValidBits(physicalDevice, queueFamilyIndex);
+    if (validBits > 0 && selectedProps.limits.timestampPeriod > 0.0f) {
+      VkQueryPoolCreateInfo queryInfo{};
+      queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      queryInfo.queryCount = 2;
+      if (vkCreateQueryPool(device, &queryInfo, nullptr, &queryPool) ==
+          VK_SUCCESS) {
+        timestampPeriodNs =
+            static_cast<double>(selectedProps.limits.timestampPeriod);
+        timestampMask =
+            validBits >= 64 ? UINT64_MAX : (uint64_t{1} << validBits) - 1;
+      } else {
+        queryPool = VK_NULL_HANDLE;
+        std::cerr << "Warning: Vulkan timestamp query pool unavailable; GPU "
+                     "timing disabled.\n";
+      }
+    } else {
+      std::cerr << "Vulkan queue has no timestamp support; GPU timing "
+                   "disabled.\n";
+    }
+
     bufferSize = static_cast<uint64_t>(sizeof(float) * 2 * fftSize);
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -353,6 +473,10 @@ struct VulkanStreamingUpsampler::VkfftContext {
       vkFreeMemory(device, bufferMemory, nullptr);
       bufferMemory = VK_NULL_HANDLE;
     }
+    if (queryPool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device, queryPool, nullptr);
+      queryPool = VK_NULL_HANDLE;
+    }
     if (fence != VK_NULL_HANDLE) {
       vkDestroyFence(device, fence, nullptr);
       fence = VK_NULL_HANDLE;
@@ -391,6 +515,11 @@ struct VulkanStreamingUpsampler::VkfftContext {
       return false;
     }
 
+    if (HasTimestamps()) {
+      vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                          queryPool, 0);
+    }
     launchParams.commandBuffer = &commandBuffer;
     VkFFTResult res = VkFFTAppend(&app, direction, &launchParams);
     if (res != VKFFT_SUCCESS) {
@@ -399,6 +528,10 @@ struct VulkanStreamingUpsampler::VkfftContext {
       }
       return false;
     }
+    if (HasTimestamps()) {
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                          queryPool, 1);
+    }
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
       if (errorMessage) {
@@ -411,20 +544,48 @@ struct VulkanStreamingUpsampler::VkfftContext {
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
-    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+    const auto submitStart = std::chrono::steady_clock::now();
+    VkResult submitted;
+    {
+      totton::audio::trace::Scope traceSubmit("vkQueueSubmit");
+      submitted = vkQueueSubmit(queue, 1, &submitInfo, fence);
+    }
+    if (submitted != VK_SUCCESS) {
       if (errorMessage) {
         *errorMessage = "Failed to submit Vulkan queue";
       }
       return false;
     }
-    if (vkWaitForFences(device, 1, &fence, VK_TRUE, 100000000000) !=
-        VK_SUCCESS) {
+    VkResult waited;
+    {
+      totton::audio::trace::Scope traceWait("vkWaitForFences");
+      waited = vkWaitForFences(device, 1, &fence, VK_TRUE, 100000000000);
+    }
+    if (waited != VK_SUCCESS) {
       if (errorMessage) {
         *errorMessage = "Failed to wait for Vulkan fence";
       }
       return false;
     }
+    lastSubmitNs = ElapsedNs(submitStart, std::chrono::steady_clock::now());
     vkResetFences(device, 1, &fence);
+
+    lastGpuNs = 0;
+    lastGpuTimed = false;
+    if (HasTimestamps()) {
+      // The fence has signalled, so both results are already available.
+      uint64_t ticks[2] = {0, 0};
+      if (vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(ticks), ticks,
+                                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) ==
+          VK_SUCCESS) {
+        // Masking the difference handles counters narrower than 64 bits
+        // wrapping between the two writes.
+        const uint64_t elapsed = (ticks[1] - ticks[0]) & timestampMask;
+        lastGpuNs = static_cast<uint64_t>(static_cast<double>(elapsed) *
+                                          timestampPeriodNs);
+        lastGpuTimed = true;
+      }
+    }
     return true;
   }
 
@@ -460,18 +621,31 @@ VulkanStreamingUpsampler::operator=(const VulkanStreamingUpsampler &other) {
   config_ = other.config_;
   coefficients_ = other.coefficients_;
   overlap_ = other.overlap_;
+  pending_ = other.pending_;
+  // A copied vector only has room for its current contents; the block
+  // buffer has to hold a whole block without growing on the audio thread.
+  pending_.reserve(other.pending_.capacity());
   filterSpectrum_ = other.filterSpectrum_;
+  kernel_ = other.kernel_;
+  timeScratch_.assign(other.timeScratch_.size(), 0.0f);
+  freqScratch_.assign(other.freqScratch_.size(), std::complex<float>());
+  halfbands_ = other.halfbands_;
+  foldScratch_.assign(other.foldScratch_.size(), std::complex<float>());
+  spectrumBand_ = other.spectrumBand_;
+  spectrumPower_ = other.spectrumPower_;
+  spectrumBlocks_ = other.spectrumBlocks_;
+  gpuEnabled_ = other.gpuEnabled_;
   initialized_ = other.initialized_;
 #if defined(ENABLE_VULKAN) && defined(USE_VKFFT)
   vkfft_.reset();
-  if (initialized_) {
+  if (initialized_ && gpuEnabled_) {
     std::string error;
     auto context = std::make_unique<VkfftContext>();
     if (context->Initialize(config_.fftSize, &error)) {
       vkfft_ = std::move(context);
     } else {
-      std::cerr << "VkFFT initialization failed; falling back to CPU: " << error
-                << "\n";
+      totton::audio::rtlog::Post(totton::audio::rtlog::Code::VkfftFallback,
+                                 error.c_str());
     }
   }
 #endif
@@ -486,7 +660,8 @@ bool VulkanStreamingUpsampler::LoadFilter(const std::string &jsonPath,
   if (!LoadFilterConfig(jsonPath, &config, errorMessage)) {
     return false;
   }
-  if (!LoadCoefficients(config, errorMessage)) {
+  if (!LoadCoefficients(config, &coefficients_, errorMessage) ||
+      !LoadHalfbands(config, &halfbands_, errorMessage)) {
     return false;
   }
   config_ = config;
@@ -497,47 +672,181 @@ bool VulkanStreamingUpsampler::LoadFilter(const std::string &jsonPath,
   return true;
 }
 
+bool VulkanStreamingUpsampler::BuildKernel(const std::string &jsonPath,
+                                           FilterKernel *kernel,
+                                           std::string *errorMessage) {
+  if (!kernel) {
+    return false;
+  }
+  FilterConfig config;
+  std::vector<float> coefficients;
+  if (!LoadFilterConfig(jsonPath, &config, errorMessage) ||
+      !LoadCoefficients(config, &coefficients, errorMessage) ||
+      !ComputeSpectrum(config, coefficients, &kernel->spectrum,
+                       errorMessage)) {
+    return false;
+  }
+  kernel->config = config;
+  return true;
+}
+
+bool VulkanStreamingUpsampler::UseKernel(const FilterKernel *kernel) {
+  if (kernel && (!initialized_ || kernel->config.fftSize != config_.fftSize ||
+                 kernel->config.blockSize != config_.blockSize ||
+                 kernel->config.upsampleFactor != config_.upsampleFactor ||
+                 kernel->config.downsampleFactor != config_.downsampleFactor ||
+                 kernel->config.halfbandStages.size() !=
+                     config_.halfbandStages.size() ||
+                 kernel->spectrum.size() != config_.fftSize)) {
+    return false;
+  }
+  kernel_ = kernel;
+  return true;
+}
+
 std::vector<float> VulkanStreamingUpsampler::ProcessBlock(const float *input,
                                                           std::size_t count) {
   if (!initialized_ || !input) {
     return {};
   }
-  if (count == 0) {
+  const std::size_t inputBlockSize = GetInputBlockSize();
+  if (inputBlockSize == 0 || count != inputBlockSize) {
     return {};
   }
 
-  const std::size_t upsampleFactor =
-      std::max<std::size_t>(config_.upsampleFactor, 1);
-  if (config_.blockSize % upsampleFactor != 0) {
+  std::vector<float> output(config_.OutputBlockSize(), 0.0f);
+  if (!FilterBlock(input, output.data())) {
     return {};
   }
-  const std::size_t maxInputSamples = upsampleFactor > 1
-                                          ? (config_.blockSize / upsampleFactor)
-                                          : config_.blockSize;
-  if (maxInputSamples == 0 || count != maxInputSamples) {
-    return {};
+  return output;
+}
+
+bool VulkanStreamingUpsampler::Process(const float *input, std::size_t count,
+                                       std::vector<float> *output) {
+  if (!initialized_ || !output || (!input && count > 0)) {
+    return false;
+  }
+  const std::size_t inputBlockSize = GetInputBlockSize();
+  if (inputBlockSize == 0) {
+    return false;
   }
 
+  std::size_t consumed = 0;
+  while (consumed < count) {
+    const std::size_t take =
+        std::min(count - consumed, inputBlockSize - pending_.size());
+    // Whole blocks filter straight from the caller's buffer.
+    const bool direct = pending_.empty() && take == inputBlockSize;
+    if (!direct) {
+      pending_.insert(pending_.end(), input + consumed,
+                      input + consumed + take);
+    }
+    consumed += take;
+    if (!direct && pending_.size() < inputBlockSize) {
+      break;
+    }
+
+    const std::size_t offset = output->size();
+    output->resize(offset + config_.OutputBlockSize());
+    const float *block = direct ? input + consumed - take : pending_.data();
+    if (!FilterBlock(block, output->data() + offset)) {
+      output->resize(offset);
+      return false;
+    }
+    pending_.clear();
+  }
+  return true;
+}
+
+bool VulkanStreamingUpsampler::Flush(std::vector<float> *output) {
+  if (!initialized_ || !output) {
+    return false;
+  }
+  // The kernel's tail, then each stage's own tail, in output samples.
+  std::size_t remaining =
+      pending_.size() * config_.KernelFactor() + overlap_.size();
+  for (const auto &stage : halfbands_) {
+    remaining = remaining * 2 + 2 * stage.History();
+  }
+  // Blocks start on a kept sample, so the tail keeps every Mth from its
+  // first one.
+  const std::size_t downsampleFactor = config_.downsampleFactor;
+  remaining = (remaining + downsampleFactor - 1) / downsampleFactor;
+  std::vector<float> block(config_.OutputBlockSize(), 0.0f);
+  while (remaining > 0) {
+    pending_.resize(GetInputBlockSize(), 0.0f);
+    if (!FilterBlock(pending_.data(), block.data())) {
+      Reset();
+      return false;
+    }
+    std::fill(pending_.begin(), pending_.end(), 0.0f);
+    const std::size_t emit = std::min(remaining, block.size());
+    output->insert(output->end(), block.begin(), block.begin() + emit);
+    remaining -= emit;
+  }
+  Reset();
+  return true;
+}
+
+bool VulkanStreamingUpsampler::FilterBlock(const float *input, float *output) {
+  const std::size_t upsampleFactor = config_.KernelFactor();
+  const std::size_t count = GetInputBlockSize();
   const std::size_t fftSize = config_.fftSize;
   const std::size_t overlapSize = overlap_.size();
   const std::size_t upsampledCount = count * upsampleFactor;
   if (overlapSize + upsampledCount > fftSize) {
-    return {};
+    return false;
   }
 
-  std::vector<float> timeBuffer(fftSize, 0.0f);
-  for (std::size_t i = 0; i < overlapSize; ++i) {
-    timeBuffer[i] = overlap_[i];
-  }
+  const std::vector<std::complex<float>> &spectrum =
+      kernel_ ? kernel_->spectrum : filterSpectrum_;
+  // Decimation keeps samples M apart, which in the spectrum is the sum of
+  // its M aliases: folding the bins onto fftSize / M and transforming back
+  // at that size yields exactly the kept samples.
+  const bool decimating = !foldScratch_.empty();
+  const std::size_t foldMask = foldScratch_.size() - 1;
+  float *kernelOutput =
+      halfbands_.empty()
+          ? output
+          : halfbands_.front().buffer.data() + halfbands_.front().History();
+  std::vector<float> &timeBuffer = timeScratch_;
+  std::copy(overlap_.begin(), overlap_.end(), timeBuffer.begin());
+  std::fill(timeBuffer.begin() + static_cast<std::ptrdiff_t>(overlapSize),
+            timeBuffer.end(), 0.0f);
   for (std::size_t i = 0; i < count; ++i) {
     timeBuffer[overlapSize + i * upsampleFactor] = input[i];
   }
 
+  // Stage boundaries for TakeStageTimings(); the forward stage includes the
+  // upload, the inverse stage the readback.
+  const auto start = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point fftDone;
+  std::chrono::steady_clock::time_point multiplyDone;
+  auto recordTimings = [&]() {
+    const auto end = std::chrono::steady_clock::now();
+    timings_.fftNs += ElapsedNs(start, fftDone);
+    timings_.multiplyNs += ElapsedNs(fftDone, multiplyDone);
+    timings_.ifftNs += ElapsedNs(multiplyDone, end);
+    ++timings_.blocks;
+    if (!spectrumBand_.empty()) {
+      ++spectrumBlocks_;
+    }
+    if (totton::audio::trace::Enabled()) {
+      const uint64_t startNs = SinceEpochNs(start);
+      const uint64_t fftNs = SinceEpochNs(fftDone);
+      const uint64_t multiplyNs = SinceEpochNs(multiplyDone);
+      totton::audio::trace::Record("upsampler.fft", startNs, fftNs);
+      totton::audio::trace::Record("upsampler.multiply", fftNs, multiplyNs);
+      totton::audio::trace::Record("upsampler.ifft", multiplyNs,
+                                   SinceEpochNs(end));
+    }
+  };
+
 #if defined(ENABLE_VULKAN) && defined(USE_VKFFT)
   if (vkfft_) {
     float *mapped = nullptr;
     if (!vkfft_->Map(&mapped, nullptr)) {
-      return {};
+      return false;
     }
     for (std::size_t i = 0; i < fftSize; ++i) {
       mapped[2 * i] = timeBuffer[i];
@@ -545,69 +854,269 @@ std::vector<float> VulkanStreamingUpsampler::ProcessBlock(const float *input,
     }
     vkfft_->Unmap();
     if (!vkfft_->Execute(-1, nullptr)) {
-      return {};
+      return false;
     }
+    uint64_t gpuNs = vkfft_->lastGpuNs;
+    uint64_t submitNs = vkfft_->lastSubmitNs;
+    // A block whose timestamps were lost would count its whole submit time
+    // as queue time, so it is left out of the GPU timings.
+    bool gpuTimed = vkfft_->lastGpuTimed;
+    fftDone = std::chrono::steady_clock::now();
     if (!vkfft_->Map(&mapped, nullptr)) {
-      return {};
+      return false;
+    }
+    if (decimating) {
+      // The inverse transform is only fftSize / M points, which the CPU
+      // FFT handles without a second VkFFT plan.
+      std::fill(foldScratch_.begin(), foldScratch_.end(),
+                std::complex<float>());
+      for (std::size_t i = 0; i < fftSize; ++i) {
+        foldScratch_[i & foldMask] += FilterBin(
+            i, std::complex<float>(mapped[2 * i], mapped[2 * i + 1]),
+            spectrum[i]);
+      }
+      vkfft_->Unmap();
+      multiplyDone = std::chrono::steady_clock::now();
+      fft::Fft(foldScratch_, true);
+      EmitDecimated(output);
+      std::copy(timeBuffer.end() - static_cast<std::ptrdiff_t>(overlapSize),
+                timeBuffer.end(), overlap_.begin());
+      if (gpuTimed) {
+        const uint64_t blockNs =
+            ElapsedNs(start, std::chrono::steady_clock::now());
+        timings_.gpuNs += gpuNs;
+        timings_.queueNs += submitNs - std::min(gpuNs, submitNs);
+        timings_.hostNs += blockNs - std::min(submitNs, blockNs);
+        ++timings_.gpuBlocks;
+      }
+      recordTimings();
+      return true;
     }
     for (std::size_t i = 0; i < fftSize; ++i) {
-      const std::complex<float> value(mapped[2 * i], mapped[2 * i + 1]);
-      const std::complex<float> filtered = value * filterSpectrum_[i];
+      const std::complex<float> filtered = FilterBin(
+          i, std::complex<float>(mapped[2 * i], mapped[2 * i + 1]),
+          spectrum[i]);
       mapped[2 * i] = filtered.real();
       mapped[2 * i + 1] = filtered.imag();
     }
     vkfft_->Unmap();
+    multiplyDone = std::chrono::steady_clock::now();
     if (!vkfft_->Execute(1, nullptr)) {
-      return {};
+      return false;
     }
+    gpuNs += vkfft_->lastGpuNs;
+    submitNs += vkfft_->lastSubmitNs;
+    gpuTimed = gpuTimed && vkfft_->lastGpuTimed;
     if (!vkfft_->Map(&mapped, nullptr)) {
-      return {};
+      return false;
     }
-    std::vector<float> output(upsampledCount, 0.0f);
     for (std::size_t i = 0; i < upsampledCount; ++i) {
-      output[i] = mapped[2 * (overlapSize + i)];
+      kernelOutput[i] = mapped[2 * (overlapSize + i)];
     }
     vkfft_->Unmap();
-    overlap_.assign(timeBuffer.end() - static_cast<std::ptrdiff_t>(overlapSize),
-                    timeBuffer.end());
-    return output;
+    std::copy(timeBuffer.end() - static_cast<std::ptrdiff_t>(overlapSize),
+              timeBuffer.end(), overlap_.begin());
+    if (gpuTimed) {
+      const uint64_t blockNs =
+          ElapsedNs(start, std::chrono::steady_clock::now());
+      timings_.gpuNs += gpuNs;
+      timings_.queueNs += submitNs - std::min(gpuNs, submitNs);
+      timings_.hostNs += blockNs - std::min(submitNs, blockNs);
+      ++timings_.gpuBlocks;
+    }
+    recordTimings();
+    RunHalfbands(output);
+    return true;
   }
 #endif
 
-  std::vector<std::complex<float>> freqBuffer(fftSize);
+  std::vector<std::complex<float>> &freqBuffer = freqScratch_;
   for (std::size_t i = 0; i < fftSize; ++i) {
     freqBuffer[i] = std::complex<float>(timeBuffer[i], 0.0f);
   }
 
   fft::Fft(freqBuffer, false);
+  fftDone = std::chrono::steady_clock::now();
+  if (decimating) {
+    std::fill(foldScratch_.begin(), foldScratch_.end(), std::complex<float>());
+    for (std::size_t i = 0; i < fftSize; ++i) {
+      foldScratch_[i & foldMask] += FilterBin(i, freqBuffer[i], spectrum[i]);
+    }
+    multiplyDone = std::chrono::steady_clock::now();
+    fft::Fft(foldScratch_, true);
+    EmitDecimated(output);
+    std::copy(timeBuffer.end() - static_cast<std::ptrdiff_t>(overlapSize),
+              timeBuffer.end(), overlap_.begin());
+    recordTimings();
+    return true;
+  }
   for (std::size_t i = 0; i < fftSize; ++i) {
-    freqBuffer[i] *= filterSpectrum_[i];
+    freqBuffer[i] = FilterBin(i, freqBuffer[i], spectrum[i]);
   }
+  multiplyDone = std::chrono::steady_clock::now();
   fft::Fft(freqBuffer, true);
 
-  std::vector<float> output(upsampledCount, 0.0f);
   for (std::size_t i = 0; i < upsampledCount; ++i) {
-    output[i] = freqBuffer[overlapSize + i].real();
+    kernelOutput[i] = freqBuffer[overlapSize + i].real();
   }
 
-  overlap_.assign(timeBuffer.end() - static_cast<std::ptrdiff_t>(overlapSize),
-                  timeBuffer.end());
-  return output;
+  std::copy(timeBuffer.end() - static_cast<std::ptrdiff_t>(overlapSize),
+            timeBuffer.end(), overlap_.begin());
+  recordTimings();
+  RunHalfbands(output);
+  return true;
+}
+
+void VulkanStreamingUpsampler::EmitDecimated(float *output) {
+  // Sample n of the folded transform is filtered sample n * M, so block
+  // output starts at overlap / M; the overlap is a multiple of M because
+  // fft_size and block_size are. The fold sums M aliases, hence the 1 / M.
+  const std::size_t downsampleFactor = config_.downsampleFactor;
+  const std::size_t first = overlap_.size() / downsampleFactor;
+  const std::size_t count = config_.OutputBlockSize();
+  const float scale = 1.0f / static_cast<float>(downsampleFactor);
+  for (std::size_t i = 0; i < count; ++i) {
+    output[i] = foldScratch_[first + i].real() * scale;
+  }
+}
+
+void VulkanStreamingUpsampler::RunHalfbands(float *output) {
+  if (halfbands_.empty()) {
+    return;
+  }
+  totton::audio::trace::Scope trace("upsampler.halfband");
+  std::size_t count = config_.blockSize;
+  for (std::size_t s = 0; s < halfbands_.size(); ++s) {
+    float *next = output;
+    if (s + 1 < halfbands_.size()) {
+      Halfband &following = halfbands_[s + 1];
+      next = following.buffer.data() + following.History();
+    }
+    halfbands_[s].Filter(count, next);
+    count *= 2;
+  }
+}
+
+void VulkanStreamingUpsampler::Halfband::Filter(std::size_t count,
+                                                float *output) {
+  // One pass over the block per tap pair keeps the inner loop a plain
+  // multiply-add over contiguous samples, which the compiler vectorises.
+  const std::size_t k = side.size();
+  const float *x = buffer.data();
+  float *acc = even.data();
+  std::fill(acc, acc + count, 0.0f);
+  for (std::size_t t = 0; t < k; ++t) {
+    const float tap = side[t];
+    const float *newer = x + k + t;
+    const float *older = x + k - 1 - t;
+    for (std::size_t i = 0; i < count; ++i) {
+      acc[i] += tap * (newer[i] + older[i]);
+    }
+  }
+  const float *middle = x + k;
+  for (std::size_t i = 0; i < count; ++i) {
+    output[2 * i] = acc[i];
+    output[2 * i + 1] = centre * middle[i];
+  }
+  const auto history = static_cast<std::ptrdiff_t>(History());
+  std::copy(buffer.end() - history, buffer.end(), buffer.begin());
 }
 
 void VulkanStreamingUpsampler::Reset() {
   std::fill(overlap_.begin(), overlap_.end(), 0.0f);
+  for (auto &stage : halfbands_) {
+    std::fill(stage.buffer.begin(), stage.buffer.end(), 0.0f);
+  }
+  pending_.clear();
+}
+
+std::complex<float>
+VulkanStreamingUpsampler::FilterBin(std::size_t i, std::complex<float> value,
+                                    const std::complex<float> &response) {
+  value *= response;
+  if (i < spectrumBand_.size()) {
+    const uint16_t band = spectrumBand_[i];
+    if (band != kNoBand) {
+      spectrumPower_[band] += std::norm(value);
+    }
+  }
+  return value;
+}
+
+void VulkanStreamingUpsampler::EnableSpectrum(std::size_t bands,
+                                              double outputRate) {
+  spectrumBand_.clear();
+  spectrumPower_.assign(bands, 0.0f);
+  spectrumBlocks_ = 0;
+  const std::size_t fftSize = config_.fftSize;
+  if (bands == 0 || fftSize == 0 || outputRate <= 0.0 || bands >= kNoBand) {
+    return;
+  }
+  const double nyquist = outputRate / 2.0;
+  const double lowest = std::min(kSpectrumLowestHz, nyquist / 2.0);
+  const double span = std::log(nyquist / lowest);
+  const double kernelRate = outputRate *
+                            static_cast<double>(config_.downsampleFactor) /
+                            static_cast<double>(config_.CascadeFactor());
+  spectrumBand_.assign(fftSize / 2 + 1, kNoBand);
+  for (std::size_t i = 1; i < spectrumBand_.size(); ++i) {
+    const double hz = static_cast<double>(i) * kernelRate /
+                      static_cast<double>(fftSize);
+    if (hz > nyquist) {
+      break;
+    }
+    if (hz < lowest) {
+      continue;
+    }
+    const auto band = static_cast<std::size_t>(
+        std::log(hz / lowest) / span * static_cast<double>(bands));
+    spectrumBand_[i] = static_cast<uint16_t>(std::min(band, bands - 1));
+  }
+}
+
+std::size_t VulkanStreamingUpsampler::TakeSpectrum(float *bands) {
+  const std::size_t blocks = spectrumBlocks_;
+  if (blocks == 0) {
+    return 0;
+  }
+  // A full-scale sine peaks at fftSize / 2 in the bin it falls on.
+  const float halfSize = static_cast<float>(config_.fftSize) / 2.0f;
+  const float scale = 1.0f / (halfSize * halfSize * static_cast<float>(blocks));
+  for (std::size_t b = 0; b < spectrumPower_.size(); ++b) {
+    bands[b] += spectrumPower_[b] * scale;
+    spectrumPower_[b] = 0.0f;
+  }
+  spectrumBlocks_ = 0;
+  return blocks;
 }
 
 const FilterConfig &VulkanStreamingUpsampler::GetConfig() const {
   return config_;
 }
 
+FilterKernel VulkanStreamingUpsampler::GetKernel() const {
+  return FilterKernel{config_, filterSpectrum_};
+}
+
+StageTimings VulkanStreamingUpsampler::TakeStageTimings() {
+  const StageTimings timings = timings_;
+  timings_ = StageTimings{};
+  return timings;
+}
+
+std::size_t VulkanStreamingUpsampler::GetInputBlockSize() const {
+  const std::size_t upsampleFactor = config_.KernelFactor();
+  if (upsampleFactor == 0 || config_.blockSize % upsampleFactor != 0) {
+    return 0;
+  }
+  return config_.blockSize / upsampleFactor;
+}
+
 bool VulkanStreamingUpsampler::LoadFilterConfig(const std::string &jsonPath,
                                                 FilterConfig *config,
                                                 std::string *errorMessage) {
   const std::filesystem::path path(jsonPath);
-  const std::string json = ReadFileToString(path);
+  std::string json = ReadFileToString(path);
   if (json.empty()) {
     if (errorMessage) {
       *errorMessage = BuildError("Failed to read filter config", jsonPath);
@@ -615,6 +1124,32 @@ bool VulkanStreamingUpsampler::LoadFilterConfig(const std::string &jsonPath,
     return false;
   }
 
+  std::vector<std::string> stages;
+  if (!ExtractJsonObjects(&json, "halfband_stages", &stages) ||
+      stages.size() > kMaxHalfbandStages) {
+    if (errorMessage) {
+      *errorMessage = "halfband_stages must be an array of up to " +
+                      std::to_string(kMaxHalfbandStages) + " objects";
+    }
+    return false;
+  }
+  config->halfbandStages.clear();
+  for (const std::string &stage : stages) {
+    std::string stageBin;
+    std::size_t stageTaps = 0;
+    if (!ExtractJsonString(stage, "coefficients_bin", &stageBin) ||
+        !ExtractJsonUnsigned(stage, "taps", &stageTaps) || stageTaps < 3 ||
+        stageTaps % 4 != 3) {
+      if (errorMessage) {
+        *errorMessage = "halfband_stages need coefficients_bin and taps of "
+                        "the form 4k - 1";
+      }
+      return false;
+    }
+    config->halfbandStages.push_back(
+        {ResolveBin(path, stageBin).string(), stageTaps});
+  }
+
   std::string binPath;
   if (!ExtractJsonString(json, "coefficients_bin", &binPath)) {
     if (errorMessage) {
@@ -630,6 +1165,7 @@ bool VulkanStreamingUpsampler::LoadFilterConfig(const std::string &jsonPath,
   ExtractJsonUnsigned(json, "fft_size", &fftSize);
   ExtractJsonUnsigned(json, "block_size", &blockSize);
   ExtractJsonUnsigned(json, "upsample_factor", &config->upsampleFactor);
+  ExtractJsonUnsigned(json, "downsample_factor", &config->downsampleFactor);
 
   if (taps == 0 || fftSize == 0 || blockSize == 0) {
     if (errorMessage) {
@@ -658,22 +1194,49 @@ bool VulkanStreamingUpsampler::LoadFilterConfig(const std::string &jsonPath,
     return false;
   }
 
-  std::filesystem::path bin = binPath;
-  if (!bin.is_absolute()) {
-    bin = path.parent_path() / bin;
-  }
-
-  config->coefficientsPath = bin.string();
+  config->coefficientsPath = ResolveBin(path, binPath).string();
   config->taps = taps;
   config->fftSize = fftSize;
   config->blockSize = blockSize;
   if (config->upsampleFactor == 0) {
     config->upsampleFactor = 1;
   }
-  if (config->upsampleFactor > 1 &&
-      (config->blockSize % config->upsampleFactor) != 0) {
+  if (config->downsampleFactor == 0) {
+    config->downsampleFactor = 1;
+  }
+  const std::size_t downsampleFactor = config->downsampleFactor;
+  if (downsampleFactor > 1) {
+    if (config->upsampleFactor > 1 || !config->halfbandStages.empty()) {
+      if (errorMessage) {
+        *errorMessage = "downsample_factor cannot be combined with "
+                        "upsample_factor or halfband_stages";
+      }
+      return false;
+    }
+    // The folded spectrum has to stay a power-of-two FFT.
+    if (!fft::IsPowerOfTwo(downsampleFactor) || downsampleFactor > fftSize ||
+        blockSize % downsampleFactor != 0) {
+      if (errorMessage) {
+        *errorMessage = "downsample_factor must be a power of two dividing "
+                        "block_size";
+      }
+      return false;
+    }
+  }
+  if (config->upsampleFactor % config->CascadeFactor() != 0) {
     if (errorMessage) {
-      *errorMessage = "block_size must be divisible by upsample_factor";
+      *errorMessage =
+          "upsample_factor must include a factor of 2 per half-band stage";
+    }
+    return false;
+  }
+  const std::size_t kernelFactor = config->KernelFactor();
+  if (kernelFactor > 1 && (config->blockSize % kernelFactor) != 0) {
+    if (errorMessage) {
+      *errorMessage = config->halfbandStages.empty()
+                          ? "block_size must be divisible by upsample_factor"
+                          : "block_size must be divisible by the kernel's "
+                            "share of upsample_factor";
     }
     return false;
   }
@@ -681,36 +1244,85 @@ bool VulkanStreamingUpsampler::LoadFilterConfig(const std::string &jsonPath,
   return true;
 }
 
-bool VulkanStreamingUpsampler::LoadCoefficients(const FilterConfig &config,
-                                                std::string *errorMessage) {
+bool VulkanStreamingUpsampler::LoadCoefficients(
+    const FilterConfig &config, std::vector<float> *coefficients,
+    std::string *errorMessage) {
+  return ReadCoefficients(config.coefficientsPath, config.taps, coefficients,
+                          errorMessage);
+}
+
+bool VulkanStreamingUpsampler::LoadHalfbands(const FilterConfig &config,
+                                             std::vector<Halfband> *halfbands,
+                                             std::string *errorMessage) {
+  halfbands->clear();
+  for (const auto &stageConfig : config.halfbandStages) {
+    std::vector<float> taps;
+    if (!ReadCoefficients(stageConfig.coefficientsPath, stageConfig.taps,
+                          &taps, errorMessage)) {
+      return false;
+    }
+    // taps = 4K - 1: centre at 2K - 1, K nonzero taps on either side at odd
+    // offsets, zeros at even ones.
+    const std::size_t centre = taps.size() / 2;
+    const std::size_t k = (taps.size() + 1) / 4;
+    Halfband stage;
+    stage.centre = taps[centre];
+    const float tolerance = kHalfbandTolerance * std::abs(stage.centre);
+    bool valid = stage.centre != 0.0f;
+    for (std::size_t offset = 1; offset <= centre; ++offset) {
+      const float before = taps[centre - offset];
+      const float after = taps[centre + offset];
+      valid = valid && std::abs(before - after) <= tolerance;
+      if (offset % 2 == 0) {
+        valid = valid && std::abs(before) <= tolerance;
+      }
+    }
+    if (!valid) {
+      if (errorMessage) {
+        *errorMessage = BuildError(
+            "Half-band stage must be symmetric with zeros at even offsets "
+            "from a nonzero centre tap",
+            stageConfig.coefficientsPath);
+      }
+      return false;
+    }
+    for (std::size_t t = 0; t < k; ++t) {
+      stage.side.push_back(taps[centre - 1 - 2 * t]);
+    }
+    halfbands->push_back(std::move(stage));
+  }
+  return true;
+}
+
+bool VulkanStreamingUpsampler::ReadCoefficients(
+    const std::string &path, std::size_t taps,
+    std::vector<float> *coefficients, std::string *errorMessage) {
   std::error_code ec;
-  const auto fileSize = std::filesystem::file_size(config.coefficientsPath, ec);
+  const auto fileSize = std::filesystem::file_size(path, ec);
   if (ec) {
     if (errorMessage) {
-      *errorMessage =
-          BuildError("Failed to stat coefficients", config.coefficientsPath);
+      *errorMessage = BuildError("Failed to stat coefficients", path);
     }
     return false;
   }
 
-  std::ifstream file(config.coefficientsPath, std::ios::binary);
+  std::ifstream file(path, std::ios::binary);
   if (!file) {
     if (errorMessage) {
-      *errorMessage =
-          BuildError("Failed to open coefficients", config.coefficientsPath);
+      *errorMessage = BuildError("Failed to open coefficients", path);
     }
     return false;
   }
 
-  const std::size_t expectedBytes = config.taps * sizeof(float);
+  const std::size_t expectedBytes = taps * sizeof(float);
   if (fileSize != expectedBytes) {
     if (errorMessage) {
       *errorMessage = "Coefficient file size does not match taps";
     }
     return false;
   }
-  std::vector<float> coefficients(config.taps, 0.0f);
-  file.read(reinterpret_cast<char *>(coefficients.data()),
+  std::vector<float> loaded(taps, 0.0f);
+  file.read(reinterpret_cast<char *>(loaded.data()),
             static_cast<std::streamsize>(expectedBytes));
   if (static_cast<std::size_t>(file.gcount()) != expectedBytes) {
     if (errorMessage) {
@@ -719,33 +1331,66 @@ bool VulkanStreamingUpsampler::LoadCoefficients(const FilterConfig &config,
     return false;
   }
 
-  coefficients_ = std::move(coefficients);
+  *coefficients = std::move(loaded);
   return true;
 }
 
-bool VulkanStreamingUpsampler::PrepareSpectrum(std::string *errorMessage) {
-  if (config_.taps > config_.fftSize) {
+bool VulkanStreamingUpsampler::ComputeSpectrum(
+    const FilterConfig &config, const std::vector<float> &coefficients,
+    std::vector<std::complex<float>> *spectrum, std::string *errorMessage) {
+  if (config.taps > config.fftSize || coefficients.size() < config.taps) {
     if (errorMessage) {
       *errorMessage = "taps must be <= fft_size for minimal overlap-save";
     }
     return false;
   }
 
-  filterSpectrum_.assign(config_.fftSize, std::complex<float>(0.0f, 0.0f));
-  for (std::size_t i = 0; i < config_.taps; ++i) {
-    filterSpectrum_[i] = std::complex<float>(coefficients_[i], 0.0f);
+  spectrum->assign(config.fftSize, std::complex<float>(0.0f, 0.0f));
+  for (std::size_t i = 0; i < config.taps; ++i) {
+    (*spectrum)[i] = std::complex<float>(coefficients[i], 0.0f);
   }
 
-  fft::Fft(filterSpectrum_, false);
+  fft::Fft(*spectrum, false);
+  return true;
+}
+
+bool VulkanStreamingUpsampler::PrepareSpectrum(std::string *errorMessage) {
+  if (!ComputeSpectrum(config_, coefficients_, &filterSpectrum_,
+                       errorMessage)) {
+    return false;
+  }
+  kernel_ = nullptr;
+  spectrumBand_.clear();
+  spectrumPower_.clear();
+  spectrumBlocks_ = 0;
 
   overlap_.assign(config_.fftSize - config_.blockSize, 0.0f);
+  pending_.clear();
+  pending_.reserve(GetInputBlockSize());
+  timeScratch_.assign(config_.fftSize, 0.0f);
+  freqScratch_.assign(config_.fftSize, std::complex<float>());
+  foldScratch_.clear();
+  if (config_.downsampleFactor > 1) {
+    foldScratch_.assign(config_.fftSize / config_.downsampleFactor,
+                        std::complex<float>());
+  }
+  std::size_t stageInput = config_.blockSize;
+  for (auto &stage : halfbands_) {
+    stage.buffer.assign(stage.History() + stageInput, 0.0f);
+    stage.even.assign(stageInput, 0.0f);
+    stageInput *= 2;
+  }
 
 #if defined(ENABLE_VULKAN) && defined(USE_VKFFT)
+  vkfft_.reset();
+  if (!gpuEnabled_) {
+    return true;
+  }
   vkfft_ = std::make_unique<VkfftContext>();
   std::string vkfftError;
   if (!vkfft_->Initialize(config_.fftSize, &vkfftError)) {
-    std::cerr << "VkFFT initialization failed; falling back to CPU: "
-              << vkfftError << "\n";
+    totton::audio::rtlog::Post(totton::audio::rtlog::Code::VkfftFallback,
+                               vkfftError.c_str());
     vkfft_.reset();
   }
 #endif
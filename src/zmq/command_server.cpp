@@ -1,6 +1,8 @@
 #include "zmq/command_server.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <sstream>
@@ -11,33 +13,6 @@ namespace totton::zmq_server {
 
 namespace {
 
-std::string EscapeJson(const std::string &value) {
-  std::ostringstream out;
-  for (char c : value) {
-    switch (c) {
-    case '\\':
-      out << "\\\\";
-      break;
-    case '"':
-      out << "\\\"";
-      break;
-    case '\n':
-      out << "\\n";
-      break;
-    case '\r':
-      out << "\\r";
-      break;
-    case '\t':
-      out << "\\t";
-      break;
-    default:
-      out << c;
-      break;
-    }
-  }
-  return out.str();
-}
-
 bool LooksLikeJsonObject(const std::string &raw, bool *hasClosingBrace) {
   const std::string whitespace = " \t\r\n";
   std::size_t first = raw.find_first_not_of(whitespace);
@@ -67,24 +42,66 @@ std::string Trim(const std::string &value) {
   return value.substr(first, last - first + 1);
 }
 
+// Workers push finished replies here; inproc endpoints are per context, so
+// every server instance has its own.
+constexpr char kResultEndpoint[] = "inproc://command_results";
+constexpr auto kPollInterval = std::chrono::milliseconds(100);
+// Requests beyond this many waiting for a worker are refused with BUSY.
+constexpr std::size_t kMaxQueuedJobs = 64;
+
+// Reads every frame of one message without blocking. Returns false when no
+// message is waiting.
+bool ReceiveMultipart(zmq::socket_t &socket,
+                      std::vector<zmq::message_t> *frames) {
+  frames->clear();
+  while (true) {
+    zmq::message_t frame;
+    if (!socket.recv(frame, zmq::recv_flags::dontwait)) {
+      return !frames->empty();
+    }
+    const bool more = frame.more();
+    frames->push_back(std::move(frame));
+    if (!more) {
+      return true;
+    }
+  }
+}
+
+// Sends the routing envelope of a request followed by payload.
+void SendReply(zmq::socket_t &socket, std::vector<zmq::message_t> *envelope,
+               zmq::message_t payload) {
+  for (auto &frame : *envelope) {
+    socket.send(frame, zmq::send_flags::sndmore);
+  }
+  socket.send(payload, zmq::send_flags::none);
+}
+
+zmq::message_t ToMessage(const std::string &text) {
+  return zmq::message_t(text.data(), text.size());
+}
+
 } // namespace
 
 class ZmqCommandServer::Impl {
 public:
   zmq::context_t context{1};
-  zmq::socket_t repSocket{context, zmq::socket_type::rep};
+  zmq::socket_t routerSocket{context, zmq::socket_type::router};
+  zmq::socket_t resultSocket{context, zmq::socket_type::pull};
   std::optional<zmq::socket_t> pubSocket;
 };
 
 ZmqCommandServer::ZmqCommandServer(std::string endpoint,
-                                   std::string pubEndpoint)
+                                   std::string pubEndpoint,
+                                   std::size_t workerCount)
     : endpoint_(std::move(endpoint)), pubEndpoint_(std::move(pubEndpoint)),
+      workerCount_(std::max<std::size_t>(workerCount, 1)),
       impl_(std::make_unique<Impl>()) {}
 
 ZmqCommandServer::~ZmqCommandServer() { Stop(); }
 
-void ZmqCommandServer::Register(const std::string &command, Handler handler) {
-  handlers_[command] = std::move(handler);
+void ZmqCommandServer::Register(const std::string &command, Handler handler,
+                                HandlerOptions options) {
+  handlers_[command] = Entry{std::move(handler), options};
 }
 
 bool ZmqCommandServer::Start() {
@@ -97,30 +114,178 @@ bool ZmqCommandServer::Start() {
     return false;
   }
 
-  serverThread_ = std::thread([this]() {
-    while (running_.load()) {
-      zmq::message_t request;
-      auto recv = impl_->repSocket.recv(request, zmq::recv_flags::none);
-      if (!recv.has_value()) {
-        continue;
-      }
-      std::string raw(static_cast<char *>(request.data()), request.size());
-      auto response = Dispatch(BuildRequest(raw));
-      impl_->repSocket.send(zmq::buffer(response), zmq::send_flags::none);
-    }
-    CleanupSockets();
-  });
+  {
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    stopWorkers_ = false;
+  }
+  for (std::size_t i = 0; i < workerCount_; ++i) {
+    workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+  serverThread_ = std::thread([this]() { ServeLoop(); });
   return true;
 }
 
 void ZmqCommandServer::Stop() {
   running_.store(false);
+  {
+    std::lock_guard<std::mutex> lock(jobMutex_);
+    stopWorkers_ = true;
+    jobs_.clear();
+  }
+  jobCv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
   if (serverThread_.joinable()) {
     serverThread_.join();
   }
   CleanupSockets();
 }
 
+void ZmqCommandServer::ServeLoop() {
+  // Requests handed to workers, keyed by job id. Socket thread only.
+  struct Pending {
+    std::vector<zmq::message_t> envelope;
+    std::chrono::steady_clock::time_point deadline;
+  };
+  std::unordered_map<uint64_t, Pending> pending;
+  uint64_t nextId = 1;
+  std::vector<zmq::message_t> frames;
+
+  while (running_.load()) {
+    auto now = std::chrono::steady_clock::now();
+    auto wait = kPollInterval;
+    for (const auto &item : pending) {
+      const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+          item.second.deadline - now);
+      wait = std::max(std::min(wait, left), std::chrono::milliseconds(0));
+    }
+    zmq::pollitem_t items[] = {
+        {impl_->routerSocket.handle(), 0, ZMQ_POLLIN, 0},
+        {impl_->resultSocket.handle(), 0, ZMQ_POLLIN, 0},
+    };
+    try {
+      zmq::poll(items, 2, wait);
+    } catch (const zmq::error_t &) {
+      // Interrupted by a signal; the loop condition decides.
+      continue;
+    }
+
+    if (items[1].revents & ZMQ_POLLIN) {
+      while (ReceiveMultipart(impl_->resultSocket, &frames)) {
+        uint64_t id = 0;
+        if (frames.size() != 2 || frames[0].size() != sizeof(id)) {
+          continue;
+        }
+        std::memcpy(&id, frames[0].data(), sizeof(id));
+        auto it = pending.find(id);
+        if (it == pending.end()) {
+          // Already answered with TIMEOUT.
+          continue;
+        }
+        SendReply(impl_->routerSocket, &it->second.envelope,
+                  std::move(frames[1]));
+        pending.erase(it);
+      }
+    }
+
+    if (items[0].revents & ZMQ_POLLIN) {
+      now = std::chrono::steady_clock::now();
+      while (ReceiveMultipart(impl_->routerSocket, &frames)) {
+        // Routing id, REQ's empty delimiter if any, then the request body.
+        if (frames.size() < 2) {
+          continue;
+        }
+        const std::string raw(static_cast<const char *>(frames.back().data()),
+                              frames.back().size());
+        frames.pop_back();
+        ZmqRequest request = BuildRequest(raw);
+        std::string error;
+        const Entry *entry = Resolve(request, &error);
+        if (!entry) {
+          SendReply(impl_->routerSocket, &frames, ToMessage(error));
+          continue;
+        }
+        if (entry->options.runInline) {
+          SendReply(impl_->routerSocket, &frames,
+                    ToMessage(Invoke(*entry, request).payload));
+          continue;
+        }
+        const uint64_t id = nextId++;
+        const auto deadline = now + entry->options.timeout;
+        bool queued = false;
+        {
+          std::lock_guard<std::mutex> lock(jobMutex_);
+          if (jobs_.size() < kMaxQueuedJobs) {
+            jobs_.push_back(Job{id, std::move(request), entry, deadline});
+            queued = true;
+          }
+        }
+        if (!queued) {
+          SendReply(impl_->routerSocket, &frames,
+                    ToMessage(BuildError("BUSY", "too many requests queued")));
+          continue;
+        }
+        jobCv_.notify_one();
+        // The result can only be read by this thread, after this insert.
+        pending.emplace(id, Pending{std::move(frames), deadline});
+      }
+    }
+
+    now = std::chrono::steady_clock::now();
+    for (auto it = pending.begin(); it != pending.end();) {
+      if (it->second.deadline > now) {
+        ++it;
+        continue;
+      }
+      SendReply(impl_->routerSocket, &it->second.envelope,
+                ToMessage(BuildError("TIMEOUT", "command timed out")));
+      it = pending.erase(it);
+    }
+  }
+}
+
+void ZmqCommandServer::WorkerLoop() {
+  zmq::socket_t results(impl_->context, zmq::socket_type::push);
+  results.set(zmq::sockopt::linger, 0);
+  results.connect(kResultEndpoint);
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(jobMutex_);
+      jobCv_.wait(lock, [this]() { return stopWorkers_ || !jobs_.empty(); });
+      if (stopWorkers_) {
+        return;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    if (std::chrono::steady_clock::now() >= job.deadline) {
+      // Expired while queued; the client already has its TIMEOUT.
+      continue;
+    }
+    const ZmqResponse response = Invoke(*job.entry, job.request);
+    try {
+      results.send(zmq::message_t(&job.id, sizeof(job.id)),
+                   zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+      results.send(ToMessage(response.payload), zmq::send_flags::dontwait);
+    } catch (const zmq::error_t &) {
+      // The server is shutting down.
+      return;
+    }
+  }
+}
+
+ZmqResponse ZmqCommandServer::Invoke(const Entry &entry,
+                                     const ZmqRequest &request) {
+  try {
+    return entry.handler(request);
+  } catch (const std::exception &e) {
+    return ZmqResponse{BuildError("INTERNAL_ERROR", e.what()), false};
+  }
+}
+
 std::string ZmqCommandServer::BuildOk(const std::string &dataJson) {
   if (dataJson.empty()) {
     return "{\"status\":\"ok\"}";
@@ -148,6 +313,46 @@ ZmqCommandServer::Publish(const std::string &message) {
   return std::nullopt;
 }
 
+std::optional<std::string>
+ZmqCommandServer::Publish(const std::string &topic,
+                          const std::string &message) {
+  std::lock_guard<std::mutex> lock(pubMutex_);
+  if (!impl_->pubSocket) {
+    return std::nullopt;
+  }
+  try {
+    const auto more = zmq::send_flags::sndmore | zmq::send_flags::dontwait;
+    impl_->pubSocket->send(zmq::buffer(topic), more);
+    impl_->pubSocket->send(zmq::buffer(message), zmq::send_flags::dontwait);
+  } catch (const zmq::error_t &e) {
+    return std::string(e.what());
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string>
+ZmqCommandServer::PublishZeroCopy(const std::string &topic,
+                                  std::string message) {
+  std::lock_guard<std::mutex> lock(pubMutex_);
+  if (!impl_->pubSocket) {
+    return std::nullopt;
+  }
+  // The message frame owns the string from here on, sent or not.
+  auto *owned = new std::string(std::move(message));
+  zmq::message_t body(
+      owned->data(), owned->size(),
+      [](void *, void *hint) { delete static_cast<std::string *>(hint); },
+      owned);
+  try {
+    const auto more = zmq::send_flags::sndmore | zmq::send_flags::dontwait;
+    impl_->pubSocket->send(zmq::buffer(topic), more);
+    impl_->pubSocket->send(body, zmq::send_flags::dontwait);
+  } catch (const zmq::error_t &e) {
+    return std::string(e.what());
+  }
+  return std::nullopt;
+}
+
 ZmqRequest ZmqCommandServer::BuildRequest(const std::string &raw) const {
   ZmqRequest req;
   req.raw = raw;
@@ -168,30 +373,32 @@ ZmqRequest ZmqCommandServer::BuildRequest(const std::string &raw) const {
   return req;
 }
 
-std::string ZmqCommandServer::Dispatch(const ZmqRequest &request) {
+const ZmqCommandServer::Entry *
+ZmqCommandServer::Resolve(const ZmqRequest &request, std::string *error) const {
   if (!request.parseError.empty()) {
-    return BuildError("INVALID_JSON", request.parseError);
+    *error = BuildError("INVALID_JSON", request.parseError);
+    return nullptr;
   }
   if (request.cmd.empty()) {
-    return BuildError("INVALID_JSON", "cmd is required");
+    *error = BuildError("INVALID_JSON", "cmd is required");
+    return nullptr;
   }
   auto it = handlers_.find(request.cmd);
   if (it == handlers_.end()) {
-    return BuildError("UNKNOWN_CMD", "unknown command");
-  }
-  ZmqResponse response = it->second(request);
-  if (!response.ok) {
-    return response.payload;
+    *error = BuildError("UNKNOWN_CMD", "unknown command");
+    return nullptr;
   }
-  return response.payload;
+  return &it->second;
 }
 
 bool ZmqCommandServer::InitializeSockets() {
   try {
-    impl_->repSocket.set(zmq::sockopt::linger, 0);
-    impl_->repSocket.set(zmq::sockopt::rcvtimeo, 100);
+    impl_->routerSocket.set(zmq::sockopt::linger, 0);
     CleanupIpcPath(endpoint_);
-    impl_->repSocket.bind(endpoint_);
+    impl_->routerSocket.bind(endpoint_);
+    // Bound before any worker connects to it.
+    impl_->resultSocket.set(zmq::sockopt::linger, 0);
+    impl_->resultSocket.bind(kResultEndpoint);
 
     if (!pubEndpoint_.empty()) {
       impl_->pubSocket.emplace(impl_->context, zmq::socket_type::pub);
@@ -208,9 +415,12 @@ bool ZmqCommandServer::InitializeSockets() {
 
 void ZmqCommandServer::CleanupSockets() {
   try {
-    impl_->repSocket.close();
+    impl_->routerSocket.close();
+    impl_->resultSocket.close();
+    std::lock_guard<std::mutex> lock(pubMutex_);
     if (impl_->pubSocket) {
       impl_->pubSocket->close();
+      impl_->pubSocket.reset();
     }
   } catch (const zmq::error_t &) {
   }
@@ -252,4 +462,31 @@ std::string ExtractJsonString(const std::string &json, const std::string &key,
   return json.substr(pos + 1, end - pos - 1);
 }
 
+std::string EscapeJson(const std::string &value) {
+  std::ostringstream out;
+  for (char c : value) {
+    switch (c) {
+    case '\\':
+      out << "\\\\";
+      break;
+    case '"':
+      out << "\\\"";
+      break;
+    case '\n':
+      out << "\\n";
+      break;
+    case '\r':
+      out << "\\r";
+      break;
+    case '\t':
+      out << "\\t";
+      break;
+    default:
+      out << c;
+      break;
+    }
+  }
+  return out.str();
+}
+
 } // namespace totton::zmq_server
@@ -0,0 +1,138 @@
+#include "zmq/event_stream.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <utility>
+
+#include "zmq/command_server.h"
+
+namespace totton::zmq_server {
+
+namespace {
+
+// Reads the unsigned number after the last of keys, each searched after the
+// one before: {"xrun", "capture"} is the capture count inside "xrun". Good
+// enough for the fixed layout MetricsRegistry writes, not for general JSON.
+bool FindNumber(const std::string &json,
+                std::initializer_list<const char *> keys, uint64_t *value) {
+  std::size_t pos = 0;
+  for (const char *key : keys) {
+    const std::string pattern = "\"" + std::string(key) + "\":";
+    pos = json.find(pattern, pos);
+    if (pos == std::string::npos) {
+      return false;
+    }
+    pos += pattern.size();
+  }
+  std::size_t end = pos;
+  while (end < json.size() &&
+         std::isdigit(static_cast<unsigned char>(json[end]))) {
+    ++end;
+  }
+  if (end == pos) {
+    return false;
+  }
+  *value = std::stoull(json.substr(pos, end - pos));
+  return true;
+}
+
+uint64_t Delta(uint64_t current, uint64_t previous) {
+  return current > previous ? current - previous : 0;
+}
+
+} // namespace
+
+void EventPublisher::Emit(const std::string &topic,
+                          const std::string &dataJson) {
+  if (!server_) {
+    return;
+  }
+  const auto nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  // Held across the send so seq order is wire order.
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint64_t seq = ++sequences_[topic];
+  std::string body =
+      "{\"topic\":\"" + EscapeJson(topic) + "\",\"seq\":" +
+      std::to_string(seq) + ",\"ts_ms\":" + std::to_string(nowMs) +
+      ",\"data\":" + (dataJson.empty() ? std::string("{}") : dataJson) + "}";
+  if (auto error = server_->PublishZeroCopy(topic, std::move(body))) {
+    std::cerr << "Event " << topic << " not published: " << *error << "\n";
+  }
+}
+
+std::optional<StatsSample> ParseStatsSample(const std::string &json) {
+  StatsSample sample;
+  uint64_t inputRate = 0;
+  uint64_t outputRate = 0;
+  if (!FindNumber(json, {"input_rate"}, &inputRate) ||
+      !FindNumber(json, {"output_rate"}, &outputRate) ||
+      !FindNumber(json, {"audio", "uptime_ms"}, &sample.uptimeMs) ||
+      !FindNumber(json, {"xrun", "capture"}, &sample.captureXruns) ||
+      !FindNumber(json, {"xrun", "playback"}, &sample.playbackXruns) ||
+      !FindNumber(json, {"overflow", "input"}, &sample.inputOverflows) ||
+      !FindNumber(json, {"overflow", "output"}, &sample.outputOverflows) ||
+      !FindNumber(json, {"deadline", "misses"}, &sample.deadlineMisses)) {
+    return std::nullopt;
+  }
+  sample.inputRate = static_cast<unsigned int>(inputRate);
+  sample.outputRate = static_cast<unsigned int>(outputRate);
+  return sample;
+}
+
+void StatsEventTracker::Update(const StatsSample &sample) {
+  if (!last_ || sample.inputRate != last_->inputRate ||
+      sample.outputRate != last_->outputRate) {
+    const StatsSample previous = last_ ? *last_ : StatsSample{};
+    sink_(topic::kRate,
+          "{\"input_rate\":" + std::to_string(sample.inputRate) +
+              ",\"output_rate\":" + std::to_string(sample.outputRate) +
+              ",\"previous_input_rate\":" +
+              std::to_string(previous.inputRate) +
+              ",\"previous_output_rate\":" +
+              std::to_string(previous.outputRate) + "}");
+  }
+  if (!last_) {
+    // Nothing to diff against; counts so far predate this tracker.
+    last_ = sample;
+    return;
+  }
+
+  const bool restarted = sample.uptimeMs < last_->uptimeMs ||
+                         sample.captureXruns < last_->captureXruns ||
+                         sample.playbackXruns < last_->playbackXruns ||
+                         sample.inputOverflows < last_->inputOverflows ||
+                         sample.outputOverflows < last_->outputOverflows ||
+                         sample.deadlineMisses < last_->deadlineMisses;
+  const StatsSample base = restarted ? StatsSample{} : *last_;
+  const uint64_t capture = Delta(sample.captureXruns, base.captureXruns);
+  const uint64_t playback = Delta(sample.playbackXruns, base.playbackXruns);
+  if (capture + playback > 0) {
+    sink_(topic::kXrun,
+          "{\"count\":" + std::to_string(capture + playback) +
+              ",\"capture\":" + std::to_string(capture) +
+              ",\"playback\":" + std::to_string(playback) + ",\"total\":" +
+              std::to_string(sample.captureXruns + sample.playbackXruns) +
+              "}");
+  }
+  sink_(topic::kMetrics,
+        "{\"interval_ms\":" +
+            std::to_string(Delta(sample.uptimeMs, base.uptimeMs)) +
+            ",\"restarted\":" + (restarted ? "true" : "false") +
+            ",\"xruns\":" + std::to_string(capture + playback) +
+            ",\"overflows\":{\"input\":" +
+            std::to_string(Delta(sample.inputOverflows, base.inputOverflows)) +
+            ",\"output\":" +
+            std::to_string(
+                Delta(sample.outputOverflows, base.outputOverflows)) +
+            "},\"deadline_misses\":" +
+            std::to_string(Delta(sample.deadlineMisses, base.deadlineMisses)) +
+            "}");
+  last_ = sample;
+}
+
+} // namespace totton::zmq_server
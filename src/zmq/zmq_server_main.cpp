@@ -4,13 +4,18 @@
 #include <chrono>
 #include <csignal>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "io/dac_capability.h"
+#include "zmq/event_stream.h"
 
 namespace {
 
@@ -90,9 +95,99 @@ BuildJsonDeviceArray(const std::vector<DacCapability::DeviceOption> &values) {
   return out.str();
 }
 
+std::string ReadTextFile(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    return "";
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Returns the members of the streamer's stats file (written by alsa_streamer
+// once per second) without the enclosing braces, or an empty string.
+std::string ReadStreamerStatsMembers(const std::string &path) {
+  const std::string json = ReadTextFile(path);
+  const auto begin = json.find('{');
+  const auto end = json.rfind('}');
+  if (begin == std::string::npos || end == std::string::npos ||
+      end <= begin + 1) {
+    return "";
+  }
+  return json.substr(begin + 1, end - begin - 1);
+}
+
+std::string BuildDeviceListJson() {
+  const auto devices = DacCapability::DeviceRegistry::instance().devices();
+  return "{\"playback\":" + BuildJsonDeviceArray(devices.playback) +
+         ",\"capture\":" + BuildJsonDeviceArray(devices.capture) + "}";
+}
+
+// Publishes what the web UI used to poll for: rate, xrun and metrics events
+// derived from the streamer's stats file whenever it is rewritten, and the
+// device list whenever a hotplug event changes it. Runs on the main thread
+// between sleeps.
+class StateWatcher {
+public:
+  StateWatcher(std::string statsPath,
+               totton::zmq_server::EventPublisher *events)
+      : statsPath_(std::move(statsPath)), events_(events),
+        tracker_([events](const std::string &topic, const std::string &data) {
+          events->Emit(topic, data);
+        }) {}
+
+  void Poll() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= nextStatsCheck_) {
+      nextStatsCheck_ = now + kStatsCheckInterval;
+      CheckStats();
+    }
+    const uint64_t generation =
+        DacCapability::DeviceRegistry::instance().generation();
+    if (devices_.empty() || generation != deviceGeneration_) {
+      deviceGeneration_ = generation;
+      CheckDevices();
+    }
+  }
+
+private:
+  static constexpr auto kStatsCheckInterval = std::chrono::milliseconds(250);
+
+  void CheckStats() {
+    std::error_code ec;
+    const auto modified = std::filesystem::last_write_time(statsPath_, ec);
+    if (ec || modified == statsModified_) {
+      return;
+    }
+    statsModified_ = modified;
+    if (auto sample =
+            totton::zmq_server::ParseStatsSample(ReadTextFile(statsPath_))) {
+      tracker_.Update(*sample);
+    }
+  }
+
+  void CheckDevices() {
+    std::string devices = BuildDeviceListJson();
+    if (devices != devices_) {
+      devices_ = std::move(devices);
+      events_->Emit(totton::zmq_server::topic::kDevices, devices_);
+    }
+  }
+
+  std::string statsPath_;
+  totton::zmq_server::EventPublisher *events_;
+  totton::zmq_server::StatsEventTracker tracker_;
+  std::filesystem::file_time_type statsModified_{};
+  std::string devices_;
+  uint64_t deviceGeneration_ = 0;
+  std::chrono::steady_clock::time_point nextStatsCheck_{};
+};
+
 void PrintUsage(const char *argv0) {
   std::cout << "Usage: " << argv0
-            << " [--endpoint <endpoint>] [--pub-endpoint <endpoint>]\n";
+            << " [--endpoint <endpoint>] [--pub-endpoint <endpoint>]"
+               " [--workers <n>]\n";
 }
 
 } // namespace
@@ -101,6 +196,9 @@ int main(int argc, char **argv) {
   std::string endpoint =
       GetEnvOrDefault("TOTTON_ZMQ_ENDPOINT", "ipc:///tmp/totton_zmq.sock");
   std::string pubEndpoint = GetEnvOrDefault("TOTTON_ZMQ_PUB_ENDPOINT", "");
+  const std::string statsPath =
+      GetEnvOrDefault("TOTTON_STATS_PATH", "/tmp/gpu_upsampler_stats.json");
+  std::size_t workerCount = 2;
 
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
@@ -132,6 +230,18 @@ int main(int argc, char **argv) {
       pubEndpoint = val;
       continue;
     }
+    if (arg == "--workers") {
+      const char *val = requireValue("--workers");
+      if (!val) {
+        return 1;
+      }
+      workerCount = std::strtoul(val, nullptr, 10);
+      if (workerCount == 0) {
+        std::cerr << "--workers must be at least 1\n";
+        return 1;
+      }
+      continue;
+    }
 
     std::cerr << "Unknown argument: " << arg << "\n";
     PrintUsage(argv[0]);
@@ -141,16 +251,29 @@ int main(int argc, char **argv) {
   std::signal(SIGINT, SignalHandler);
   std::signal(SIGTERM, SignalHandler);
 
-  totton::zmq_server::ZmqCommandServer server(endpoint, pubEndpoint);
+  totton::zmq_server::ZmqCommandServer server(endpoint, pubEndpoint,
+                                              workerCount);
   std::atomic<int> reloadCount{0};
   std::atomic<int> softResetCount{0};
+  // Handlers run on the server's socket thread and its workers at once.
+  std::mutex phaseMutex;
   std::string phaseType = "minimum";
+  auto currentPhase = [&]() {
+    std::lock_guard<std::mutex> lock(phaseMutex);
+    return phaseType;
+  };
+  totton::zmq_server::HandlerOptions inlineOptions;
+  inlineOptions.runInline = true;
+  totton::zmq_server::EventPublisher events(&server);
   auto startTime = std::chrono::steady_clock::now();
 
-  server.Register("PING", [&](const totton::zmq_server::ZmqRequest &) {
-    return totton::zmq_server::ZmqResponse{
-        totton::zmq_server::ZmqCommandServer::BuildOk("{\"pong\":true}")};
-  });
+  server.Register(
+      "PING",
+      [&](const totton::zmq_server::ZmqRequest &) {
+        return totton::zmq_server::ZmqResponse{
+            totton::zmq_server::ZmqCommandServer::BuildOk("{\"pong\":true}")};
+      },
+      inlineOptions);
 
   server.Register("STATS", [&](const totton::zmq_server::ZmqRequest &) {
     auto now = std::chrono::steady_clock::now();
@@ -159,14 +282,21 @@ int main(int argc, char **argv) {
             .count();
     std::string data =
         "{\"uptime_ms\":" + std::to_string(uptimeMs) + ",\"phase_type\":\"" +
-        phaseType + "\",\"reloads\":" + std::to_string(reloadCount.load()) +
-        ",\"soft_resets\":" + std::to_string(softResetCount.load()) + "}";
+        currentPhase() +
+        "\",\"reloads\":" + std::to_string(reloadCount.load()) +
+        ",\"soft_resets\":" + std::to_string(softResetCount.load());
+    const std::string streamer = ReadStreamerStatsMembers(statsPath);
+    if (!streamer.empty()) {
+      data += "," + streamer;
+    }
+    data += "}";
     return totton::zmq_server::ZmqResponse{
         totton::zmq_server::ZmqCommandServer::BuildOk(data)};
   });
 
   server.Register("RELOAD", [&](const totton::zmq_server::ZmqRequest &) {
     reloadCount.fetch_add(1);
+    events.Emit(totton::zmq_server::topic::kFilter, "{\"reason\":\"reload\"}");
     return totton::zmq_server::ZmqResponse{
         totton::zmq_server::ZmqCommandServer::BuildOk("{\"reloaded\":true}")};
   });
@@ -177,12 +307,14 @@ int main(int argc, char **argv) {
         totton::zmq_server::ZmqCommandServer::BuildOk("{\"reset\":true}")};
   });
 
-  server.Register("PHASE_TYPE_GET",
-                  [&](const totton::zmq_server::ZmqRequest &) {
-                    std::string data = "{\"phase_type\":\"" + phaseType + "\"}";
-                    return totton::zmq_server::ZmqResponse{
-                        totton::zmq_server::ZmqCommandServer::BuildOk(data)};
-                  });
+  server.Register(
+      "PHASE_TYPE_GET",
+      [&](const totton::zmq_server::ZmqRequest &) {
+        std::string data = "{\"phase_type\":\"" + currentPhase() + "\"}";
+        return totton::zmq_server::ZmqResponse{
+            totton::zmq_server::ZmqCommandServer::BuildOk(data)};
+      },
+      inlineOptions);
 
   server.Register(
       "PHASE_TYPE_SET", [&](const totton::zmq_server::ZmqRequest &request) {
@@ -196,29 +328,42 @@ int main(int argc, char **argv) {
                   "INVALID_PARAMS", "phase must be minimum or linear"),
               false};
         }
-        phaseType = phase;
-        std::string data = "{\"phase_type\":\"" + phaseType + "\"}";
+        {
+          std::lock_guard<std::mutex> lock(phaseMutex);
+          phaseType = phase;
+        }
+        std::string data = "{\"phase_type\":\"" + phase + "\"}";
+        events.Emit(totton::zmq_server::topic::kFilter,
+                    "{\"reason\":\"phase\",\"phase_type\":\"" + phase + "\"}");
         return totton::zmq_server::ZmqResponse{
             totton::zmq_server::ZmqCommandServer::BuildOk(data)};
       });
 
   auto listDevicesHandler = [&](const totton::zmq_server::ZmqRequest &) {
-    const auto playback = DacCapability::listPlaybackDevices();
-    const auto capture = DacCapability::listCaptureDevices();
-    std::string data = "{\"playback\":" + BuildJsonDeviceArray(playback) +
-                       ",\"capture\":" + BuildJsonDeviceArray(capture) + "}";
     return totton::zmq_server::ZmqResponse{
-        totton::zmq_server::ZmqCommandServer::BuildOk(data)};
+        totton::zmq_server::ZmqCommandServer::BuildOk(BuildDeviceListJson())};
   };
 
-  server.Register("LIST_ALSA_DEVICES", listDevicesHandler);
-  server.Register("list_alsa_devices", listDevicesHandler);
+  // Enumerate the cards once and again only on hotplug.
+  auto &registry = DacCapability::DeviceRegistry::instance();
+  registry.startWatching();
+  // Answered from the registry's cache while it watches, so it can run
+  // inline; otherwise every query enumerates the cards and needs a worker.
+  const totton::zmq_server::HandlerOptions listOptions =
+      registry.watching() ? inlineOptions
+                          : totton::zmq_server::HandlerOptions{};
+  server.Register("LIST_ALSA_DEVICES", listDevicesHandler, listOptions);
+  server.Register("list_alsa_devices", listDevicesHandler, listOptions);
 
-  server.Register("SHUTDOWN", [&](const totton::zmq_server::ZmqRequest &) {
-    gRunning.store(false);
-    return totton::zmq_server::ZmqResponse{
-        totton::zmq_server::ZmqCommandServer::BuildOk("{\"shutdown\":true}")};
-  });
+  server.Register(
+      "SHUTDOWN",
+      [&](const totton::zmq_server::ZmqRequest &) {
+        gRunning.store(false);
+        return totton::zmq_server::ZmqResponse{
+            totton::zmq_server::ZmqCommandServer::BuildOk(
+                "{\"shutdown\":true}")};
+      },
+      inlineOptions);
 
   std::cout << "ZMQ server listening on " << endpoint << "\n";
   if (!pubEndpoint.empty()) {
@@ -229,10 +374,19 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  // Without a PUB endpoint nobody would see the events.
+  std::optional<StateWatcher> watcher;
+  if (!pubEndpoint.empty()) {
+    watcher.emplace(statsPath, &events);
+  }
   while (gRunning.load()) {
+    if (watcher) {
+      watcher->Poll();
+    }
     std::this_thread::sleep_for(std::chrono::milliseconds(50));
   }
 
   server.Stop();
+  DacCapability::DeviceRegistry::instance().stopWatching();
   return 0;
 }
@@ -0,0 +1,178 @@
+#include "io/audio_ring_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// SPSC throughput benchmark for AudioRingBuffer.
+//
+// A producer and a consumer thread stream a counting sequence through the
+// ring in fixed-size blocks, once through the copying write()/read() API and
+// once through the in-place prepareWrite()/peekRead() span API. Not part of
+// ctest; run manually to compare boards or changes:
+//   ./audio_ring_buffer_bench [--samples N] [--block N] [--capacity N]
+
+namespace {
+
+struct BenchOptions {
+  std::size_t samples = std::size_t{1} << 26;
+  std::size_t block = 256;
+  std::size_t capacity = 8192;
+};
+
+struct BenchResult {
+  double seconds = 0.0;
+  bool mismatch = false;
+};
+
+template <typename ProduceFn, typename ConsumeFn>
+BenchResult RunSpsc(const BenchOptions &options, ProduceFn produce,
+                    ConsumeFn consume) {
+  std::atomic<bool> mismatch{false};
+  const auto start = std::chrono::steady_clock::now();
+
+  std::thread producer([&]() {
+    std::size_t written = 0;
+    while (written < options.samples) {
+      if (produce(written)) {
+        written += options.block;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::thread consumer([&]() {
+    std::size_t read = 0;
+    while (read < options.samples) {
+      bool ok = false;
+      if (consume(read, &ok)) {
+        if (!ok) {
+          mismatch.store(true, std::memory_order_relaxed);
+        }
+        read += options.block;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  producer.join();
+  consumer.join();
+  const auto end = std::chrono::steady_clock::now();
+
+  BenchResult result;
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.mismatch = mismatch.load();
+  return result;
+}
+
+BenchResult BenchCopy(const BenchOptions &options) {
+  AudioRingBuffer buffer;
+  buffer.init(options.capacity);
+  std::vector<float> in(options.block);
+  std::vector<float> out(options.block);
+  return RunSpsc(
+      options,
+      [&](std::size_t written) {
+        for (std::size_t i = 0; i < options.block; ++i) {
+          in[i] = static_cast<float>((written + i) & 0xFFFF);
+        }
+        return buffer.write(in.data(), options.block);
+      },
+      [&](std::size_t read, bool *ok) {
+        if (!buffer.read(out.data(), options.block)) {
+          return false;
+        }
+        *ok = out[0] == static_cast<float>(read & 0xFFFF);
+        return true;
+      });
+}
+
+BenchResult BenchSpan(const BenchOptions &options) {
+  AudioRingBuffer buffer;
+  buffer.init(options.capacity);
+  return RunSpsc(
+      options,
+      [&](std::size_t written) {
+        AudioRingBuffer::WriteSpan span = buffer.prepareWrite(options.block);
+        if (span.empty()) {
+          return false;
+        }
+        for (std::size_t i = 0; i < span.firstSize; ++i) {
+          span.first[i] = static_cast<float>((written + i) & 0xFFFF);
+        }
+        for (std::size_t i = 0; i < span.secondSize; ++i) {
+          span.second[i] =
+              static_cast<float>((written + span.firstSize + i) & 0xFFFF);
+        }
+        buffer.commitWrite(options.block);
+        return true;
+      },
+      [&](std::size_t read, bool *ok) {
+        AudioRingBuffer::ReadSpan span = buffer.peekRead(options.block);
+        if (span.empty()) {
+          return false;
+        }
+        *ok = span.first[0] == static_cast<float>(read & 0xFFFF);
+        buffer.consume(options.block);
+        return true;
+      });
+}
+
+void Report(const char *name, const BenchOptions &options,
+            const BenchResult &result) {
+  const double samples = static_cast<double>(options.samples);
+  std::cout << name << ": " << (samples / result.seconds) / 1e6
+            << " Msamples/s, " << (result.seconds * 1e9) / samples
+            << " ns/sample" << (result.mismatch ? " (DATA MISMATCH)" : "")
+            << "\n";
+}
+
+bool ParseArgs(int argc, char **argv, BenchOptions *options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return false;
+    }
+    const std::size_t value = std::stoull(argv[++i]);
+    if (arg == "--samples") {
+      options->samples = value;
+    } else if (arg == "--block") {
+      options->block = value;
+    } else if (arg == "--capacity") {
+      options->capacity = value;
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return false;
+    }
+  }
+  if (options->block == 0 || options->block > options->capacity) {
+    std::cerr << "--block must be in [1, capacity]\n";
+    return false;
+  }
+  options->samples -= options->samples % options->block;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!ParseArgs(argc, argv, &options)) {
+    return 1;
+  }
+
+  std::cout << "AudioRingBuffer SPSC: " << options.samples << " samples, block "
+            << options.block << ", capacity " << options.capacity << "\n";
+  const BenchResult copy = BenchCopy(options);
+  Report("write/read", options, copy);
+  const BenchResult span = BenchSpan(options);
+  Report("prepareWrite/peekRead", options, span);
+  return (copy.mismatch || span.mismatch) ? 1 : 0;
+}
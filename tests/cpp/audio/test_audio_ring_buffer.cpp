@@ -195,6 +195,78 @@ bool TestMultipleWriteReadCycles() {
   return true;
 }
 
+bool TestPrepareWriteSplitsAtWrap() {
+  AudioRingBuffer buffer;
+  buffer.init(8);
+  std::vector<float> data(6, 1.0f);
+  if (!Expect(buffer.write(data.data(), data.size()), "Fill before wrap") ||
+      !Expect(buffer.read(data.data(), data.size()), "Drain before wrap")) {
+    return false;
+  }
+  AudioRingBuffer::WriteSpan span = buffer.prepareWrite(5);
+  if (!ExpectSizeEq(span.firstSize, 2, "First segment ends at storage end") ||
+      !ExpectSizeEq(span.secondSize, 3, "Second segment wraps to start")) {
+    return false;
+  }
+  for (size_t i = 0; i < span.firstSize; ++i) {
+    span.first[i] = static_cast<float>(i);
+  }
+  for (size_t i = 0; i < span.secondSize; ++i) {
+    span.second[i] = static_cast<float>(span.firstSize + i);
+  }
+  if (!ExpectSizeEq(buffer.availableToRead(), 0,
+                    "Prepared samples are not visible before commit")) {
+    return false;
+  }
+  buffer.commitWrite(5);
+  std::vector<float> readData(5);
+  if (!Expect(buffer.read(readData.data(), readData.size()),
+              "Read committed span")) {
+    return false;
+  }
+  for (size_t i = 0; i < readData.size(); ++i) {
+    if (!Expect(readData[i] == static_cast<float>(i), "Span data mismatch")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TestPrepareWriteFailsWhenFull() {
+  AudioRingBuffer buffer;
+  buffer.init(100);
+  if (!Expect(buffer.prepareWrite(100).size() == 100, "Prepare full span")) {
+    return false;
+  }
+  buffer.commitWrite(100);
+  return Expect(buffer.prepareWrite(1).empty(), "Prepare fails when full") &&
+         Expect(buffer.prepareWrite(101).empty(),
+                "Prepare fails over capacity");
+}
+
+bool TestPeekReadDoesNotConsume() {
+  AudioRingBuffer buffer;
+  buffer.init(16);
+  std::vector<float> data = {1.0f, 2.0f, 3.0f, 4.0f};
+  if (!Expect(buffer.write(data.data(), data.size()), "Write before peek")) {
+    return false;
+  }
+  AudioRingBuffer::ReadSpan span = buffer.peekRead(3);
+  if (!ExpectSizeEq(span.size(), 3, "Peek span size") ||
+      !Expect(span.first[0] == 1.0f && span.first[2] == 3.0f,
+              "Peek span data")) {
+    return false;
+  }
+  if (!ExpectSizeEq(buffer.availableToRead(), 4, "Peek does not consume")) {
+    return false;
+  }
+  buffer.consume(3);
+  if (!ExpectSizeEq(buffer.availableToRead(), 1, "Consume releases samples")) {
+    return false;
+  }
+  return Expect(buffer.peekRead(2).empty(), "Peek fails when under available");
+}
+
 bool TestUninitializedBufferWriteReturnsFalse() {
   AudioRingBuffer buffer;
   std::vector<float> data(10, 1.0f);
@@ -369,6 +441,9 @@ int main() {
       {"WrapAroundWriteThenRead", TestWrapAroundWriteThenRead},
       {"ClearResetsBuffer", TestClearResetsBuffer},
       {"MultipleWriteReadCycles", TestMultipleWriteReadCycles},
+      {"PrepareWriteSplitsAtWrap", TestPrepareWriteSplitsAtWrap},
+      {"PrepareWriteFailsWhenFull", TestPrepareWriteFailsWhenFull},
+      {"PeekReadDoesNotConsume", TestPeekReadDoesNotConsume},
       {"UninitializedWriteReturnsFalse",
        TestUninitializedBufferWriteReturnsFalse},
       {"UninitializedReadReturnsFalse",
@@ -8,6 +8,7 @@
  * - Output rate negotiation
  * - Cross-family switching detection (requiresReconfiguration flag)
  * - DAC capability validation
+ * - Resampling inputs with no integer path to the DAC
  */
 
 #include "audio/auto_negotiation.h"
@@ -232,11 +233,98 @@ void testErrorCases() {
   config = negotiate(-1, dac);
   assert(!config.isValid);
 
-  // Unsupported ratio (11025Hz would require 64x)
+  std::cout << "  ✓ Error case tests passed" << std::endl;
+}
+
+// Test inputs that are resampled ahead of the upsampler
+void testResampledInputs() {
+  std::cout << "Testing resampled inputs..." << std::endl;
+
+  assert(getResampleRate(44100, 705600) == 44100);
+  assert(getResampleRate(22050, 705600) == 44100);
+  assert(getResampleRate(44100, 768000) == 48000);
+  assert(getResampleRate(96000, 705600) == 176400);
+  assert(getResampleRate(768000, 192000) == 192000);
+  assert(getResampleRate(0, 705600) == 0);
+
+  auto dac = createFullCapabilityDac();
+  auto config = negotiate(44100, dac);
+  assert(config.resampleRate == 0);
+
+  // Below the families: 11025Hz would need 64x, 32000Hz is not a multiple
   config = negotiate(11025, dac);
+  assert(config.isValid);
+  assert(config.resampleRate == 44100);
+  assert(config.outputRate == 705600);
+  assert(config.upsampleRatio == 16);
+
+  config = negotiate(32000, dac, 0, 1000);
+  assert(config.isValid);
+  assert(config.resampleRate == 48000);
+  assert(config.outputRate == 768000);
+  assert(config.upsampleRatio == 16);
+  assert(config.periodFrames == 24000);
+
+  // A DAC that only runs the 48kHz family
+  dac.supportedRates = {48000, 96000, 192000, 384000, 768000};
+  config = negotiate(44100, dac);
+  assert(config.isValid);
+  assert(config.resampleRate == 48000);
+  assert(config.outputRate == 768000);
+  assert(config.upsampleRatio == 16);
+
+  // Above the DAC's best rate
+  auto limited = createLimitedDac();
+  config = negotiate(384000, limited);
+  assert(config.isValid);
+  assert(config.resampleRate == 192000);
+  assert(config.outputRate == 192000);
+  assert(config.upsampleRatio == 1);
+
+  std::cout << "  ✓ Resampled input tests passed" << std::endl;
+}
+
+void testOutputLayout() {
+  std::cout << "Testing output layout selection..." << std::endl;
+
+  // Without probed details: S32_LE, the upsampled period, two periods
+  auto dac = createFullCapabilityDac();
+  auto config = negotiate(48000, dac, 0, 256);
+  assert(config.isValid);
+  assert(config.outputFormat == DacCapability::SampleFormat::S32_LE);
+  assert(config.periodFrames == 256 * 16);
+  assert(config.bufferFrames == 2 * config.periodFrames);
+  assert(config.latencyMs > 10.6 && config.latencyMs < 10.7);
+
+  // A USB DAC: no S32_LE, period and buffer capped, batch position updates
+  dac.formats = {DacCapability::SampleFormat::S16_LE,
+                 DacCapability::SampleFormat::S24_3LE};
+  dac.minPeriodFrames = 64;
+  dac.maxPeriodFrames = 3000;
+  dac.maxBufferFrames = 8000;
+  dac.isBatch = true;
+  config = negotiate(48000, dac, 0, 256);
+  assert(config.isValid);
+  assert(config.outputFormat == DacCapability::SampleFormat::S24_3LE);
+  assert(config.periodFrames == 3000);
+  assert(config.bufferFrames == 8000);
+
+  // Buffer too small for two upsampled periods
+  dac.maxPeriodFrames = 0;
+  dac.maxBufferFrames = 4096;
+  config = negotiate(48000, dac, 0, 1024);
+  assert(config.isValid);
+  assert(config.periodFrames == 2048);
+  assert(config.bufferFrames == 4096);
+
+  // Only formats the output conversion cannot write
+  dac.formats = {DacCapability::SampleFormat::S24_LE,
+                 DacCapability::SampleFormat::FLOAT_LE};
+  config = negotiate(48000, dac);
   assert(!config.isValid);
+  assert(!config.errorMessage.empty());
 
-  std::cout << "  ✓ Error case tests passed" << std::endl;
+  std::cout << "  ✓ Output layout tests passed" << std::endl;
 }
 
 int main() {
@@ -250,6 +338,8 @@ int main() {
   testLimitedDac();
   testRangeOnlyDac();
   testErrorCases();
+  testResampledInputs();
+  testOutputLayout();
 
   std::cout << "\n✓ All tests passed!\n" << std::endl;
   return 0;
@@ -0,0 +1,95 @@
+#include "io/dac_capability.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Covers DacCapability::DeviceRegistry against a scratch directory standing
+// in for /dev/snd: creating or removing a node re-enumerates the cards.
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool WaitForGeneration(const DacCapability::DeviceRegistry &registry,
+                       uint64_t generation) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(3);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (registry.generation() >= generation) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+bool TestEnumerate() {
+  const auto list = DacCapability::enumerateDevices();
+  return Expect(!list.playback.empty() && list.playback[0].value == "default",
+                "playback list starts with default") &&
+         Expect(!list.capture.empty() && list.capture[0].value == "default",
+                "capture list starts with default");
+}
+
+bool TestHotplug() {
+  const auto dir = std::filesystem::temp_directory_path() /
+                   ("totton_device_registry_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+
+  DacCapability::DeviceRegistry registry;
+  bool ok = Expect(!registry.watching(), "idle registry is not watching") &&
+            Expect(registry.startWatching(dir.string()), "watcher starts") &&
+            Expect(registry.watching(), "registry is watching") &&
+            Expect(registry.generation() == 0, "no refresh before hotplug") &&
+            Expect(!registry.devices().playback.empty(), "cached list");
+
+  if (ok) {
+    std::ofstream(dir / "pcmC9D0p") << "";
+    ok = Expect(WaitForGeneration(registry, 1), "node added");
+  }
+  if (ok) {
+    std::filesystem::remove(dir / "pcmC9D0p");
+    ok = Expect(WaitForGeneration(registry, 2), "node removed");
+  }
+  if (ok) {
+    ok = Expect(!registry.capability("hw:99").isValid,
+                "missing device scan fails");
+  }
+
+  registry.stopWatching();
+  std::filesystem::remove_all(dir);
+  return ok && Expect(!registry.watching(), "watcher stopped");
+}
+
+} // namespace
+
+int main() {
+  std::cout << "Running device registry tests...\n";
+  int passed = 0;
+  int failed = 0;
+  for (auto test : {TestEnumerate, TestHotplug}) {
+    if (test()) {
+      ++passed;
+    } else {
+      ++failed;
+    }
+  }
+  if (failed > 0) {
+    std::cerr << failed << " test(s) failed\n";
+    return 1;
+  }
+  std::cout << "OK: " << passed << " device registry tests passed\n";
+  return 0;
+}
@@ -0,0 +1,193 @@
+#include "audio/adaptive_resampler.h"
+#include "audio/drift_controller.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::vector<float> MakeSine(std::size_t frames, unsigned int channels,
+                            double cyclesPerFrame) {
+  std::vector<float> data(frames * channels);
+  for (std::size_t i = 0; i < frames; ++i) {
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+      data[i * channels + ch] = static_cast<float>(
+          0.5 * std::sin(2.0 * kPi * cyclesPerFrame * static_cast<double>(i) +
+                         ch));
+    }
+  }
+  return data;
+}
+
+// Runs input through the resampler in uneven chunks.
+std::vector<float> Resample(totton::audio::AdaptiveResampler *resampler,
+                            const std::vector<float> &input,
+                            unsigned int channels) {
+  std::vector<float> output;
+  const std::size_t frames = input.size() / channels;
+  const std::size_t chunks[] = {37, 256, 1, 900, 64};
+  std::size_t offset = 0;
+  for (std::size_t n = 0; offset < frames; ++n) {
+    const std::size_t chunk =
+        std::min(chunks[n % (sizeof(chunks) / sizeof(chunks[0]))],
+                 frames - offset);
+    resampler->Process(input.data() + offset * channels, chunk, &output);
+    offset += chunk;
+  }
+  return output;
+}
+
+bool TestUnityRatioReproducesInput() {
+  const unsigned int channels = 2;
+  const std::size_t frames = 4000;
+  const auto input = MakeSine(frames, channels, 0.01);
+  totton::audio::AdaptiveResampler resampler;
+  resampler.Init(channels);
+  const auto output = Resample(&resampler, input, channels);
+
+  const std::size_t delay = totton::audio::AdaptiveResampler::LatencyFrames();
+  if (!Expect(output.size() / channels == frames - delay,
+              "Unity ratio emits one frame per input frame after latency")) {
+    return false;
+  }
+  double maxError = 0.0;
+  for (std::size_t i = 64; i < output.size() / channels; ++i) {
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+      maxError = std::max(maxError,
+                          std::abs(static_cast<double>(
+                              output[i * channels + ch] -
+                              input[i * channels + ch])));
+    }
+  }
+  if (maxError > 1e-3) {
+    std::cerr << "max error " << maxError << "\n";
+  }
+  return Expect(maxError < 1e-3, "Unity ratio reproduces the input");
+}
+
+bool TestRatioSetsOutputRateAndPitch() {
+  const unsigned int channels = 1;
+  const std::size_t frames = 200000;
+  const double ratio = 1.0005;
+  const double cycles = 0.02;
+  const auto input = MakeSine(frames, channels, cycles);
+  totton::audio::AdaptiveResampler resampler;
+  resampler.Init(channels);
+  resampler.SetRatio(ratio);
+  const auto output = Resample(&resampler, input, channels);
+
+  const double expected = static_cast<double>(
+      frames - totton::audio::AdaptiveResampler::LatencyFrames()) * ratio;
+  if (!Expect(std::abs(static_cast<double>(output.size()) - expected) < 2.0,
+              "Output frame count follows ratio")) {
+    return false;
+  }
+
+  // The tone must be stretched by the ratio: count rising zero crossings.
+  std::size_t crossings = 0;
+  for (std::size_t i = 1000; i < output.size(); ++i) {
+    if (output[i - 1] < 0.0f && output[i] >= 0.0f) {
+      ++crossings;
+    }
+  }
+  const double measured = static_cast<double>(crossings) /
+                          static_cast<double>(output.size() - 1000);
+  return Expect(std::abs(measured * ratio - cycles) < cycles * 1e-3,
+                "Resampled tone frequency scales by 1 / ratio");
+}
+
+bool TestEstimatorMeasuresClockRatio() {
+  totton::audio::DriftEstimator estimator(5.0);
+  const double captureRate = 48000.0;
+  const double playbackRate = 48000.0 * (1.0 + 150e-6);
+  for (int step = 0; step <= 100; ++step) {
+    const double t = 100.0 + step * 0.1;
+    estimator.AddCaptureSample(
+        static_cast<uint64_t>(step * 0.1 * captureRate), t + 0.001);
+    estimator.AddPlaybackSample(
+        static_cast<uint64_t>(step * 0.1 * playbackRate), t);
+    if (step < 50 && !Expect(!estimator.HasEstimate(),
+                             "No estimate before the window elapses")) {
+      return false;
+    }
+  }
+  return Expect(estimator.HasEstimate(), "Estimate after window") &&
+         Expect(std::abs(estimator.Ratio() - (1.0 + 150e-6)) < 5e-6,
+                "Estimator ratio matches clocks");
+}
+
+bool TestControllerHoldsFillUnderDrift() {
+  // Capture delivers 48 kHz; playback consumes 250 ppm faster. Without
+  // correction the buffer would drain 0.25 ms per second.
+  const double drift = 250e-6;
+  const double dt = 0.01;
+  totton::audio::DriftController controller;
+  double fill = 0.020;
+  double ratio = 1.0;
+  double maxDeviation = 0.0;
+  for (int step = 0; step < 60000; ++step) {
+    // Block-wise output makes the observed fill jitter by +-2 ms.
+    const double jitter = (step % 4 < 2) ? 0.002 : -0.002;
+    fill += (ratio - (1.0 + drift)) * dt;
+    ratio = controller.Update(fill + jitter, dt, 1.0);
+    if (controller.IsLocked()) {
+      maxDeviation =
+          std::max(maxDeviation, std::abs(fill - controller.TargetSeconds()));
+    }
+  }
+  if (!Expect(std::abs(ratio - (1.0 + drift)) < 5e-6,
+              "Controller converges to the clock ratio")) {
+    std::cerr << "ratio " << ratio << "\n";
+    return false;
+  }
+  if (!Expect(maxDeviation < 0.005, "Fill stays within 5 ms of target")) {
+    std::cerr << "max deviation " << maxDeviation << "\n";
+    return false;
+  }
+  return Expect(std::abs(fill - controller.TargetSeconds()) < 0.0005,
+                "Fill returns to target");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"UnityRatioReproducesInput", TestUnityRatioReproducesInput},
+      {"RatioSetsOutputRateAndPitch", TestRatioSetsOutputRateAndPitch},
+      {"EstimatorMeasuresClockRatio", TestEstimatorMeasuresClockRatio},
+      {"ControllerHoldsFillUnderDrift", TestControllerHoldsFillUnderDrift},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: drift compensation tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " drift compensation tests failed\n";
+  return 1;
+}
@@ -0,0 +1,109 @@
+#include "audio/meter_publisher.h"
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using totton::audio::MeterFrame;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+MeterFrame StereoFrame() {
+  MeterFrame frame;
+  frame.frames = 1600;
+  frame.channels = 2;
+  frame.peak[0] = 1.0f;
+  frame.rms[0] = 0.5f;
+  frame.clips[0] = 3;
+  return frame;
+}
+
+bool TestFrameJson() {
+  const std::string json = totton::audio::MeterFrameJson(StereoFrame());
+  if (!Expect(Contains(json, "{\"frames\":1600,\"channels\":["),
+              "frame count") ||
+      !Expect(Contains(json, "{\"peak_db\":0.0,\"rms_db\":-6.0,\"clips\":3}"),
+              "first channel levels") ||
+      !Expect(Contains(json, "{\"peak_db\":-160.0,\"rms_db\":-160.0,"
+                             "\"clips\":0}"),
+              "silent channel at the floor") ||
+      !Expect(!Contains(json, "spectrum_db"), "spectrum without blocks")) {
+    std::cerr << json << "\n";
+    return false;
+  }
+  MeterFrame frame = StereoFrame();
+  frame.spectrumBlocks = 4;
+  frame.spectrum[0] = 0.01f;
+  const std::string withSpectrum = totton::audio::MeterFrameJson(frame);
+  return Expect(Contains(withSpectrum, "\"spectrum_db\":[-20.0,-160.0,"),
+                "band powers in dB");
+}
+
+bool TestPublishesQueuedFrames() {
+  totton::audio::MeterQueue queue;
+  std::mutex mutex;
+  std::vector<std::string> emitted;
+  totton::audio::MeterPublisher publisher(
+      &queue,
+      [&](const std::string &json) {
+        std::lock_guard<std::mutex> lock(mutex);
+        emitted.push_back(json);
+      },
+      50.0);
+  publisher.Start();
+  queue.TryPush(StereoFrame());
+  MeterFrame second = StereoFrame();
+  second.frames = 800;
+  queue.TryPush(second);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  publisher.Stop();
+  std::lock_guard<std::mutex> lock(mutex);
+  return Expect(emitted.size() == 2, "every queued frame emitted") &&
+         Expect(Contains(emitted[0], "\"frames\":1600") &&
+                    Contains(emitted[1], "\"frames\":800"),
+                "frames emitted in queue order");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"FrameJson", TestFrameJson},
+      {"PublishesQueuedFrames", TestPublishesQueuedFrames},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: meter publisher tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " meter publisher tests failed\n";
+  return 1;
+}
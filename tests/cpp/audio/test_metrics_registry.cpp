@@ -0,0 +1,184 @@
+#include "audio/metrics_registry.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &haystack, const std::string &needle) {
+  return haystack.find(needle) != std::string::npos;
+}
+
+bool TestHistogramBucketsAndPercentiles() {
+  totton::audio::LatencyHistogram histogram;
+  // 90 samples around 1 us, 10 around 100 us.
+  for (int i = 0; i < 90; ++i) {
+    histogram.Record(1000);
+  }
+  for (int i = 0; i < 10; ++i) {
+    histogram.Record(100000);
+  }
+  const auto snapshot = histogram.Read();
+  return Expect(snapshot.count == 100, "Histogram counts samples") &&
+         Expect(snapshot.maxNs == 100000, "Histogram tracks max") &&
+         Expect(snapshot.sumNs == 90 * 1000 + 10 * 100000,
+                "Histogram sums durations") &&
+         Expect(snapshot.buckets[9] == 90, "1 us lands in [512, 1024)") &&
+         Expect(snapshot.PercentileNs(0.5) == 1023,
+                "Median reports its bucket bound") &&
+         Expect(snapshot.PercentileNs(0.99) == 100000,
+                "Tail percentile is capped at max");
+}
+
+bool TestDeadlineMissesAndWatermarks() {
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetDeadlineNs(5000);
+  metrics.RecordCycle(4000);
+  metrics.RecordCycle(5000);
+  metrics.RecordCycle(6000);
+  metrics.OutputFill().SetCapacity(1024);
+  metrics.OutputFill().Observe(300);
+  metrics.OutputFill().Observe(40);
+  metrics.OutputFill().Observe(700);
+  metrics.OutputFill().Observe(200);
+  const auto fill = metrics.OutputFill().Read();
+  return Expect(metrics.DeadlineMissCount() == 1,
+                "Only cycles over budget miss the deadline") &&
+         Expect(fill.current == 200, "Fill reports latest level") &&
+         Expect(fill.low == 40, "Fill tracks low watermark") &&
+         Expect(fill.high == 700, "Fill tracks high watermark") &&
+         Expect(fill.capacity == 1024, "Fill reports capacity") &&
+         Expect(metrics.InputFill().Read().low == 0,
+                "Unobserved low watermark reads as 0");
+}
+
+bool TestJsonMatchesStatsFileLayout() {
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetRates(44100, 88200);
+  metrics.SetMode("filter");
+  metrics.CaptureXruns()->fetch_add(2);
+  metrics.PlaybackXruns()->fetch_add(3);
+  metrics.CountOutputOverflow();
+  metrics.RecordStage(totton::audio::Stage::Fft, 2000);
+  metrics.RecordGpu(totton::audio::GpuTiming::Execute, 1500);
+  const std::string json = metrics.ToJson();
+  if (!Expect(Contains(json, "\"input_rate\":44100"), "JSON input_rate") ||
+      !Expect(Contains(json, "\"output_rate\":88200"), "JSON output_rate") ||
+      !Expect(Contains(json, "\"mode\":\"filter\""), "JSON mode") ||
+      !Expect(Contains(json, "\"xrun\":{\"total\":5,\"capture\":2,"
+                             "\"playback\":3}"),
+              "JSON audio.xrun") ||
+      !Expect(Contains(json, "\"overflow\":{\"input\":0,\"output\":1}"),
+              "JSON audio.overflow") ||
+      !Expect(Contains(json, "\"fft\":{\"count\":1,"), "JSON stage entry") ||
+      !Expect(Contains(json, "\"gpu\":{\"execute\":{\"count\":1,"),
+              "JSON GPU timing entry")) {
+    std::cerr << json << "\n";
+    return false;
+  }
+  for (const char *stage :
+       {"\"convert\"", "\"multiply\"", "\"ifft\"", "\"output\""}) {
+    if (!Expect(Contains(json, stage), "JSON lists every stage")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TestStatsFileIsReplacedAtomically() {
+  const auto dir = std::filesystem::temp_directory_path();
+  const std::string path =
+      (dir / ("metrics_registry_test_" + std::to_string(::getpid()) + ".json"))
+          .string();
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetRates(48000, 48000);
+
+  std::atomic<bool> done{false};
+  std::atomic<bool> torn{false};
+  std::thread reader([&]() {
+    while (!done.load()) {
+      std::ifstream file(path);
+      if (!file) {
+        continue;
+      }
+      std::ostringstream contents;
+      contents << file.rdbuf();
+      const std::string json = contents.str();
+      if (json.empty() || json.front() != '{' ||
+          json.find("}}}") == std::string::npos) {
+        torn.store(true);
+      }
+    }
+  });
+
+  bool ok = true;
+  std::string error;
+  for (int i = 0; i < 200 && ok; ++i) {
+    metrics.PlaybackXruns()->fetch_add(1);
+    ok = metrics.WriteStatsFile(path, &error);
+  }
+  done.store(true);
+  reader.join();
+
+  std::ifstream file(path);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  std::remove(path.c_str());
+  if (!Expect(ok, "Stats file write succeeds")) {
+    std::cerr << error << "\n";
+    return false;
+  }
+  return Expect(!torn.load(), "Readers never see a partial file") &&
+         Expect(Contains(contents.str(), "\"total\":200"),
+                "Stats file holds the latest snapshot") &&
+         Expect(!std::filesystem::exists(path + ".tmp"),
+                "Temp file is renamed away");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"HistogramBucketsAndPercentiles", TestHistogramBucketsAndPercentiles},
+      {"DeadlineMissesAndWatermarks", TestDeadlineMissesAndWatermarks},
+      {"JsonMatchesStatsFileLayout", TestJsonMatchesStatsFileLayout},
+      {"StatsFileIsReplacedAtomically", TestStatsFileIsReplacedAtomically},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: metrics registry tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " metrics registry tests failed\n";
+  return 1;
+}
@@ -0,0 +1,177 @@
+#include "audio/param_exchange.h"
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using totton::audio::ParamExchange;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Records which thread destroyed each snapshot.
+struct Snapshot {
+  static constexpr uint32_t kAlive = 0x5eed5eed;
+
+  explicit Snapshot(int value, std::vector<std::thread::id> *deletions = nullptr,
+                    std::mutex *mutex = nullptr)
+      : value(value), deletions(deletions), mutex(mutex) {}
+  ~Snapshot() {
+    magic = 0;
+    if (deletions) {
+      std::lock_guard<std::mutex> lock(*mutex);
+      deletions->push_back(std::this_thread::get_id());
+    }
+  }
+
+  uint32_t magic = kAlive;
+  int value = 0;
+  std::vector<std::thread::id> *deletions = nullptr;
+  std::mutex *mutex = nullptr;
+};
+
+bool TestEmptyBeforePublish() {
+  ParamExchange<Snapshot> exchange;
+  exchange.Collect();
+  return Expect(exchange.Acquire() == nullptr,
+                "Acquire() is null before the first Publish()");
+}
+
+bool TestNewestSnapshotWins() {
+  std::vector<std::thread::id> deletions;
+  std::mutex mutex;
+  ParamExchange<Snapshot> exchange;
+  exchange.Publish(std::make_unique<Snapshot>(1, &deletions, &mutex));
+  exchange.Publish(std::make_unique<Snapshot>(2, &deletions, &mutex));
+  if (!Expect(deletions.size() == 1,
+              "An unconsumed snapshot is freed by the next Publish()")) {
+    return false;
+  }
+  const Snapshot *current = exchange.Acquire();
+  if (!Expect(current && current->value == 2, "Newest snapshot is acquired")) {
+    return false;
+  }
+  return Expect(exchange.Acquire() == current,
+                "Acquire() keeps returning the current snapshot");
+}
+
+bool TestRetiredSnapshotsFreedOnControlSide() {
+  std::vector<std::thread::id> deletions;
+  std::mutex mutex;
+  {
+    ParamExchange<Snapshot> exchange;
+    std::thread::id audioThread;
+    std::atomic<int> seen{0};
+    std::thread audio([&]() {
+      audioThread = std::this_thread::get_id();
+      // Picks up each of the three snapshots, retiring the one before.
+      for (int expected = 1; expected <= 3; ++expected) {
+        while (true) {
+          const Snapshot *current = exchange.Acquire();
+          if (current && current->value == expected) {
+            break;
+          }
+          std::this_thread::yield();
+        }
+        seen.store(expected);
+      }
+    });
+    for (int value = 1; value <= 3; ++value) {
+      exchange.Publish(std::make_unique<Snapshot>(value, &deletions, &mutex));
+      while (seen.load() != value) {
+        std::this_thread::yield();
+      }
+    }
+    audio.join();
+    exchange.Collect();
+    if (!Expect(deletions.size() == 2, "Retired snapshots are freed")) {
+      return false;
+    }
+    for (const auto &id : deletions) {
+      if (!Expect(id != audioThread,
+                  "The audio thread never frees a snapshot")) {
+        return false;
+      }
+    }
+  }
+  return Expect(deletions.size() == 3, "The destructor frees the rest");
+}
+
+bool TestConcurrentPublishAndAcquire() {
+  constexpr int kUpdates = 200000;
+  ParamExchange<Snapshot> exchange;
+  std::atomic<bool> done{false};
+  std::atomic<bool> ok{true};
+  std::thread audio([&]() {
+    int last = 0;
+    while (!done.load(std::memory_order_acquire)) {
+      const Snapshot *current = exchange.Acquire();
+      if (!current) {
+        continue;
+      }
+      if (current->magic != Snapshot::kAlive || current->value < last) {
+        ok.store(false);
+        return;
+      }
+      last = current->value;
+    }
+  });
+  std::thread collector([&]() {
+    while (!done.load(std::memory_order_acquire)) {
+      exchange.Collect();
+    }
+  });
+  for (int value = 1; value <= kUpdates; ++value) {
+    exchange.Publish(std::make_unique<Snapshot>(value));
+  }
+  done.store(true, std::memory_order_release);
+  audio.join();
+  collector.join();
+  const Snapshot *last = exchange.Acquire();
+  return Expect(ok.load(), "Snapshots are live and arrive in order") &&
+         Expect(last && last->value == kUpdates,
+                "The final snapshot is delivered");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"EmptyBeforePublish", TestEmptyBeforePublish},
+      {"NewestSnapshotWins", TestNewestSnapshotWins},
+      {"RetiredSnapshotsFreedOnControlSide",
+       TestRetiredSnapshotsFreedOnControlSide},
+      {"ConcurrentPublishAndAcquire", TestConcurrentPublishAndAcquire},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: param_exchange tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " param_exchange tests failed\n";
+  return 1;
+}
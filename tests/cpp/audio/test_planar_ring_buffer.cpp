@@ -0,0 +1,294 @@
+#include "io/planar_ring_buffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool ExpectSizeEq(size_t actual, size_t expected, const char *message) {
+  if (actual != expected) {
+    std::cerr << "FAIL: " << message << " (got " << actual << ", expected "
+              << expected << ")\n";
+    return false;
+  }
+  return true;
+}
+
+// Sample value for frame index and channel; channels differ by a large
+// offset so a cross-channel mix-up is visible.
+float SampleValue(size_t frame, unsigned int channel) {
+  return static_cast<float>((frame & 0xFFFF) + channel * 100000u);
+}
+
+std::vector<float> MakeInterleaved(size_t startFrame, size_t frames,
+                                   unsigned int channels) {
+  std::vector<float> data(frames * channels);
+  for (size_t i = 0; i < frames; ++i) {
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+      data[i * channels + ch] = SampleValue(startFrame + i, ch);
+    }
+  }
+  return data;
+}
+
+float RegionSample(const PlanarRingBuffer::ReadRegion &region,
+                   unsigned int channel, size_t index) {
+  if (index < region.firstFrames) {
+    return region.first(channel)[index];
+  }
+  return region.second(channel)[index - region.firstFrames];
+}
+
+bool TestInitStartsEmpty() {
+  PlanarRingBuffer buffer;
+  buffer.init(2, 1000);
+  return ExpectSizeEq(buffer.channels(), 2, "Init sets channels") &&
+         ExpectSizeEq(buffer.capacityFrames(), 1000, "Init sets capacity") &&
+         ExpectSizeEq(buffer.availableToRead(), 0, "Init starts empty") &&
+         ExpectSizeEq(buffer.availableToWrite(), 1000,
+                      "Init starts writable") &&
+         Expect(buffer.epoch() == 0, "Init starts at epoch 0");
+}
+
+bool TestWriteInterleavedDeinterleaves() {
+  PlanarRingBuffer buffer;
+  buffer.init(3, 64);
+  const std::vector<float> data = MakeInterleaved(0, 10, 3);
+  if (!Expect(buffer.writeInterleaved(data.data(), 10), "Write succeeds") ||
+      !ExpectSizeEq(buffer.availableToRead(), 10, "Write counts frames")) {
+    return false;
+  }
+  PlanarRingBuffer::ReadRegion region = buffer.peekRead(10);
+  if (!ExpectSizeEq(region.frames(), 10, "Peek frames")) {
+    return false;
+  }
+  for (unsigned int ch = 0; ch < 3; ++ch) {
+    for (size_t i = 0; i < 10; ++i) {
+      if (!Expect(RegionSample(region, ch, i) == SampleValue(i, ch),
+                  "Planar data mismatch")) {
+        return false;
+      }
+    }
+  }
+  buffer.consume(10);
+  return ExpectSizeEq(buffer.availableToRead(), 0, "Consume releases frames");
+}
+
+bool TestWriteFailsWhenFull() {
+  PlanarRingBuffer buffer;
+  buffer.init(2, 100);
+  const std::vector<float> data = MakeInterleaved(0, 101, 2);
+  if (!Expect(!buffer.writeInterleaved(data.data(), 101),
+              "Write fails over capacity") ||
+      !Expect(buffer.writeInterleaved(data.data(), 100), "Write fills")) {
+    return false;
+  }
+  return Expect(!buffer.writeInterleaved(data.data(), 1),
+                "Write fails when full") &&
+         Expect(buffer.prepareWrite(1).empty(), "Prepare fails when full");
+}
+
+bool TestRegionSplitsAtWrap() {
+  PlanarRingBuffer buffer;
+  buffer.init(2, 8);
+  const std::vector<float> first = MakeInterleaved(0, 6, 2);
+  if (!Expect(buffer.writeInterleaved(first.data(), 6), "Fill before wrap") ||
+      !Expect(!buffer.peekRead(6).empty(), "Peek before wrap")) {
+    return false;
+  }
+  buffer.consume(6);
+
+  const std::vector<float> second = MakeInterleaved(6, 5, 2);
+  if (!Expect(buffer.writeInterleaved(second.data(), 5), "Wrap write")) {
+    return false;
+  }
+  PlanarRingBuffer::ReadRegion region = buffer.peekRead(5);
+  if (!ExpectSizeEq(region.firstFrames, 2, "First segment ends at storage") ||
+      !ExpectSizeEq(region.secondFrames, 3, "Second segment wraps")) {
+    return false;
+  }
+  for (unsigned int ch = 0; ch < 2; ++ch) {
+    for (size_t i = 0; i < 5; ++i) {
+      if (!Expect(RegionSample(region, ch, i) == SampleValue(6 + i, ch),
+                  "Wrapped data mismatch")) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool TestFlushDropsOnlyEarlierFrames() {
+  PlanarRingBuffer buffer;
+  buffer.init(2, 64);
+  const std::vector<float> stale = MakeInterleaved(0, 20, 2);
+  if (!Expect(buffer.writeInterleaved(stale.data(), 20), "Write stale")) {
+    return false;
+  }
+  buffer.requestFlush();
+  if (!ExpectSizeEq(buffer.availableToRead(), 20,
+                    "Flush is deferred to the consumer") ||
+      !Expect(buffer.epoch() == 0, "Epoch unchanged before service")) {
+    return false;
+  }
+  const std::vector<float> fresh = MakeInterleaved(100, 4, 2);
+  if (!Expect(buffer.writeInterleaved(fresh.data(), 4), "Write fresh")) {
+    return false;
+  }
+  PlanarRingBuffer::ReadRegion region = buffer.peekRead(4);
+  if (!Expect(buffer.epoch() == 1, "Peek services flush") ||
+      !ExpectSizeEq(buffer.availableToRead(), 4, "Stale frames dropped") ||
+      !ExpectSizeEq(region.frames(), 4, "Fresh frames readable")) {
+    return false;
+  }
+  if (!Expect(RegionSample(region, 0, 0) == SampleValue(100, 0) &&
+                  RegionSample(region, 1, 3) == SampleValue(103, 1),
+              "Fresh data survives flush")) {
+    return false;
+  }
+  buffer.consume(4);
+  buffer.requestFlush();
+  buffer.peekRead(1);
+  return Expect(buffer.epoch() == 1, "Flush of empty ring is a no-op");
+}
+
+// Sizing a drain-everything read after a flush must not count the frames
+// the flush drops, or the whole request fails.
+bool TestReadableAppliesFlush() {
+  PlanarRingBuffer buffer;
+  buffer.init(2, 64);
+  const std::vector<float> stale = MakeInterleaved(0, 20, 2);
+  const std::vector<float> fresh = MakeInterleaved(200, 6, 2);
+  if (!Expect(buffer.writeInterleaved(stale.data(), 20), "Write stale")) {
+    return false;
+  }
+  buffer.requestFlush();
+  if (!Expect(buffer.writeInterleaved(fresh.data(), 6), "Write fresh")) {
+    return false;
+  }
+  const size_t frames = buffer.readable();
+  const PlanarRingBuffer::ReadRegion region = buffer.peekRead(frames);
+  return ExpectSizeEq(frames, 6, "Readable excludes flushed frames") &&
+         Expect(buffer.epoch() == 1, "Readable services flush") &&
+         ExpectSizeEq(region.frames(), 6, "Peek of readable succeeds") &&
+         Expect(RegionSample(region, 1, 0) == SampleValue(200, 1),
+                "Region starts at first fresh frame");
+}
+
+bool TestConcurrentFlushKeepsFramesAligned() {
+  PlanarRingBuffer buffer;
+  const unsigned int channels = 4;
+  buffer.init(channels, 1024);
+  const size_t totalFrames = 1 << 17;
+  const size_t block = 48;
+  std::atomic<bool> producerDone{false};
+  std::atomic<bool> mismatch{false};
+
+  std::thread producer([&]() {
+    std::vector<float> data;
+    size_t written = 0;
+    while (written < totalFrames) {
+      data = MakeInterleaved(written, block, channels);
+      if (buffer.writeInterleaved(data.data(), block)) {
+        written += block;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    producerDone.store(true, std::memory_order_release);
+  });
+
+  // Control thread: flushes at arbitrary points while both sides run.
+  std::thread control([&]() {
+    while (!producerDone.load(std::memory_order_acquire)) {
+      buffer.requestFlush();
+      std::this_thread::yield();
+    }
+  });
+
+  size_t lastFrame = 0;
+  bool haveLast = false;
+  uint64_t lastEpoch = 0;
+  while (!mismatch.load(std::memory_order_relaxed)) {
+    PlanarRingBuffer::ReadRegion region = buffer.peekRead(block);
+    if (buffer.epoch() != lastEpoch) {
+      lastEpoch = buffer.epoch();
+      haveLast = false;
+    }
+    if (region.empty()) {
+      if (producerDone.load(std::memory_order_acquire) &&
+          buffer.availableToRead() < block) {
+        break;
+      }
+      std::this_thread::yield();
+      continue;
+    }
+    for (size_t i = 0; i < block; ++i) {
+      const float base = RegionSample(region, 0, i);
+      for (unsigned int ch = 1; ch < channels; ++ch) {
+        if (RegionSample(region, ch, i) != base + ch * 100000.0f) {
+          mismatch.store(true, std::memory_order_relaxed);
+        }
+      }
+      const size_t frame = static_cast<size_t>(base);
+      if (haveLast && frame != ((lastFrame + 1) & 0xFFFF)) {
+        // Frames must stay contiguous within one epoch.
+        mismatch.store(true, std::memory_order_relaxed);
+      }
+      lastFrame = frame;
+      haveLast = true;
+    }
+    buffer.consume(block);
+  }
+
+  producer.join();
+  control.join();
+  return Expect(!mismatch.load(), "Concurrent flush data mismatch");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"InitStartsEmpty", TestInitStartsEmpty},
+      {"WriteInterleavedDeinterleaves", TestWriteInterleavedDeinterleaves},
+      {"WriteFailsWhenFull", TestWriteFailsWhenFull},
+      {"RegionSplitsAtWrap", TestRegionSplitsAtWrap},
+      {"FlushDropsOnlyEarlierFrames", TestFlushDropsOnlyEarlierFrames},
+      {"ReadableAppliesFlush", TestReadableAppliesFlush},
+      {"ConcurrentFlushKeepsFramesAligned",
+       TestConcurrentFlushKeepsFramesAligned},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: PlanarRingBuffer tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " PlanarRingBuffer tests failed\n";
+  return 1;
+}
@@ -0,0 +1,156 @@
+#include "audio/rate_detector.h"
+
+#include <cstdint>
+#include <iostream>
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Feeds `seconds` of status samples every 10 ms for a source running at
+// sourceRate, continuing from *frames and *time. Returns the first non-zero
+// detection.
+unsigned int Feed(totton::audio::RateDetector *detector, double sourceRate,
+                  double seconds, uint64_t *frames, double *time) {
+  unsigned int detected = 0;
+  for (double elapsed = 0.0; elapsed < seconds; elapsed += 0.01) {
+    *time += 0.01;
+    *frames += static_cast<uint64_t>(sourceRate * 0.01);
+    const unsigned int rate = detector->AddSample(*frames, *time);
+    if (detected == 0) {
+      detected = rate;
+    }
+  }
+  return detected;
+}
+
+bool TestStandardRates() {
+  using totton::audio::NearestStandardRate;
+  return Expect(NearestStandardRate(44100.0) == 44100, "exact rate") &&
+         Expect(NearestStandardRate(48100.0) == 48000, "within tolerance") &&
+         Expect(NearestStandardRate(46000.0) == 0, "between families") &&
+         Expect(NearestStandardRate(768000.0) == 768000, "highest rate");
+}
+
+bool TestSteadySourceIsQuiet() {
+  totton::audio::RateDetector detector;
+  detector.Reset(44100);
+  uint64_t frames = 1000;
+  double time = 10.0;
+  // 100 ppm of clock drift is not a rate change.
+  return Expect(Feed(&detector, 44104.4, 3.0, &frames, &time) == 0,
+                "drifting clock reported as a change") &&
+         Expect(detector.MeasuredRate() > 44000.0, "measured rate");
+}
+
+bool TestDetectsCrossAndSameFamilyChanges() {
+  totton::audio::RateDetector detector;
+  detector.Reset(44100);
+  uint64_t frames = 0;
+  double time = 1.0;
+  if (!Expect(Feed(&detector, 44100.0, 1.0, &frames, &time) == 0,
+              "nominal rate") ||
+      !Expect(Feed(&detector, 48000.0, 2.0, &frames, &time) == 48000,
+              "44.1k to 48k")) {
+    return false;
+  }
+  detector.Reset(48000);
+  return Expect(Feed(&detector, 96000.0, 2.0, &frames, &time) == 96000,
+                "48k to 96k");
+}
+
+bool TestNeedsConfirmation() {
+  totton::audio::RateDetector detector(0.5, 2);
+  detector.Reset(48000);
+  uint64_t frames = 0;
+  double time = 1.0;
+  // One odd window (a burst after a stall) is not enough.
+  return Expect(Feed(&detector, 48000.0, 1.0, &frames, &time) == 0,
+                "nominal rate") &&
+         Expect(Feed(&detector, 88200.0, 0.55, &frames, &time) == 0,
+                "single window reported") &&
+         Expect(Feed(&detector, 48000.0, 1.0, &frames, &time) == 0,
+                "back to nominal");
+}
+
+bool TestIgnoresMissingTimestamps() {
+  totton::audio::RateDetector detector;
+  detector.Reset(44100);
+  unsigned int detected = 0;
+  for (uint64_t frames = 0; frames < 500000; frames += 441) {
+    detected |= detector.AddSample(frames, 0.0);
+  }
+  return Expect(detected == 0, "untimestamped samples reported a change");
+}
+
+// The source switched to 96k but the capture PCM could only be reopened at
+// 48k again: 96k must not be reported on every period after that.
+bool TestFailedReopenIsHeldBack() {
+  totton::audio::RateChangeGate gate;
+  gate.Rearm(48000, 0);
+  if (!Expect(gate.Update(96000, true) == 96000, "switch reported")) {
+    return false;
+  }
+  gate.Rearm(48000, 96000);
+  if (!Expect(gate.Rejected() == 96000, "rejected rate recorded") ||
+      !Expect(gate.Update(96000, false) == 0, "re-read reported again") ||
+      !Expect(gate.Update(96000, false) == 0, "measurement reported again") ||
+      !Expect(gate.Rejected() == 96000, "rejection kept")) {
+    return false;
+  }
+  // A new announcement of the same rate is worth one more try.
+  if (!Expect(gate.Update(96000, true) == 96000, "new event not retried")) {
+    return false;
+  }
+  gate.Rearm(48000, 96000);
+  // The source moving on ends the rejection, back at the PCM's rate too.
+  if (!Expect(gate.Update(44100, false) == 44100, "other rate held back") ||
+      !Expect(gate.Rejected() == 0, "rejection cleared by other rate")) {
+    return false;
+  }
+  gate.Rearm(48000, 96000);
+  return Expect(gate.Update(48000, false) == 0, "nominal rate reported") &&
+         Expect(gate.Rejected() == 0, "rejection cleared by nominal rate") &&
+         Expect(gate.Update(96000, false) == 96000,
+                "later switch held back");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"StandardRates", TestStandardRates},
+      {"SteadySourceIsQuiet", TestSteadySourceIsQuiet},
+      {"DetectsCrossAndSameFamilyChanges",
+       TestDetectsCrossAndSameFamilyChanges},
+      {"NeedsConfirmation", TestNeedsConfirmation},
+      {"IgnoresMissingTimestamps", TestIgnoresMissingTimestamps},
+      {"FailedReopenIsHeldBack", TestFailedReopenIsHeldBack},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: rate detector tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " rate detector tests failed\n";
+  return 1;
+}
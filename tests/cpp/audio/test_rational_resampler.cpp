@@ -0,0 +1,228 @@
+#include "audio/rational_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::vector<float> Sine(double frequency, double rate, std::size_t frames,
+                        unsigned int channels) {
+  std::vector<float> samples(frames * channels);
+  for (std::size_t i = 0; i < frames; ++i) {
+    const auto value = static_cast<float>(
+        0.5 * std::sin(2.0 * kPi * frequency * static_cast<double>(i) / rate));
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+      samples[i * channels + ch] = value;
+    }
+  }
+  return samples;
+}
+
+// Runs input through the resampler in chunks of chunkFrames.
+std::vector<float> Run(totton::audio::RationalResampler *resampler,
+                       const std::vector<float> &input, unsigned int channels,
+                       std::size_t chunkFrames) {
+  std::vector<float> output;
+  const std::size_t frames = input.size() / channels;
+  for (std::size_t start = 0; start < frames; start += chunkFrames) {
+    const std::size_t count = std::min(chunkFrames, frames - start);
+    if (!resampler->Process(&input[start * channels], count, &output)) {
+      return {};
+    }
+  }
+  return output;
+}
+
+// Amplitude of frequency in channel 0, from frames [begin, end).
+double Amplitude(const std::vector<float> &samples, unsigned int channels,
+                 double frequency, double rate, std::size_t begin,
+                 std::size_t end) {
+  double re = 0.0;
+  double im = 0.0;
+  for (std::size_t i = begin; i < end; ++i) {
+    const double angle = 2.0 * kPi * frequency * static_cast<double>(i) / rate;
+    re += samples[i * channels] * std::cos(angle);
+    im += samples[i * channels] * std::sin(angle);
+  }
+  return 2.0 * std::sqrt(re * re + im * im) / static_cast<double>(end - begin);
+}
+
+double Rms(const std::vector<float> &samples, unsigned int channels,
+           std::size_t begin, std::size_t end) {
+  double sum = 0.0;
+  for (std::size_t i = begin; i < end; ++i) {
+    sum += samples[i * channels] * samples[i * channels];
+  }
+  return std::sqrt(sum / static_cast<double>(end - begin));
+}
+
+bool TestReducesRatio() {
+  totton::audio::RationalResampler resampler;
+  std::string error;
+  if (!Expect(resampler.Init(2, 44100, 48000, &error), "44.1k to 48k")) {
+    return false;
+  }
+  if (!Expect(resampler.Interpolation() == 160 &&
+                  resampler.Decimation() == 147,
+              "160/147") ||
+      !Expect(resampler.Taps() % 8 == 0, "taps padded to SIMD blocks")) {
+    return false;
+  }
+  if (!Expect(resampler.Init(2, 96000, 44100, &error), "96k to 44.1k") ||
+      !Expect(resampler.Taps() > 128, "decimating kernel is stretched")) {
+    return false;
+  }
+  return Expect(resampler.Init(1, 11025, 48000, &error) &&
+                    resampler.Interpolation() == 640,
+                "11.025k to 48k") &&
+         Expect(!resampler.Init(1, 44100, 48001, &error) && !error.empty(),
+                "ratio without a small L rejected") &&
+         Expect(!resampler.Init(0, 44100, 48000, &error), "no channels");
+}
+
+bool TestOutputLength() {
+  totton::audio::RationalResampler resampler;
+  std::string error;
+  resampler.Init(2, 44100, 48000, &error);
+  const std::vector<float> input(1024 * 2, 0.0f);
+  std::vector<float> output;
+  std::size_t total = 0;
+  for (int call = 0; call < 147; ++call) {
+    output.clear();
+    if (!resampler.Process(input.data(), 1024, &output)) {
+      return Expect(false, "process");
+    }
+    const std::size_t frames = output.size() / 2;
+    if (!Expect(frames == resampler.MinOutputFrames(1024) ||
+                    frames == resampler.MinOutputFrames(1024) + 1,
+                "frames per call")) {
+      return false;
+    }
+    total += frames;
+  }
+  // 147 calls of 1024 frames are exactly 160 * 1024 output frames.
+  return Expect(total == 160 * 1024, "total output frames");
+}
+
+bool TestDcGain() {
+  totton::audio::RationalResampler resampler;
+  std::string error;
+  resampler.Init(1, 32000, 48000, &error);
+  const std::vector<float> input(8000, 0.25f);
+  const auto output = Run(&resampler, input, 1, 500);
+  for (std::size_t i = resampler.Taps() * 2; i < output.size(); ++i) {
+    if (std::fabs(output[i] - 0.25f) > 1e-4f) {
+      return Expect(false, "DC gain");
+    }
+  }
+  return Expect(output.size() == 12000, "32k to 48k length");
+}
+
+bool TestPreservesSine() {
+  totton::audio::RationalResampler resampler;
+  std::string error;
+  resampler.Init(2, 44100, 48000, &error);
+  const auto input = Sine(1000.0, 44100.0, 44100, 2);
+  const auto output = Run(&resampler, input, 2, 441);
+  const std::size_t frames = output.size() / 2;
+  const double amplitude =
+      Amplitude(output, 2, 1000.0, 48000.0, 4800, frames - 4800);
+  const double offTone =
+      Amplitude(output, 2, 1000.0 * 44100.0 / 48000.0, 48000.0, 4800,
+                frames - 4800);
+  return Expect(frames == 48000, "one second in, one second out") &&
+         Expect(std::fabs(amplitude - 0.5) < 0.005, "1 kHz amplitude") &&
+         Expect(offTone < 0.01, "tone lands at 1 kHz of the output rate") &&
+         Expect(output[4800 * 2] == output[4800 * 2 + 1], "channels equal");
+}
+
+bool TestRejectsAliases() {
+  totton::audio::RationalResampler resampler;
+  std::string error;
+  resampler.Init(1, 48000, 44100, &error);
+  // Above the output Nyquist: must not fold back into the audio band.
+  const auto input = Sine(23000.0, 48000.0, 48000, 1);
+  const auto output = Run(&resampler, input, 1, 1000);
+  const double rms = Rms(output, 1, 4410, output.size() - 4410);
+  return Expect(rms < 0.5 * 1e-4, "23 kHz rejected by 80 dB");
+}
+
+bool TestChunkingIsTransparent() {
+  totton::audio::RationalResampler whole;
+  totton::audio::RationalResampler chunked;
+  std::string error;
+  whole.Init(2, 48000, 44100, &error);
+  chunked.Init(2, 48000, 44100, &error);
+  chunked.Reserve(1024);
+  const auto input = Sine(440.0, 48000.0, 9600, 2);
+  const auto reference = Run(&whole, input, 2, 9600);
+  const auto output = Run(&chunked, input, 2, 7);
+  if (!Expect(output.size() == reference.size(), "chunked length")) {
+    return false;
+  }
+  for (std::size_t i = 0; i < output.size(); ++i) {
+    if (output[i] != reference[i]) {
+      return Expect(false, "chunked output differs");
+    }
+  }
+  return true;
+}
+
+bool TestReset() {
+  totton::audio::RationalResampler resampler;
+  std::string error;
+  resampler.Init(1, 44100, 48000, &error);
+  const auto input = Sine(1000.0, 44100.0, 4410, 1);
+  const auto first = Run(&resampler, input, 1, 4410);
+  resampler.Reset();
+  const auto second = Run(&resampler, input, 1, 4410);
+  return Expect(first == second, "reset restarts the stream");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"ReducesRatio", TestReducesRatio},
+      {"OutputLength", TestOutputLength},
+      {"DcGain", TestDcGain},
+      {"PreservesSine", TestPreservesSine},
+      {"RejectsAliases", TestRejectsAliases},
+      {"ChunkingIsTransparent", TestChunkingIsTransparent},
+      {"Reset", TestReset},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: rational resampler tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " rational resampler tests failed\n";
+  return 1;
+}
@@ -0,0 +1,164 @@
+#include "audio/rt_log.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using totton::audio::rtlog::Code;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::size_t CountOccurrences(const std::string &text,
+                             const std::string &needle) {
+  std::size_t count = 0;
+  for (std::size_t pos = text.find(needle); pos != std::string::npos;
+       pos = text.find(needle, pos + needle.size())) {
+    ++count;
+  }
+  return count;
+}
+
+bool TestFormatsRecords() {
+  totton::audio::rtlog::Record record;
+  record.code = Code::RecoverFailed;
+  std::snprintf(record.text, sizeof(record.text), "ALSA capture");
+  record.detail = "Broken pipe";
+  if (!Expect(totton::audio::rtlog::Format(record) ==
+                  "ALSA capture: recover failed: Broken pipe",
+              "Label and static detail are formatted")) {
+    return false;
+  }
+  record = totton::audio::rtlog::Record{};
+  record.code = Code::DriftLocked;
+  record.arg0 = 42500;
+  return Expect(totton::audio::rtlog::Format(record) ==
+                    "Drift compensation locked: target 42.5 ms",
+                "Integer arguments are formatted");
+}
+
+bool TestWriterDrainsInOrder() {
+  std::ostringstream out;
+  totton::audio::rtlog::StartWriter(&out);
+  if (!Expect(totton::audio::rtlog::WriterRunning(), "Writer running")) {
+    return false;
+  }
+  totton::audio::rtlog::Post(Code::XrunRecovered, "ALSA playback");
+  totton::audio::rtlog::Post(Code::PcmError, "ALSA capture", "No such device");
+  totton::audio::rtlog::StopWriter();
+  const std::string text = out.str();
+  const std::size_t xrun = text.find("ALSA playback: XRUN recovered\n");
+  const std::size_t error = text.find("ALSA capture error: No such device\n");
+  return Expect(xrun != std::string::npos && error != std::string::npos,
+                "Queued records are written on stop") &&
+         Expect(xrun < error, "Records keep their order");
+}
+
+bool TestLongTextIsTruncated() {
+  std::ostringstream out;
+  const std::string longText(500, 'x');
+  totton::audio::rtlog::StartWriter(&out);
+  totton::audio::rtlog::Post(Code::VkfftFallback, longText.c_str());
+  totton::audio::rtlog::StopWriter();
+  const std::string expected =
+      "falling back to CPU: " +
+      std::string(totton::audio::rtlog::kTextBytes - 1, 'x') + "\n";
+  return Expect(out.str().find(expected) != std::string::npos,
+                "Text is copied up to kTextBytes - 1");
+}
+
+bool TestRateLimitsPerCode() {
+  std::ostringstream out;
+  totton::audio::rtlog::StartWriter(&out);
+  for (int i = 0; i < 20; ++i) {
+    totton::audio::rtlog::Post(Code::InputOverflow);
+  }
+  totton::audio::rtlog::Post(Code::OutputUnderrun);
+  totton::audio::rtlog::StopWriter();
+  const std::string text = out.str();
+  const std::size_t limit = totton::audio::rtlog::kBurstPerSecond;
+  return Expect(CountOccurrences(text, "Input buffer overflow") == limit,
+                "Burst limit applies per code") &&
+         Expect(text.find("input overflow: " + std::to_string(20 - limit) +
+                          " similar message(s) suppressed") !=
+                    std::string::npos,
+                "Suppressed records are summarised") &&
+         Expect(text.find("Output buffer underrun") != std::string::npos,
+                "Other codes are unaffected");
+}
+
+bool TestFullQueueDropsAndCounts() {
+  std::ostringstream out;
+  const uint64_t droppedBefore = totton::audio::rtlog::DroppedCount();
+  totton::audio::rtlog::StartWriter(&out);
+  // Two producers together post far more than the queue holds between two
+  // writer wake-ups.
+  auto produce = []() {
+    for (std::size_t i = 0; i < totton::audio::rtlog::kQueueCapacity * 4;
+         ++i) {
+      totton::audio::rtlog::Post(Code::OutputOverflow);
+    }
+  };
+  std::thread first(produce);
+  std::thread second(produce);
+  first.join();
+  second.join();
+  totton::audio::rtlog::StopWriter();
+  return Expect(totton::audio::rtlog::DroppedCount() > droppedBefore,
+                "Full queue drops records instead of blocking") &&
+         Expect(out.str().find("Log queue full; ") != std::string::npos,
+                "Drops are reported by the writer");
+}
+
+bool TestSynchronousWithoutWriter() {
+  std::ostringstream captured;
+  std::streambuf *original = std::cerr.rdbuf(captured.rdbuf());
+  totton::audio::rtlog::Post(Code::XrunRecovered, "ALSA capture");
+  std::cerr.rdbuf(original);
+  return Expect(!totton::audio::rtlog::WriterRunning(), "No writer running") &&
+         Expect(captured.str() == "ALSA capture: XRUN recovered\n",
+                "Records are written immediately without a writer");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"FormatsRecords", TestFormatsRecords},
+      {"WriterDrainsInOrder", TestWriterDrainsInOrder},
+      {"LongTextIsTruncated", TestLongTextIsTruncated},
+      {"RateLimitsPerCode", TestRateLimitsPerCode},
+      {"FullQueueDropsAndCounts", TestFullQueueDropsAndCounts},
+      {"SynchronousWithoutWriter", TestSynchronousWithoutWriter},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: rt_log tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " rt_log tests failed\n";
+  return 1;
+}
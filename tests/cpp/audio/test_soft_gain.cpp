@@ -0,0 +1,170 @@
+#include "audio/soft_gain.h"
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using totton::audio::ControlCommand;
+using totton::audio::SoftGain;
+
+constexpr unsigned int kChannels = 2;
+constexpr unsigned int kRate = 48000;
+// The ramp takes 10 ms.
+constexpr std::size_t kRampFrames = kRate / 100;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+// frames of full-scale DC through gain; returns the gain of each frame.
+// *reset is set when Process() asks for a filter reset.
+std::vector<float> Run(SoftGain *gain, std::size_t frames,
+                       bool *reset = nullptr) {
+  std::vector<float> samples(frames * kChannels, 1.0f);
+  const bool resetDue = gain->Process(samples.data(), frames);
+  if (reset) {
+    *reset = resetDue;
+  }
+  std::vector<float> gains(frames);
+  for (std::size_t i = 0; i < frames; ++i) {
+    gains[i] = samples[i * kChannels];
+  }
+  return gains;
+}
+
+bool AllEqual(const std::vector<float> &gains, float value) {
+  for (float gain : gains) {
+    if (gain != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TestUnityPassesThrough() {
+  SoftGain gain(kChannels, kRate, 0);
+  return Expect(gain.IsUnity(), "starts at unity") &&
+         Expect(AllEqual(Run(&gain, 256), 1.0f), "unity changed samples");
+}
+
+bool TestMuteRampsOverTenMilliseconds() {
+  SoftGain gain(kChannels, kRate, 0);
+  gain.Apply(ControlCommand::Mute);
+  const std::vector<float> ramp = Run(&gain, kRampFrames + 16);
+  bool falling = true;
+  for (std::size_t i = 1; i < ramp.size(); ++i) {
+    falling = falling && ramp[i] <= ramp[i - 1];
+  }
+  if (!Expect(ramp[0] < 1.0f && ramp[0] > 0.99f, "ramp starts at unity") ||
+      !Expect(falling, "ramp not monotonic") ||
+      !Expect(ramp[kRampFrames / 2] > 0.0f, "ramp shorter than 10 ms") ||
+      !Expect(ramp[kRampFrames - 1] == 0.0f, "ramp longer than 10 ms") ||
+      !Expect(!gain.IsUnity(), "muted reported as unity")) {
+    return false;
+  }
+  gain.Apply(ControlCommand::Unmute);
+  const std::vector<float> back = Run(&gain, kRampFrames + 16);
+  return Expect(back[0] > 0.0f && back[0] < 0.01f, "fade in starts silent") &&
+         Expect(back[kRampFrames - 1] == 1.0f, "fade in longer than 10 ms") &&
+         Expect(gain.IsUnity(), "back at unity");
+}
+
+bool TestHoldIsIndependentOfMute() {
+  SoftGain gain(kChannels, kRate, 0);
+  gain.Hold(true);
+  if (!Expect(Run(&gain, kRampFrames).back() == 0.0f, "hold silences")) {
+    return false;
+  }
+  // Unmute does not end a hold.
+  gain.Apply(ControlCommand::Mute);
+  gain.Apply(ControlCommand::Unmute);
+  if (!Expect(AllEqual(Run(&gain, 64), 0.0f), "unmute ended the hold")) {
+    return false;
+  }
+  // Nor does releasing the hold end a mute.
+  gain.Apply(ControlCommand::Mute);
+  gain.Hold(false);
+  if (!Expect(AllEqual(Run(&gain, kRampFrames), 0.0f),
+              "releasing the hold ended the mute")) {
+    return false;
+  }
+  gain.Apply(ControlCommand::Unmute);
+  return Expect(Run(&gain, kRampFrames).back() == 1.0f,
+                "unmute after the hold stays silent");
+}
+
+bool TestSoftResetWaitsForHold() {
+  const std::size_t holdFrames = 1000;
+  SoftGain gain(kChannels, kRate, holdFrames);
+  gain.Apply(ControlCommand::SoftReset);
+  bool reset = false;
+  // The fade out's last frame is the first silent one.
+  Run(&gain, kRampFrames - 1 + holdFrames - 1, &reset);
+  if (!Expect(!reset, "reset before the hold ended")) {
+    return false;
+  }
+  const std::vector<float> last = Run(&gain, 1, &reset);
+  if (!Expect(reset, "reset after the hold") ||
+      !Expect(last[0] == 0.0f, "signal during the hold")) {
+    return false;
+  }
+  const std::vector<float> after = Run(&gain, kRampFrames, &reset);
+  return Expect(!reset, "reset reported twice") &&
+         Expect(after[0] > 0.0f && after.back() == 1.0f,
+                "signal does not fade back in");
+}
+
+bool TestRestartFadesIn() {
+  SoftGain gain(kChannels, kRate, 0);
+  gain.Restart(96000, 0);
+  // Rounding may leave the ramp a frame short of unity.
+  const std::vector<float> ramp = Run(&gain, 96000 / 100 + 1);
+  if (!Expect(ramp[0] > 0.0f && ramp[0] < 0.01f, "restart not silent") ||
+      !Expect(ramp[96000 / 200] < 1.0f, "ramp not re-timed") ||
+      !Expect(ramp.back() == 1.0f, "restart does not fade in")) {
+    return false;
+  }
+  // A mute stays in effect.
+  gain.Apply(ControlCommand::Mute);
+  gain.Restart(kRate, 0);
+  return Expect(AllEqual(Run(&gain, kRampFrames), 0.0f),
+                "restart ended the mute");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"UnityPassesThrough", TestUnityPassesThrough},
+      {"MuteRampsOverTenMilliseconds", TestMuteRampsOverTenMilliseconds},
+      {"HoldIsIndependentOfMute", TestHoldIsIndependentOfMute},
+      {"SoftResetWaitsForHold", TestSoftResetWaitsForHold},
+      {"RestartFadesIn", TestRestartFadesIn},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: soft gain tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " soft gain tests failed\n";
+  return 1;
+}
@@ -0,0 +1,77 @@
+#include "audio/stats_publisher.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+std::string ReadFile(const std::filesystem::path &path) {
+  std::ifstream in(path);
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+} // namespace
+
+int main() {
+  std::cout << "Running stats publisher tests...\n";
+  const auto path =
+      std::filesystem::temp_directory_path() /
+      ("totton_stats_publisher_" + std::to_string(::getpid()) + ".json");
+  std::filesystem::remove(path);
+
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetRates(44100, 705600);
+  std::atomic<int> housekeeping{0};
+  int failures = 0;
+  {
+    totton::audio::StatsPublisher publisher(metrics, path.string(), "",
+                                            std::chrono::milliseconds(20));
+    publisher.SetHousekeeping([&housekeeping]() { ++housekeeping; });
+    publisher.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if (!Expect(housekeeping.load() >= 2, "housekeeping runs every write") ||
+        !Expect(Contains(ReadFile(path), "\"output_rate\":705600"),
+                "stats file contents")) {
+      ++failures;
+    }
+    // Stop() writes once more, so the file ends with the final counters.
+    metrics.SetRates(48000, 768000);
+    const int before = housekeeping.load();
+    publisher.Stop();
+    if (!Expect(housekeeping.load() > before, "final write on stop") ||
+        !Expect(Contains(ReadFile(path), "\"output_rate\":768000"),
+                "final stats file")) {
+      ++failures;
+    }
+    // The destructor after Stop() does nothing.
+  }
+  std::filesystem::remove(path);
+
+  if (failures > 0) {
+    return 1;
+  }
+  std::cout << "OK: stats publisher tests passed\n";
+  return 0;
+}
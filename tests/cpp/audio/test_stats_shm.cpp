@@ -0,0 +1,176 @@
+#include "audio/metrics_registry.h"
+#include "audio/stats_shm.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string TestSegmentName(const char *suffix) {
+  return "/totton_stats_test_" + std::to_string(::getpid()) + "_" + suffix;
+}
+
+bool TestRoundTripsRegistrySnapshot() {
+  const std::string name = TestSegmentName("roundtrip");
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetRates(48000, 96000);
+  metrics.SetMode("filter");
+  metrics.SetDeadlineNs(21333333);
+  metrics.CaptureXruns()->fetch_add(1);
+  metrics.PlaybackXruns()->fetch_add(4);
+  metrics.RecordStage(totton::audio::Stage::Ifft, 3000);
+  metrics.RecordGpu(totton::audio::GpuTiming::Queue, 700);
+  metrics.OutputFill().SetCapacity(4096);
+  metrics.OutputFill().Observe(512);
+
+  totton::audio::StatsShmWriter writer;
+  std::string error;
+  if (!Expect(writer.Open(name, &error), "Writer opens segment")) {
+    std::cerr << error << "\n";
+    return false;
+  }
+  totton::audio::StatsShmPayload payload{};
+  totton::audio::FillStatsShmPayload(metrics, &payload);
+  writer.Publish(payload);
+
+  totton::audio::StatsShmReader reader;
+  totton::audio::StatsShmPayload read{};
+  if (!Expect(reader.Open(name, &error), "Reader opens segment") ||
+      !Expect(reader.Read(&read), "Reader gets a snapshot")) {
+    std::cerr << error << "\n";
+    return false;
+  }
+  const auto ifft = static_cast<std::size_t>(totton::audio::Stage::Ifft);
+  const auto queue =
+      static_cast<std::size_t>(totton::audio::GpuTiming::Queue);
+  return Expect(read.updateCount == 1, "First publish is update 1") &&
+         Expect(read.inputRate == 48000 && read.outputRate == 96000,
+                "Rates round-trip") &&
+         Expect(std::strcmp(read.mode, "filter") == 0, "Mode round-trips") &&
+         Expect(read.captureXruns == 1 && read.playbackXruns == 4,
+                "Xruns round-trip") &&
+         Expect(read.deadlineNs == 21333333, "Deadline round-trips") &&
+         Expect(read.stages[ifft].count == 1 &&
+                    read.stages[ifft].sumNs == 3000,
+                "Stage timing round-trips") &&
+         Expect(read.gpu[queue].count == 1 && read.gpu[queue].sumNs == 700,
+                "GPU timing round-trips") &&
+         Expect(read.outputFill.current == 512 &&
+                    read.outputFill.capacity == 4096,
+                "Fill round-trips");
+}
+
+bool TestReaderRejectsMissingSegment() {
+  totton::audio::StatsShmReader reader;
+  std::string error;
+  return Expect(!reader.Open(TestSegmentName("missing"), &error),
+                "Missing segment fails to open") &&
+         Expect(!error.empty(), "Missing segment reports an error");
+}
+
+bool TestCloseUnlinksSegment() {
+  const std::string name = TestSegmentName("unlink");
+  std::string error;
+  {
+    totton::audio::StatsShmWriter writer;
+    if (!Expect(writer.Open(name, &error), "Writer opens segment")) {
+      return false;
+    }
+  }
+  totton::audio::StatsShmReader reader;
+  return Expect(!reader.Open(name, &error),
+                "Segment is gone after the writer closes");
+}
+
+bool TestConcurrentReadsAreConsistent() {
+  const std::string name = TestSegmentName("seqlock");
+  totton::audio::StatsShmWriter writer;
+  std::string error;
+  if (!Expect(writer.Open(name, &error), "Writer opens segment")) {
+    return false;
+  }
+  std::atomic<bool> done{false};
+  // Every field of a published payload carries the same value, so any mix
+  // of two updates is visible.
+  std::thread producer([&]() {
+    totton::audio::StatsShmPayload payload{};
+    for (uint64_t value = 1; value <= 200000; ++value) {
+      payload.inputRate = payload.outputRate = value;
+      payload.captureXruns = payload.playbackXruns = value;
+      payload.cycle.sumNs = payload.outputFill.capacity = value;
+      writer.Publish(payload);
+    }
+    done.store(true);
+  });
+
+  totton::audio::StatsShmReader reader;
+  if (!Expect(reader.Open(name, &error), "Reader opens segment")) {
+    done.store(true);
+    producer.join();
+    return false;
+  }
+  bool consistent = true;
+  uint64_t lastUpdate = 0;
+  uint64_t reads = 0;
+  while (!done.load() && consistent) {
+    totton::audio::StatsShmPayload read{};
+    if (!reader.Read(&read)) {
+      continue;
+    }
+    const uint64_t v = read.inputRate;
+    consistent = read.outputRate == v && read.captureXruns == v &&
+                 read.playbackXruns == v && read.cycle.sumNs == v &&
+                 read.outputFill.capacity == v && read.updateCount == v &&
+                 read.updateCount >= lastUpdate;
+    lastUpdate = read.updateCount;
+    ++reads;
+  }
+  producer.join();
+  return Expect(consistent, "Reader never sees a torn payload") &&
+         Expect(reads > 0, "Reader made progress");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"RoundTripsRegistrySnapshot", TestRoundTripsRegistrySnapshot},
+      {"ReaderRejectsMissingSegment", TestReaderRejectsMissingSegment},
+      {"CloseUnlinksSegment", TestCloseUnlinksSegment},
+      {"ConcurrentReadsAreConsistent", TestConcurrentReadsAreConsistent},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: stats shm tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " stats shm tests failed\n";
+  return 1;
+}
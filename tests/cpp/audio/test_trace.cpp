@@ -0,0 +1,156 @@
+#include "audio/trace.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string TracePath(const char *suffix) {
+  return (std::filesystem::temp_directory_path() /
+          ("trace_test_" + std::to_string(::getpid()) + "_" + suffix +
+           ".json"))
+      .string();
+}
+
+std::string DumpToString(const char *suffix) {
+  const std::string path = TracePath(suffix);
+  std::string error;
+  if (!totton::audio::trace::Dump(path, &error)) {
+    std::cerr << error << "\n";
+    return "";
+  }
+  std::ifstream file(path);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  std::remove(path.c_str());
+  return contents.str();
+}
+
+std::size_t CountOccurrences(const std::string &haystack,
+                             const std::string &needle) {
+  std::size_t count = 0;
+  for (auto pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + needle.size())) {
+    ++count;
+  }
+  return count;
+}
+
+// Runs first: nothing is recorded before Enable().
+bool TestDisabledRecordsNothing() {
+  {
+    totton::audio::trace::Scope scope("disabled.scope");
+  }
+  totton::audio::trace::Record("disabled.record", 1, 2);
+  const std::string json = DumpToString("disabled");
+  return Expect(json.find("\"traceEvents\":[") != std::string::npos,
+                "Empty dump is still a trace document") &&
+         Expect(json.find("disabled.") == std::string::npos,
+                "Disabled tracing records nothing");
+}
+
+bool TestScopesBecomeCompleteEvents() {
+  totton::audio::trace::Enable(64);
+  totton::audio::trace::RegisterThread("main");
+  {
+    totton::audio::trace::Scope outer("outer");
+    totton::audio::trace::Scope inner("inner");
+  }
+  totton::audio::trace::Record("explicit", 5000, 7500);
+  const std::string json = DumpToString("scopes");
+  return Expect(json.find("\"name\":\"thread_name\"") != std::string::npos &&
+                    json.find("\"args\":{\"name\":\"main\"}") !=
+                        std::string::npos,
+                "Registered thread is named") &&
+         Expect(json.find("\"ph\":\"X\",\"name\":\"outer\"") !=
+                    std::string::npos,
+                "Outer scope recorded") &&
+         Expect(json.find("\"ph\":\"X\",\"name\":\"inner\"") !=
+                    std::string::npos,
+                "Inner scope recorded") &&
+         Expect(json.find("\"ts\":5.000,\"dur\":2.500") != std::string::npos,
+                "Timestamps are microseconds");
+}
+
+bool TestRingKeepsNewestEvents() {
+  // A fresh thread gets a ring of the capacity passed to Enable().
+  totton::audio::trace::Enable(8);
+  std::thread worker([]() {
+    totton::audio::trace::RegisterThread("ring");
+    for (uint64_t i = 0; i < 20; ++i) {
+      totton::audio::trace::Record(i < 12 ? "ring.old" : "ring.new", i, i + 1);
+    }
+  });
+  worker.join();
+  const std::string json = DumpToString("ring");
+  return Expect(CountOccurrences(json, "ring.old") == 0,
+                "Overwritten events are dropped") &&
+         Expect(CountOccurrences(json, "ring.new") == 8,
+                "The newest capacity events survive");
+}
+
+bool TestDumpOnlyWhenRequested() {
+  const std::string path = TracePath("request");
+  std::string error;
+  std::remove(path.c_str());
+  if (!Expect(totton::audio::trace::DumpIfRequested(path, &error),
+              "Idle poll succeeds") ||
+      !Expect(!std::filesystem::exists(path), "No dump without a request")) {
+    return false;
+  }
+  totton::audio::trace::RequestDump();
+  const bool dumped = totton::audio::trace::DumpIfRequested(path, &error) &&
+                      std::filesystem::exists(path);
+  std::remove(path.c_str());
+  const bool once = totton::audio::trace::DumpIfRequested(path, &error) &&
+                    !std::filesystem::exists(path);
+  totton::audio::trace::Disable();
+  return Expect(dumped, "Requested dump is written") &&
+         Expect(once, "A request produces one dump");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"DisabledRecordsNothing", TestDisabledRecordsNothing},
+      {"ScopesBecomeCompleteEvents", TestScopesBecomeCompleteEvents},
+      {"RingKeepsNewestEvents", TestRingKeepsNewestEvents},
+      {"DumpOnlyWhenRequested", TestDumpOnlyWhenRequested},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: trace tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " trace tests failed\n";
+  return 1;
+}
@@ -0,0 +1,446 @@
+#include "alsa/alsa_common.h"
+#include "fft_utils.h"
+#include "io/audio_ring_buffer.h"
+#include "vulkan/vulkan_streaming_upsampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/utsname.h>
+
+// Microbenchmarks for the DSP hot paths: every FFT backend across sizes,
+// ProcessBlock() for each shipped coefficient set on the CPU FFT and on
+// VkFFT (any Vulkan device, lavapipe included), PCM <-> float conversion per
+// sample format and AudioRingBuffer block copies.
+//
+// Each case reports ns per sample and, where a rate applies, the real-time
+// factor: seconds of audio processed per second of compute (above 1 keeps
+// up). Not part of ctest; run manually and keep the JSON to compare boards
+// and releases:
+//   ./dsp_bench [--json PATH|-] [--coefficients DIR] [--min-time SECONDS]
+//               [--rate HZ] [--only SUBSTRING]
+
+#ifndef DSP_BENCH_COEFFICIENTS_DIR
+#define DSP_BENCH_COEFFICIENTS_DIR "data/coefficients"
+#endif
+
+namespace {
+
+constexpr unsigned int kChannels = 2;
+constexpr std::size_t kPeriodFrames = 4096;
+constexpr std::size_t kMinIterations = 3;
+
+struct BenchOptions {
+  std::string jsonPath;
+  std::string coefficientsDir = DSP_BENCH_COEFFICIENTS_DIR;
+  double minSeconds = 0.5;
+  // Output rate the conversion and ring cases are measured against.
+  unsigned int rate = 768000;
+  std::string only;
+};
+
+struct BenchResult {
+  std::string group;
+  std::string name;
+  std::string backend;
+  // Samples handled per iteration, all channels included.
+  std::size_t samples = 0;
+  // Real-time target; 0 for cases without one (raw FFTs).
+  unsigned int rate = 0;
+  unsigned int channels = 1;
+  std::size_t iterations = 0;
+  double meanNs = 0.0;
+  double minNs = 0.0;
+
+  double NsPerSample() const {
+    return samples > 0 ? meanNs / static_cast<double>(samples) : 0.0;
+  }
+  double RealtimeFactor() const {
+    const double budgetNs = static_cast<double>(samples) * 1e9 /
+                            (static_cast<double>(rate) * channels);
+    return (rate > 0 && meanNs > 0.0) ? budgetNs / meanNs : 0.0;
+  }
+};
+
+bool Selected(const BenchOptions &options, const std::string &group,
+              const std::string &name) {
+  return options.only.empty() ||
+         (group + "/" + name).find(options.only) != std::string::npos;
+}
+
+// Runs fn once to warm up, then repeatedly until minSeconds have passed and
+// at least kMinIterations were timed. fn returns false on failure.
+template <typename Fn>
+bool Measure(const BenchOptions &options, Fn fn, BenchResult *result) {
+  if (!fn()) {
+    return false;
+  }
+  using Clock = std::chrono::steady_clock;
+  const auto deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(options.minSeconds));
+  double totalNs = 0.0;
+  double minNs = std::numeric_limits<double>::max();
+  std::size_t iterations = 0;
+  do {
+    const auto start = Clock::now();
+    const bool ok = fn();
+    const auto end = Clock::now();
+    if (!ok) {
+      return false;
+    }
+    const double ns = std::chrono::duration<double, std::nano>(end - start)
+                          .count();
+    totalNs += ns;
+    minNs = std::min(minNs, ns);
+    ++iterations;
+  } while (iterations < kMinIterations || Clock::now() < deadline);
+  result->iterations = iterations;
+  result->meanNs = totalNs / static_cast<double>(iterations);
+  result->minNs = minNs;
+  return true;
+}
+
+void Report(std::ostream &out, const BenchResult &result) {
+  out << std::left << std::setw(10) << result.group << std::setw(36)
+      << result.name << std::setw(8) << result.backend << std::right
+      << std::fixed << std::setprecision(3) << std::setw(12)
+      << result.NsPerSample() << " ns/sample";
+  if (result.rate > 0) {
+    out << std::setprecision(2) << std::setw(10) << result.RealtimeFactor()
+        << "x realtime";
+  }
+  out << "\n";
+}
+
+// A fixed pseudo-random signal so runs are comparable.
+std::vector<float> TestSignal(std::size_t count) {
+  std::vector<float> signal(count);
+  uint32_t state = 0x12345678u;
+  for (auto &sample : signal) {
+    state = state * 1664525u + 1013904223u;
+    sample = static_cast<float>(state >> 8) / 16777216.0f - 0.5f;
+  }
+  return signal;
+}
+
+// New FFT backends are benchmarked by adding them here.
+struct FftBackend {
+  const char *name;
+  void (*run)(std::vector<std::complex<float>> &data, bool inverse);
+};
+
+const FftBackend kFftBackends[] = {
+    {"radix2", totton::vulkan::fft::Fft},
+};
+
+bool BenchFft(const BenchOptions &options, std::vector<BenchResult> *results) {
+  bool ok = true;
+  for (const FftBackend &backend : kFftBackends) {
+    for (std::size_t size = std::size_t{1} << 8; size <= std::size_t{1} << 17;
+         size <<= 1) {
+      const std::string name = "fft_" + std::to_string(size);
+      if (!Selected(options, "fft", name)) {
+        continue;
+      }
+      const std::vector<float> signal = TestSignal(size);
+      std::vector<std::complex<float>> data(signal.begin(), signal.end());
+      BenchResult result;
+      result.group = "fft";
+      result.name = name;
+      result.backend = backend.name;
+      // One forward plus one inverse transform keeps the data bounded.
+      result.samples = 2 * size;
+      ok &= Measure(
+          options,
+          [&]() {
+            backend.run(data, false);
+            backend.run(data, true);
+            return true;
+          },
+          &result);
+      results->push_back(result);
+    }
+  }
+  return ok;
+}
+
+bool ReadOutputRate(const std::filesystem::path &jsonPath,
+                    unsigned int *rate) {
+  std::ifstream file(jsonPath);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  const std::string json = contents.str();
+  const std::string key = "\"sample_rate_output\"";
+  std::size_t pos = json.find(key);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  pos = json.find(':', pos + key.size());
+  if (pos == std::string::npos) {
+    return false;
+  }
+  *rate = static_cast<unsigned int>(std::strtoul(json.c_str() + pos + 1,
+                                                 nullptr, 10));
+  return *rate > 0;
+}
+
+std::vector<std::filesystem::path> FilterConfigs(const std::string &dir) {
+  std::vector<std::filesystem::path> configs;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.path().extension() == ".json") {
+      configs.push_back(entry.path());
+    }
+  }
+  std::sort(configs.begin(), configs.end());
+  return configs;
+}
+
+bool BenchUpsampler(const BenchOptions &options,
+                    std::vector<BenchResult> *results) {
+  const auto configs = FilterConfigs(options.coefficientsDir);
+  if (configs.empty()) {
+    std::cerr << "No filter configs in " << options.coefficientsDir << "\n";
+    return false;
+  }
+  bool ok = true;
+  for (const auto &config : configs) {
+    const std::string name = config.stem().string();
+    if (!Selected(options, "upsampler", name)) {
+      continue;
+    }
+    for (const bool gpu : {false, true}) {
+      totton::vulkan::VulkanStreamingUpsampler upsampler;
+      upsampler.SetGpuEnabled(gpu);
+      std::string error;
+      if (!upsampler.LoadFilter(config.string(), &error)) {
+        std::cerr << name << ": " << error << "\n";
+        ok = false;
+        break;
+      }
+      if (gpu && !upsampler.UsingGpu()) {
+        std::cerr << name << ": VkFFT unavailable, skipping GPU case\n";
+        break;
+      }
+      BenchResult result;
+      result.group = "upsampler";
+      result.name = name;
+      result.backend = gpu ? "vkfft" : "cpu";
+      result.samples = upsampler.GetConfig().OutputBlockSize();
+      if (!ReadOutputRate(config, &result.rate)) {
+        result.rate = options.rate;
+      }
+      const std::size_t inputCount = upsampler.GetInputBlockSize();
+      const std::vector<float> input = TestSignal(inputCount);
+      ok &= Measure(
+          options,
+          [&]() {
+            return !upsampler.ProcessBlock(input.data(), inputCount).empty();
+          },
+          &result);
+      results->push_back(result);
+    }
+  }
+  return ok;
+}
+
+bool BenchConvert(const BenchOptions &options,
+                  std::vector<BenchResult> *results) {
+  bool ok = true;
+  const std::size_t samples = kPeriodFrames * kChannels;
+  const std::vector<float> signal = TestSignal(samples);
+  for (const char *formatName : {"s16_le", "s24_3le", "s32_le"}) {
+    const snd_pcm_format_t format = totton::alsa::ParseFormat(formatName);
+    std::vector<uint8_t> pcm;
+    if (!totton::alsa::ConvertFloatToPcm(signal, format, &pcm)) {
+      std::cerr << "Conversion setup failed for " << formatName << "\n";
+      ok = false;
+      continue;
+    }
+    std::vector<float> floats;
+
+    BenchResult toFloat;
+    toFloat.group = "convert";
+    toFloat.name = std::string("pcm_to_float_") + formatName;
+    toFloat.backend = "cpu";
+    toFloat.samples = samples;
+    toFloat.rate = options.rate;
+    toFloat.channels = kChannels;
+    if (Selected(options, toFloat.group, toFloat.name)) {
+      ok &= Measure(
+          options,
+          [&]() {
+            return totton::alsa::ConvertPcmToFloat(pcm.data(), format,
+                                                   kPeriodFrames, kChannels,
+                                                   &floats);
+          },
+          &toFloat);
+      results->push_back(toFloat);
+    }
+
+    BenchResult toPcm = toFloat;
+    toPcm.name = std::string("float_to_pcm_") + formatName;
+    if (Selected(options, toPcm.group, toPcm.name)) {
+      ok &= Measure(
+          options,
+          [&]() {
+            return totton::alsa::ConvertFloatToPcm(signal, format, &pcm);
+          },
+          &toPcm);
+      results->push_back(toPcm);
+    }
+  }
+  return ok;
+}
+
+bool BenchRing(const BenchOptions &options,
+               std::vector<BenchResult> *results) {
+  BenchResult result;
+  result.group = "ring";
+  result.name = "write_read_period";
+  result.backend = "cpu";
+  result.samples = kPeriodFrames * kChannels;
+  result.rate = options.rate;
+  result.channels = kChannels;
+  if (!Selected(options, result.group, result.name)) {
+    return true;
+  }
+  AudioRingBuffer buffer;
+  buffer.init(result.samples * 4);
+  const std::vector<float> in = TestSignal(result.samples);
+  std::vector<float> out(result.samples);
+  const bool ok = Measure(
+      options,
+      [&]() {
+        return buffer.write(in.data(), in.size()) &&
+               buffer.read(out.data(), out.size());
+      },
+      &result);
+  results->push_back(result);
+  return ok;
+}
+
+void WriteEscaped(std::ostream &out, const std::string &value) {
+  out << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out << '\\';
+    }
+    out << c;
+  }
+  out << '"';
+}
+
+void WriteJson(std::ostream &out, const BenchOptions &options,
+               const std::vector<BenchResult> &results) {
+  utsname host{};
+  uname(&host);
+  out << std::fixed << std::setprecision(3);
+  out << "{\"schema\":1,\"host\":{\"nodename\":";
+  WriteEscaped(out, host.nodename);
+  out << ",\"sysname\":";
+  WriteEscaped(out, host.sysname);
+  out << ",\"release\":";
+  WriteEscaped(out, host.release);
+  out << ",\"machine\":";
+  WriteEscaped(out, host.machine);
+  out << "},\"options\":{\"min_time_s\":" << options.minSeconds
+      << ",\"rate_hz\":" << options.rate << "},\"results\":[";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const BenchResult &result = results[i];
+    out << (i > 0 ? "," : "") << "\n{\"group\":";
+    WriteEscaped(out, result.group);
+    out << ",\"name\":";
+    WriteEscaped(out, result.name);
+    out << ",\"backend\":";
+    WriteEscaped(out, result.backend);
+    out << ",\"samples\":" << result.samples << ",\"rate_hz\":" << result.rate
+        << ",\"channels\":" << result.channels
+        << ",\"iterations\":" << result.iterations
+        << ",\"mean_ns\":" << result.meanNs << ",\"min_ns\":" << result.minNs
+        << ",\"ns_per_sample\":" << result.NsPerSample()
+        << ",\"realtime_factor\":";
+    if (result.rate > 0) {
+      out << result.RealtimeFactor();
+    } else {
+      out << "null";
+    }
+    out << "}";
+  }
+  out << "\n]}\n";
+}
+
+bool ParseArgs(int argc, char **argv, BenchOptions *options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--json") {
+      options->jsonPath = value;
+    } else if (arg == "--coefficients") {
+      options->coefficientsDir = value;
+    } else if (arg == "--min-time") {
+      options->minSeconds = std::stod(value);
+    } else if (arg == "--rate") {
+      options->rate = static_cast<unsigned int>(std::stoul(value));
+    } else if (arg == "--only") {
+      options->only = value;
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return false;
+    }
+  }
+  if (options->minSeconds < 0.0 || options->rate == 0) {
+    std::cerr << "--min-time must be >= 0 and --rate > 0\n";
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!ParseArgs(argc, argv, &options)) {
+    return 1;
+  }
+
+  // With JSON on stdout the table goes to stderr.
+  std::ostream &table = options.jsonPath == "-" ? std::cerr : std::cout;
+  std::vector<BenchResult> results;
+  bool ok = BenchFft(options, &results);
+  ok &= BenchUpsampler(options, &results);
+  ok &= BenchConvert(options, &results);
+  ok &= BenchRing(options, &results);
+  for (const BenchResult &result : results) {
+    Report(table, result);
+  }
+
+  if (options.jsonPath == "-") {
+    WriteJson(std::cout, options, results);
+  } else if (!options.jsonPath.empty()) {
+    std::ofstream file(options.jsonPath, std::ios::trunc);
+    WriteJson(file, options, results);
+    if (!file) {
+      std::cerr << "Failed to write " << options.jsonPath << "\n";
+      return 1;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+#include "alloc_counter.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Plain thread_local integer: no constructor, so it is usable from the
+// first allocation of every thread.
+thread_local uint64_t tAllocations = 0;
+
+} // namespace
+
+#if defined(__GLIBC__)
+// glibc exports its allocator under __libc_* names as well, so malloc itself
+// can be replaced: allocations made by C code and libraries (ALSA, stdio)
+// are counted too. operator new below ends up here.
+extern "C" {
+
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(std::size_t size) noexcept {
+  ++tAllocations;
+  return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept {
+  ++tAllocations;
+  return __libc_calloc(count, size);
+}
+
+// Counted even when the block grows in place: the caller still took the
+// allocator lock.
+void *realloc(void *ptr, std::size_t size) noexcept {
+  ++tAllocations;
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) noexcept {
+  ++tAllocations;
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+  ++tAllocations;
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, std::size_t alignment,
+                   std::size_t size) noexcept {
+  if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  ++tAllocations;
+  void *result = __libc_memalign(alignment, size);
+  if (!result) {
+    return ENOMEM;
+  }
+  *ptr = result;
+  return 0;
+}
+
+void free(void *ptr) noexcept { __libc_free(ptr); }
+
+} // extern "C"
+#endif
+
+namespace {
+
+// With malloc replaced the count happens there; counting here as well would
+// report every operator new twice.
+void CountOperatorNew() {
+#if !defined(__GLIBC__)
+  ++tAllocations;
+#endif
+}
+
+void *Allocate(std::size_t size) {
+  CountOperatorNew();
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *AllocateAligned(std::size_t size, std::align_val_t alignment) {
+  CountOperatorNew();
+  const auto align = static_cast<std::size_t>(alignment);
+  // aligned_alloc requires the size to be a multiple of the alignment.
+  const std::size_t rounded = ((size == 0 ? 1 : size) + align - 1) / align *
+                              align;
+  return std::aligned_alloc(align, rounded);
+}
+
+} // namespace
+
+namespace totton::test {
+
+uint64_t ThreadAllocationCount() { return tAllocations; }
+
+} // namespace totton::test
+
+void *operator new(std::size_t size) {
+  if (void *ptr = Allocate(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return ::operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  if (void *ptr = AllocateAligned(size, alignment)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return ::operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Linking alloc_counter.cpp replaces the global operator new/delete, and on
+// glibc malloc and friends as well, so tests can count heap allocations.
+// Counters are per thread, so work on other threads never shows up in a
+// measurement.
+namespace totton::test {
+
+// Heap allocations made by the calling thread so far.
+uint64_t ThreadAllocationCount();
+
+} // namespace totton::test
@@ -0,0 +1,541 @@
+#include "alloc_counter.h"
+
+#include "alsa/alsa_common.h"
+#include "fft_utils.h"
+#include "io/audio_ring_buffer.h"
+#include "vulkan/vulkan_streaming_upsampler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Performance regression gate (ctest -L perf).
+//
+// Runs core kernels and the offline file pipeline on fixed synthetic input
+// and compares each case's real-time factor (best of several runs) and heap
+// allocations per block against a per-machine baseline. Everything runs on
+// the CPU FFT unless --gpu is given, so it works on a plain Linux box.
+//   ./perf_regression --record-baseline   # store this machine's numbers
+//   ./perf_regression                     # compare; exit 77 (skip) if none
+// Options: --baseline PATH, --tolerance FRACTION, --alloc-tolerance N,
+//          --streamer PATH, --filter-dir DIR, --only SUBSTRING, --gpu
+
+#ifndef PERF_BASELINE_DIR
+#define PERF_BASELINE_DIR "."
+#endif
+#ifndef PERF_FILTER_DIR
+#define PERF_FILTER_DIR "data/coefficients"
+#endif
+
+namespace {
+
+constexpr int kSkipped = 77;
+constexpr int kRepeats = 5;
+// Short kernels keep repeating until this much time has passed, so the
+// best run is not an outlier of a noisy few milliseconds.
+constexpr double kMinKernelSeconds = 0.25;
+constexpr int kPipelineRepeats = 3;
+// Reference stream for kernels that have no rate of their own.
+constexpr double kStreamRate = 768000.0;
+constexpr unsigned int kChannels = 2;
+constexpr std::size_t kPeriodFrames = 4096;
+
+struct PerfOptions {
+  bool record = false;
+  bool gpu = false;
+  std::string baselinePath;
+  double tolerance = 0.25;
+  double allocTolerance = 0.0;
+  std::string streamerPath;
+  std::string filterDir = PERF_FILTER_DIR;
+  std::string only;
+};
+
+struct CaseResult {
+  double realtimeFactor = 0.0;
+  // Negative when the case does not count allocations.
+  double allocationsPerBlock = -1.0;
+};
+
+using CaseMap = std::map<std::string, CaseResult>;
+
+std::string HostKey() {
+  utsname host{};
+  uname(&host);
+  std::string key = std::string(host.nodename) + "-" + host.machine;
+  for (char &c : key) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' &&
+        c != '_' && c != '.') {
+      c = '_';
+    }
+  }
+  return key;
+}
+
+std::string DefaultBaselinePath() {
+  if (const char *env = std::getenv("TOTTON_PERF_BASELINE")) {
+    if (*env != '\0') {
+      return env;
+    }
+  }
+  return (std::filesystem::path(PERF_BASELINE_DIR) / (HostKey() + ".json"))
+      .string();
+}
+
+// Reads the one-case-per-line layout written by SaveBaseline().
+bool LoadBaseline(const std::string &path, CaseMap *cases) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  const std::string rtfKey = "\"realtime_factor\":";
+  const std::string allocKey = "\"allocations_per_block\":";
+  std::string line;
+  while (std::getline(file, line)) {
+    const std::size_t nameEnd = line.find("\":{");
+    const std::size_t rtf = line.find(rtfKey);
+    const std::size_t alloc = line.find(allocKey);
+    if (line.empty() || line[0] != '"' || nameEnd == std::string::npos ||
+        rtf == std::string::npos || alloc == std::string::npos) {
+      continue;
+    }
+    CaseResult result;
+    result.realtimeFactor =
+        std::strtod(line.c_str() + rtf + rtfKey.size(), nullptr);
+    const char *allocValue = line.c_str() + alloc + allocKey.size();
+    if (std::strncmp(allocValue, "null", 4) != 0) {
+      result.allocationsPerBlock = std::strtod(allocValue, nullptr);
+    }
+    (*cases)[line.substr(1, nameEnd - 1)] = result;
+  }
+  return !cases->empty();
+}
+
+bool SaveBaseline(const std::string &path, const CaseMap &cases) {
+  const std::filesystem::path target(path);
+  std::error_code ec;
+  if (target.has_parent_path()) {
+    std::filesystem::create_directories(target.parent_path(), ec);
+  }
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file << std::fixed << std::setprecision(3);
+  file << "{\"schema\":1,\"host\":\"" << HostKey() << "\",\"cases\":{\n";
+  std::size_t index = 0;
+  for (const auto &[name, result] : cases) {
+    file << "\"" << name << "\":{\"realtime_factor\":" << result.realtimeFactor
+         << ",\"allocations_per_block\":";
+    if (result.allocationsPerBlock >= 0.0) {
+      file << result.allocationsPerBlock;
+    } else {
+      file << "null";
+    }
+    file << "}" << (++index < cases.size() ? "," : "") << "\n";
+  }
+  file << "}}\n";
+  return static_cast<bool>(file);
+}
+
+// A fixed pseudo-random signal so every run sees the same input.
+std::vector<float> TestSignal(std::size_t count) {
+  std::vector<float> signal(count);
+  uint32_t state = 0x12345678u;
+  for (auto &sample : signal) {
+    state = state * 1664525u + 1013904223u;
+    sample = static_cast<float>(state >> 8) / 16777216.0f - 0.5f;
+  }
+  return signal;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+class PerfRunner {
+public:
+  explicit PerfRunner(const PerfOptions &options) : options_(options) {}
+
+  const CaseMap &Results() const { return results_; }
+  bool Ok() const { return ok_; }
+
+  bool Selected(const std::string &name) const {
+    return options_.only.empty() ||
+           name.find(options_.only) != std::string::npos;
+  }
+
+  // Two warm-up calls, then at least kRepeats timed runs (and
+  // kMinKernelSeconds) of `blocks` calls on this thread; keeps the fastest
+  // run and the allocations of the last one.
+  template <typename Fn>
+  void Kernel(const std::string &name, std::size_t blocks,
+              double audioSecondsPerBlock, Fn fn) {
+    for (int i = 0; i < 2; ++i) {
+      if (!fn()) {
+        Fail(name);
+        return;
+      }
+    }
+    CaseResult result;
+    uint64_t allocations = 0;
+    const auto begin = std::chrono::steady_clock::now();
+    for (int repeat = 0;
+         repeat < kRepeats || SecondsSince(begin) < kMinKernelSeconds;
+         ++repeat) {
+      const uint64_t before = totton::test::ThreadAllocationCount();
+      const auto start = std::chrono::steady_clock::now();
+      for (std::size_t block = 0; block < blocks; ++block) {
+        if (!fn()) {
+          Fail(name);
+          return;
+        }
+      }
+      const double seconds = SecondsSince(start);
+      allocations = totton::test::ThreadAllocationCount() - before;
+      result.realtimeFactor =
+          std::max(result.realtimeFactor,
+                   static_cast<double>(blocks) * audioSecondsPerBlock /
+                       seconds);
+    }
+    result.allocationsPerBlock =
+        static_cast<double>(allocations) / static_cast<double>(blocks);
+    results_[name] = result;
+  }
+
+  void Record(const std::string &name, const CaseResult &result) {
+    results_[name] = result;
+  }
+
+  void Fail(const std::string &name) {
+    std::cerr << "FAIL: " << name << " did not run\n";
+    ok_ = false;
+  }
+
+private:
+  const PerfOptions &options_;
+  CaseMap results_;
+  bool ok_ = true;
+};
+
+void RunFft(PerfRunner *runner) {
+  constexpr std::size_t kSize = std::size_t{1} << 17;
+  const std::string name = "fft_131072";
+  if (!runner->Selected(name)) {
+    return;
+  }
+  const std::vector<float> signal = TestSignal(kSize);
+  std::vector<std::complex<float>> data(signal.begin(), signal.end());
+  // One forward/inverse pair per kSize samples of the reference stream.
+  runner->Kernel(name, 8, static_cast<double>(kSize) / kStreamRate, [&]() {
+    totton::vulkan::fft::Fft(data, false);
+    totton::vulkan::fft::Fft(data, true);
+    return true;
+  });
+}
+
+void RunUpsampler(const PerfOptions &options, PerfRunner *runner) {
+  const std::string name =
+      std::string("upsampler_48k_16x_") + (options.gpu ? "gpu" : "cpu");
+  if (!runner->Selected(name)) {
+    return;
+  }
+  totton::vulkan::VulkanStreamingUpsampler upsampler;
+  upsampler.SetGpuEnabled(options.gpu);
+  std::string error;
+  const std::string filter =
+      (std::filesystem::path(options.filterDir) /
+       "filter_48k_16x_80000_min_phase.json")
+          .string();
+  if (!upsampler.LoadFilter(filter, &error)) {
+    std::cerr << name << ": " << error << "\n";
+    runner->Fail(name);
+    return;
+  }
+  const std::size_t inputCount = upsampler.GetInputBlockSize();
+  const std::size_t outputCount = upsampler.GetConfig().OutputBlockSize();
+  const std::vector<float> input = TestSignal(inputCount);
+  std::vector<float> output;
+  output.reserve(outputCount);
+  runner->Kernel(name, 4, static_cast<double>(outputCount) / kStreamRate,
+                 [&]() {
+                   output.clear();
+                   return upsampler.Process(input.data(), inputCount,
+                                            &output) &&
+                          output.size() == outputCount;
+                 });
+}
+
+void RunConvert(PerfRunner *runner) {
+  const std::size_t samples = kPeriodFrames * kChannels;
+  const double periodSeconds = static_cast<double>(kPeriodFrames) / kStreamRate;
+  const std::vector<float> signal = TestSignal(samples);
+  std::vector<uint8_t> pcm;
+  std::vector<float> floats;
+  if (runner->Selected("convert_s32_to_float")) {
+    totton::alsa::ConvertFloatToPcm(signal, SND_PCM_FORMAT_S32_LE, &pcm);
+    runner->Kernel("convert_s32_to_float", 256, periodSeconds, [&]() {
+      return totton::alsa::ConvertPcmToFloat(
+          pcm.data(), SND_PCM_FORMAT_S32_LE, kPeriodFrames, kChannels,
+          &floats);
+    });
+  }
+  if (runner->Selected("convert_float_to_s24")) {
+    runner->Kernel("convert_float_to_s24", 256, periodSeconds, [&]() {
+      return totton::alsa::ConvertFloatToPcm(signal, SND_PCM_FORMAT_S24_3LE,
+                                             &pcm);
+    });
+  }
+}
+
+void RunRing(PerfRunner *runner) {
+  const std::string name = "ring_period";
+  if (!runner->Selected(name)) {
+    return;
+  }
+  const std::size_t samples = kPeriodFrames * kChannels;
+  AudioRingBuffer buffer;
+  buffer.init(samples * 4);
+  const std::vector<float> in = TestSignal(samples);
+  std::vector<float> out(samples);
+  runner->Kernel(name, 1024, static_cast<double>(kPeriodFrames) / kStreamRate,
+                 [&]() {
+                   return buffer.write(in.data(), in.size()) &&
+                          buffer.read(out.data(), out.size());
+                 });
+}
+
+bool RunProcess(const std::vector<std::string> &arguments) {
+  const pid_t pid = fork();
+  if (pid < 0) {
+    return false;
+  }
+  if (pid == 0) {
+    const int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0) {
+      dup2(devNull, STDOUT_FILENO);
+      dup2(devNull, STDERR_FILENO);
+      close(devNull);
+    }
+    std::vector<char *> argv;
+    for (const auto &arg : arguments) {
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid) {
+    return false;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The whole offline path through alsa_streamer's file mode: one second of
+// stereo s32 at 44.1 kHz through the 2x filter, startup included.
+void RunFilePipeline(const PerfOptions &options, PerfRunner *runner) {
+  const std::string name = "file_pipeline_44k_2x";
+  if (!runner->Selected(name)) {
+    return;
+  }
+  if (options.streamerPath.empty()) {
+    std::cerr << name << ": no --streamer given, skipping\n";
+    return;
+  }
+  constexpr unsigned int kRate = 44100;
+  const auto tempDir =
+      std::filesystem::temp_directory_path() /
+      ("totton_perf_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(tempDir);
+  const auto inputPath = tempDir / "input.raw";
+  const auto outputPath = tempDir / "output.raw";
+  {
+    const std::vector<float> signal = TestSignal(kRate * kChannels);
+    std::vector<uint8_t> pcm;
+    totton::alsa::ConvertFloatToPcm(signal, SND_PCM_FORMAT_S32_LE, &pcm);
+    std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+    input.write(reinterpret_cast<const char *>(pcm.data()),
+                static_cast<std::streamsize>(pcm.size()));
+  }
+  const std::vector<std::string> arguments = {
+      options.streamerPath,
+      "--in-file",
+      inputPath.string(),
+      "--out-file",
+      outputPath.string(),
+      "--rate",
+      std::to_string(kRate),
+      "--channels",
+      std::to_string(kChannels),
+      "--format",
+      "s32",
+      "--filter",
+      (std::filesystem::path(options.filterDir) /
+       "filter_44k_2x_80000_min_phase.json")
+          .string()};
+
+  CaseResult result;
+  for (int repeat = 0; repeat < kPipelineRepeats; ++repeat) {
+    const auto start = std::chrono::steady_clock::now();
+    if (!RunProcess(arguments)) {
+      runner->Fail(name);
+      std::filesystem::remove_all(tempDir);
+      return;
+    }
+    result.realtimeFactor =
+        std::max(result.realtimeFactor, 1.0 / SecondsSince(start));
+  }
+  std::filesystem::remove_all(tempDir);
+  runner->Record(name, result);
+}
+
+// Prints every case against its baseline; returns the number of regressions.
+int Compare(const PerfOptions &options, const CaseMap &baseline,
+            const CaseMap &results) {
+  int regressions = 0;
+  std::cout << std::fixed;
+  for (const auto &[name, result] : results) {
+    std::cout << std::setprecision(2) << name << ": " << result.realtimeFactor
+              << "x realtime";
+    if (result.allocationsPerBlock >= 0.0) {
+      std::cout << ", " << result.allocationsPerBlock << " allocs/block";
+    }
+    const auto it = baseline.find(name);
+    if (it == baseline.end()) {
+      std::cout << " (not in baseline)\n";
+      continue;
+    }
+    const CaseResult &base = it->second;
+    const bool slower =
+        result.realtimeFactor < base.realtimeFactor * (1.0 - options.tolerance);
+    const bool allocates = base.allocationsPerBlock >= 0.0 &&
+                           result.allocationsPerBlock >
+                               base.allocationsPerBlock +
+                                   options.allocTolerance;
+    std::cout << " [baseline " << base.realtimeFactor << "x";
+    if (base.allocationsPerBlock >= 0.0) {
+      std::cout << ", " << base.allocationsPerBlock << " allocs/block";
+    }
+    std::cout << "]";
+    if (slower || allocates) {
+      std::cout << " REGRESSION" << (slower ? " (real-time factor)" : "")
+                << (allocates ? " (allocations)" : "");
+      ++regressions;
+    }
+    std::cout << "\n";
+  }
+  return regressions;
+}
+
+bool ParseArgs(int argc, char **argv, PerfOptions *options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--record-baseline") {
+      options->record = true;
+      continue;
+    }
+    if (arg == "--gpu") {
+      options->gpu = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--baseline") {
+      options->baselinePath = value;
+    } else if (arg == "--tolerance") {
+      options->tolerance = std::stod(value);
+    } else if (arg == "--alloc-tolerance") {
+      options->allocTolerance = std::stod(value);
+    } else if (arg == "--streamer") {
+      options->streamerPath = value;
+    } else if (arg == "--filter-dir") {
+      options->filterDir = value;
+    } else if (arg == "--only") {
+      options->only = value;
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return false;
+    }
+  }
+  if (options->tolerance < 0.0 || options->tolerance >= 1.0) {
+    std::cerr << "--tolerance must be in [0, 1)\n";
+    return false;
+  }
+  if (options->baselinePath.empty()) {
+    options->baselinePath = DefaultBaselinePath();
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  PerfOptions options;
+  if (!ParseArgs(argc, argv, &options)) {
+    return 1;
+  }
+
+  CaseMap baseline;
+  const bool haveBaseline = LoadBaseline(options.baselinePath, &baseline);
+  if (!options.record && !haveBaseline) {
+    std::cout << "No perf baseline at " << options.baselinePath
+              << "; record one with --record-baseline\n";
+    return kSkipped;
+  }
+
+  PerfRunner runner(options);
+  RunFft(&runner);
+  RunUpsampler(options, &runner);
+  RunConvert(&runner);
+  RunRing(&runner);
+  RunFilePipeline(options, &runner);
+  if (!runner.Ok()) {
+    return 1;
+  }
+
+  if (options.record) {
+    // Keep cases this run did not measure (e.g. with --only).
+    for (const auto &[name, result] : runner.Results()) {
+      baseline[name] = result;
+    }
+    Compare(options, {}, runner.Results());
+    if (!SaveBaseline(options.baselinePath, baseline)) {
+      std::cerr << "Failed to write " << options.baselinePath << "\n";
+      return 1;
+    }
+    std::cout << "Recorded baseline " << options.baselinePath << "\n";
+    return 0;
+  }
+
+  const int regressions = Compare(options, baseline, runner.Results());
+  if (regressions > 0) {
+    std::cerr << "FAIL: " << regressions << " perf regressions (tolerance "
+              << options.tolerance * 100.0 << "%)\n";
+    return 1;
+  }
+  std::cout << "OK: no perf regressions\n";
+  return 0;
+}
@@ -0,0 +1,224 @@
+#include "alsa/alsa_common.h"
+
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Runs alsa_streamer_alloc_check, the streamer built with the counting
+// allocator, and checks that its audio thread makes no heap allocations
+// once the loop is warm:
+//   ./alsa_streamer_alloc_smoke PATH_TO_ALSA_STREAMER_ALLOC_CHECK
+
+#ifndef ALLOC_FILTER_DIR
+#define ALLOC_FILTER_DIR "data/coefficients"
+#endif
+
+namespace {
+
+constexpr unsigned int kChannels = 2;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::string FilterPath(const char *name) {
+  return (std::filesystem::path(ALLOC_FILTER_DIR) / name).string();
+}
+
+// Runs the streamer with stdout/stderr captured. When interruptAfter is
+// non-zero the process gets SIGINT after that delay.
+bool RunStreamer(const std::string &streamerPath,
+                 const std::vector<std::string> &arguments,
+                 std::chrono::milliseconds interruptAfter,
+                 std::string *output) {
+  int pipefd[2];
+  if (pipe(pipefd) != 0) {
+    std::cerr << "FAIL: pipe: " << std::strerror(errno) << "\n";
+    return false;
+  }
+  const pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "FAIL: fork: " << std::strerror(errno) << "\n";
+    return false;
+  }
+  if (pid == 0) {
+    close(pipefd[0]);
+    dup2(pipefd[1], STDOUT_FILENO);
+    dup2(pipefd[1], STDERR_FILENO);
+    close(pipefd[1]);
+    std::vector<const char *> args = {streamerPath.c_str()};
+    for (const auto &arg : arguments) {
+      args.push_back(arg.c_str());
+    }
+    args.push_back(nullptr);
+    execv(args[0], const_cast<char *const *>(args.data()));
+    _exit(127);
+  }
+  close(pipefd[1]);
+
+  if (interruptAfter.count() > 0) {
+    std::this_thread::sleep_for(interruptAfter);
+    kill(pid, SIGINT);
+  }
+  char buffer[4096];
+  ssize_t n = 0;
+  while ((n = read(pipefd[0], buffer, sizeof(buffer))) > 0) {
+    output->append(buffer, static_cast<size_t>(n));
+  }
+  close(pipefd[0]);
+
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid) {
+    std::cerr << "FAIL: waitpid: " << std::strerror(errno) << "\n";
+    return false;
+  }
+  if (!Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+              "alloc-check streamer exit code")) {
+    std::cerr << *output << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Parses the "Steady-state allocations: N in M periods" report.
+bool ExpectNoSteadyStateAllocations(const std::string &output,
+                                    const char *label) {
+  const std::string key = "Steady-state allocations: ";
+  const std::size_t pos = output.find(key);
+  if (!Expect(pos != std::string::npos, "allocation report present")) {
+    std::cerr << output << "\n";
+    return false;
+  }
+  unsigned long long allocations = 0;
+  unsigned long long periods = 0;
+  if (std::sscanf(output.c_str() + pos + key.size(), "%llu in %llu",
+                  &allocations, &periods) != 2) {
+    std::cerr << "FAIL: malformed allocation report\n" << output << "\n";
+    return false;
+  }
+  std::cout << label << ": " << allocations << " allocations in " << periods
+            << " steady-state periods\n";
+  return Expect(periods > 0, "steady state reached") &&
+         Expect(allocations == 0, "audio thread allocates in steady state");
+}
+
+bool WriteInputFile(const std::filesystem::path &path, unsigned int rate,
+                    double seconds, snd_pcm_format_t format) {
+  const auto frames = static_cast<std::size_t>(rate * seconds);
+  std::vector<float> signal(frames * kChannels);
+  for (std::size_t i = 0; i < frames; ++i) {
+    const float value = 0.25f * std::sin(2.0f * 3.14159265f * 997.0f *
+                                         static_cast<float>(i) / rate);
+    for (unsigned int ch = 0; ch < kChannels; ++ch) {
+      signal[i * kChannels + ch] = value;
+    }
+  }
+  std::vector<uint8_t> pcm;
+  if (!totton::alsa::ConvertFloatToPcm(signal, format, &pcm)) {
+    return false;
+  }
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(pcm.data()),
+             static_cast<std::streamsize>(pcm.size()));
+  return static_cast<bool>(file);
+}
+
+bool RunFileCase(const std::string &streamerPath, const char *label,
+                 unsigned int rate, const char *format,
+                 const char *filterName) {
+  const auto tempDir = std::filesystem::temp_directory_path() /
+                       ("totton_alloc_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(tempDir);
+  const auto inputPath = tempDir / "input.raw";
+  const auto outputPath = tempDir / "output.raw";
+  if (!Expect(WriteInputFile(inputPath, rate, 2.0,
+                             totton::alsa::ParseFormat(format)),
+              "write input file")) {
+    std::filesystem::remove_all(tempDir);
+    return false;
+  }
+  std::string output;
+  const bool ok =
+      RunStreamer(streamerPath,
+                  {"--in-file", inputPath.string(), "--out-file",
+                   outputPath.string(), "--rate", std::to_string(rate),
+                   "--channels", std::to_string(kChannels), "--format",
+                   format, "--filter", FilterPath(filterName)},
+                  std::chrono::milliseconds(0), &output) &&
+      ExpectNoSteadyStateAllocations(output, label);
+  std::filesystem::remove_all(tempDir);
+  return ok;
+}
+
+bool TestFileMode2x(const std::string &streamerPath) {
+  return RunFileCase(streamerPath, "file 44.1k stereo 2x s32", 44100, "s32",
+                     "filter_44k_2x_80000_min_phase.json");
+}
+
+bool TestFileModeStereo16x(const std::string &streamerPath) {
+  return RunFileCase(streamerPath, "file 48k stereo 16x s24", 48000, "s24",
+                     "filter_48k_16x_80000_min_phase.json");
+}
+
+// The live loop on ALSA null devices, filter and output ring included.
+bool TestNullDeviceStereo16x(const std::string &streamerPath) {
+  std::string output;
+  return RunStreamer(
+             streamerPath,
+             {"--in", "null", "--out", "null", "--rate", "48000", "--period",
+              "1024", "--channels", std::to_string(kChannels), "--format",
+              "s32", "--filter",
+              FilterPath("filter_48k_16x_80000_min_phase.json")},
+             std::chrono::milliseconds(2000), &output) &&
+         ExpectNoSteadyStateAllocations(output, "null device 48k stereo 16x");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " PATH_TO_ALSA_STREAMER_ALLOC_CHECK\n";
+    return 1;
+  }
+  const std::string streamerPath = argv[1];
+
+  struct TestCase {
+    const char *name;
+    bool (*fn)(const std::string &);
+  };
+
+  const TestCase tests[] = {
+      {"FileMode2x", TestFileMode2x},
+      {"FileModeStereo16x", TestFileModeStereo16x},
+      {"NullDeviceStereo16x", TestNullDeviceStereo16x},
+  };
+
+  int failed = 0;
+  for (const auto &test : tests) {
+    if (!test.fn(streamerPath)) {
+      std::cerr << "Test failed: " << test.name << "\n";
+      ++failed;
+    }
+  }
+  if (failed > 0) {
+    return 1;
+  }
+  std::cout << "OK\n";
+  return 0;
+}
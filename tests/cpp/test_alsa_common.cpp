@@ -1,4 +1,6 @@
 #include "alsa/alsa_common.h"
+#include "alsa/rate_monitor.h"
+#include "audio/level_meter.h"
 
 #include <atomic>
 #include <cmath>
@@ -82,6 +84,49 @@ bool TestConversions(snd_pcm_format_t format, float eps) {
   return true;
 }
 
+bool TestMeteredConversion() {
+  // Two interleaved channels; the right one clips twice.
+  const std::vector<float> input = {0.5f, 1.0f, -0.5f, -1.5f, 0.0f, 0.25f};
+  std::vector<uint8_t> plain;
+  std::vector<uint8_t> metered;
+  totton::audio::LevelMeter meter(2);
+  if (!totton::alsa::ConvertFloatToPcm(input, SND_PCM_FORMAT_S16_LE, &plain) ||
+      !totton::alsa::ConvertFloatToPcm(input, SND_PCM_FORMAT_S16_LE, &metered,
+                                       &meter)) {
+    std::cerr << "FAIL: ConvertFloatToPcm metered\n";
+    return false;
+  }
+  if (!Expect(metered == plain, "metering leaves the PCM unchanged") ||
+      !Expect(meter.Frames() == 3, "metered frames")) {
+    return false;
+  }
+
+  totton::audio::MeterFrame frame;
+  meter.Finish(&frame);
+  const float leftRms = std::sqrt((0.25f + 0.25f) / 3.0f);
+  if (!Expect(frame.channels == 2 && frame.frames == 3, "frame shape") ||
+      !Expect(AlmostEqual(frame.peak[0], 0.5f, 1e-6f) &&
+                  AlmostEqual(frame.peak[1], 1.5f, 1e-6f),
+              "peak per channel") ||
+      !Expect(AlmostEqual(frame.rms[0], leftRms, 1e-6f), "rms") ||
+      !Expect(frame.clips[0] == 0 && frame.clips[1] == 2, "clip counts")) {
+    return false;
+  }
+
+  meter.Finish(&frame);
+  return Expect(frame.frames == 0 && frame.peak[1] == 0.0f &&
+                    frame.clips[1] == 0,
+                "Finish starts a new window");
+}
+
+bool TestCardIndexForPcm() {
+  using totton::alsa::CardIndexForPcm;
+  return Expect(CardIndexForPcm("default") == -1, "default has no card") &&
+         Expect(CardIndexForPcm("null") == -1, "null has no card") &&
+         Expect(CardIndexForPcm("hw:CARD=NoSuchCard,DEV=0") == -1,
+                "missing card");
+}
+
 bool TestAlsaNullDevice() {
   constexpr unsigned int kChannels = 2;
   constexpr unsigned int kRate = 44100;
@@ -159,6 +204,12 @@ int main() {
   if (!TestConversions(SND_PCM_FORMAT_S32_LE, 1e-7f)) {
     return 1;
   }
+  if (!TestMeteredConversion()) {
+    return 1;
+  }
+  if (!TestCardIndexForPcm()) {
+    return 1;
+  }
   if (!TestAlsaNullDevice()) {
     return 1;
   }
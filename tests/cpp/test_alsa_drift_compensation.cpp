@@ -0,0 +1,151 @@
+#include "alsa/alsa_common.h"
+#include "alsa/drift_compensation.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr unsigned int kChannels = 2;
+constexpr unsigned int kRate = 48000;
+constexpr std::size_t kPeriod = 256;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::vector<float> Period(std::size_t index) {
+  std::vector<float> samples(kPeriod * kChannels);
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<float>(
+        0.5 * std::sin(0.01 * static_cast<double>(index * samples.size() + i)));
+  }
+  return samples;
+}
+
+bool AllFinite(const std::vector<float> &samples) {
+  for (float sample : samples) {
+    if (!std::isfinite(sample)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Without a status update the resampler stays at the nominal ratio.
+bool TestNominalRatioKeepsLength() {
+  totton::alsa::DriftCompensation drift(kChannels, kRate, 1.0, kPeriod);
+  std::vector<float> output;
+  std::size_t produced = 0;
+  constexpr std::size_t kPeriods = 40;
+  for (std::size_t p = 0; p < kPeriods; ++p) {
+    const std::vector<float> input = Period(p);
+    if (!Expect(drift.Process(input.data(), kPeriod, &output),
+                "Process at nominal ratio")) {
+      return false;
+    }
+    produced += output.size() / kChannels;
+    // PCMs without status leave the ratio alone.
+    drift.Update(nullptr, nullptr, 0);
+  }
+  const std::size_t consumed = kPeriods * kPeriod;
+  return Expect(produced <= consumed && produced + kPeriod > consumed,
+                "nominal ratio changed the length");
+}
+
+// Runs the loop the streamer runs against the null devices, whose status
+// reports the clocks as ALSA sees them.
+bool TestUpdatesFromNullDevices() {
+  auto capture = totton::alsa::OpenCaptureAutoRate(
+      "null", SND_PCM_FORMAT_S32_LE, kChannels, kRate, kPeriod, 0);
+  if (!Expect(capture.has_value(), "open null capture")) {
+    return false;
+  }
+  auto playback = totton::alsa::OpenPcm(
+      "null", SND_PCM_STREAM_PLAYBACK, SND_PCM_FORMAT_S32_LE, kChannels,
+      capture->rate, capture->periodFrames, 0);
+  if (!Expect(playback.has_value(), "open null playback")) {
+    snd_pcm_close(capture->handle);
+    return false;
+  }
+
+  totton::alsa::DriftCompensation drift(kChannels, capture->rate, 1.0,
+                                        capture->periodFrames);
+  std::atomic<bool> running{true};
+  const std::size_t frameBytes =
+      totton::alsa::BytesPerSample(SND_PCM_FORMAT_S32_LE) * kChannels;
+  std::vector<uint8_t> raw(capture->periodFrames * frameBytes);
+  std::vector<float> input;
+  std::vector<float> output;
+  std::vector<uint8_t> out;
+  bool ok = true;
+  for (std::size_t p = 0; p < 50 && ok; ++p) {
+    ok = Expect(totton::alsa::ReadFull(capture->handle, raw.data(),
+                                       capture->periodFrames, running),
+                "read null capture") &&
+         Expect(totton::alsa::ConvertPcmToFloat(
+                    raw.data(), SND_PCM_FORMAT_S32_LE, capture->periodFrames,
+                    kChannels, &input),
+                "convert capture");
+    drift.OnCaptured(capture->periodFrames);
+    ok = ok &&
+         Expect(drift.Process(input.data(), capture->periodFrames, &output),
+                "Process after updates") &&
+         Expect(AllFinite(output), "non-finite output");
+    const std::size_t frames = output.size() / kChannels;
+    if (ok && frames > 0) {
+      ok = Expect(totton::alsa::ConvertFloatToPcm(
+                      output, SND_PCM_FORMAT_S32_LE, &out),
+                  "convert playback") &&
+           Expect(totton::alsa::WriteFull(playback->handle, out.data(),
+                                          frames, running),
+                  "write null playback");
+      drift.OnPlayed(frames);
+    }
+    drift.Update(capture->handle, playback->handle, 0);
+  }
+
+  snd_pcm_drop(capture->handle);
+  snd_pcm_close(capture->handle);
+  snd_pcm_drop(playback->handle);
+  snd_pcm_close(playback->handle);
+  return ok;
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)();
+  };
+
+  const TestCase tests[] = {
+      {"NominalRatioKeepsLength", TestNominalRatioKeepsLength},
+      {"UpdatesFromNullDevices", TestUpdatesFromNullDevices},
+  };
+
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn()) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: ALSA drift compensation tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures
+            << " ALSA drift compensation tests failed\n";
+  return 1;
+}
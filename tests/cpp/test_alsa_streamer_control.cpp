@@ -0,0 +1,132 @@
+#include "alsa/streamer_control.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <zmq.hpp>
+
+// The streamer's control commands against a context without a stream or a
+// filter: queue posts reach the audio side's queue, and the commands that
+// need a filter say so.
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+std::string Request(zmq::socket_t &socket, const std::string &payload) {
+  socket.send(zmq::buffer(payload), zmq::send_flags::none);
+  zmq::message_t reply;
+  if (!socket.recv(reply, zmq::recv_flags::none)) {
+    return {};
+  }
+  return reply.to_string();
+}
+
+} // namespace
+
+int main() {
+  std::cout << "Running streamer control tests...\n";
+  const std::string endpoint = "ipc:///tmp/totton_streamer_control_test_" +
+                               std::to_string(::getpid()) + ".sock";
+
+  totton::audio::MetricsRegistry metrics;
+  metrics.SetRates(44100, 705600);
+  totton::audio::ControlQueue commands;
+  std::atomic<bool> running{true};
+  totton::alsa::ControlContext context;
+  context.filterDir = "/nonexistent";
+  context.inputRate = 44100;
+  context.metrics = &metrics;
+  context.commands = &commands;
+  context.running = &running;
+  context.startTime = std::chrono::steady_clock::now();
+  context.phase = "minimum";
+
+  totton::zmq_server::ZmqCommandServer server(endpoint, "");
+  totton::alsa::RegisterControlCommands(&server, &context);
+  if (!Expect(server.Start(), "server starts")) {
+    return 1;
+  }
+  zmq::context_t zmqContext(1);
+  zmq::socket_t client(zmqContext, zmq::socket_type::req);
+  client.set(zmq::sockopt::linger, 0);
+  client.set(zmq::sockopt::rcvtimeo, 2000);
+  client.connect(endpoint);
+
+  int failures = 0;
+  auto check = [&](bool condition, const char *message) {
+    if (!Expect(condition, message)) {
+      ++failures;
+    }
+  };
+
+  check(Contains(Request(client, "{\"cmd\":\"PING\"}"), "\"pong\":true"),
+        "PING reply");
+
+  check(Contains(Request(client, "{\"cmd\":\"MUTE\"}"), "\"muted\":true"),
+        "MUTE reply");
+  totton::audio::ControlCommand command;
+  check(commands.TryPop(&command) &&
+            command == totton::audio::ControlCommand::Mute,
+        "MUTE posted");
+  check(Contains(Request(client, "{\"cmd\":\"SOFT_RESET\"}"),
+                 "\"reset\":true"),
+        "SOFT_RESET reply");
+  check(commands.TryPop(&command) &&
+            command == totton::audio::ControlCommand::SoftReset,
+        "SOFT_RESET posted");
+
+  const std::string stats = Request(client, "{\"cmd\":\"STATS\"}");
+  check(Contains(stats, "\"phase_type\":\"minimum\"") &&
+            Contains(stats, "\"muted\":true") &&
+            Contains(stats, "\"soft_resets\":1") &&
+            Contains(stats, "\"output_rate\":705600"),
+        "STATS reports the context and metrics");
+  check(!Contains(stats, "\"filter\""), "STATS without a filter");
+
+  // A full queue answers BUSY instead of blocking the socket thread.
+  for (int i = 0; i < 16; ++i) {
+    commands.TryPush(totton::audio::ControlCommand::Unmute);
+  }
+  check(Contains(Request(client, "{\"cmd\":\"UNMUTE\"}"), "BUSY"),
+        "full queue reply");
+  check(context.muted.load(), "refused UNMUTE changed the state");
+  while (commands.TryPop(&command)) {
+  }
+
+  check(Contains(Request(client, "{\"cmd\":\"RELOAD\"}"), "NO_FILTER"),
+        "RELOAD without a filter");
+  check(Contains(Request(client,
+                         "{\"cmd\":\"PHASE_TYPE_SET\",\"phase\":\"bogus\"}"),
+                 "INVALID_PARAMS"),
+        "PHASE_TYPE_SET checks the phase");
+  check(Contains(Request(client, "{\"cmd\":\"PHASE_TYPE_GET\"}"),
+                 "\"phase_type\":\"minimum\""),
+        "PHASE_TYPE_GET reply");
+
+  check(Contains(Request(client, "{\"cmd\":\"SHUTDOWN\"}"),
+                 "\"shutdown\":true"),
+        "SHUTDOWN reply");
+  check(!running.load(), "SHUTDOWN stops the stream");
+
+  server.Stop();
+  if (failures > 0) {
+    return 1;
+  }
+  std::cout << "OK: streamer control tests passed\n";
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zmq.hpp>
+
+// Runs alsa_streamer on ALSA null devices with --zmq-endpoint and drives the
+// running pipeline through its control commands:
+//   ./alsa_streamer_control_e2e PATH_TO_ALSA_STREAMER
+
+#ifndef CONTROL_FILTER_DIR
+#define CONTROL_FILTER_DIR "data/coefficients"
+#endif
+
+namespace {
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+std::string SendCommand(zmq::socket_t &socket, const std::string &payload) {
+  socket.send(zmq::buffer(payload), zmq::send_flags::none);
+  zmq::message_t reply;
+  if (!socket.recv(reply, zmq::recv_flags::none)) {
+    return {};
+  }
+  return std::string(static_cast<char *>(reply.data()), reply.size());
+}
+
+bool WaitForExit(pid_t pid, int *status, int timeoutMs) {
+  int waited = 0;
+  while (waited < timeoutMs) {
+    pid_t result = waitpid(pid, status, WNOHANG);
+    if (result == pid) {
+      return true;
+    }
+    if (result < 0) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    waited += 20;
+  }
+  return false;
+}
+
+std::string ReadFile(const std::filesystem::path &path) {
+  std::ifstream file(path);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+// Each step sends one command and checks its reply for every needle.
+struct Step {
+  const char *name;
+  std::string request;
+  std::vector<std::string> expected;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " PATH_TO_ALSA_STREAMER\n";
+    return 1;
+  }
+  const std::string streamerPath = argv[1];
+  const std::string endpoint = "ipc:///tmp/totton_streamer_control_test.sock";
+  std::filesystem::remove("/tmp/totton_streamer_control_test.sock");
+
+  const auto tempDir =
+      std::filesystem::temp_directory_path() /
+      ("totton_control_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(tempDir);
+  const auto eqPath = tempDir / "eq.txt";
+  {
+    std::ofstream eq(eqPath);
+    eq << "Preamp: -3 dB\n"
+       << "Filter 1: ON PK Fc 1000 Hz Gain 3.0 dB Q 1.41\n";
+  }
+  const std::string otherGeometry =
+      (std::filesystem::path(CONTROL_FILTER_DIR) /
+       "filter_48k_16x_80000_min_phase.json")
+          .string();
+
+  // The log goes to a file: a full pipe would block the streamer's threads
+  // while this process waits on replies.
+  const auto logPath = tempDir / "streamer.log";
+  const pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "FAIL: fork\n";
+    return 1;
+  }
+  if (pid == 0) {
+    if (!std::freopen(logPath.c_str(), "w", stdout) ||
+        dup2(STDOUT_FILENO, STDERR_FILENO) < 0) {
+      _exit(127);
+    }
+    std::vector<const char *> args = {
+        streamerPath.c_str(), "--in",         "null",
+        "--out",              "null",         "--rate",
+        "48000",              "--period",     "1024",
+        "--filter-dir",       CONTROL_FILTER_DIR,
+        "--ratio",            "2",            "--zmq-endpoint",
+        endpoint.c_str(),     nullptr};
+    execv(args[0], const_cast<char *const *>(args.data()));
+    _exit(127);
+  }
+
+  zmq::context_t ctx(1);
+  zmq::socket_t req(ctx, zmq::socket_type::req);
+  req.set(zmq::sockopt::rcvtimeo, 2000);
+  req.set(zmq::sockopt::sndtimeo, 2000);
+  // A timed-out REQ socket is stuck; let the next send go through anyway.
+  req.set(zmq::sockopt::req_relaxed, 1);
+  req.connect(endpoint);
+
+  bool ready = false;
+  for (int i = 0; i < 50 && !ready; ++i) {
+    ready = Contains(SendCommand(req, "{\"cmd\":\"PING\"}"), "\"pong\"");
+    if (!ready) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+  if (!Expect(ready, "streamer control server ready")) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    std::cerr << ReadFile(logPath) << "\n";
+    std::filesystem::remove_all(tempDir);
+    return 1;
+  }
+
+  const std::vector<Step> steps = {
+      {"STATS", "{\"cmd\":\"STATS\"}",
+       {"\"status\":\"ok\"", "\"mode\":\"filter\"",
+        "\"phase_type\":\"minimum\"", "\"eq\":false"}},
+      {"RELOAD", "{\"cmd\":\"RELOAD\"}", {"\"reloaded\":true"}},
+      {"RELOAD missing file",
+       "{\"cmd\":\"RELOAD\",\"params\":{\"path\":\"/nonexistent.json\"}}",
+       {"FILTER_ERROR"}},
+      {"RELOAD other geometry",
+       "{\"cmd\":\"RELOAD\",\"params\":{\"path\":\"" + otherGeometry + "\"}}",
+       {"FILTER_ERROR", "geometry"}},
+      {"PHASE_TYPE_SET invalid",
+       "{\"cmd\":\"PHASE_TYPE_SET\",\"params\":{\"phase\":\"mixed\"}}",
+       {"INVALID_PARAMS"}},
+      // Only minimum-phase filters ship with the repository.
+      {"PHASE_TYPE_SET linear",
+       "{\"cmd\":\"PHASE_TYPE_SET\",\"params\":{\"phase\":\"linear\"}}",
+       {"FILTER_ERROR"}},
+      {"PHASE_TYPE_GET", "{\"cmd\":\"PHASE_TYPE_GET\"}", {"minimum"}},
+      {"PHASE_TYPE_SET minimum",
+       "{\"cmd\":\"PHASE_TYPE_SET\",\"params\":{\"phase\":\"minimum\"}}",
+       {"\"status\":\"ok\""}},
+      {"EQ_SET",
+       "{\"cmd\":\"EQ_SET\",\"params\":{\"path\":\"" + eqPath.string() +
+           "\"}}",
+       {"\"eq\":true"}},
+      {"STATS with EQ", "{\"cmd\":\"STATS\"}", {"\"eq\":true"}},
+      {"EQ_CLEAR", "{\"cmd\":\"EQ_CLEAR\"}", {"\"eq\":false"}},
+      {"MUTE", "{\"cmd\":\"MUTE\"}", {"\"muted\":true"}},
+      {"STATS muted", "{\"cmd\":\"STATS\"}", {"\"muted\":true"}},
+      {"UNMUTE", "{\"cmd\":\"UNMUTE\"}", {"\"muted\":false"}},
+      {"SOFT_RESET", "{\"cmd\":\"SOFT_RESET\"}", {"\"reset\":true"}},
+      {"STATS counters", "{\"cmd\":\"STATS\"}",
+       {"\"reloads\":1", "\"soft_resets\":1"}},
+      {"unknown", "{\"cmd\":\"NOPE\"}", {"UNKNOWN_CMD"}},
+      {"SHUTDOWN", "{\"cmd\":\"SHUTDOWN\"}", {"\"shutdown\":true"}},
+  };
+
+  int failures = 0;
+  for (const auto &step : steps) {
+    // Give the audio thread a few periods between commands.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const std::string reply = SendCommand(req, step.request);
+    for (const auto &needle : step.expected) {
+      if (!Contains(reply, needle)) {
+        std::cerr << "FAIL: " << step.name << ": expected " << needle
+                  << " in reply: " << reply << "\n";
+        ++failures;
+        break;
+      }
+    }
+  }
+
+  int status = 0;
+  if (!Expect(WaitForExit(pid, &status, 5000), "streamer exits on SHUTDOWN")) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    ++failures;
+  } else if (!Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                     "streamer exit code")) {
+    ++failures;
+  }
+  const std::string output = ReadFile(logPath);
+  std::filesystem::remove_all(tempDir);
+  if (!Expect(Contains(output, "Control server listening on " + endpoint),
+              "control server log") ||
+      !Expect(Contains(output, "Filter reloaded: "), "reload log")) {
+    ++failures;
+  }
+
+  if (failures > 0) {
+    std::cerr << output << "\n";
+    return 1;
+  }
+  std::cout << "OK\n";
+  return 0;
+}
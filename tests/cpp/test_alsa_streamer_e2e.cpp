@@ -4,9 +4,14 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <cstdlib>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <string>
 #include <thread>
 #include <vector>
@@ -48,26 +53,22 @@ std::filesystem::path GetExecutableDir() {
   return std::filesystem::path(path).parent_path();
 }
 
-} // namespace
-
-int main() {
-  std::filesystem::path execDir = GetExecutableDir();
-  std::filesystem::path streamerPath = execDir / "alsa_streamer";
-  if (!std::filesystem::exists(streamerPath)) {
-    std::cerr << "FAIL: alsa_streamer not found at " << streamerPath << "\n";
-    return 1;
-  }
-
+// Runs alsa_streamer with the given arguments, capturing stdout/stderr. When
+// interruptAfter is non-zero the process is sent SIGINT after that delay.
+bool RunStreamer(const std::filesystem::path &streamerPath,
+                 const std::vector<std::string> &arguments,
+                 std::chrono::milliseconds interruptAfter, int *status,
+                 std::string *output) {
   int pipefd[2];
   if (pipe(pipefd) != 0) {
     std::cerr << "FAIL: pipe: " << std::strerror(errno) << "\n";
-    return 1;
+    return false;
   }
 
   pid_t pid = fork();
   if (pid < 0) {
     std::cerr << "FAIL: fork: " << std::strerror(errno) << "\n";
-    return 1;
+    return false;
   }
 
   if (pid == 0) {
@@ -76,24 +77,11 @@ int main() {
     dup2(pipefd[1], STDERR_FILENO);
     close(pipefd[1]);
 
-    std::vector<const char *> args = {
-        streamerPath.c_str(),
-        "--in",
-        "null",
-        "--out",
-        "null",
-        "--rate",
-        "44100",
-        "--period",
-        "128",
-        "--buffer",
-        "512",
-        "--channels",
-        "2",
-        "--format",
-        "s32",
-        nullptr,
-    };
+    std::vector<const char *> args = {streamerPath.c_str()};
+    for (const auto &arg : arguments) {
+      args.push_back(arg.c_str());
+    }
+    args.push_back(nullptr);
     execv(args[0], const_cast<char *const *>(args.data()));
     std::cerr << "FAIL: execv: " << std::strerror(errno) << "\n";
     _exit(127);
@@ -101,40 +89,283 @@ int main() {
 
   close(pipefd[1]);
 
-  std::this_thread::sleep_for(std::chrono::milliseconds(200));
-  kill(pid, SIGINT);
+  if (interruptAfter.count() > 0) {
+    std::this_thread::sleep_for(interruptAfter);
+    kill(pid, SIGINT);
+  }
 
-  int status = 0;
-  if (!WaitForExit(pid, &status, std::chrono::seconds(3))) {
+  if (!WaitForExit(pid, status, std::chrono::seconds(3))) {
     kill(pid, SIGKILL);
     std::cerr << "FAIL: timeout waiting for alsa_streamer\n";
-    return 1;
+    return false;
   }
 
-  std::string output;
   char buffer[4096];
   ssize_t n = 0;
   while ((n = read(pipefd[0], buffer, sizeof(buffer))) > 0) {
-    output.append(buffer, static_cast<size_t>(n));
+    output->append(buffer, static_cast<size_t>(n));
   }
   close(pipefd[0]);
+  return true;
+}
+
+bool TestNullDeviceStreaming(const std::filesystem::path &streamerPath) {
+  int status = 0;
+  std::string output;
+  if (!RunStreamer(streamerPath,
+                   {"--in", "null", "--out", "null", "--rate", "44100",
+                    "--period", "128", "--buffer", "512", "--channels", "2",
+                    "--format", "s32"},
+                   std::chrono::milliseconds(200), &status, &output)) {
+    return false;
+  }
 
   if (!Expect(WIFEXITED(status), "alsa_streamer exit")) {
-    return 1;
+    return false;
   }
   if (!Expect(WEXITSTATUS(status) == 0, "alsa_streamer exit code")) {
     std::cerr << output << "\n";
-    return 1;
+    return false;
   }
 
   if (!Expect(output.find("ALSA streaming started") != std::string::npos,
               "start log")) {
     std::cerr << output << "\n";
-    return 1;
+    return false;
+  }
+  if (!Expect(output.find("mode passthrough") != std::string::npos,
+              "passthrough mode log")) {
+    std::cerr << output << "\n";
+    return false;
   }
   if (!Expect(output.find("ALSA streaming stopped") != std::string::npos,
               "stop log")) {
     std::cerr << output << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool TestFilePassthroughBitExact(const std::filesystem::path &streamerPath) {
+  const auto tempDir =
+      std::filesystem::temp_directory_path() /
+      ("totton_streamer_e2e_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(tempDir);
+  const auto inputPath = tempDir / "input.raw";
+  const auto outputPath = tempDir / "output.raw";
+
+  // Odd frame count and full-scale values: any float round trip or period
+  // padding would alter the bytes.
+  std::vector<int32_t> samples(2 * 1001);
+  std::mt19937 rng(1234);
+  for (auto &sample : samples) {
+    sample = static_cast<int32_t>(rng());
+  }
+  samples[0] = std::numeric_limits<int32_t>::max();
+  samples[1] = std::numeric_limits<int32_t>::min();
+  {
+    std::ofstream input(inputPath, std::ios::binary);
+    input.write(reinterpret_cast<const char *>(samples.data()),
+                static_cast<std::streamsize>(samples.size() * sizeof(int32_t)));
+  }
+
+  int status = 0;
+  std::string output;
+  const bool ran = RunStreamer(
+      streamerPath,
+      {"--in-file", inputPath.string(), "--out-file", outputPath.string(),
+       "--rate", "44100", "--channels", "2", "--format", "s32"},
+      std::chrono::milliseconds(0), &status, &output);
+
+  std::vector<int32_t> processed;
+  {
+    std::ifstream result(outputPath, std::ios::binary);
+    processed.resize(samples.size() + 1);
+    result.read(reinterpret_cast<char *>(processed.data()),
+                static_cast<std::streamsize>(processed.size() *
+                                             sizeof(int32_t)));
+    processed.resize(static_cast<size_t>(result.gcount()) / sizeof(int32_t));
+  }
+  std::filesystem::remove_all(tempDir);
+
+  if (!ran) {
+    return false;
+  }
+  if (!Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+              "file passthrough exit code")) {
+    std::cerr << output << "\n";
+    return false;
+  }
+  if (!Expect(output.find("mode passthrough") != std::string::npos,
+              "file passthrough mode log")) {
+    std::cerr << output << "\n";
+    return false;
+  }
+  return Expect(processed == samples, "file passthrough is bit-exact");
+}
+
+bool TestFileFilterUpsamplesWithTail(
+    const std::filesystem::path &streamerPath) {
+  const auto tempDir =
+      std::filesystem::temp_directory_path() /
+      ("totton_streamer_filter_e2e_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(tempDir);
+  const auto inputPath = tempDir / "input.raw";
+  const auto outputPath = tempDir / "output.raw";
+  const auto filterPath = tempDir / "filter.json";
+
+  // Unit impulse FIR at 2x: output is the zero-stuffed input followed by the
+  // taps - 1 sample tail, so length and content are easy to predict.
+  const std::vector<float> taps = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  {
+    std::ofstream bin(tempDir / "coeffs.bin", std::ios::binary);
+    bin.write(reinterpret_cast<const char *>(taps.data()),
+              static_cast<std::streamsize>(taps.size() * sizeof(float)));
+    std::ofstream json(filterPath);
+    json << "{\"coefficients_bin\": \"coeffs.bin\", \"taps\": 5, "
+         << "\"fft_size\": 16, \"block_size\": 12, "
+         << "\"upsample_factor\": 2}\n";
+  }
+
+  const size_t frames = 1001;
+  std::vector<int16_t> samples(2 * frames);
+  std::mt19937 rng(99);
+  for (auto &sample : samples) {
+    sample = static_cast<int16_t>(rng() % 20000) - 10000;
+  }
+  {
+    std::ofstream input(inputPath, std::ios::binary);
+    input.write(reinterpret_cast<const char *>(samples.data()),
+                static_cast<std::streamsize>(samples.size() * sizeof(int16_t)));
+  }
+
+  int status = 0;
+  std::string output;
+  const bool ran = RunStreamer(
+      streamerPath,
+      {"--in-file", inputPath.string(), "--out-file", outputPath.string(),
+       "--rate", "44100", "--channels", "2", "--format", "s16", "--filter",
+       filterPath.string()},
+      std::chrono::milliseconds(0), &status, &output);
+
+  std::vector<int16_t> processed;
+  {
+    std::ifstream result(outputPath, std::ios::binary);
+    processed.resize(samples.size() * 4);
+    result.read(reinterpret_cast<char *>(processed.data()),
+                static_cast<std::streamsize>(processed.size() *
+                                             sizeof(int16_t)));
+    processed.resize(static_cast<size_t>(result.gcount()) / sizeof(int16_t));
+  }
+  std::filesystem::remove_all(tempDir);
+
+  if (!ran) {
+    return false;
+  }
+  if (!Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+              "file filter exit code")) {
+    std::cerr << output << "\n";
+    return false;
+  }
+  const size_t expectedFrames = frames * 2 + taps.size() - 1;
+  if (!Expect(processed.size() == expectedFrames * 2,
+              "file filter output includes upsampled frames and tail")) {
+    std::cerr << "got " << processed.size() / 2 << " frames, expected "
+              << expectedFrames << "\n";
+    return false;
+  }
+  for (size_t i = 0; i < expectedFrames; ++i) {
+    for (size_t ch = 0; ch < 2; ++ch) {
+      const int expected =
+          (i % 2 == 0 && i / 2 < frames) ? samples[(i / 2) * 2 + ch] : 0;
+      if (std::abs(processed[i * 2 + ch] - expected) > 1) {
+        std::cerr << "FAIL: file filter sample mismatch at frame " << i
+                  << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// --auto probes the null device, which takes every rate, so 44.1 kHz input
+// negotiates 705.6 kHz and needs a 16x filter from --filter-dir.
+bool TestAutoNegotiation(const std::filesystem::path &streamerPath) {
+  const auto tempDir =
+      std::filesystem::temp_directory_path() /
+      ("totton_streamer_auto_e2e_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(tempDir);
+  const std::vector<std::string> arguments = {
+      "--in", "null", "--out", "null", "--rate", "44100", "--period", "128",
+      "--auto", "--filter-dir", tempDir.string()};
+
+  int status = 0;
+  std::string output;
+  if (!RunStreamer(streamerPath, arguments, std::chrono::milliseconds(0),
+                   &status, &output)) {
+    std::filesystem::remove_all(tempDir);
+    return false;
+  }
+  if (!Expect(WIFEXITED(status) && WEXITSTATUS(status) == 1 &&
+                  output.find("needs a 16x filter") != std::string::npos,
+              "--auto without a matching filter fails")) {
+    std::cerr << output << "\n";
+    std::filesystem::remove_all(tempDir);
+    return false;
+  }
+
+  std::vector<float> taps(17, 0.0f);
+  taps[0] = 1.0f;
+  {
+    std::ofstream bin(tempDir / "coeffs.bin", std::ios::binary);
+    bin.write(reinterpret_cast<const char *>(taps.data()),
+              static_cast<std::streamsize>(taps.size() * sizeof(float)));
+    std::ofstream json(tempDir / "filter_44k_16x_17_min_phase.json");
+    json << "{\"coefficients_bin\": \"coeffs.bin\", \"taps\": 17, "
+         << "\"fft_size\": 64, \"block_size\": 48, "
+         << "\"upsample_factor\": 16}\n";
+  }
+  output.clear();
+  const bool ran = RunStreamer(streamerPath, arguments,
+                               std::chrono::milliseconds(300), &status,
+                               &output);
+  std::filesystem::remove_all(tempDir);
+  if (!ran) {
+    return false;
+  }
+  if (!Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+              "--auto exit code") ||
+      !Expect(output.find("runs 705600 Hz for 44100 Hz input (16x)") !=
+                  std::string::npos,
+              "--auto negotiation log") ||
+      !Expect(output.find("mode filter") != std::string::npos,
+              "--auto streams through the filter")) {
+    std::cerr << output << "\n";
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  std::filesystem::path execDir = GetExecutableDir();
+  std::filesystem::path streamerPath = execDir / "alsa_streamer";
+  if (!std::filesystem::exists(streamerPath)) {
+    std::cerr << "FAIL: alsa_streamer not found at " << streamerPath << "\n";
+    return 1;
+  }
+
+  if (!TestNullDeviceStreaming(streamerPath)) {
+    return 1;
+  }
+  if (!TestFilePassthroughBitExact(streamerPath)) {
+    return 1;
+  }
+  if (!TestFileFilterUpsamplesWithTail(streamerPath)) {
+    return 1;
+  }
+  if (!TestAutoNegotiation(streamerPath)) {
     return 1;
   }
 
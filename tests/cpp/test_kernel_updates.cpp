@@ -0,0 +1,265 @@
+#include "alsa/kernel_updates.h"
+
+#include <unistd.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Kernel switching without a running stream: rebuilt kernels reach the
+// upsamplers at Apply(), and nothing built for an earlier rate does.
+
+namespace {
+
+using totton::alsa::KernelUpdates;
+using totton::vulkan::FilterKernel;
+using totton::vulkan::VulkanStreamingUpsampler;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+// 2x filters that differ only in where their single tap sits, so the filter
+// an upsampler runs with shows in its output.
+class Filters {
+public:
+  Filters()
+      : dir_(std::filesystem::temp_directory_path() /
+             ("totton_kernel_updates_" + std::to_string(::getpid()))) {
+    std::filesystem::create_directories(dir_);
+    Write("a.json", 0, 64, 48);
+    Write("b.json", 3, 64, 48);
+    Write("c.json", 5, 64, 48);
+    Write("wide.json", 0, 128, 112);
+  }
+  ~Filters() { std::filesystem::remove_all(dir_); }
+
+  std::string Path(const std::string &name) const {
+    return (dir_ / name).string();
+  }
+
+private:
+  void Write(const std::string &name, std::size_t tap, std::size_t fftSize,
+             std::size_t blockSize) {
+    std::vector<float> taps(17, 0.0f);
+    taps[tap] = 1.0f;
+    const std::string bin = name + ".bin";
+    std::ofstream coefficients(dir_ / bin, std::ios::binary);
+    coefficients.write(
+        reinterpret_cast<const char *>(taps.data()),
+        static_cast<std::streamsize>(taps.size() * sizeof(float)));
+    std::ofstream json(dir_ / name);
+    json << "{\"coefficients_bin\": \"" << bin << "\", \"taps\": 17, "
+         << "\"fft_size\": " << fftSize << ", \"block_size\": " << blockSize
+         << ", \"upsample_factor\": 2}\n";
+  }
+
+  std::filesystem::path dir_;
+};
+
+bool Load(const std::string &path, VulkanStreamingUpsampler *upsampler) {
+  std::string error;
+  upsampler->SetGpuEnabled(false);
+  if (!upsampler->LoadFilter(path, &error)) {
+    std::cerr << "FAIL: loading " << path << ": " << error << "\n";
+    return false;
+  }
+  return true;
+}
+
+// One block of an impulse through upsampler.
+std::vector<float> Impulse(VulkanStreamingUpsampler *upsampler) {
+  std::vector<float> input(upsampler->GetInputBlockSize(), 0.0f);
+  input[0] = 1.0f;
+  return upsampler->ProcessBlock(input.data(), input.size());
+}
+
+// Whether upsampler filters like a fresh one loaded from path.
+bool RunsFilter(VulkanStreamingUpsampler *upsampler, const std::string &path) {
+  VulkanStreamingUpsampler reference;
+  if (!Load(path, &reference)) {
+    return false;
+  }
+  upsampler->Reset();
+  const std::vector<float> actual = Impulse(upsampler);
+  const std::vector<float> expected = Impulse(&reference);
+  if (actual.empty() || actual.size() != expected.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < actual.size(); ++i) {
+    if (std::fabs(actual[i] - expected[i]) > 1e-5f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TestStaleGenerationIsRefused(const Filters &filters) {
+  std::vector<VulkanStreamingUpsampler> upsamplers(1);
+  if (!Load(filters.Path("a.json"), &upsamplers[0])) {
+    return false;
+  }
+  KernelUpdates updates(filters.Path("a.json"), upsamplers[0].GetConfig(),
+                        96000.0);
+  const uint64_t generation = updates.Generation();
+  updates.BeginRebase();
+  std::string error;
+  if (!Expect(!updates.SwitchFilter(filters.Path("b.json"), generation,
+                                    &error),
+              "switch resolved before a rate change published") ||
+      !Expect(Contains(error, "rate changed"), "stale switch error") ||
+      !Expect(updates.FilterPath() == filters.Path("a.json"),
+              "stale switch changed the filter")) {
+    return false;
+  }
+  updates.Apply(&upsamplers);
+  if (!Expect(RunsFilter(&upsamplers[0], filters.Path("a.json")),
+              "stale kernel applied")) {
+    return false;
+  }
+  return Expect(updates.SwitchFilter(filters.Path("b.json"),
+                                     updates.Generation(), &error),
+                "switch in the current generation") &&
+         Expect(updates.FilterPath() == filters.Path("b.json"),
+                "switch made the filter current");
+}
+
+bool TestRebasePublishesLoadedKernel(const Filters &filters) {
+  std::vector<VulkanStreamingUpsampler> upsamplers(2);
+  for (auto &upsampler : upsamplers) {
+    if (!Load(filters.Path("a.json"), &upsampler)) {
+      return false;
+    }
+  }
+  KernelUpdates updates(filters.Path("a.json"), upsamplers[0].GetConfig(),
+                        96000.0);
+  const uint64_t generation = updates.Generation();
+  updates.BeginRebase();
+  VulkanStreamingUpsampler loaded;
+  if (!Load(filters.Path("b.json"), &loaded)) {
+    return false;
+  }
+  updates.Rebase(filters.Path("b.json"), loaded.GetKernel(), 88200.0);
+  if (!Expect(updates.Generation() == generation + 2,
+              "rebase moves the generation on") ||
+      !Expect(updates.FilterPath() == filters.Path("b.json"),
+              "rebase follows the loaded filter")) {
+    return false;
+  }
+  updates.Apply(&upsamplers);
+  return Expect(RunsFilter(&upsamplers[0], filters.Path("b.json")) &&
+                    RunsFilter(&upsamplers[1], filters.Path("b.json")),
+                "rebased kernel reaches every channel") &&
+         Expect(!updates.TakeRejected(), "rebased kernel rejected");
+}
+
+bool TestNewestPublishWins(const Filters &filters) {
+  std::vector<VulkanStreamingUpsampler> upsamplers(1);
+  if (!Load(filters.Path("a.json"), &upsamplers[0])) {
+    return false;
+  }
+  KernelUpdates updates(filters.Path("a.json"), upsamplers[0].GetConfig(),
+                        96000.0);
+  std::string error;
+  if (!Expect(updates.SwitchFilter(filters.Path("b.json"),
+                                   updates.Generation(), &error),
+              "first switch") ||
+      !Expect(updates.SwitchFilter(filters.Path("c.json"),
+                                   updates.Generation(), &error),
+              "second switch")) {
+    return false;
+  }
+  updates.Apply(&upsamplers);
+  updates.Collect();
+  if (!Expect(RunsFilter(&upsamplers[0], filters.Path("c.json")),
+              "newest kernel applied")) {
+    return false;
+  }
+  // A reload rebuilds the current filter, not the one first published.
+  if (!Expect(updates.Reload(&error), "reload")) {
+    return false;
+  }
+  updates.Apply(&upsamplers);
+  updates.Collect();
+  if (!Expect(RunsFilter(&upsamplers[0], filters.Path("c.json")),
+              "reload switched filters")) {
+    return false;
+  }
+  return Expect(!updates.SwitchFilter(filters.Path("wide.json"),
+                                      updates.Generation(), &error),
+                "geometry change accepted") &&
+         Expect(Contains(error, "geometry"), "geometry change error") &&
+         Expect(updates.FilterPath() == filters.Path("c.json"),
+                "refused switch changed the filter");
+}
+
+bool TestRejectedKernelKeepsLoadedFilter(const Filters &filters) {
+  // The upsamplers run a filter of another geometry than the one the
+  // updates were set up for, so every kernel published is rejected.
+  std::vector<VulkanStreamingUpsampler> upsamplers(1);
+  VulkanStreamingUpsampler narrow;
+  if (!Load(filters.Path("wide.json"), &upsamplers[0]) ||
+      !Load(filters.Path("a.json"), &narrow)) {
+    return false;
+  }
+  KernelUpdates updates(filters.Path("a.json"), narrow.GetConfig(), 96000.0);
+  std::string error;
+  if (!Expect(updates.SwitchFilter(filters.Path("b.json"),
+                                   updates.Generation(), &error),
+              "switch")) {
+    return false;
+  }
+  updates.Apply(&upsamplers);
+  if (!Expect(updates.TakeRejected(), "rejection reported") ||
+      !Expect(!updates.TakeRejected(), "rejection reported twice") ||
+      !Expect(RunsFilter(&upsamplers[0], filters.Path("wide.json")),
+              "rejected kernel left the loaded filter")) {
+    return false;
+  }
+  // The same kernel is not retried every period.
+  updates.Apply(&upsamplers);
+  return Expect(!updates.TakeRejected(), "rejected kernel retried");
+}
+
+} // namespace
+
+int main() {
+  struct TestCase {
+    const char *name;
+    bool (*fn)(const Filters &);
+  };
+
+  const TestCase tests[] = {
+      {"StaleGenerationIsRefused", TestStaleGenerationIsRefused},
+      {"RebasePublishesLoadedKernel", TestRebasePublishesLoadedKernel},
+      {"NewestPublishWins", TestNewestPublishWins},
+      {"RejectedKernelKeepsLoadedFilter", TestRejectedKernelKeepsLoadedFilter},
+  };
+
+  const Filters filters;
+  int failures = 0;
+  for (const auto &test : tests) {
+    std::cout << "Running " << test.name << "...\n";
+    if (!test.fn(filters)) {
+      ++failures;
+    }
+  }
+
+  if (failures == 0) {
+    std::cout << "OK: kernel updates tests passed\n";
+    return 0;
+  }
+  std::cerr << "FAIL: " << failures << " kernel updates tests failed\n";
+  return 1;
+}
@@ -1,5 +1,6 @@
 #include "vulkan/vulkan_streaming_upsampler.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <filesystem>
@@ -39,8 +40,18 @@ bool HasVulkanDevice() {
 }
 #endif
 
-std::filesystem::path WriteTempFilter(const std::filesystem::path &dir,
-                                      std::size_t upsampleFactor) {
+void WriteTaps(const std::filesystem::path &path,
+               const std::vector<float> &taps) {
+  std::ofstream bin(path, std::ios::binary);
+  bin.write(reinterpret_cast<const char *>(taps.data()),
+            static_cast<std::streamsize>(taps.size() * sizeof(float)));
+}
+
+// upsampleFactor is the overall factor, halfbands included.
+std::filesystem::path
+WriteTempFilter(const std::filesystem::path &dir, std::size_t upsampleFactor,
+                std::size_t downsampleFactor = 1,
+                const std::vector<std::vector<float>> &halfbands = {}) {
   std::filesystem::create_directories(dir);
 
   const std::filesystem::path binPath = dir / "coeffs.bin";
@@ -58,8 +69,21 @@ std::filesystem::path WriteTempFilter(const std::filesystem::path &dir,
        << "  \"taps\": 5,\n"
        << "  \"fft_size\": 16,\n"
        << "  \"block_size\": 12,\n"
-       << "  \"upsample_factor\": " << upsampleFactor << "\n"
-       << "}\n";
+       << "  \"upsample_factor\": " << upsampleFactor;
+  if (downsampleFactor > 1) {
+    json << ",\n  \"downsample_factor\": " << downsampleFactor;
+  }
+  if (!halfbands.empty()) {
+    json << ",\n  \"halfband_stages\": [";
+    for (std::size_t s = 0; s < halfbands.size(); ++s) {
+      const std::string name = "halfband" + std::to_string(s) + ".bin";
+      WriteTaps(dir / name, halfbands[s]);
+      json << (s > 0 ? ", " : "") << "{\"coefficients_bin\": \"" << name
+           << "\", \"taps\": " << halfbands[s].size() << "}";
+    }
+    json << "]";
+  }
+  json << "\n}\n";
   json.close();
 
   return jsonPath;
@@ -105,6 +129,57 @@ bool CheckVectorNear(const std::vector<float> &actual,
   return true;
 }
 
+// Reference for a kernel upsampling by factor followed by 2x half-band
+// stages: zero-stuff and convolve once per stage.
+std::vector<float>
+Cascade(const std::vector<float> &input, const std::vector<float> &taps,
+        std::size_t factor,
+        const std::vector<std::vector<float>> &halfbands = {}) {
+  std::vector<float> output = Convolve(ZeroStuff(input, factor), taps);
+  for (const auto &halfband : halfbands) {
+    output = Convolve(ZeroStuff(output, 2), halfband);
+  }
+  return output;
+}
+
+std::vector<float> Decimate(const std::vector<float> &input,
+                            std::size_t factor) {
+  std::vector<float> output;
+  for (std::size_t i = 0; i < input.size(); i += factor) {
+    output.push_back(input[i]);
+  }
+  return output;
+}
+
+// Feeds input through Process() in uneven chunks, then Flush(); the result
+// must equal the full linear convolution of the zero-stuffed input.
+bool CheckStreamingMatchesConvolution(
+    totton::vulkan::VulkanStreamingUpsampler *upsampler,
+    const std::vector<float> &taps, std::size_t factor,
+    const std::vector<std::vector<float>> &halfbands = {},
+    std::size_t downsampleFactor = 1) {
+  std::vector<float> input(29, 0.0f);
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    input[i] = static_cast<float>((i * 7) % 11) - 5.0f;
+  }
+  const std::size_t chunks[] = {5, 1, 7, 0, 3, 13};
+  std::vector<float> actual;
+  std::size_t offset = 0;
+  for (std::size_t chunk : chunks) {
+    chunk = std::min(chunk, input.size() - offset);
+    if (!upsampler->Process(input.data() + offset, chunk, &actual)) {
+      return false;
+    }
+    offset += chunk;
+  }
+  if (offset != input.size() || !upsampler->Flush(&actual)) {
+    return false;
+  }
+  return CheckVectorNear(
+      actual,
+      Decimate(Cascade(input, taps, factor, halfbands), downsampleFactor));
+}
+
 } // namespace
 
 int main() {
@@ -168,6 +243,12 @@ int main() {
     return 1;
   }
 
+  upsampler.Reset();
+  if (!CheckStreamingMatchesConvolution(&upsampler, taps, 1)) {
+    std::cerr << "Streaming Process/Flush mismatch\n";
+    return 1;
+  }
+
   const auto upsampleDir = tempDir / "upsample2x";
   const auto upsampleJsonPath = WriteTempFilter(upsampleDir, 2);
   totton::vulkan::VulkanStreamingUpsampler upsampled;
@@ -194,6 +275,166 @@ int main() {
     return 1;
   }
 
+  upsampled.Reset();
+  if (!CheckStreamingMatchesConvolution(&upsampled, taps, 2)) {
+    std::cerr << "Streaming Process/Flush mismatch (2x)\n";
+    return 1;
+  }
+
+  // A kernel built off-thread from the same filter filters identically; a
+  // scaled kernel scales the output without a reset, and nullptr reverts.
+  totton::vulkan::FilterKernel kernel;
+  if (!totton::vulkan::VulkanStreamingUpsampler::BuildKernel(
+          jsonPath.string(), &kernel, &error)) {
+    std::cerr << "BuildKernel failed: " << error << "\n";
+    return 1;
+  }
+  upsampler.Reset();
+  if (!upsampler.UseKernel(&kernel) ||
+      upsampler.ProcessBlock(blockA.data(), blockA.size()) != outA) {
+    std::cerr << "Rebuilt kernel output mismatch\n";
+    return 1;
+  }
+  if (upsampler.GetKernel().spectrum != kernel.spectrum) {
+    std::cerr << "Loaded kernel differs from the built one\n";
+    return 1;
+  }
+  for (auto &bin : kernel.spectrum) {
+    bin *= 2.0f;
+  }
+  std::vector<float> expectedScaled(expectedStream.begin() + blockSize,
+                                    expectedStream.end());
+  for (auto &value : expectedScaled) {
+    value *= 2.0f;
+  }
+  if (!CheckVectorNear(upsampler.ProcessBlock(blockB.data(), blockB.size()),
+                       expectedScaled, 5e-3f)) {
+    std::cerr << "Scaled kernel output mismatch\n";
+    return 1;
+  }
+  if (!upsampler.UseKernel(nullptr)) {
+    std::cerr << "UseKernel(nullptr) failed\n";
+    return 1;
+  }
+  upsampler.Reset();
+  if (upsampler.ProcessBlock(blockA.data(), blockA.size()) != outA) {
+    std::cerr << "Loaded filter not restored\n";
+    return 1;
+  }
+
+  totton::vulkan::FilterKernel upsampleKernel;
+  if (!totton::vulkan::VulkanStreamingUpsampler::BuildKernel(
+          upsampleJsonPath.string(), &upsampleKernel, &error)) {
+    std::cerr << "BuildKernel failed (2x): " << error << "\n";
+    return 1;
+  }
+  if (upsampler.UseKernel(&upsampleKernel)) {
+    std::cerr << "Kernel with a different upsample factor accepted\n";
+    return 1;
+  }
+
+  // A 2x kernel followed by two half-band stages: same kernel geometry,
+  // four times the output per block, and the same result as running each
+  // stage as a full convolution.
+  const std::vector<std::vector<float>> halfbands = {
+      {-0.0625f, 0.0f, 0.5625f, 1.0f, 0.5625f, 0.0f, -0.0625f},
+      {0.5f, 1.0f, 0.5f}};
+  const auto cascadeJsonPath =
+      WriteTempFilter(tempDir / "cascade8x", 8, 1, halfbands);
+  totton::vulkan::VulkanStreamingUpsampler cascade;
+  if (!cascade.LoadFilter(cascadeJsonPath.string(), &error)) {
+    std::cerr << "LoadFilter failed (cascade): " << error << "\n";
+    return 1;
+  }
+  const auto cascadeOut =
+      cascade.ProcessBlock(impulseInput.data(), impulseInput.size());
+  const auto cascadeConv = Cascade(impulseInput, taps, 2, halfbands);
+  if (cascade.GetInputBlockSize() != inputBlockSize ||
+      cascadeOut.size() != 4 * blockSize ||
+      !CheckVectorNear(cascadeOut,
+                       std::vector<float>(cascadeConv.begin(),
+                                          cascadeConv.begin() +
+                                              4 * blockSize))) {
+    std::cerr << "Cascade impulse response mismatch\n";
+    return 1;
+  }
+  cascade.Reset();
+  if (!CheckStreamingMatchesConvolution(&cascade, taps, 2, halfbands)) {
+    std::cerr << "Streaming Process/Flush mismatch (cascade)\n";
+    return 1;
+  }
+  totton::vulkan::FilterKernel cascadeKernel;
+  if (!totton::vulkan::VulkanStreamingUpsampler::BuildKernel(
+          cascadeJsonPath.string(), &cascadeKernel, &error) ||
+      !cascade.UseKernel(&cascadeKernel)) {
+    std::cerr << "Cascade kernel rejected: " << error << "\n";
+    return 1;
+  }
+  cascadeKernel.config.halfbandStages.pop_back();
+  if (cascade.UseKernel(&cascadeKernel)) {
+    std::cerr << "Kernel with different half-band stages accepted\n";
+    return 1;
+  }
+  const auto notHalfbandPath = WriteTempFilter(
+      tempDir / "not_halfband", 4, 1, {{0.5f, 1.0f, 0.25f}});
+  totton::vulkan::VulkanStreamingUpsampler notHalfband;
+  if (notHalfband.LoadFilter(notHalfbandPath.string(), &error)) {
+    std::cerr << "Asymmetric half-band stage accepted\n";
+    return 1;
+  }
+
+  // Decimation keeps every other filtered sample of the same kernel: half
+  // the output per block, and the spectrum is folded rather than fully
+  // inverse-transformed.
+  const auto decimateJsonPath = WriteTempFilter(tempDir / "decimate2x", 1, 2);
+  totton::vulkan::VulkanStreamingUpsampler decimated;
+  if (!decimated.LoadFilter(decimateJsonPath.string(), &error)) {
+    std::cerr << "LoadFilter failed (decimate): " << error << "\n";
+    return 1;
+  }
+  const auto decimatedOut =
+      decimated.ProcessBlock(blockA.data(), blockA.size());
+  const auto decimatedConv = Decimate(Convolve(blockA, taps), 2);
+  if (decimated.GetInputBlockSize() != blockSize ||
+      decimatedOut.size() != blockSize / 2 ||
+      !CheckVectorNear(decimatedOut,
+                       std::vector<float>(decimatedConv.begin(),
+                                          decimatedConv.begin() +
+                                              blockSize / 2))) {
+    std::cerr << "Decimated block mismatch\n";
+    return 1;
+  }
+  decimated.Reset();
+  if (!CheckStreamingMatchesConvolution(&decimated, taps, 1, {}, 2)) {
+    std::cerr << "Streaming Process/Flush mismatch (decimate)\n";
+    return 1;
+  }
+  if (decimated.UseKernel(&kernel)) {
+    std::cerr << "Kernel with a different downsample factor accepted\n";
+    return 1;
+  }
+  totton::vulkan::VulkanStreamingUpsampler invalid;
+  if (invalid.LoadFilter(
+          WriteTempFilter(tempDir / "decimate3x", 1, 3).string(), &error) ||
+      invalid.LoadFilter(
+          WriteTempFilter(tempDir / "updown", 2, 2).string(), &error)) {
+    std::cerr << "Invalid downsample_factor accepted\n";
+    return 1;
+  }
+
+  // Band power is collected in the multiply without changing the output,
+  // and each TakeSpectrum() drains what the blocks since the last one left.
+  upsampler.EnableSpectrum(4, 16000.0);
+  upsampler.Reset();
+  std::vector<float> bands(4, 0.0f);
+  if (upsampler.ProcessBlock(blockA.data(), blockA.size()) != outA ||
+      upsampler.TakeSpectrum(bands.data()) != 1 ||
+      std::accumulate(bands.begin(), bands.end(), 0.0f) <= 0.0f ||
+      upsampler.TakeSpectrum(bands.data()) != 0) {
+    std::cerr << "Spectrum metering mismatch\n";
+    return 1;
+  }
+
   std::cout << "OK\n";
   return 0;
 }
@@ -0,0 +1,170 @@
+#include "zmq/command_server.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <zmq.hpp>
+
+// Drives ZmqCommandServer in process: inline handlers answer while workers
+// are busy, worker handlers overlap, and timeouts and exceptions become
+// error replies.
+
+namespace {
+
+using totton::zmq_server::HandlerOptions;
+using totton::zmq_server::ZmqCommandServer;
+using totton::zmq_server::ZmqRequest;
+using totton::zmq_server::ZmqResponse;
+
+constexpr auto kSlowHandler = std::chrono::milliseconds(300);
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+// A DEALER client: several can be in flight on one server at once.
+class Client {
+public:
+  Client(zmq::context_t &context, const std::string &endpoint)
+      : socket_(context, zmq::socket_type::dealer) {
+    socket_.set(zmq::sockopt::linger, 0);
+    socket_.set(zmq::sockopt::rcvtimeo, 2000);
+    socket_.connect(endpoint);
+  }
+
+  void Send(const std::string &payload) {
+    socket_.send(zmq::buffer(payload), zmq::send_flags::none);
+  }
+
+  std::string Receive() {
+    zmq::message_t reply;
+    if (!socket_.recv(reply, zmq::recv_flags::none)) {
+      return {};
+    }
+    return std::string(static_cast<char *>(reply.data()), reply.size());
+  }
+
+private:
+  zmq::socket_t socket_;
+};
+
+long long ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void RegisterHandlers(ZmqCommandServer *server) {
+  HandlerOptions inlineOptions;
+  inlineOptions.runInline = true;
+  server->Register(
+      "PING",
+      [](const ZmqRequest &) {
+        return ZmqResponse{ZmqCommandServer::BuildOk("{\"pong\":true}")};
+      },
+      inlineOptions);
+  server->Register("SLOW", [](const ZmqRequest &) {
+    std::this_thread::sleep_for(kSlowHandler);
+    return ZmqResponse{ZmqCommandServer::BuildOk("{\"slow\":true}")};
+  });
+  HandlerOptions shortTimeout;
+  shortTimeout.timeout = std::chrono::milliseconds(100);
+  server->Register(
+      "HANG",
+      [](const ZmqRequest &) {
+        std::this_thread::sleep_for(kSlowHandler);
+        return ZmqResponse{ZmqCommandServer::BuildOk("{\"late\":true}")};
+      },
+      shortTimeout);
+  server->Register("THROW", [](const ZmqRequest &) -> ZmqResponse {
+    throw std::runtime_error("handler failed");
+  });
+}
+
+} // namespace
+
+int main() {
+  std::cout << "Running zmq command server tests...\n";
+  const std::string endpoint = "ipc:///tmp/totton_command_server_test_" +
+                               std::to_string(::getpid()) + ".sock";
+
+  ZmqCommandServer server(endpoint, "", 2);
+  RegisterHandlers(&server);
+  if (!Expect(server.Start(), "server starts")) {
+    return 1;
+  }
+
+  zmq::context_t context(1);
+  Client first(context, endpoint);
+  Client second(context, endpoint);
+  int failures = 0;
+  auto check = [&](bool condition, const char *message) {
+    if (!Expect(condition, message)) {
+      ++failures;
+    }
+  };
+
+  // An inline PING answers while a worker is busy with SLOW.
+  auto start = std::chrono::steady_clock::now();
+  first.Send("{\"cmd\":\"SLOW\"}");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  second.Send("{\"cmd\":\"PING\"}");
+  check(Contains(second.Receive(), "\"pong\":true"), "PING reply");
+  check(ElapsedMs(start) < kSlowHandler.count(), "PING not behind SLOW");
+  check(Contains(first.Receive(), "\"slow\":true"), "SLOW reply");
+
+  // Two slow requests run on both workers at once.
+  start = std::chrono::steady_clock::now();
+  first.Send("{\"cmd\":\"SLOW\"}");
+  second.Send("{\"cmd\":\"SLOW\"}");
+  check(Contains(first.Receive(), "\"slow\":true"), "first SLOW reply");
+  check(Contains(second.Receive(), "\"slow\":true"), "second SLOW reply");
+  check(ElapsedMs(start) < 2 * kSlowHandler.count(), "SLOW requests overlap");
+
+  // The client gets TIMEOUT and never sees the late reply.
+  first.Send("{\"cmd\":\"HANG\"}");
+  check(Contains(first.Receive(), "\"error_code\":\"TIMEOUT\""),
+        "HANG times out");
+  std::this_thread::sleep_for(kSlowHandler);
+  first.Send("{\"cmd\":\"PING\"}");
+  check(Contains(first.Receive(), "\"pong\":true"), "late reply dropped");
+
+  first.Send("{\"cmd\":\"THROW\"}");
+  check(Contains(first.Receive(), "INTERNAL_ERROR"), "exception reply");
+  first.Send("{\"cmd\":\"NOPE\"}");
+  check(Contains(first.Receive(), "UNKNOWN_CMD"), "unknown command reply");
+  first.Send("{\"cmd\":");
+  check(Contains(first.Receive(), "INVALID_JSON"), "invalid json reply");
+
+  // REQ clients add an empty delimiter frame; the reply must keep it.
+  zmq::socket_t req(context, zmq::socket_type::req);
+  req.set(zmq::sockopt::linger, 0);
+  req.set(zmq::sockopt::rcvtimeo, 2000);
+  req.connect(endpoint);
+  req.send(zmq::buffer(std::string("{\"cmd\":\"SLOW\"}")),
+           zmq::send_flags::none);
+  zmq::message_t reply;
+  check(req.recv(reply, zmq::recv_flags::none) &&
+            Contains(reply.to_string(), "\"slow\":true"),
+        "REQ client reply");
+
+  server.Stop();
+  if (failures > 0) {
+    return 1;
+  }
+  std::cout << "OK: zmq command server tests passed\n";
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include "audio/metrics_registry.h"
+#include "zmq/command_server.h"
+#include "zmq/event_stream.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <zmq.hpp>
+
+namespace {
+
+using totton::zmq_server::StatsSample;
+
+bool Expect(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool Contains(const std::string &text, const std::string &needle) {
+  return text.find(needle) != std::string::npos;
+}
+
+using Event = std::pair<std::string, std::string>;
+
+bool TestParseRegistryJson() {
+  totton::audio::MetricsRegistry registry;
+  registry.SetRates(44100, 705600);
+  registry.CaptureXruns()->store(2);
+  registry.PlaybackXruns()->store(3);
+  registry.CountOutputOverflow();
+  const auto sample = totton::zmq_server::ParseStatsSample(registry.ToJson());
+  return Expect(sample.has_value(), "registry JSON parses") &&
+         Expect(sample->inputRate == 44100 && sample->outputRate == 705600,
+                "rates") &&
+         Expect(sample->captureXruns == 2 && sample->playbackXruns == 3,
+                "xrun counters") &&
+         Expect(sample->inputOverflows == 0 && sample->outputOverflows == 1,
+                "overflow counters") &&
+         Expect(!totton::zmq_server::ParseStatsSample("{}").has_value(),
+                "empty document rejected");
+}
+
+bool TestTracker() {
+  std::vector<Event> events;
+  totton::zmq_server::StatsEventTracker tracker(
+      [&events](const std::string &topic, const std::string &data) {
+        events.emplace_back(topic, data);
+      });
+  StatsSample sample;
+  sample.inputRate = 48000;
+  sample.outputRate = 768000;
+  sample.uptimeMs = 1000;
+  sample.captureXruns = 4;
+  tracker.Update(sample);
+  if (!Expect(events.size() == 1 && events[0].first == "event.rate",
+              "first sample only reports the rate")) {
+    return false;
+  }
+
+  events.clear();
+  sample.uptimeMs = 2000;
+  sample.playbackXruns = 2;
+  sample.deadlineMisses = 1;
+  tracker.Update(sample);
+  if (!Expect(events.size() == 2 && events[0].first == "event.xrun" &&
+                  Contains(events[0].second, "\"count\":2") &&
+                  Contains(events[0].second, "\"total\":6"),
+              "xrun burst") ||
+      !Expect(events[1].first == "event.metrics" &&
+                  Contains(events[1].second, "\"interval_ms\":1000") &&
+                  Contains(events[1].second, "\"deadline_misses\":1"),
+              "metrics delta")) {
+    return false;
+  }
+
+  events.clear();
+  sample.inputRate = 44100;
+  sample.outputRate = 705600;
+  sample.uptimeMs = 500; // The streamer restarted.
+  sample.captureXruns = 1;
+  sample.playbackXruns = 0;
+  sample.deadlineMisses = 0;
+  tracker.Update(sample);
+  return Expect(events.size() == 3, "restart event count") &&
+         Expect(events[0].first == "event.rate" &&
+                    Contains(events[0].second, "\"previous_input_rate\":48000"),
+                "rate change") &&
+         Expect(Contains(events[1].second, "\"capture\":1"),
+                "xruns since restart") &&
+         Expect(Contains(events[2].second, "\"restarted\":true"),
+                "restart flagged");
+}
+
+// Receives one [topic, body] event, or an empty pair on timeout.
+Event Receive(zmq::socket_t &socket) {
+  zmq::message_t topic;
+  zmq::message_t body;
+  if (!socket.recv(topic, zmq::recv_flags::none) || !topic.more() ||
+      !socket.recv(body, zmq::recv_flags::none)) {
+    return {};
+  }
+  return {topic.to_string(), body.to_string()};
+}
+
+bool TestPublisher() {
+  const std::string endpoint = "ipc:///tmp/totton_event_stream_test_" +
+                               std::to_string(::getpid()) + ".sock";
+  const std::string pubEndpoint = "ipc:///tmp/totton_event_stream_pub_" +
+                                  std::to_string(::getpid()) + ".sock";
+  totton::zmq_server::ZmqCommandServer server(endpoint, pubEndpoint, 1);
+  if (!Expect(server.Start(), "server starts")) {
+    return false;
+  }
+  totton::zmq_server::EventPublisher events(&server);
+
+  zmq::context_t context(1);
+  zmq::socket_t sub(context, zmq::socket_type::sub);
+  sub.set(zmq::sockopt::linger, 0);
+  sub.set(zmq::sockopt::rcvtimeo, 1000);
+  sub.set(zmq::sockopt::subscribe, "event.filter");
+  sub.connect(pubEndpoint);
+  // PUB drops everything until the subscription has propagated.
+  bool subscribed = false;
+  for (int i = 0; i < 50 && !subscribed; ++i) {
+    events.Emit(totton::zmq_server::topic::kFilter, "{\"probe\":true}");
+    subscribed = !Receive(sub).first.empty();
+  }
+  if (!Expect(subscribed, "subscriber connected")) {
+    server.Stop();
+    return false;
+  }
+  // Drain probes that were still in flight.
+  sub.set(zmq::sockopt::rcvtimeo, 100);
+  while (!Receive(sub).first.empty()) {
+  }
+  sub.set(zmq::sockopt::rcvtimeo, 1000);
+
+  events.Emit(totton::zmq_server::topic::kXrun, "{\"count\":1}");
+  events.Emit(totton::zmq_server::topic::kFilter, "{\"reason\":\"reload\"}");
+  events.Emit(totton::zmq_server::topic::kFilter, "");
+  const Event first = Receive(sub);
+  const Event second = Receive(sub);
+  server.Stop();
+
+  // Sequence numbers are per topic, so the probes are counted too.
+  const auto seqOf = [](const std::string &body) {
+    const auto pos = body.find("\"seq\":");
+    return pos == std::string::npos ? 0ULL
+                                    : std::stoull(body.substr(pos + 6));
+  };
+  return Expect(first.first == "event.filter", "topic frame") &&
+         Expect(Contains(first.second, "\"topic\":\"event.filter\"") &&
+                    Contains(first.second, "\"ts_ms\":") &&
+                    Contains(first.second, "\"data\":{\"reason\":\"reload\"}"),
+                "event body") &&
+         Expect(second.first == "event.filter" &&
+                    Contains(second.second, "\"data\":{}"),
+                "empty data") &&
+         Expect(seqOf(second.second) == seqOf(first.second) + 1,
+                "consecutive sequence numbers");
+}
+
+} // namespace
+
+int main() {
+  std::cout << "Running zmq event stream tests...\n";
+  int passed = 0;
+  int failed = 0;
+  for (auto test : {TestParseRegistryJson, TestTracker, TestPublisher}) {
+    if (test()) {
+      ++passed;
+    } else {
+      ++failed;
+    }
+  }
+  if (failed > 0) {
+    std::cerr << failed << " test(s) failed\n";
+    return 1;
+  }
+  std::cout << "OK: " << passed << " zmq event stream tests passed\n";
+  return 0;
+}
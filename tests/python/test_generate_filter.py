@@ -5,6 +5,7 @@ Tests filter coefficient generation, validation, and normalization.
 Uses small tap counts for fast execution.
 """
 
+import json
 from pathlib import Path
 
 import numpy as np
@@ -13,12 +14,15 @@ from scipy import signal
 
 from scripts.filters.generate_filter import (
     FilterConfig,
+    FilterExporter,
     FilterValidator,
     MinimumPhaseMethod,
     MULTI_RATE_CONFIGS,
     calculate_safe_gain,
     compute_padded_taps,
+    design_halfband,
     normalize_coefficients,
+    split_cascade_ratio,
     validate_tap_count,
 )
 
@@ -485,6 +489,83 @@ class TestCoefficientFileNaming:
         assert "500000" in config_500k.base_name
 
 
+class TestHalfbandCascade:
+    """Tests for the half-band stages emitted after a 2x kernel."""
+
+    def test_halfband_shape(self):
+        """Stages should be 4k - 1 taps, centre 1.0, zero at even offsets."""
+
+        h = design_halfband(176400, 20000, 160)
+        centre = len(h) // 2
+        assert len(h) % 4 == 3
+        assert h[centre] == 1.0
+        assert np.all(h[centre + 2 :: 2] == 0.0)
+        assert np.allclose(h, h[::-1])
+        assert np.isclose(np.sum(h), 2.0)
+
+    def test_halfband_rejects_images(self):
+        """Images of the passband should be attenuated to the target."""
+
+        h = design_halfband(176400, 20000, 120)
+        w, response = signal.freqz(h, worN=8192, fs=176400)
+        stopband = np.abs(response[w >= 88200 - 20000])
+        assert 20 * np.log10(np.max(stopband) / 2.0) < -115
+
+    def test_later_stages_are_shorter(self):
+        """Each stage has a wider transition band than the one before."""
+
+        taps = [len(design_halfband(88200 << n, 20000, 160)) for n in range(1, 4)]
+        assert taps == sorted(taps, reverse=True)
+
+    def test_split_cascade_ratio(self):
+        """The kernel keeps the ratio the stages do not provide."""
+
+        assert split_cascade_ratio(16, 3) == 2
+        assert split_cascade_ratio(16, 0) == 16
+        with pytest.raises(ValueError):
+            split_cascade_ratio(2, 2)
+
+    def test_base_name_uses_overall_ratio(self):
+        """Filter lookups by ratio should find the cascade."""
+
+        config = FilterConfig(
+            n_taps=10_000, input_rate=44100, upsample_ratio=2, halfband_stages=3
+        )
+        assert config.overall_ratio == 16
+        assert config.base_name == "filter_44k_16x_10000_min_phase"
+
+    def test_too_many_stages_raises_error(self):
+        """The streamer loads at most 4 stages."""
+
+        with pytest.raises(ValueError):
+            FilterConfig(
+                n_taps=10_000, input_rate=44100, upsample_ratio=1, halfband_stages=5
+            )
+
+    def test_exporter_writes_halfband_sidecar(self, tmp_path):
+        """The sidecar should list each stage and the overall factor."""
+
+        config = FilterConfig(
+            n_taps=1_000, input_rate=44100, upsample_ratio=2, halfband_stages=2
+        )
+        h = np.zeros(1_000)
+        h[0] = 2.0
+        metadata = {"n_taps_actual": 1_000}
+        base_name = FilterExporter(config, str(tmp_path)).export(
+            h, metadata, skip_header=True
+        )
+        sidecar = json.loads((tmp_path / f"{base_name}.json").read_text())
+        assert sidecar["upsample_factor"] == 8
+        assert [stage["coefficients_bin"] for stage in sidecar["halfband_stages"]] == [
+            f"{base_name}_hb1.bin",
+            f"{base_name}_hb2.bin",
+        ]
+        for stage in sidecar["halfband_stages"]:
+            taps = np.fromfile(tmp_path / stage["coefficients_bin"], dtype=np.float32)
+            assert len(taps) == stage["taps"]
+            assert taps[len(taps) // 2] == 1.0
+
+
 class TestMultiRateConfigs:
     """Tests for MULTI_RATE_CONFIGS and multi-rate filter generation."""
 
@@ -1,7 +1,9 @@
 import json
+import struct
 from pathlib import Path
 
 from web.services.daemon import load_stats
+from web.services.stats_shm import STATS_SHM_MAGIC, read_stats_shm
 
 
 def test_load_stats_reads_rates_and_xrun(tmp_path: Path):
@@ -28,3 +30,41 @@ def test_load_stats_falls_back_to_xrun_count(tmp_path: Path):
     stats = load_stats(stats_path)
 
     assert stats["xrun_total"] == 7
+
+
+def _write_stats_shm(path: Path, sequence: int = 2) -> None:
+    header = struct.pack("=IIIIQ", STATS_SHM_MAGIC, 2, 64, 432, sequence)
+    words = [7, 123456, 44100, 176400]
+    mode = b"filter".ljust(16, b"\0")
+    tail = [1, 2, 0, 23219954]
+    tail += [10, 5000, 900, 1023]  # cycle
+    tail += [0] * 4 * 5  # stages
+    tail += [100, 50, 200, 2112, 4000, 1800, 6000, 8192]  # fills
+    tail += [4, 800, 300, 511] + [0] * 4 * 2  # gpu
+    payload = struct.pack("=4Q", *words) + mode + struct.pack(f"={len(tail)}Q", *tail)
+    path.write_bytes(header + bytes(40) + payload)
+
+
+def test_read_stats_shm_decodes_layout(tmp_path: Path):
+    shm_path = tmp_path / "totton_stats"
+    _write_stats_shm(shm_path)
+
+    stats = read_stats_shm(shm_path)
+
+    assert stats is not None
+    assert stats["input_rate"] == 44100
+    assert stats["output_rate"] == 176400
+    assert stats["mode"] == "filter"
+    assert stats["audio"]["xrun"] == {"total": 3, "capture": 1, "playback": 2}
+    assert stats["audio"]["deadline"]["cycle"]["max_ns"] == 900
+    assert stats["audio"]["fill"]["output"]["capacity"] == 8192
+    assert stats["audio"]["gpu"]["execute"]["sum_ns"] == 800
+
+
+def test_read_stats_shm_rejects_busy_or_missing_block(tmp_path: Path):
+    shm_path = tmp_path / "totton_stats"
+    assert read_stats_shm(shm_path) is None
+
+    _write_stats_shm(shm_path, sequence=3)
+
+    assert read_stats_shm(shm_path, max_attempts=3) is None
@@ -13,6 +13,8 @@ ZEROMQ_IPC_PATH = os.environ.get("TOTTON_ZMQ_ENDPOINT", "ipc:///tmp/totton_zmq.s
 STATS_FILE_PATH = Path(
     os.environ.get("TOTTON_STATS_PATH", "/tmp/gpu_upsampler_stats.json")
 )
+STATS_SHM_NAME = os.environ.get("TOTTON_STATS_SHM", "/totton_stats")
+STATS_SHM_PATH = Path("/dev/shm") / STATS_SHM_NAME.lstrip("/")
 DOCKER_SOCKET_PATH = Path(
     os.environ.get("TOTTON_DOCKER_SOCKET", "/var/run/docker.sock")
 )
@@ -10,6 +10,7 @@ from .eq import (
     read_and_validate_upload,
     validate_eq_profile_content,
 )
+from .stats_shm import read_stats_shm
 
 __all__ = [
     "check_daemon_running",
@@ -20,6 +21,7 @@ __all__ = [
     "load_stats",
     "parse_eq_profile_content",
     "read_and_validate_upload",
+    "read_stats_shm",
     "restart_dsp_container",
     "save_config",
     "save_config_updates",
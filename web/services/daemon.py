@@ -5,6 +5,7 @@ from pathlib import Path
 
 from ..constants import STATS_FILE_PATH
 from .daemon_client import get_daemon_client
+from .stats_shm import read_stats_shm
 
 
 def check_daemon_running() -> bool:
@@ -17,7 +18,19 @@ def check_daemon_running() -> bool:
 
 
 def load_stats(stats_path: Path | None = None) -> dict[str, int]:
-    """Load runtime stats for UI display."""
+    """Load runtime stats for UI display.
+
+    Prefers the streamer's shared-memory block, which is refreshed every
+    period, and falls back to the JSON stats file.
+    """
+    if stats_path is None:
+        shm = read_stats_shm()
+        if shm is not None:
+            return {
+                "input_rate": shm["input_rate"],
+                "output_rate": shm["output_rate"],
+                "xrun_total": shm["audio"]["xrun"]["total"],
+            }
     path = stats_path or STATS_FILE_PATH
     default_stats = {"input_rate": 0, "output_rate": 0, "xrun_total": 0}
     if not path.exists():
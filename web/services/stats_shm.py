@@ -0,0 +1,100 @@
+"""Reader for the streamer's shared-memory stats block.
+
+Layout v2 matches include/audio/stats_shm.h: a 64-byte header followed by a
+fixed payload of native-endian 64-bit words, guarded by a seqlock counter.
+"""
+
+import mmap
+import struct
+from pathlib import Path
+
+from ..constants import STATS_SHM_PATH
+
+STATS_SHM_MAGIC = 0x53545354
+STATS_SHM_VERSION = 2
+STAGE_NAMES = ("convert", "fft", "multiply", "ifft", "output")
+GPU_TIMING_NAMES = ("execute", "queue", "host")
+
+_HEADER = struct.Struct("=IIIIQ")
+_SEQUENCE_OFFSET = 16
+_SEQUENCE = struct.Struct("=Q")
+_TIMING_FIELDS = ("count", "sum_ns", "max_ns", "p99_ns")
+_FILL_FIELDS = ("current", "low", "high", "capacity")
+_PAYLOAD = struct.Struct(
+    "=4Q16s4Q"
+    + "4Q" * (1 + len(STAGE_NAMES))
+    + "4Q" * 2
+    + "4Q" * len(GPU_TIMING_NAMES)
+)
+
+
+def _decode_payload(raw: bytes) -> dict:
+    values = _PAYLOAD.unpack(raw)
+    update_count, timestamp_ns, input_rate, output_rate = values[:4]
+    mode = values[4].split(b"\0", 1)[0].decode("ascii", "replace")
+    capture_xruns, playback_xruns, deadline_misses, deadline_ns = values[5:9]
+    words = values[9:]
+
+    def take(fields: tuple[str, ...]) -> dict[str, int]:
+        nonlocal words
+        chunk, words = words[: len(fields)], words[len(fields) :]
+        return dict(zip(fields, chunk))
+
+    cycle = take(_TIMING_FIELDS)
+    stages = {name: take(_TIMING_FIELDS) for name in STAGE_NAMES}
+    fill = {"input": take(_FILL_FIELDS), "output": take(_FILL_FIELDS)}
+    gpu = {name: take(_TIMING_FIELDS) for name in GPU_TIMING_NAMES}
+    return {
+        "update_count": update_count,
+        "timestamp_ns": timestamp_ns,
+        "input_rate": input_rate,
+        "output_rate": output_rate,
+        "mode": mode,
+        "audio": {
+            "xrun": {
+                "total": capture_xruns + playback_xruns,
+                "capture": capture_xruns,
+                "playback": playback_xruns,
+            },
+            "deadline": {
+                "budget_ns": deadline_ns,
+                "misses": deadline_misses,
+                "cycle": cycle,
+            },
+            "stages": stages,
+            "gpu": gpu,
+            "fill": fill,
+        },
+    }
+
+
+def _read_consistent(mm: mmap.mmap, max_attempts: int) -> dict | None:
+    if len(mm) < _HEADER.size:
+        return None
+    magic, version, offset, size, _ = _HEADER.unpack_from(mm, 0)
+    if (
+        magic != STATS_SHM_MAGIC
+        or version != STATS_SHM_VERSION
+        or size != _PAYLOAD.size
+        or len(mm) < offset + size
+    ):
+        return None
+    for _ in range(max_attempts):
+        (before,) = _SEQUENCE.unpack_from(mm, _SEQUENCE_OFFSET)
+        if before & 1:
+            continue
+        raw = mm[offset : offset + size]
+        (after,) = _SEQUENCE.unpack_from(mm, _SEQUENCE_OFFSET)
+        if before == after:
+            return _decode_payload(raw)
+    return None
+
+
+def read_stats_shm(path: Path | None = None, max_attempts: int = 100) -> dict | None:
+    """Return a consistent snapshot of the stats block, or None if unavailable."""
+    try:
+        with open(path or STATS_SHM_PATH, "rb") as f:
+            with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+                return _read_consistent(mm, max_attempts)
+    except (OSError, ValueError):
+        return None